@@ -93,6 +93,14 @@ enum ENTITY_TYPE
     , ENTITY_LINESEGMENT
 };
 
+/*! Layout of the meshes within an exported scene file, see RootScene::exportSceneToFile(). */
+enum MESH_EXPORT
+{
+    MESH_EXPORT_TUBES /*!< a separate mesh for each stroke or line segment */
+    , MESH_EXPORT_MERGED /*!< a single welded mesh for each canvas */
+    , MESH_EXPORT_MERGED_GROUPS /*!< a welded mesh for each canvas, with a named group for each stroke */
+};
+
 /*! Enum class for mouse modes */
 enum MOUSE_MODE
 {
@@ -173,6 +181,8 @@ enum TraversalMask
     MASK_CANVASFRAME_IN = 0x100, /*!< sees only canvas frame drawables */
     MASK_SVMDATA_IN = 0x1000, /*!< sees only entity::SVMData */
     MASK_BOOKMARK_IN = 0x1100, /*!< sees only bookmark tools */
+    MASK_PHOTOATLAS_IN = 0x10000, /*!< sees only photo atlas batches, see PhotoAtlas */
+    MASK_STROKEBATCH_IN = 0x100000, /*!< sees only merged stroke batches, see StrokeBatcher */
     MASK_ALL_IN = ~0x0
 };
 
@@ -199,6 +209,10 @@ const float BOOKMARK_X = 10;
 const float BOOKMARK_Y = BOOKMARK_X;
 const float BOOKMARK_Z = BOOKMARK_X;
 
+// bookmark thumbnails refresh, see entity::Bookmarks
+const int BOOKMARK_REFRESH_DELAY = 500; /*!< in ms after the last scene edit */
+const int BOOKMARK_REFRESH_BATCH = 4; /*!< bookmarks checked per step of the refresh */
+
 // bookmark SVM data settings
 const float SVMDATA_HALFWIDTH = 0.25f;
 const std::vector<QColor> SVMDATA_CLR_POINTS = {
@@ -223,8 +237,14 @@ const int STROKE_SEGMENTS_NUMBER = 11;
 const float STROKE_FOG_MIN = 4.f;
 const float STROKE_FOG_MAX = 30.f;
 const float STROKE_MESH_RADIUS = 0.1f;
+const int STROKE_BATCH_SETTLE = 500; // strokes unchanged for longer than that are merged into the canvas batch, in msec
+const unsigned int STROKE_BATCH_MIN = 2; // canvases with fewer settled strokes than that are not batched
 const float SEGMENT_MESH_RADIUS = 0.2f;
 const unsigned int EXTRUSION_MESH_SHAPE = 8;
+const unsigned int EXTRUSION_MESH_SHAPE_MIN = 3; /*!< fewest tube sides of adaptive tessellation */
+const unsigned int EXTRUSION_MESH_SHAPE_MAX = 24; /*!< most tube sides of adaptive tessellation */
+const float MESH_CHORDAL_ERROR = 0.01f; /*!< default chordal error of adaptive tessellation */
+const float MESH_WELD_TOLERANCE = 0.0001f; /*!< distance within which export mesh vertices are welded */
 
 // polygon settings
 const float POLYGON_LINE_WIDTH = 4.f;
@@ -247,11 +267,23 @@ const float CANVAS_EDITSLACK = CANVAS_CORNER + 0.1f;
 const float CANVAS_AXIS = 0.5f; // loxal axis size
 const float CANVAS_EDITAXIS = CANVAS_AXIS*0.5;
 const float CANVAS_LINE_WIDTH = 1.5f;
+const int CANVAS_SET_SIZE = 4; // number of canvases within a ring, coaxial or parallel set
+const float CANVAS_SET_STEP = CANVAS_MINW; // distance between the canvases of a parallel set
+const float CANVAS_SET_RADIUS = 2.f*CANVAS_MINW; // radius of a ring set
 
 // photo settings
 const float PHOTO_MINW = 1; // half width
 const float PHOTO_MINH = 1; // half height
 const float PHOTO_TRANSPARECY_DELTA = 0.2f;
+const int PHOTO_PYRAMID_MIN = 128; // largest side of the coarsest photo pyramid level, in pixels
+const quint64 PHOTO_TEXTURE_BUDGET = Q_UINT64_C(256)*1024*1024; // photo texture memory budget, in bytes
+const quint64 PHOTO_RESIDENCY_BUDGET = Q_UINT64_C(512)*1024*1024; // photo host and GPU memory budget, in bytes
+const int PHOTO_RESIDENCY_AGE = 60000; // photos of a canvas unseen for longer than that are evicted, in msec
+const int PHOTO_TILED_MIN = 4096; // pyramid levels larger than that are rendered and stored as tiles, in pixels
+const int PHOTO_TILE_SIZE = 512; // side of a photo tile, in pixels
+const unsigned int PHOTO_TILE_CACHE = 64; // maximal number of resident tiles of a photo image
+const int PHOTO_ATLAS_MAX = 256; // photos at most that large are packed into atlas textures, in pixels
+const int PHOTO_ATLAS_SIZE = 1024; // side of a photo atlas texture, in pixels
 
 // global axis settings
 const float AXES_SIZE = 100.f;
@@ -272,6 +304,14 @@ const std::string NAME_CAM_EYE = "CamEye";
 const std::string NAME_CAM_CENTER = "CamCenter";
 const std::string NAME_CAM_FOCAL = "CamFocal";
 
+// undo history settings, see fur::UndoHistory
+const quint64 UNDO_HISTORY_BUDGET = Q_UINT64_C(128)*1024*1024; // memory kept alive by the undo history, in bytes
+
+// project container settings, see entity::ProjectContainer
+const std::string PROJECT_EXTENSION = "cherish";
+const char PROJECT_MAGIC[8] = {'C','H','E','R','I','S','H','\0'};
+const unsigned int PROJECT_VERSION = 2;
+
 // variable that helps to adapt to high DPI monitors
 extern double DPI_SCALING;
 
@@ -287,6 +327,9 @@ const size_t APP_WIDGET_ICONSIZE_H = 80;
 // photo format, used for drag and drop functionality
 const QString MIME_PHOTO = "image/cherish";
 
+// photo base thumbnails, cached within the application cache location
+const QString PHOTO_THUMBNAIL_CACHE = "thumbnails";
+
 // CanvasPhotoWidget roles
 const int DelegateVisibilityRole = Qt::UserRole + 1;
 const int DelegateChildRole = Qt::UserRole + 2;
@@ -14,6 +14,7 @@
 #include "CMainWindow.h"
 #include "Settings.h"
 #include "Data.h"
+#include "ProjectContainer.h"
 
 
 /*! \mainpage Cherish - Tool for Cultural Heritage Data Representation Image and Sketching Manipulation.
@@ -58,6 +59,17 @@ int main(int argc, char** argv)
     qputenv("QT_DEVICE_PIXEL_RATIO", QByteArray("1"));
 #endif // QT_VERSION
 
+    /* conversion of an existing scene file into project container, no GUI is created */
+    if (argc == 4 && std::string(argv[1]) == "--convert"){
+        qInfo() << "Converting" << argv[2] << "into project container" << argv[3];
+        if (!entity::ProjectContainer::convert(argv[2], argv[3])){
+            qCritical("Conversion failed. See the log for more details.");
+            return 1;
+        }
+        qInfo("Conversion is done.");
+        return 0;
+    }
+
     /* application */
     CherishApplication cherish_app(argc, argv);
     cherish_app.setWindowIcon(Data::appIcon());
@@ -1,6 +1,7 @@
 #include "GLWidget.h"
 
 #include <iostream>
+#include <algorithm>
 #include <stdexcept>
 #include <vector>
 
@@ -48,6 +49,9 @@ GLWidget::GLWidget(RootScene *root, QUndoStack *stack, QWidget *parent, Qt::Wind
 
     , m_viewStack(stack)
 {
+    m_batchTimer.setSingleShot(true);
+    QObject::connect(&m_batchTimer, SIGNAL(timeout()), this, SLOT(update()));
+
     /* camera settings */
     float ratio = static_cast<float>(this->width()) / static_cast<float>( this->height());
     osg::Vec3 look = osg::Vec3(osg::Y_AXIS);
@@ -77,6 +81,9 @@ GLWidget::GLWidget(RootScene *root, QUndoStack *stack, QWidget *parent, Qt::Wind
 
     m_viewer->realize();
 
+    /* offscreen screenshots, they share the context and scene with the viewer */
+    m_thumbnails = new ThumbnailRenderer(m_viewer.get());
+
     /* OpenGL graphics context */
     m_traits->samples = 4; // multi sampling (anti-aliasing)
     m_traits->sampleBuffers = 4;
@@ -184,33 +191,54 @@ void GLWidget::setTabletActivity(bool active)
 
 QPixmap GLWidget::getScreenShot(const osg::Vec3d &eye, const osg::Vec3d &center, const osg::Vec3d &up)
 {
-    /* save the current camera view */
-    osg::Vec3d eye_, center_, up_;
-    double fov_;
-    this->getCameraView(eye_, center_, up_, fov_);
+    QList<QPixmap> pmaps = this->getScreenShots(std::vector<osg::Vec3d>(1, eye), std::vector<osg::Vec3d>(1, center),
+                                                std::vector<osg::Vec3d>(1, up), std::vector<entity::SceneState*>());
+    return pmaps.isEmpty()? QPixmap() : pmaps.front();
+}
 
-    /* move the camera to bookmark view */
-    m_manipulator->setTransformation(eye, center, up);
+QList<QPixmap> GLWidget::getScreenShots(const std::vector<osg::Vec3d> &eyes, const std::vector<osg::Vec3d> &centers,
+                                        const std::vector<osg::Vec3d> &ups, const std::vector<entity::SceneState *> &states)
+{
+    QList<QPixmap> pmaps;
+    size_t count = std::min(eyes.size(), std::min(centers.size(), ups.size()));
+    if (count == 0) return pmaps;
+
+    /* the context is only created when the widget is shown or grabbed for the first time */
+    if (!this->isValid()) this->grabFramebuffer();
+    this->makeCurrent();
+    if (!m_thumbnails->begin()){
+        qWarning("getScreenShots: could not attach the thumbnail renderer");
+        this->doneCurrent();
+        for (size_t i=0; i<count; ++i) pmaps.push_back(QPixmap());
+        return pmaps;
+    }
 
     /* save the current scene state */
     osg::ref_ptr<entity::SceneState> ss = new entity::SceneState();
     ss->stripDataFrom(m_RootScene.get());
 
-    /* make sure tools are off */
+    /* make sure tools are off, each of the scene states might turn them back on */
     m_RootScene->setToolsVisibility(false);
-    this->update();
-
-    /* grab the screenshot */
-    QPixmap pmap = this->grab();
+    for (size_t i=0; i<count; ++i){
+        if (i < states.size() && states[i]){
+            m_RootScene->setSceneState(states[i]);
+            m_RootScene->setToolsVisibility(false);
+        }
+        pmaps.push_back(m_thumbnails->render(eyes[i], centers[i], ups[i]));
+    }
+    m_thumbnails->end();
+    this->doneCurrent();
 
     /* apply the saved scene state */
     m_RootScene->setSceneState(ss);
-
-    /* return to the current camera view */
-    m_manipulator->setTransformation(eye_, center_, up_);
     this->update();
 
-    return pmap;
+    return pmaps;
+}
+
+ThumbnailRenderer *GLWidget::getThumbnailRenderer() const
+{
+    return m_thumbnails.get();
 }
 
 /* FOV is a whole angle, not half angle */
@@ -256,6 +284,14 @@ void GLWidget::initializeGL()
 
 void GLWidget::paintGL()
 {
+    /* photo texture resolution follows the on-screen size of the photos */
+    m_RootScene->updatePhotoLevels(m_viewer->getCamera());
+    /* the settled strokes of each canvas are drawn by a single batch */
+    m_RootScene->updateStrokeBatches();
+    /* the intersections of the current canvas with all the others are taken from the intersection tables */
+    m_RootScene->updateCanvasIntersections();
+    qint64 settle = m_RootScene->getStrokeBatcher().getTimeToSettle();
+    if (settle >= 0) m_batchTimer.start(static_cast<int>(settle));
     m_viewer->frame();
 }
 
@@ -497,11 +533,23 @@ void GLWidget::dropEvent(QDropEvent *event)
         qInfo() << "GLWidget accepted filename " << fileName;
         qInfo() << "GLWidget accepted path " << directory;
 
+        // the rest of a multi-selection drag
+        QStringList fileNames;
+        fileNames << directory + "/" + fileName;
+        while (!dataStream.atEnd()){
+            QString name, dir;
+            dataStream >> name >> dir;
+            fileNames << dir + "/" + name;
+        }
+
         event->setDropAction(Qt::CopyAction);
         event->accept();
 
-        // emit signal to let know image should be imported
-        emit this->importPhoto(directory, fileName);
+        // emit signal to let know image(s) should be imported
+        if (fileNames.size() > 1)
+            emit this->importPhotos(fileNames);
+        else
+            emit this->importPhoto(directory, fileName);
     }
     else
         event->ignore();
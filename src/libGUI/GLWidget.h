@@ -11,6 +11,9 @@
 #include <QDragLeaveEvent>
 #include <QDragMoveEvent>
 #include <QDropEvent>
+#include <QStringList>
+#include <QList>
+#include <QTimer>
 
 #include <osg/ref_ptr>
 #include <osg/observer_ptr>
@@ -23,6 +26,7 @@
 
 #include "RootScene.h"
 #include "Settings.h"
+#include "ThumbnailRenderer.h"
 #include "../libSGControls/Manipulator.h"
 #include "../libSGControls/EventHandler.h"
 #include "../libSGControls/ViewerCommand.h"
@@ -91,14 +95,31 @@ signals:
     /*! Signal is emitted when user performs drag-and-drop from PhotoWidget to GLWidget. */
     void importPhoto(const QString& path, const QString& fileName);
 
+    /*! Signal is emitted when user performs drag-and-drop of several photos from PhotoWidget to GLWidget.
+     * \param fileNames are full paths of the dropped photos. */
+    void importPhotos(const QStringList& fileNames);
+
 public:
     /*! Method to set tablet proximity flag. */
     void setTabletActivity(bool active);
 
     /*! Method to obtain a scene graph screenshot by given camera position.
-     * This method resets the view back to what it was before the screenshot was taken. */
+     * The screenshot is rendered offscreen, so the view is not changed, see getScreenShots(). */
     QPixmap getScreenShot(const osg::Vec3d& eye, const osg::Vec3d& center, const osg::Vec3d& up);
 
+    /*! Method to obtain a batch of scene graph screenshots at the thumbnail resolution, see ThumbnailRenderer.
+     * The screenshots are rendered offscreen one after another, without the tools, and the scene state is
+     * restored after the last one, so the view is neither moved nor redrawn in between.
+     * \param eyes, centers, ups are the camera positions, one per screenshot
+     * \param states are the scene states to apply before each screenshot; if a state is NULL or the vector
+     * is shorter than the camera positions, the current scene state is used
+     * \return the screenshots, a null pixmap for each screenshot that could not be rendered */
+    QList<QPixmap> getScreenShots(const std::vector<osg::Vec3d>& eyes, const std::vector<osg::Vec3d>& centers,
+                                  const std::vector<osg::Vec3d>& ups, const std::vector<entity::SceneState*>& states);
+
+    /*! \return the offscreen renderer of the screenshots. */
+    ThumbnailRenderer* getThumbnailRenderer() const;
+
 public slots:
 
     /*! \param fov is the new  FOV (to change manipulator's camera) */
@@ -160,6 +181,8 @@ private:
 
     QUndoStack* m_viewStack;
     osg::Vec3d m_eye, m_center, m_up; /* for prev/next views */
+    osg::ref_ptr<ThumbnailRenderer> m_thumbnails;
+    QTimer m_batchTimer; /* repaints the idle view once the strokes settle, see StrokeBatcher */
 };
 
 #endif // GLWIDGET
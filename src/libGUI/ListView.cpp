@@ -22,6 +22,7 @@ PhotoWidget::PhotoWidget(QWidget *parent)
     this->setAcceptDrops(false);
     this->setDragEnabled(true);
     this->setDropIndicatorShown(true);
+    this->setSelectionMode(QAbstractItemView::ExtendedSelection);
 }
 
 void PhotoWidget::dragEnterEvent(QDragEnterEvent *event)
@@ -21,6 +21,7 @@
 #include "Settings.h"
 #include "Data.h"
 #include "Utilities.h"
+#include "ImageDecoder.h"
 
 MainWindow* MainWindow::m_instance = nullptr;
 
@@ -35,6 +36,8 @@ MainWindow::MainWindow(QWidget *parent, Qt::WindowFlags flags)
     , m_photoModel(new PhotoModel)
 
     , m_undoStack(new QUndoStack(this))
+    , m_undoHistory(new fur::UndoHistory(m_undoStack, this))
+    , m_labelHistory(new QLabel(this))
 
     , m_menuBar(new QMenuBar(this))
 
@@ -42,6 +45,9 @@ MainWindow::MainWindow(QWidget *parent, Qt::WindowFlags flags)
     , m_viewStack(new QUndoStack(this))
     , m_glWidget(new GLWidget(m_rootScene.get(), m_viewStack))
     , m_cameraProperties( new CameraProperties(60.f, this) )
+    , m_sceneLoader(0)
+    , m_progressLoad(0)
+    , m_exportChordalError(cher::MESH_CHORDAL_ERROR)
     , m_colorDialog(new QColorDialog(this))
 {
     /* singleton check and setup */
@@ -77,6 +83,10 @@ MainWindow::MainWindow(QWidget *parent, Qt::WindowFlags flags)
     /* viewer stack */
     m_viewStack->setUndoLimit(50);
 
+    /* undo history memory is shown permanently */
+    this->statusBar()->addPermanentWidget(m_labelHistory);
+    this->onUndoHistoryUsage(m_undoHistory->getMemoryUsage(), m_undoHistory->getBudget());
+
     /* actions, menu, toolbars initialization */
     this->setCentralWidget(m_mdiArea);
     this->initializeActions();
@@ -147,6 +157,12 @@ QPixmap MainWindow::getScreenshot(const osg::Vec3d &eye, const osg::Vec3d &cente
     return m_glWidget->getScreenShot(eye, center, up);
 }
 
+QList<QPixmap> MainWindow::getScreenshots(const std::vector<osg::Vec3d> &eyes, const std::vector<osg::Vec3d> &centers,
+                                          const std::vector<osg::Vec3d> &ups, const std::vector<entity::SceneState *> &states)
+{
+    return m_glWidget->getScreenShots(eyes, centers, ups, states);
+}
+
 int MainWindow::getViewportWidth() const
 {
     return m_glWidget->width();
@@ -422,6 +438,29 @@ void MainWindow::onRequestSceneToolStatus(bool &visibility)
     visibility = m_actionTools->isChecked();
 }
 
+void MainWindow::onImportPhotos(const QStringList &fileNames)
+{
+    if (m_rootScene->isEmptyScene()){
+        QMessageBox::warning(this, tr("Import Photos"), tr("There are no canvases on the scene. Add a canvas first. "
+                                                           "No import will be performed."));
+        return;
+    }
+
+    std::vector<std::string> fnames;
+    foreach (const QString& fileName, fileNames){
+        QFileInfo checkFile(fileName);
+        if (!checkFile.exists() || !checkFile.isFile()){
+            qWarning() << "onImportPhotos: skipping non-existing file" << fileName;
+            continue;
+        }
+        fnames.push_back(fileName.toStdString());
+    }
+    if (fnames.empty()) return;
+
+    m_rootScene->addPhotos(fnames);
+    this->statusBar()->showMessage(tr("%1 images are being loaded to current canvas.").arg(fnames.size()));
+}
+
 void MainWindow::onImportPhoto(const QString &path, const QString &fileName)
 {
     QString fullPath = path + "/" + fileName;
@@ -485,6 +524,44 @@ void MainWindow::onRequestCanvasCreate(const osg::Vec3f &eye, const osg::Vec3f &
     }
 }
 
+void MainWindow::onSceneLoaded(bool success)
+{
+    SceneLoader* loader = m_sceneLoader;
+    m_sceneLoader = 0;
+    if (m_progressLoad){
+        m_progressLoad->deleteLater();
+        m_progressLoad = 0;
+    }
+    if (!loader) return;
+
+    if (loader->isCanceled()){
+        m_rootScene->setFilePath("");
+        this->statusBar()->showMessage(tr("Opening of the scene was canceled"));
+    }
+    else if (!success || !m_rootScene->setLoadedScene(loader->getScene(), loader->getContainer())
+             || !this->initializeLoadedScene()){
+        QMessageBox::critical(this, tr("Error"), tr("Could not read from file. See the log for more details."));
+        m_rootScene->setFilePath("");
+    }
+    else
+        this->statusBar()->showMessage(tr("Scene was successfully read from file"));
+
+    loader->deleteLater();
+}
+
+void MainWindow::onUndoHistoryUsage(quint64 usage, quint64 budget)
+{
+    m_labelHistory->setText(tr("Undo history: %1 / %2 MB")
+                            .arg(usage / (1024.0*1024.0), 0, 'f', 1)
+                            .arg(budget / (1024.0*1024.0), 0, 'f', 0));
+}
+
+void MainWindow::onCanvasesReset()
+{
+    if (!m_rootScene->getUserScene()) return;
+    m_rootScene->getUserScene()->resetModel(m_canvasWidget);
+}
+
 void MainWindow::onCanvasClicked(const QModelIndex &index)
 {
     entity::Canvas* canvas = m_rootScene->getCanvasCurrent();
@@ -515,16 +592,12 @@ void MainWindow::onFileNew()
 void MainWindow::onFileOpen()
 {
     QString fname = QFileDialog::getOpenFileName(this, tr("Open a scene from file"),
-                                                 QString(), tr("OSG files (*.osg *.osgt)"));
+                                                 QString(), tr("Scene files (*.cherish *.osg *.osgt);;"
+                                                              "Cherish projects (*.cherish);;"
+                                                              "OSG files (*.osg *.osgt)"));
     if (!fname.isEmpty()){
         this->onFileClose();
-        m_rootScene->setFilePath(fname.toStdString());
-        if (!this->loadSceneFromFile()){
-            QMessageBox::critical(this, tr("Error"), tr("Could not read from file. See the log for more details."));
-            m_rootScene->setFilePath("");
-        }
-        else
-            this->statusBar()->setStatusTip(tr("Scene was successfully read from file"));
+        this->loadSceneFromFileAsync(fname);
     }
 }
 
@@ -538,7 +611,8 @@ void MainWindow::onFileSave()
 {
     if (!m_rootScene->isSetFilePath()){
         QString fname = QFileDialog::getSaveFileName(this, tr("Saving scene to file"),
-                                                     QString(), tr("OSG file (*.osgt)"));
+                                                     QString(), tr("OSG file (*.osgt);;"
+                                                                          "Cherish project (*.cherish)"));
         if (fname.isEmpty()){
             QMessageBox::warning(this, tr("Chosing filename"), tr("No file name is chosen. Changes were not saved."));
             this->statusBar()->showMessage(tr("Scene was not saved to file"));
@@ -568,13 +642,16 @@ void MainWindow::onFileSaveAs()
 
 void MainWindow::onFileExport()
 {
-    QString fname = QFileDialog::getSaveFileName(this, tr("Exporting file"), QString(), tr("File formats (*.osgt *.obj *.3ds)"));
+    QString fname = QFileDialog::getSaveFileName(this, tr("Exporting file"), QString(), tr("File formats (*.obj *.ply *.osgt *.3ds)"));
     if (fname.isEmpty()){
         QMessageBox::warning(this, tr("Chosing filename"), tr("No file name is chosen. File was not exported."));
         this->statusBar()->showMessage(tr("Scene was not exported."));
         return;
     }
-    if (!m_rootScene->exportSceneToFile(fname.toStdString())){
+    cher::MESH_EXPORT layout = cher::MESH_EXPORT_TUBES;
+    if (m_actionExportMerged->isChecked())
+        layout = m_actionExportGroups->isChecked()? cher::MESH_EXPORT_MERGED_GROUPS : cher::MESH_EXPORT_MERGED;
+    if (!m_rootScene->exportSceneToFile(fname.toStdString(), layout, m_exportChordalError)){
         QMessageBox::critical(this, tr("Error"), tr("Could not export scene to file"));
         this->statusBar()->showMessage(tr("Scene was not exported to file"));
         return;
@@ -582,6 +659,18 @@ void MainWindow::onFileExport()
     this->statusBar()->showMessage(tr("Scene was successfully exported."));
 }
 
+void MainWindow::onFileExportTessellation()
+{
+    bool ok = false;
+    double error = QInputDialog::getDouble(this, tr("Tessellation tolerance"),
+                                           tr("Maximal distance between exported tubes and ideal stroke surface "
+                                              "(0 for fixed tessellation):"),
+                                           m_exportChordalError, 0, cher::STROKE_MESH_RADIUS, 4, &ok);
+    if (!ok) return;
+    m_exportChordalError = static_cast<float>(error);
+    this->statusBar()->showMessage(tr("Export tessellation tolerance is set to %1").arg(error));
+}
+
 void MainWindow::onFileImage()
 {
     if (m_rootScene->isEmptyScene()){
@@ -832,17 +921,53 @@ void MainWindow::onNewCanvasStandard()
 
 void MainWindow::onNewCanvasCoaxial()
 {
-    this->statusBar()->showMessage(tr("This functionality does not exist yet."));
+    /* the canvases share the V axis of the current canvas, the angles are distributed evenly within a half-turn */
+    osg::Matrix R = osg::Matrix::identity(), T = osg::Matrix::identity();
+    this->getCanvasSetBase(R, T);
+    std::vector<osg::Matrix> Rs, Ts;
+    for (int i=0; i<cher::CANVAS_SET_SIZE; ++i){
+        double angle = cher::PI * (i+1) / (cher::CANVAS_SET_SIZE+1);
+        Rs.push_back(osg::Matrix::rotate(angle, 0, 1, 0) * R);
+        Ts.push_back(T);
+    }
+    m_rootScene->addCanvases(Rs, Ts);
+    this->onSketch();
+    this->statusBar()->showMessage(tr("Set of coaxial canvases created."));
+    this->onRequestUpdate();
 }
 
 void MainWindow::onNewCanvasParallel()
 {
-    this->statusBar()->showMessage(tr("This functionality does not exist yet."));
+    /* the canvases are offset along the normal of the current canvas */
+    osg::Matrix R = osg::Matrix::identity(), T = osg::Matrix::identity();
+    this->getCanvasSetBase(R, T);
+    osg::Vec3f normal = cher::NORMAL * R;
+    std::vector<osg::Matrix> Rs, Ts;
+    for (int i=0; i<cher::CANVAS_SET_SIZE; ++i){
+        Rs.push_back(R);
+        Ts.push_back(T * osg::Matrix::translate(normal * cher::CANVAS_SET_STEP * (i+1)));
+    }
+    m_rootScene->addCanvases(Rs, Ts);
+    this->onSketch();
+    this->statusBar()->showMessage(tr("Set of parallel canvases created."));
+    this->onRequestUpdate();
 }
 
 void MainWindow::onNewCanvasRing()
 {
-    this->statusBar()->showMessage(tr("This functionality does not exist yet."));
+    /* the canvases are tangent to a circle around the V axis of the current canvas, their normals look outwards */
+    osg::Matrix R = osg::Matrix::identity(), T = osg::Matrix::identity();
+    this->getCanvasSetBase(R, T);
+    std::vector<osg::Matrix> Rs, Ts;
+    for (int i=0; i<cher::CANVAS_SET_SIZE; ++i){
+        osg::Matrix Ri = osg::Matrix::rotate(2.0 * cher::PI * i / cher::CANVAS_SET_SIZE, 0, 1, 0) * R;
+        Rs.push_back(Ri);
+        Ts.push_back(T * osg::Matrix::translate(cher::NORMAL * Ri * cher::CANVAS_SET_RADIUS));
+    }
+    m_rootScene->addCanvases(Rs, Ts);
+    this->onSketch();
+    this->statusBar()->showMessage(tr("Ring of canvases created."));
+    this->onRequestUpdate();
 }
 
 void MainWindow::onCanvasEdit()
@@ -1052,6 +1177,12 @@ void MainWindow::onStrokeFogFactor()
     }
 }
 
+void MainWindow::onCanvasIntersections()
+{
+    m_rootScene->setCanvasIntersectionsVisibility(m_actionCanvasIntersections->isChecked());
+    m_glWidget->update();
+}
+
 void MainWindow::initializeActions()
 {
     // FILE
@@ -1085,12 +1216,25 @@ void MainWindow::initializeActions()
     m_actionExportAs = new QAction(Data::fileExportIcon(), tr("Export as..."), this);
     this->connect(m_actionExportAs, SIGNAL(triggered(bool)), this, SLOT(onFileExport()));
 
+    m_actionExportMerged = new QAction(tr("Merge exported meshes per canvas"), this);
+    m_actionExportMerged->setCheckable(true);
+    m_actionExportMerged->setChecked(false);
+
+    m_actionExportGroups = new QAction(tr("Keep stroke groups in merged meshes"), this);
+    m_actionExportGroups->setCheckable(true);
+    m_actionExportGroups->setChecked(false);
+    m_actionExportGroups->setEnabled(false);
+    this->connect(m_actionExportMerged, SIGNAL(toggled(bool)), m_actionExportGroups, SLOT(setEnabled(bool)));
+
+    m_actionExportTessellation = new QAction(tr("Tessellation tolerance..."), this);
+    this->connect(m_actionExportTessellation, SIGNAL(triggered(bool)), this, SLOT(onFileExportTessellation()));
+
     m_actionPhotoBase = new QAction(Data::controlImagesIcon(), tr("Chose folder with photo base..."), this);
     this->connect(m_actionPhotoBase, SIGNAL(triggered(bool)), this, SLOT(onFilePhotoBase()));
 
     // EDIT
 
-    m_actionUndo = m_undoStack->createUndoAction(this, tr("&Undo"));
+    m_actionUndo = m_undoHistory->createUndoAction(this, tr("&Undo"));
     m_actionUndo->setIcon(Data::editUndoIcon());
     m_actionUndo->setShortcut(QKeySequence::Undo);
 
@@ -1199,6 +1343,15 @@ void MainWindow::initializeActions()
     m_actionSetStandard = new QAction(Data::sceneNewCanvasSetStandardIcon(), tr("Standard"), this);
     this->connect(m_actionSetStandard, SIGNAL(triggered(bool)), this, SLOT(onNewCanvasStandard()));
 
+    m_actionSetParallel = new QAction(Data::sceneNewCanvasSetParallelIcon(), tr("Parallel"), this);
+    this->connect(m_actionSetParallel, SIGNAL(triggered(bool)), this, SLOT(onNewCanvasParallel()));
+
+    m_actionSetCoaxial = new QAction(Data::sceneNewCanvasSetCoaxialIcon(), tr("Coaxial"), this);
+    this->connect(m_actionSetCoaxial, SIGNAL(triggered(bool)), this, SLOT(onNewCanvasCoaxial()));
+
+    m_actionSetRing = new QAction(Data::sceneNewCanvasSetRingIcon(), tr("Ring"), this);
+    this->connect(m_actionSetRing, SIGNAL(triggered(bool)), this, SLOT(onNewCanvasRing()));
+
     m_actionCanvasEdit = new QAction(Data::sceneCanvasEditIcon(), tr("Edit canvas location"), this);
     this->connect(m_actionCanvasEdit, SIGNAL(triggered(bool)), this, SLOT(onCanvasEdit()));
 
@@ -1211,6 +1364,11 @@ void MainWindow::initializeActions()
     m_actionStrokeFogFactor->setChecked(false);
     this->connect(m_actionStrokeFogFactor, SIGNAL(toggled(bool)), this, SLOT(onStrokeFogFactor()));
 
+    m_actionCanvasIntersections = new QAction(tr("Canvas intersections"), this);
+    m_actionCanvasIntersections->setCheckable(true);
+    m_actionCanvasIntersections->setChecked(false);
+    this->connect(m_actionCanvasIntersections, SIGNAL(toggled(bool)), this, SLOT(onCanvasIntersections()));
+
 }
 
 void MainWindow::initializeMenus()
@@ -1223,6 +1381,10 @@ void MainWindow::initializeMenus()
     menuFile->addAction(m_actionSaveFile);
     menuFile->addAction(m_actionSaveAsFile);
     menuFile->addAction(m_actionExportAs);
+    QMenu* submenuExport = menuFile->addMenu(tr("Export options"));
+    submenuExport->addAction(m_actionExportMerged);
+    submenuExport->addAction(m_actionExportGroups);
+    submenuExport->addAction(m_actionExportTessellation);
     menuFile->addSeparator();
     menuFile->addAction(m_actionImportImage);
     menuFile->addAction(m_actionPhotoBase);
@@ -1285,6 +1447,9 @@ void MainWindow::initializeMenus()
     QMenu* submenuSet = menuScene->addMenu("New Canvas Set");
     submenuSet->setIcon(Data::sceneNewCanvasSetIcon());
     submenuSet->addAction(m_actionSetStandard);
+    submenuSet->addAction(m_actionSetParallel);
+    submenuSet->addAction(m_actionSetCoaxial);
+    submenuSet->addAction(m_actionSetRing);
 
     menuScene->addSeparator();
 //    QMenu* submenuEC = menuScene->addMenu("Edit Canvas");
@@ -1305,6 +1470,7 @@ void MainWindow::initializeMenus()
     QMenu* submenuVisuals = menuOptions->addMenu("Visuals");
     submenuVisuals->setIcon(Data::optionsVisibilityIcon());
     submenuVisuals->addAction(m_actionStrokeFogFactor);
+    submenuVisuals->addAction(m_actionCanvasIntersections);
 
 }
 
@@ -1364,6 +1530,9 @@ void MainWindow::initializeToolbars()
 
     QMenu* menuNewCanvasSet = new QMenu(this);
     menuNewCanvasSet->addAction(m_actionSetStandard);
+    menuNewCanvasSet->addAction(m_actionSetParallel);
+    menuNewCanvasSet->addAction(m_actionSetCoaxial);
+    menuNewCanvasSet->addAction(m_actionSetRing);
     QToolButton* tbNewCanvasSet = new QToolButton();
     tbNewCanvasSet->setIcon(Data::sceneNewCanvasSetIcon());
     tbNewCanvasSet->setMenu(menuNewCanvasSet);
@@ -1398,6 +1567,7 @@ void MainWindow::initializeToolbars()
 
     QMenu* menuVisuals = new QMenu(this);
     menuVisuals->addAction(m_actionStrokeFogFactor);
+    menuVisuals->addAction(m_actionCanvasIntersections);
     QToolButton* tbVisuals = new QToolButton();
     tbVisuals->setIcon(Data::optionsVisibilityIcon());
     tbVisuals->setMenu(menuVisuals);
@@ -1428,6 +1598,15 @@ void MainWindow::initializeCallbacks()
                      this, SLOT(onImportPhoto(QString,QString)),
                      Qt::UniqueConnection);
 
+    QObject::connect(m_glWidget, SIGNAL(importPhotos(QStringList)),
+                     this, SLOT(onImportPhotos(QStringList)),
+                     Qt::UniqueConnection);
+
+    /* redraw as soon as asynchronously decoded photo images are attached */
+    QObject::connect(&ImageDecoder::instance(), SIGNAL(imagesAttached()),
+                     this, SLOT(onRequestUpdate()),
+                     Qt::UniqueConnection);
+
     /* connect MainWindow with UserScene */
     QObject::connect(m_rootScene->getUserScene(), SIGNAL(sendRequestUpdate()),
                      this, SLOT(onRequestUpdate()),
@@ -1492,6 +1671,15 @@ void MainWindow::initializeCallbacks()
                      this, SLOT(onRequestSceneStateSet(entity::SceneState*)),
                      Qt::UniqueConnection);
 
+    QObject::connect(m_undoHistory, SIGNAL(memoryUsageChanged(quint64,quint64)),
+                     this, SLOT(onUndoHistoryUsage(quint64,quint64)),
+                     Qt::UniqueConnection);
+
+    /* each edit, undo or redo might change what the bookmark screenshots show */
+    QObject::connect(m_undoStack, SIGNAL(indexChanged(int)),
+                     m_rootScene->getBookmarksModel(), SLOT(onSceneChanged()),
+                     Qt::UniqueConnection);
+
     /* canvas widget area */
     QObject::connect(m_rootScene->getUserScene(), SIGNAL(canvasAdded(std::string)),
                      m_canvasWidget, SLOT(onCanvasAdded(std::string)),
@@ -1515,6 +1703,10 @@ void MainWindow::initializeCallbacks()
                      m_canvasWidget, SLOT(onPhotoRemoved(int,int)),
                      Qt::UniqueConnection);
 
+    QObject::connect(m_rootScene->getUserScene(), SIGNAL(canvasesReset()),
+                     this, SLOT(onCanvasesReset()),
+                     Qt::UniqueConnection);
+
     QObject::connect(m_canvasWidget, SIGNAL(clicked(QModelIndex)),
                      m_rootScene->getUserScene(), SLOT(onClicked(QModelIndex)),
                      Qt::UniqueConnection);
@@ -1547,6 +1739,10 @@ void MainWindow::initializeCallbacks()
                      m_canvasWidget, SLOT(onCanvasVisibilitySet(int,bool)),
                      Qt::UniqueConnection);
 
+    QObject::connect(m_rootScene->getUserScene(), SIGNAL(canvasMemoryUsage(int,quint64,quint64)),
+                     m_canvasWidget, SLOT(onCanvasMemoryUsage(int,quint64,quint64)),
+                     Qt::UniqueConnection);
+
     QObject::connect(m_canvasWidget->getCanvasDelegate(), SIGNAL(clickedTransparencyPlus(QModelIndex)),
                      this, SLOT(onPhotoTransparencyPlus(QModelIndex)),
                      Qt::UniqueConnection);
@@ -1582,6 +1778,41 @@ bool MainWindow::loadSceneFromFile()
 
     // load scene from file, initialize canvas tools and shader programs
     if (!m_rootScene->loadSceneFromFile()) return false;
+    return this->initializeLoadedScene();
+}
+
+void MainWindow::loadSceneFromFileAsync(const QString &fname)
+{
+    if (m_sceneLoader){
+        qWarning("loadSceneFromFileAsync: another scene is being loaded");
+        return;
+    }
+    m_rootScene->setFilePath(fname.toStdString());
+
+    QThread* thread = new QThread(this);
+    m_sceneLoader = new SceneLoader(fname.toStdString());
+    m_sceneLoader->moveToThread(thread);
+
+    m_progressLoad = new QProgressDialog(tr("Opening scene from file..."), tr("Cancel"), 0, 0, this);
+    m_progressLoad->setWindowModality(Qt::WindowModal);
+    m_progressLoad->setMinimumDuration(0);
+    m_progressLoad->setAutoClose(false);
+
+    QObject::connect(thread, SIGNAL(started()), m_sceneLoader, SLOT(process()));
+    QObject::connect(m_sceneLoader, SIGNAL(progressRangeChanged(int,int)), m_progressLoad, SLOT(setRange(int,int)));
+    QObject::connect(m_sceneLoader, SIGNAL(progressValueChanged(int)), m_progressLoad, SLOT(setValue(int)));
+    /* direct connection since the loader's thread is busy within SceneLoader::process() */
+    QObject::connect(m_progressLoad, SIGNAL(canceled()), m_sceneLoader, SLOT(cancel()), Qt::DirectConnection);
+    QObject::connect(m_sceneLoader, SIGNAL(finished(bool)), this, SLOT(onSceneLoaded(bool)));
+    QObject::connect(m_sceneLoader, SIGNAL(finished(bool)), thread, SLOT(quit()));
+    QObject::connect(thread, SIGNAL(finished()), thread, SLOT(deleteLater()));
+
+    this->statusBar()->showMessage(tr("Opening scene from file..."));
+    thread->start();
+}
+
+bool MainWindow::initializeLoadedScene()
+{
     m_glWidget->update();
     this->initializeCallbacks();
 
@@ -1623,7 +1854,7 @@ bool MainWindow::importPhoto(QString &fileName)
     }
 
     m_rootScene->addPhoto(fileName.toStdString());
-    this->statusBar()->showMessage(tr("Image loaded to current canvas."));
+    this->statusBar()->showMessage(tr("Image is being loaded to current canvas."));
     return true;
 }
 
@@ -1637,6 +1868,14 @@ void MainWindow::setSceneState(const entity::SceneState *state)
     //    m_rootScene->updateBookmark(m_bookmarkWidget, row);
 }
 
+void MainWindow::getCanvasSetBase(osg::Matrix &R, osg::Matrix &T) const
+{
+    const entity::Canvas* canvas = m_rootScene->getCanvasCurrent();
+    if (!canvas) return;
+    R = canvas->getMatrixRotation();
+    T = canvas->getMatrixTranslation();
+}
+
 void MainWindow::addMenuBookmark(const QString &name)
 {
     BookmarkAction* act = new BookmarkAction(name, this);
@@ -17,6 +17,8 @@
 #include <QAction>
 #include <QObject>
 #include <QString>
+#include <QProgressDialog>
+#include <QLabel>
 
 #include <osg/ref_ptr>
 #include <osg/Camera>
@@ -30,6 +32,8 @@
 #include "ListView.h"
 #include "PhotoModel.h"
 #include "Data.h"
+#include "SceneLoader.h"
+#include "UndoHistory.h"
 
 /*! \class BookmarkAction
  * \brief Action to edit bookmark data which was created by means of SVMData.
@@ -90,6 +94,11 @@ public:
     /*! A method to obtain a scene screenshot with the given camera position. */
     QPixmap getScreenshot(const osg::Vec3d& eye, const osg::Vec3d& center, const osg::Vec3d& up);
 
+    /*! A method to obtain a batch of scene screenshots, each with its own camera position and scene state,
+     * without changing the view, see GLWidget::getScreenShots(). */
+    QList<QPixmap> getScreenshots(const std::vector<osg::Vec3d>& eyes, const std::vector<osg::Vec3d>& centers,
+                                  const std::vector<osg::Vec3d>& ups, const std::vector<entity::SceneState*>& states);
+
     /*! \return width of GLWidget. */
     int getViewportWidth() const;
 
@@ -170,6 +179,10 @@ public slots:
     /*! Slot called when user performed drag-and-drop from PhotoWidget to GLWidget of a entity::Photo. */
     void onImportPhoto(const QString& path, const QString& fileName);
 
+    /*! Slot called when user performed drag-and-drop of several photos from PhotoWidget to GLWidget. The photos are
+     * added as one undo step, and their images are decoded in parallel. */
+    void onImportPhotos(const QStringList& fileNames);
+
     /*! Slot called when bookmark position is finished editing. The slot requests from user whether new canvas should be
      * created within the FOV of the camera position.
      * \param eye is eye position of the camera,
@@ -177,10 +190,24 @@ public slots:
      * \param up is up vector of camera position.  */
     void onRequestCanvasCreate(const osg::Vec3f& eye, const osg::Vec3f& center, const osg::Vec3f& up);
 
+    /*! Slot called when SceneLoader is done with the scene opened by onFileOpen(). The slot finalizes the
+     * loading on the GUI thread, or reports the loading error or cancellation. */
+    void onSceneLoaded(bool success);
+
     /*! Slot is called whenever user right clicks on Canvas within canvas widget. Called after similar slot
      * of user scene. This slot is only for photo re-scaling mouse mode. */
     void onCanvasClicked(const QModelIndex& index);
 
+    /*! Slot is called when the memory kept by the undo history changes, see fur::UndoHistory. It shows
+     * the usage within the status bar.
+     * \param usage is the memory kept by the history, in bytes,
+     * \param budget is the memory budget of the history, in bytes. */
+    void onUndoHistoryUsage(quint64 usage, quint64 budget);
+
+    /*! Slot is called when a batch of canvases was added or removed, see entity::UserScene::canvasesReset(). It
+     * re-builds the content of CanvasPhotoWidget at once. */
+    void onCanvasesReset();
+
 protected slots:
     /* NOTE: there should be no private slots, since all are used for unit tests */
     void onFileNew();
@@ -188,6 +215,7 @@ protected slots:
     void onFileSave();
     void onFileSaveAs();
     void onFileExport();
+    void onFileExportTessellation();
     void onFileImage();
     void onFilePhotoBase();
     void onFileClose();
@@ -243,6 +271,7 @@ protected slots:
     void onBookmarkEdit(const QString& name);
 
     void onStrokeFogFactor();
+    void onCanvasIntersections();
 
 protected:
     void        initializeActions();
@@ -251,9 +280,20 @@ protected:
     void        initializeCallbacks(); // for ctor
     bool        loadSceneFromFile();
 
+    /*! A method to start loading of the scene on a worker thread with a progress dialog which allows to cancel
+     * the loading. When done, onSceneLoaded() is called. \sa SceneLoader. */
+    void        loadSceneFromFileAsync(const QString& fname);
+
+    /*! A method to initialize GUI elements, e.g. bookmark and canvas widgets, after a new scene was set. */
+    bool        initializeLoadedScene();
+
     bool        importPhoto(QString& fileName);
     void        setSceneState(const entity::SceneState* state);
 
+    /*! A method to obtain the rotation and translation of the current canvas which are used as a base of
+     * a new canvas set; identity matrices are kept if there is no current canvas. */
+    void        getCanvasSetBase(osg::Matrix& R, osg::Matrix& T) const;
+
     /*! UI Method to add name of editable bookmark into bookmark's submenu. Has to be run
      * whenever the new bookmark is added throught the SVM method, or when opening new file.
      * Has to be cleared when the scene is cleared, or certain elements deleted when the corresponding
@@ -271,6 +311,8 @@ protected:
 
     // http://doc.qt.io/qt-5/qtwidgets-tools-undoframework-example.html
     QUndoStack*     m_undoStack;
+    fur::UndoHistory*   m_undoHistory; /* keeps m_undoStack within the memory budget */
+    QLabel*         m_labelHistory;
 
     QMenuBar*       m_menuBar;
     QMenu*          m_submenuBookmarks;
@@ -281,7 +323,8 @@ protected:
     // FILE actions
     QAction * m_actionNewFile, * m_actionClose, * m_actionExit,
             * m_actionImportImage, * m_actionOpenFile, * m_actionSaveFile,
-            * m_actionSaveAsFile, * m_actionExportAs, * m_actionPhotoBase;
+            * m_actionSaveAsFile, * m_actionExportAs, * m_actionPhotoBase,
+            * m_actionExportMerged, * m_actionExportGroups, * m_actionExportTessellation;
 
     // EDIT actions
     QAction * m_actionUndo, * m_actionRedo, * m_actionCut, * m_actionCopy,
@@ -301,7 +344,7 @@ protected:
             , * m_actionCanvasOrtho, * m_actionCanvasSeparate
             // New Canvas Set sub-menu
             , * m_actionSetStandard
-//            , * m_actionSetParallel, * m_actionSetCoaxial, * m_actionSetRing
+            , * m_actionSetParallel, * m_actionSetCoaxial, * m_actionSetRing
             // Edit Canvas
             , * m_actionCanvasEdit
             // Edit Strokes
@@ -310,9 +353,15 @@ protected:
 
     // OPTION actions
     QAction* m_actionStrokeFogFactor;
+    QAction* m_actionCanvasIntersections;
 
     CameraProperties*   m_cameraProperties;
 
+    SceneLoader*        m_sceneLoader; /* not NULL while a scene is being loaded */
+    QProgressDialog*    m_progressLoad;
+
+    float               m_exportChordalError; /* tessellation tolerance of export meshes, 0 means fixed tessellation */
+
     QColorDialog*       m_colorDialog;
 
     static MainWindow* m_instance;
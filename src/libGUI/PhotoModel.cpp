@@ -1,27 +1,105 @@
 #include "PhotoModel.h"
 
 #include <QDir>
+#include <QFile>
 #include <QFileInfoList>
 #include <QPixmap>
 #include <QMimeData>
 #include <QByteArray>
 #include <QDataStream>
 #include <QDrag>
+#include <QRunnable>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QCoreApplication>
+#include <QThread>
+#include <QDateTime>
+#include <QIcon>
+#include <QDebug>
+
+#include <osg/ref_ptr>
+#include <osg/Image>
 
 #include "Settings.h"
+#include "ImageLoader.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+/* Generates a thumbnail of a single image file on one of the pool threads. */
+class ThumbnailTask : public QRunnable
+{
+public:
+    ThumbnailTask(PhotoModel* model, int generation, const QFileInfo& info, const QString& cachePath,
+                  const QSize& size)
+        : QRunnable()
+        , m_model(model)
+        , m_generation(generation)
+        , m_info(info)
+        , m_cachePath(cachePath)
+        , m_size(size)
+    {
+    }
+
+    void run()
+    {
+        QImage thumbnail;
+        if (m_cachePath.isEmpty() || !thumbnail.load(m_cachePath, "PNG")){
+            /* decode at the smallest reduced scale that still covers the thumbnail */
+            std::string path = m_info.filePath().toStdString();
+            int width = 0, height = 0;
+            unsigned int scale = 1;
+            if (ImageLoader::readSize(path, width, height))
+                scale = ImageLoader::getScaleForSize(width, height, m_size.width(), m_size.height());
+            osg::ref_ptr<osg::Image> image = ImageLoader::read(path, scale);
+            thumbnail = ImageLoader::toQImage(image.get());
+            if (!thumbnail.isNull()) thumbnail = thumbnail.scaled(m_size);
+            if (!thumbnail.isNull() && !m_cachePath.isEmpty()){
+                /* other threads or instances may be writing the same entry */
+                QString part = QString("%1.%2.part").arg(m_cachePath).arg(reinterpret_cast<quintptr>(QThread::currentThreadId()));
+                if (!thumbnail.save(part, "PNG") || !QFile::rename(part, m_cachePath))
+                    QFile::remove(part);
+            }
+        }
+        QMetaObject::invokeMethod(m_model, "onThumbnailReady", Qt::QueuedConnection, Q_ARG(int, m_generation),
+                                  Q_ARG(QString, m_info.fileName()), Q_ARG(QImage, thumbnail));
+    }
+
+private:
+    PhotoModel* m_model;
+    int m_generation;
+    QFileInfo m_info;
+    QString m_cachePath;
+    QSize m_size;
+};
+#endif // DOXYGEN_SHOULD_SKIP_THIS
 
 PhotoModel::PhotoModel()
     : QStandardItemModel()
+    , m_generation(0)
 {
 //    this->setFilter(QDir::NoDotAndDotDot | QDir::Files);
 //    QStringList filters;
 //    filters << "*.bmp";
 //    this->setNameFilters(filters);
 //    this->setNameFilterDisables(false);
+    QString cache = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if (!cache.isEmpty())
+        this->setCacheDirectory(QDir(cache).filePath(cher::PHOTO_THUMBNAIL_CACHE));
+    m_pool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+PhotoModel::~PhotoModel()
+{
+    /* the running tasks post their results to this model */
+    m_pool.clear();
+    m_pool.waitForDone();
 }
 
 void PhotoModel::setRootPath(const QString &directory)
 {
+    /* drop the thumbnails that are queued for the previous directory */
+    m_pool.clear();
+    m_generation++;
+    m_items.clear();
     this->clear();
     m_directory.clear();
 
@@ -30,14 +108,15 @@ void PhotoModel::setRootPath(const QString &directory)
     QDir dir(directory);
     QFileInfoList fileList = dir.entryInfoList(QStringList() << "*.bmp", QDir::Files);
     int fileCount = fileList.size();
+    QSize size(cher::APP_WIDGET_ICONSIZE_W * cher::DPI_SCALING, cher::APP_WIDGET_ICONSIZE_H * cher::DPI_SCALING);
     for (int i=0; i<fileCount; ++i){
-        QPixmap originalImage(fileList[i].filePath());
-        if (!originalImage.isNull()){
-            QPixmap scaledImage = originalImage.scaled(cher::APP_WIDGET_ICONSIZE_W * cher::DPI_SCALING,
-                                                       cher::APP_WIDGET_ICONSIZE_H * cher::DPI_SCALING);
-            this->setItem(i, new QStandardItem(QIcon(scaledImage), fileList[i].fileName()));
-        }
+        QStandardItem* item = new QStandardItem(fileList[i].fileName());
+        this->setItem(i, item);
+        m_items.insert(fileList[i].fileName(), QPersistentModelIndex(item->index()));
+        m_pool.start(new ThumbnailTask(this, m_generation, fileList[i], this->getThumbnailCachePath(fileList[i]), size));
     }
+    if (m_items.isEmpty())
+        emit this->thumbnailsFinished();
 }
 
 const QString &PhotoModel::getRootPath() const
@@ -45,6 +124,57 @@ const QString &PhotoModel::getRootPath() const
     return m_directory;
 }
 
+void PhotoModel::setCacheDirectory(const QString &directory)
+{
+    m_cacheDirectory = directory;
+    if (!m_cacheDirectory.isEmpty() && !QDir().mkpath(m_cacheDirectory)){
+        qWarning() << "PhotoModel: could not create thumbnail cache directory" << m_cacheDirectory;
+        m_cacheDirectory.clear();
+    }
+}
+
+const QString &PhotoModel::getCacheDirectory() const
+{
+    return m_cacheDirectory;
+}
+
+QString PhotoModel::getThumbnailCachePath(const QFileInfo &info) const
+{
+    if (m_cacheDirectory.isEmpty()) return QString();
+    QString key = QString("%1|%2|%3|%4x%5").arg(info.absoluteFilePath()).arg(info.lastModified().toMSecsSinceEpoch())
+            .arg(info.size()).arg(cher::APP_WIDGET_ICONSIZE_W * cher::DPI_SCALING).arg(cher::APP_WIDGET_ICONSIZE_H * cher::DPI_SCALING);
+    QByteArray hash = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Md5).toHex();
+    return QDir(m_cacheDirectory).filePath(QString::fromLatin1(hash) + ".png");
+}
+
+int PhotoModel::getNumPending() const
+{
+    return m_items.size();
+}
+
+void PhotoModel::waitForDone()
+{
+    m_pool.waitForDone();
+    QCoreApplication::sendPostedEvents(this, QEvent::MetaCall);
+}
+
+void PhotoModel::onThumbnailReady(int generation, const QString &fileName, const QImage &thumbnail)
+{
+    if (generation != m_generation || !m_items.contains(fileName)) return;
+    QPersistentModelIndex index = m_items.take(fileName);
+    if (!index.isValid()) return;
+
+    if (thumbnail.isNull()){
+        qWarning() << "PhotoModel: could not read image" << fileName;
+        this->removeRow(index.row());
+    }
+    else
+        this->setData(index, QIcon(QPixmap::fromImage(thumbnail)), Qt::DecorationRole);
+
+    if (m_items.isEmpty())
+        emit this->thumbnailsFinished();
+}
+
 Qt::DropActions PhotoModel::supportedDragActions() const
 {
     return Qt::CopyAction;
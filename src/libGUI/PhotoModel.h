@@ -6,29 +6,79 @@
 #include <QStandardItemModel>
 #include <QFileSystemModel>
 #include <QModelIndex>
+#include <QPersistentModelIndex>
 #include <QDragEnterEvent>
 #include <QDragMoveEvent>
 #include <QDropEvent>
 #include <QMimeData>
 #include <QModelIndexList>
+#include <QThreadPool>
+#include <QFileInfo>
+#include <QImage>
+#include <QHash>
+#include <QSize>
 
 // drag and drop additional info: http://doc.qt.io/qt-5/model-view-programming.html#using-drag-and-drop-with-item-views
 
+/*! \class PhotoModel
+ * \brief Model of the photo base directory: one item per image file, with the image thumbnail as an icon.
+ *
+ * The items are populated as soon as the directory is set, and their thumbnails are generated by a pool of
+ * worker threads and attached as each of them is ready, so that a directory with thousands of images does not
+ * block the GUI. The images are decoded at a reduced scale, see ImageLoader. The thumbnails are cached on disk
+ * by the image path, modification time and size, see getThumbnailCachePath(), so that a directory opened
+ * before shows up almost instantly.
+*/
 class PhotoModel : public QStandardItemModel
 {
+    Q_OBJECT
 public:
     PhotoModel();
+    ~PhotoModel();
 
     void setRootPath(const QString& directory);
     const QString& getRootPath() const;
 
+    /*! A method to set the directory of the thumbnail disk cache; empty path disables the cache. By default
+     * it is cher::PHOTO_THUMBNAIL_CACHE within the application cache location. */
+    void setCacheDirectory(const QString& directory);
+
+    /*! \return directory of the thumbnail disk cache. */
+    const QString& getCacheDirectory() const;
+
+    /*! \return path of the cached thumbnail of the image file, which is unique for the image path, its
+     * modification time and size, and the thumbnail size; or empty string if the cache is disabled. */
+    QString getThumbnailCachePath(const QFileInfo& info) const;
+
+    /*! \return number of the thumbnails that are not generated yet. */
+    int getNumPending() const;
+
+    /*! A method to wait until all the thumbnails are generated and attached to their items. */
+    void waitForDone();
+
     virtual Qt::DropActions supportedDragActions() const;
     virtual Qt::ItemFlags flags(const QModelIndex &index) const;
     virtual QStringList mimeTypes() const;
     virtual QMimeData* mimeData(const QModelIndexList &indexes) const;
 
+signals:
+    /*! Signal is emitted when all the thumbnails of the directory are attached. */
+    void thumbnailsFinished();
+
+protected slots:
+    /*! A slot to attach a thumbnail generated by a worker thread; the images which could not be read are
+     * removed from the model.
+     * \param generation is the number of the setRootPath() call the thumbnail was requested by,
+     * \param fileName is the image file name within the directory,
+     * \param thumbnail is the scaled image, or null image on failure. */
+    void onThumbnailReady(int generation, const QString& fileName, const QImage& thumbnail);
+
 private:
     QString m_directory;
+    QString m_cacheDirectory;
+    QThreadPool m_pool;
+    QHash<QString, QPersistentModelIndex> m_items; /*!< items waiting for their thumbnails, by file name. */
+    int m_generation; /*!< stale thumbnails of the previous directories are dropped. */
 };
 
 #endif // PHOTOMODEL_H
@@ -0,0 +1,135 @@
+#include "ThumbnailRenderer.h"
+
+#include <algorithm>
+
+#include <QImage>
+#include <QtGlobal>
+
+#include <osg/Viewport>
+#include <osg/FrameStamp>
+#include <osgUtil/UpdateVisitor>
+#include <osgViewer/Renderer>
+
+#include "Settings.h"
+
+ThumbnailRenderer::ThumbnailRenderer(osgViewer::View *view)
+    : osg::Referenced()
+    , m_view(view)
+    , m_camera(new osg::Camera)
+    , m_image(0)
+    , m_context(0)
+    , m_height(cher::APP_SCREENSHOT_HEIGHT * cher::DPI_SCALING)
+    , m_numRendered(0)
+{
+    m_camera->setName("CameraThumbnail");
+    m_camera->setReferenceFrame(osg::Transform::ABSOLUTE_RF);
+    m_camera->setRenderOrder(osg::Camera::PRE_RENDER);
+    m_camera->setRenderTargetImplementation(osg::Camera::FRAME_BUFFER_OBJECT, osg::Camera::FRAME_BUFFER);
+    m_camera->setClearMask(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    m_camera->setClearColor(cher::BACKGROUND_CLR);
+    m_camera->attach(osg::Camera::DEPTH_BUFFER, GL_DEPTH_COMPONENT24);
+    if (view){
+        /* the renderer takes the lighting and global state of the main view */
+        m_camera->setView(view);
+        if (view->getSceneData()) m_camera->addChild(view->getSceneData());
+    }
+    m_camera->setRenderer(new osgViewer::Renderer(m_camera.get()));
+}
+
+void ThumbnailRenderer::setHeight(int height)
+{
+    m_height = std::max(1, height);
+}
+
+int ThumbnailRenderer::getHeight() const
+{
+    return m_height;
+}
+
+bool ThumbnailRenderer::begin()
+{
+    if (!m_view.valid() || !m_view->getCamera()) return false;
+    osg::GraphicsContext* gc = m_view->getCamera()->getGraphicsContext();
+    if (!gc){
+        qWarning("ThumbnailRenderer: main view has no graphics context");
+        return false;
+    }
+    if (m_camera->getNumChildren() == 0 && m_view->getSceneData())
+        m_camera->addChild(m_view->getSceneData());
+    m_camera->setGraphicsContext(gc);
+    m_context = gc;
+    return true;
+}
+
+QPixmap ThumbnailRenderer::render(const osg::Vec3d &eye, const osg::Vec3d &center, const osg::Vec3d &up)
+{
+    if (!m_context.valid() || !m_view.valid()){
+        qWarning("ThumbnailRenderer: render() is called outside of begin() and end()");
+        return QPixmap();
+    }
+    osgViewer::Renderer* renderer = dynamic_cast<osgViewer::Renderer*>(m_camera->getRenderer());
+    if (!renderer) return QPixmap();
+
+    /* the thumbnail keeps the aspect ratio of the main view, so its projection can be shared */
+    osg::Camera* main = m_view->getCamera();
+    const osg::Viewport* viewport = main->getViewport();
+    double ratio = viewport && viewport->height() > 0? viewport->width() / viewport->height() : 1.5;
+    int width = std::max(1, static_cast<int>(m_height * ratio + 0.5));
+    this->setupCamera(width, m_height);
+
+    /* the uniforms are computed from the main camera, see the class description */
+    osg::Matrixd view = main->getViewMatrix();
+    main->setViewMatrixAsLookAt(eye, center, up);
+    this->updateUniforms();
+    m_camera->setViewMatrix(main->getViewMatrix());
+    m_camera->setProjectionMatrix(main->getProjectionMatrix());
+
+    renderer->cull_draw();
+
+    main->setViewMatrix(view);
+    this->updateUniforms();
+
+    /* OpenGL rows go bottom-up; mirrored() also makes a deep copy of the image data */
+    QImage image(m_image->data(), m_image->s(), m_image->t(), QImage::Format_RGBA8888);
+    m_numRendered++;
+    return QPixmap::fromImage(image.mirrored());
+}
+
+void ThumbnailRenderer::end()
+{
+    /* it also releases the frame buffer object, the context must still be current */
+    if (m_context.valid()) m_camera->setGraphicsContext(0);
+    m_context = 0;
+}
+
+unsigned int ThumbnailRenderer::getNumRendered() const
+{
+    return m_numRendered;
+}
+
+void ThumbnailRenderer::setupCamera(int width, int height)
+{
+    if (m_image.valid() && m_image->s() == width && m_image->t() == height) return;
+
+    m_image = new osg::Image;
+    m_image->allocateImage(width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+    m_camera->setViewport(0, 0, width, height);
+    m_camera->detach(osg::Camera::COLOR_BUFFER);
+    m_camera->attach(osg::Camera::COLOR_BUFFER, m_image.get());
+
+    /* the render stage is re-created with the new attachment */
+    m_camera->setRenderingCache(0);
+}
+
+void ThumbnailRenderer::updateUniforms()
+{
+    osg::Node* scene = m_view->getSceneData();
+    if (!scene) return;
+    osgUtil::UpdateVisitor uv;
+    osg::FrameStamp* stamp = m_view->getFrameStamp();
+    if (stamp){
+        uv.setFrameStamp(stamp);
+        uv.setTraversalNumber(stamp->getFrameNumber());
+    }
+    scene->accept(uv);
+}
@@ -0,0 +1,74 @@
+#ifndef THUMBNAILRENDERER_H
+#define THUMBNAILRENDERER_H
+
+#include <osg/Referenced>
+#include <osg/ref_ptr>
+#include <osg/observer_ptr>
+#include <osg/Camera>
+#include <osg/Image>
+#include <osg/Node>
+#include <osg/GraphicsContext>
+#include <osgViewer/View>
+
+#include <QPixmap>
+
+/*! \class ThumbnailRenderer
+ * \brief Offscreen renderer of the scene graph thumbnails, e.g., bookmark screenshots.
+ *
+ * The thumbnails are rendered by a dedicated camera into a frame buffer object of the thumbnail size
+ * and read back into an image. The camera shares the graphics context and the scene of the main view,
+ * so that the GL objects are not duplicated, but it is attached to the context only between begin()
+ * and end(), so that it is never drawn by the main view frames. When the context does not support
+ * frame buffer objects, the camera falls back to the frame buffer of the context, which is then
+ * redrawn by the next main frame.
+ *
+ * The shader uniforms of the scene are computed from the main camera by the update callbacks, see
+ * ModelViewProjectionMatrixCallback. That is why the main camera matrices are set to the thumbnail view
+ * for the duration of render() and restored right after; the main view is not redrawn in between.
+*/
+class ThumbnailRenderer : public osg::Referenced
+{
+public:
+    /*! Constructor.
+     * \param view is the main view whose camera, context and scene are shared with the thumbnails. */
+    ThumbnailRenderer(osgViewer::View* view);
+
+    /*! \param height is the height of the thumbnails in pixels, the width follows the aspect
+     * ratio of the main camera viewport. By default it is cher::APP_SCREENSHOT_HEIGHT scaled by DPI. */
+    void setHeight(int height);
+
+    /*! \return the height of the thumbnails in pixels. */
+    int getHeight() const;
+
+    /*! Method to attach the thumbnail camera to the graphics context of the main view. The context
+     * must be current until end() is called.
+     * \return false if the main view has no graphics context. */
+    bool begin();
+
+    /*! Method to render the scene from the given camera position into a thumbnail.
+     * \return the thumbnail, or null pixmap if begin() was not called or the rendering failed. */
+    QPixmap render(const osg::Vec3d& eye, const osg::Vec3d& center, const osg::Vec3d& up);
+
+    /*! Method to detach the thumbnail camera from the graphics context. */
+    void end();
+
+    /*! \return the number of the thumbnails rendered so far. */
+    unsigned int getNumRendered() const;
+
+protected:
+    /*! Method to set the thumbnail size and the render target of the thumbnail camera. */
+    void setupCamera(int width, int height);
+
+    /*! Method to run the update traversal of the scene so that the uniforms follow the main camera. */
+    void updateUniforms();
+
+private:
+    osg::observer_ptr<osgViewer::View> m_view;
+    osg::ref_ptr<osg::Camera> m_camera;
+    osg::ref_ptr<osg::Image> m_image;
+    osg::observer_ptr<osg::GraphicsContext> m_context;
+    int m_height;
+    unsigned int m_numRendered;
+};
+
+#endif // THUMBNAILRENDERER_H
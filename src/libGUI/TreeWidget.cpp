@@ -23,16 +23,32 @@ CanvasDelegate *CanvasPhotoWidget::getCanvasDelegate() const
     return dynamic_cast<CanvasDelegate*>(this->itemDelegate());
 }
 
+void CanvasPhotoWidget::resetCanvases(const std::vector<CanvasPhotoWidget::CanvasData> &canvases)
+{
+    /* item data changes are not the user edits, see UserScene::onItemChanged() */
+    bool blocked = this->blockSignals(true);
+    this->setUpdatesEnabled(false);
+    this->clear();
+
+    QList<QTreeWidgetItem*> items;
+    for (size_t i=0; i<canvases.size(); ++i){
+        const CanvasData& data = canvases.at(i);
+        QTreeWidgetItem* item = this->createCanvasItem(data.name);
+        for (size_t j=0; j<data.photos.size(); ++j)
+            item->addChild(this->createPhotoItem(data.photos.at(j)));
+        item->setData(0, cher::DelegateBGColor, this->getCanvasColor(data.color));
+        item->setData(0, cher::DelegateVisibilityRole, !data.visibility);
+        items.append(item);
+    }
+    this->addTopLevelItems(items);
+
+    this->setUpdatesEnabled(true);
+    this->blockSignals(blocked);
+}
+
 void CanvasPhotoWidget::onCanvasAdded(const std::string &name)
 {
-    QTreeWidgetItem* item = new QTreeWidgetItem();
-    if (!item) return;
-    item->setText(0, QString(name.c_str()));
-    item->setFlags(item->flags() | Qt::ItemIsEditable);
-    item->setData(0,cher::DelegateChildRole,1);
-    item->setChildIndicatorPolicy(QTreeWidgetItem::ShowIndicator);
-//    item->setSizeHint(0, QSize(cher::APP_WIDGET_BUTTON, cher::APP_WIDGET_BUTTON));
-    this->addTopLevelItem(item);
+    this->addTopLevelItem(this->createCanvasItem(name));
 }
 
 void CanvasPhotoWidget::onPhotoAdded(const std::string &name, int rowParent)
@@ -47,12 +63,7 @@ void CanvasPhotoWidget::onPhotoAdded(const std::string &name, int rowParent)
     }
     QTreeWidgetItem* parent = this->topLevelItem(rowParent);
     if (!parent) return;
-    QTreeWidgetItem* child = new QTreeWidgetItem();
-    if (!child) return;
-    child->setText(0, QString(name.c_str()));
-    child->setFlags(child->flags() | Qt::ItemIsEditable);
-    child->setData(0,cher::DelegateChildRole,2);
-    parent->addChild(child);
+    parent->addChild(this->createPhotoItem(name));
 }
 
 void CanvasPhotoWidget::onCanvasRemoved(int row)
@@ -100,23 +111,8 @@ void CanvasPhotoWidget::onCanvasSelectedColor(int row, int color)
 
     QTreeWidgetItem* item = this->topLevelItem(row);
     if (!item) return;
-    QColor qcolor;
-    switch (color){
-    case 0:
-        qcolor = Qt::white;
-        break;
-    case 1:
-        qcolor = Utilities::getQColor(cher::CANVAS_CLR_CURRENT);
-        break;
-    case 2:
-        qcolor = Utilities::getQColor(cher::CANVAS_CLR_PREVIOUS);
-        break;
-    default:
-        qcolor = Qt::white;
-        break;
-    }
 //    item->setBackgroundColor(0, qcolor);
-    item->setData(0, cher::DelegateBGColor, qcolor);
+    item->setData(0, cher::DelegateBGColor, this->getCanvasColor(color));
 }
 
 void CanvasPhotoWidget::onCanvasVisibilitySet(int row, bool visibility)
@@ -138,6 +134,47 @@ void CanvasPhotoWidget::onCanvasVisibilitySet(int row, bool visibility)
     item->setData(0, cher::DelegateVisibilityRole, !visibility );
 }
 
+void CanvasPhotoWidget::onCanvasMemoryUsage(int row, quint64 host, quint64 texture)
+{
+    QTreeWidgetItem* item = this->topLevelItem(row);
+    if (!item) return;
+    item->setToolTip(0, tr("Photo memory: %1 MB host, %2 MB GPU")
+                     .arg(host / 1048576.0, 0, 'f', 1)
+                     .arg(texture / 1048576.0, 0, 'f', 1));
+}
+
+QTreeWidgetItem *CanvasPhotoWidget::createCanvasItem(const std::string &name) const
+{
+    QTreeWidgetItem* item = new QTreeWidgetItem();
+    item->setText(0, QString(name.c_str()));
+    item->setFlags(item->flags() | Qt::ItemIsEditable);
+    item->setData(0,cher::DelegateChildRole,1);
+    item->setChildIndicatorPolicy(QTreeWidgetItem::ShowIndicator);
+//    item->setSizeHint(0, QSize(cher::APP_WIDGET_BUTTON, cher::APP_WIDGET_BUTTON));
+    return item;
+}
+
+QTreeWidgetItem *CanvasPhotoWidget::createPhotoItem(const std::string &name) const
+{
+    QTreeWidgetItem* child = new QTreeWidgetItem();
+    child->setText(0, QString(name.c_str()));
+    child->setFlags(child->flags() | Qt::ItemIsEditable);
+    child->setData(0,cher::DelegateChildRole,2);
+    return child;
+}
+
+QColor CanvasPhotoWidget::getCanvasColor(int color) const
+{
+    switch (color){
+    case 1:
+        return Utilities::getQColor(cher::CANVAS_CLR_CURRENT);
+    case 2:
+        return Utilities::getQColor(cher::CANVAS_CLR_PREVIOUS);
+    default:
+        return Qt::white;
+    }
+}
+
 void CanvasPhotoWidget::mousePressEvent(QMouseEvent *event)
 {
     if (event->button() == Qt::RightButton){
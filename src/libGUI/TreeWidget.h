@@ -1,7 +1,11 @@
 #ifndef TREEWIDGET_H
 #define TREEWIDGET_H
 
+#include <string>
+#include <vector>
+
 #include <QTreeWidget>
+#include <QColor>
 
 #include "ListDelegate.h"
 
@@ -19,6 +23,20 @@ public:
     /*! \return a non-const pointer to CanvasDelegate. */
     CanvasDelegate* getCanvasDelegate() const;
 
+    /*! \struct CanvasData
+     * \brief Content of a canvas item, see resetCanvases(). */
+    struct CanvasData {
+        std::string name; /*!< canvas name */
+        std::vector<std::string> photos; /*!< names of the canvas photos */
+        int color; /*!< color indicator, see onCanvasSelectedColor() */
+        bool visibility; /*!< canvas visibility, see onCanvasVisibilitySet() */
+    };
+
+    /*! A method to re-build the whole widget content at once, e.g., when a scene is loaded. The items are
+     * created with the widget signals blocked and are inserted by a single call, so that the tree is laid out
+     * only once. \param canvases is the content of the canvas items in the order of the scene canvases. */
+    void resetCanvases(const std::vector<CanvasData>& canvases);
+
 signals:
     /*! Signal to inform whenver user performs a right click action. */
     void rightClicked(const QModelIndex& index);
@@ -47,8 +65,18 @@ public slots:
     /*! Slot called whenever canvas visibility is set (not by user), e.g., on file read or by going to specific bookmark. */
     void onCanvasVisibilitySet(int row, bool visibility);
 
+    /*! Slot called whenever the memory taken by the photos of a canvas changes. The usage is shown as the item tooltip.
+     * \param row is the integer row number of the canvas item,
+     * \param host is the host memory of the canvas photos, in bytes,
+     * \param texture is the GPU memory of the canvas photos, in bytes. */
+    void onCanvasMemoryUsage(int row, quint64 host, quint64 texture);
+
 protected:
     virtual void mousePressEvent(QMouseEvent* event);
+
+    QTreeWidgetItem* createCanvasItem(const std::string& name) const;
+    QTreeWidgetItem* createPhotoItem(const std::string& name) const;
+    QColor getCanvasColor(int color) const;
 //    virtual void dropEvent(QDropEvent* event);
 
 };
@@ -3,6 +3,8 @@
 #include <QObject>
 #include <QDebug>
 
+#include "ImageDecoder.h"
+
 fur::AddCanvasCommand::AddCanvasCommand(entity::UserScene* scene, const osg::Matrix& R, const osg::Matrix& T, const std::string& name, QUndoCommand* parent)
     : QUndoCommand(parent)
     , m_scene(scene)
@@ -50,17 +52,82 @@ fur::AddCanvasCommand::AddCanvasCommand(entity::UserScene *scene, const osg::Vec
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 void fur::AddCanvasCommand::undo()
 {
+    if (this->isReleased()) return;
     if (!m_scene->removeCanvas(m_canvas.get()))
         qFatal("AddCanvasCommand::undo() - could not remove from scene graph");
+    m_snapshot.capture(m_canvas.get());
+    this->setPayloadBytes(m_snapshot.getBytes());
 }
 
 void fur::AddCanvasCommand::redo()
 {
+    if (this->isReleased()) return;
+    m_snapshot.restore();
+    this->setPayloadBytes(0);
     if (!m_scene->addCanvas(m_canvas))
         qFatal("AddCanvasCommand::redo() - could not add canvas");
 }
+
+void fur::AddCanvasCommand::onReleasePayload()
+{
+    m_snapshot.clear();
+    m_canvas = 0;
+}
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
+fur::AddCanvasesCommand::AddCanvasesCommand(entity::UserScene *scene, const std::vector<osg::Matrix> &R, const std::vector<osg::Matrix> &T,
+                                            const std::vector<std::string> &names, QUndoCommand *parent)
+    : QUndoCommand(parent)
+    , m_scene(scene)
+    , m_canvases(0)
+    , m_current(scene->getCanvasCurrent())
+    , m_previous(scene->getCanvasPrevious())
+{
+    for (size_t i=0; i<R.size() && i<T.size() && i<names.size(); ++i){
+        osg::ref_ptr<entity::Canvas> canvas = new entity::Canvas;
+        canvas->initializeSG();
+        canvas->setName(names.at(i));
+        canvas->setMatrixRotation(R.at(i));
+        canvas->setMatrixTranslation(T.at(i));
+        m_canvases.push_back(canvas);
+    }
+    this->setText(QObject::tr("Add set of %1 canvases")
+                  .arg(m_canvases.size()));
+}
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+void fur::AddCanvasesCommand::undo()
+{
+    if (this->isReleased()) return;
+    if (!m_scene->removeCanvases(this->getCanvases()))
+        qFatal("AddCanvasesCommand::undo() - could not remove from scene graph");
+
+    /* current and previous canvases are re-assigned as they were before the addition */
+    if (m_previous.get()) m_scene->setCanvasCurrent(m_previous.get());
+    if (m_current.get()) m_scene->setCanvasCurrent(m_current.get());
+}
+
+void fur::AddCanvasesCommand::redo()
+{
+    if (this->isReleased()) return;
+    if (!m_scene->addCanvases(this->getCanvases()))
+        qFatal("AddCanvasesCommand::redo() - could not add canvases");
+}
+
+void fur::AddCanvasesCommand::onReleasePayload()
+{
+    m_canvases.clear();
+}
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
+std::vector<entity::Canvas *> fur::AddCanvasesCommand::getCanvases() const
+{
+    std::vector<entity::Canvas*> canvases;
+    for (size_t i=0; i<m_canvases.size(); ++i)
+        canvases.push_back(m_canvases.at(i).get());
+    return canvases;
+}
+
 fur::AddPhotoCommand::AddPhotoCommand(entity::UserScene* scene, const std::string& fname, const std::string &ename, QUndoCommand* parent)
     : QUndoCommand(parent)
     , m_scene(scene)
@@ -69,10 +136,11 @@ fur::AddPhotoCommand::AddPhotoCommand(entity::UserScene* scene, const std::strin
     , m_bookmarks(scene->getBookmarksModel())
 {
     m_photo->setName(ename);
-    m_photo->loadImage(fname);
-
+    /* same as for several photos, the image is decoded off the GUI thread, see AddPhotosCommand */
+    m_photo->initializeQuad(1.f);
     m_photo->getOrCreateStateSet()->setTextureAttributeAndModes(0, m_photo->getTextureAsAttribute());
     m_photo->scaleWithinViewport(m_canvas->getPlane(), m_canvas->getCenter3D(), m_canvas->getMatrixInverse());
+    ImageDecoder::instance().decode(m_photo.get(), fname);
 
     this->setText(QObject::tr("Add photo to %1")
                   .arg(QString(m_canvas->getName().c_str())));
@@ -81,15 +149,71 @@ fur::AddPhotoCommand::AddPhotoCommand(entity::UserScene* scene, const std::strin
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 void fur::AddPhotoCommand::undo()
 {
+    if (this->isReleased()) return;
     if (!m_scene->removeEntity(m_canvas.get(), m_photo.get()))
         qFatal("AddPhotoCommand::undo() failed");
 }
 
 void fur::AddPhotoCommand::redo()
 {
+    if (this->isReleased()) return;
     if (!m_scene->addEntity(m_canvas.get(), m_photo.get()))
         qFatal("AddPhotoCommand::redo() failed");
 }
+
+void fur::AddPhotoCommand::onReleasePayload()
+{
+    m_photo = 0;
+}
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
+fur::AddPhotosCommand::AddPhotosCommand(entity::UserScene *scene, const std::vector<std::string> &fnames,
+                                         const std::vector<std::string> &enames, QUndoCommand *parent)
+    : QUndoCommand(parent)
+    , m_scene(scene)
+    , m_canvas(scene->getCanvasCurrent())
+{
+    Q_ASSERT(fnames.size() == enames.size());
+    for (size_t i=0; i<fnames.size() && i<enames.size(); ++i){
+        osg::ref_ptr<entity::Photo> photo = new entity::Photo;
+        photo->setName(enames[i]);
+        /* square placeholder; it is shrunk to the image aspect ratio once decoded */
+        photo->initializeQuad(1.f);
+        photo->getOrCreateStateSet()->setTextureAttributeAndModes(0, photo->getTextureAsAttribute());
+        photo->scaleWithinViewport(m_canvas->getPlane(), m_canvas->getCenter3D(), m_canvas->getMatrixInverse());
+
+        ImageDecoder::instance().decode(photo.get(), fnames[i]);
+        m_photos.push_back(photo);
+    }
+
+    this->setText(QObject::tr("Add %1 photos to %2")
+                  .arg(m_photos.size())
+                  .arg(QString(m_canvas->getName().c_str())));
+}
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+void fur::AddPhotosCommand::undo()
+{
+    if (this->isReleased()) return;
+    for (size_t i=0; i<m_photos.size(); ++i){
+        if (!m_scene->removeEntity(m_canvas.get(), m_photos[i].get()))
+            qFatal("AddPhotosCommand::undo() failed");
+    }
+}
+
+void fur::AddPhotosCommand::redo()
+{
+    if (this->isReleased()) return;
+    for (size_t i=0; i<m_photos.size(); ++i){
+        if (!m_scene->addEntity(m_canvas.get(), m_photos[i].get()))
+            qFatal("AddPhotosCommand::redo() failed");
+    }
+}
+
+void fur::AddPhotosCommand::onReleasePayload()
+{
+    m_photos.clear();
+}
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
 fur::AddStrokeCommand::AddStrokeCommand(entity::UserScene* scene, entity::Stroke* stroke, QUndoCommand* parent)
@@ -105,15 +229,22 @@ fur::AddStrokeCommand::AddStrokeCommand(entity::UserScene* scene, entity::Stroke
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 void fur::AddStrokeCommand::undo()
 {
+    if (this->isReleased()) return;
     if (!m_scene->removeEntity(m_canvas.get(), m_stroke.get()))
         qCritical("undo(): problem while removing stroke from a canvas");
 }
 
 void fur::AddStrokeCommand::redo()
 {
+    if (this->isReleased()) return;
     if (!m_scene->addEntity(m_canvas.get(), m_stroke.get()))
         qCritical("redo(): problem while adding stroke to a canvas");
 }
+
+void fur::AddStrokeCommand::onReleasePayload()
+{
+    m_stroke = 0;
+}
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
 fur::AddCanvasSeparationCommand::AddCanvasSeparationCommand(entity::UserScene *scene, entity::Canvas *source, entity::Canvas *copy, QUndoCommand *parent)
@@ -142,6 +273,7 @@ fur::AddCanvasSeparationCommand::AddCanvasSeparationCommand(entity::UserScene *s
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 void fur::AddCanvasSeparationCommand::undo()
 {
+    if (this->isReleased()) return;
     // move entities to source, remove from target
     this->moveEntities(m_target.get(), m_source.get());
 
@@ -151,11 +283,18 @@ void fur::AddCanvasSeparationCommand::undo()
 
 void fur::AddCanvasSeparationCommand::redo()
 {
+    if (this->isReleased()) return;
     // add entities to target, remove from source
     this->moveEntities(m_source.get(), m_target.get());
 
     if (!m_scene->addCanvas(m_target.get())) qFatal("AddCanvasSeparationCommand::redo() failed");
 }
+
+void fur::AddCanvasSeparationCommand::onReleasePayload()
+{
+    m_target = 0;
+    m_entities.clear();
+}
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
 void fur::AddCanvasSeparationCommand::moveEntities(entity::Canvas *from, entity::Canvas *to)
@@ -187,15 +326,22 @@ fur::AddPolygonCommand::AddPolygonCommand(entity::UserScene *scene, entity::Poly
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 void fur::AddPolygonCommand::undo()
 {
+    if (this->isReleased()) return;
     if (!m_scene->removeEntity(m_canvas.get(), m_polygon.get()))
         qCritical("undo(): problem while removing stroke from a canvas");
 }
 
 void fur::AddPolygonCommand::redo()
 {
+    if (this->isReleased()) return;
     if (!m_scene->addEntity(m_canvas.get(), m_polygon.get()))
         qCritical("redo(): problem while adding stroke to a canvas");
 }
+
+void fur::AddPolygonCommand::onReleasePayload()
+{
+    m_polygon = 0;
+}
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
 fur::AddEntityCommand::AddEntityCommand(entity::UserScene *scene, entity::Entity2D *entity, QUndoCommand *parent)
@@ -213,16 +359,25 @@ fur::AddEntityCommand::AddEntityCommand(entity::UserScene *scene, entity::Entity
 
 void fur::AddEntityCommand::undo()
 {
+    if (this->isReleased()) return;
     if (!m_scene->removeEntity(m_canvas.get(), m_entity.get()))
         qCritical("undo(): problem while removing entity from a canvas");
 }
 
 void fur::AddEntityCommand::redo()
 {
+    if (this->isReleased()) return;
     if (!m_scene->addEntity(m_canvas.get(), m_entity.get()))
             qCritical("redo(): problem while adding entity to canvas");
 }
 
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+void fur::AddEntityCommand::onReleasePayload()
+{
+    m_entity = 0;
+}
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
 fur::AddLineSegmentCommand::AddLineSegmentCommand(entity::UserScene *scene, entity::LineSegment *segment, QUndoCommand *parent)
     : QUndoCommand(parent)
     , m_scene(scene)
@@ -234,12 +389,21 @@ fur::AddLineSegmentCommand::AddLineSegmentCommand(entity::UserScene *scene, enti
 
 void fur::AddLineSegmentCommand::undo()
 {
+    if (this->isReleased()) return;
     if (!m_scene->removeEntity(m_canvas.get(), m_segment.get()))
         qCritical("undo(): problem while removing stroke from a canvas");
 }
 
 void fur::AddLineSegmentCommand::redo()
 {
+    if (this->isReleased()) return;
     if (!m_scene->addEntity(m_canvas.get(), m_segment.get()))
         qCritical("redo(): problem while adding stroke to a canvas");
 }
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+void fur::AddLineSegmentCommand::onReleasePayload()
+{
+    m_segment = 0;
+}
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
@@ -1,6 +1,9 @@
 #ifndef ADDENTITYCOMMAND_H
 #define ADDENTITYCOMMAND_H
 
+#include <vector>
+#include <string>
+
 #include <QUndoCommand>
 
 #include <osg/ref_ptr>
@@ -13,6 +16,8 @@
 #include "Polygon.h"
 #include "Bookmarks.h"
 #include "SceneState.h"
+#include "UndoHistory.h"
+#include "CanvasSnapshot.h"
 
 namespace entity {
 class UserScene;
@@ -30,7 +35,7 @@ namespace fur {
 /*! \class AddCanvasCommand
  * \brief QUndoCommand that performs addition of a canvas to entity::UserScene.
 */
-class AddCanvasCommand : public QUndoCommand
+class AddCanvasCommand : public QUndoCommand, public UndoPayload
 {
 public:
     /*! \param scene is the scene graph to add to, \param R is the rotation matrix of the canvas, \param T is translation matrix of the canvas,
@@ -53,15 +58,50 @@ public:
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
 private:
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    void onReleasePayload() Q_DECL_OVERRIDE;
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
     osg::observer_ptr<entity::UserScene> m_scene;
     osg::ref_ptr<entity::Canvas> m_canvas;
     osg::observer_ptr<entity::Bookmarks> m_bookmarks;
+    entity::CanvasSnapshot m_snapshot; /*!< data of the canvas while its addition is undone */
 }; // class AddCanvasCommand
 
+/*! \class AddCanvasesCommand
+ * \brief QUndoCommand that performs addition of a set of canvases to entity::UserScene as a single undo step,
+ * e.g., a ring, coaxial or parallel canvas set.
+*/
+class AddCanvasesCommand : public QUndoCommand, public UndoPayload
+{
+public:
+    /*! \param scene is the scene graph to add to, \param R are the rotation matrices of the canvases,
+     * \param T are the translation matrices of the canvases, \param names are the canvas names, \param parent is normally 0. */
+    AddCanvasesCommand(entity::UserScene* scene, const std::vector<osg::Matrix>& R, const std::vector<osg::Matrix>& T,
+                       const std::vector<std::string>& names, QUndoCommand* parent = 0);
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    void undo() Q_DECL_OVERRIDE;
+    void redo() Q_DECL_OVERRIDE;
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
+private:
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    void onReleasePayload() Q_DECL_OVERRIDE;
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
+    std::vector<entity::Canvas*> getCanvases() const;
+
+    osg::observer_ptr<entity::UserScene> m_scene;
+    std::vector< osg::ref_ptr<entity::Canvas> > m_canvases;
+    osg::observer_ptr<entity::Canvas> m_current; /*!< current canvas before the addition, restored on undo */
+    osg::observer_ptr<entity::Canvas> m_previous; /*!< previous canvas before the addition, restored on undo */
+}; // class AddCanvasesCommand
+
 /*! \class AddCanvasSeparationCommand
  * \brief QUndoCommand that performs separation of a canvas and addition of it to entity::UserScene.
 */
-class AddCanvasSeparationCommand : public QUndoCommand
+class AddCanvasSeparationCommand : public QUndoCommand, public UndoPayload
 {
 public:
     /*! \param scene is the scene graph to add to, \param source is the canvas source from which separation will occur, \param copy is the destination canvas parameters, \param parent is normally 0. */
@@ -74,6 +114,10 @@ public:
 #endif // DOXYGEN_SHOULD_SKIP_THIS
 
 private:
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    void onReleasePayload() Q_DECL_OVERRIDE;
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
     void moveEntities(entity::Canvas* from, entity::Canvas* to);
 
     osg::observer_ptr<entity::UserScene> m_scene;
@@ -85,8 +129,11 @@ private:
 
 /*! \class AddPhotoCommand
  * \brief QUndoCommand that performs addition of a photo to entity::UserScene.
+ *
+ * The photo is added as a placeholder quad immediately, while its image is decoded by ImageDecoder and is
+ * attached as soon as the decode is complete, see AddPhotosCommand.
 */
-class AddPhotoCommand : public QUndoCommand
+class AddPhotoCommand : public QUndoCommand, public UndoPayload
 {
 public:
     /*! \param scene is the scene graph to add to, \param fname is path of where the photo is located, \param ename is the photo name within the scene graph, \param parent is normally 0. */
@@ -99,16 +146,50 @@ public:
 #endif // DOXYGEN_SHOULD_SKIP_THIS
 
 private:
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    void onReleasePayload() Q_DECL_OVERRIDE;
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
     osg::observer_ptr<entity::UserScene> m_scene;
     osg::observer_ptr<entity::Canvas> m_canvas;
     osg::ref_ptr<entity::Photo> m_photo;
     osg::observer_ptr<entity::Bookmarks> m_bookmarks;
 };
 
+/*! \class AddPhotosCommand
+ * \brief QUndoCommand that performs addition of several photos to the current canvas of entity::UserScene as
+ * a single undo step.
+ *
+ * The photos are added as placeholder quads immediately, while their images are decoded in parallel by
+ * ImageDecoder and are attached as soon as each decode is complete.
+*/
+class AddPhotosCommand : public QUndoCommand, public UndoPayload
+{
+public:
+    /*! \param scene is the scene graph to add to, \param fnames are paths of where the photos are located,
+     * \param enames are the photo names within the scene graph, \param parent is normally 0. */
+    AddPhotosCommand(entity::UserScene* scene, const std::vector<std::string>& fnames,
+                     const std::vector<std::string>& enames, QUndoCommand* parent = 0);
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    void undo() Q_DECL_OVERRIDE;
+    void redo() Q_DECL_OVERRIDE;
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+private:
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    void onReleasePayload() Q_DECL_OVERRIDE;
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
+    osg::observer_ptr<entity::UserScene> m_scene;
+    osg::observer_ptr<entity::Canvas> m_canvas;
+    std::vector< osg::ref_ptr<entity::Photo> > m_photos;
+};
+
 /*! \class AddStrokeCommand
  * \brief QUndoCommand that performs addition of a stroke to UserScene.
 */
-class AddStrokeCommand : public QUndoCommand
+class AddStrokeCommand : public QUndoCommand, public UndoPayload
 {
 public:
     /*! \param scene is the scene graph to add to, \param stroke is the Stroke to be added to entity::UserScene, \param parent is normally 0. */
@@ -120,12 +201,16 @@ public:
 #endif // DOXYGEN_SHOULD_SKIP_THIS
 
 private:
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    void onReleasePayload() Q_DECL_OVERRIDE;
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
     osg::observer_ptr<entity::UserScene> m_scene;
     osg::observer_ptr<entity::Canvas> m_canvas;
     osg::ref_ptr<entity::Stroke> m_stroke;
 };
 
-class AddEntityCommand : public QUndoCommand
+class AddEntityCommand : public QUndoCommand, public UndoPayload
 {
 public:
     AddEntityCommand(entity::UserScene* scene, entity::Entity2D* entity, QUndoCommand* parent = 0);
@@ -134,6 +219,10 @@ public:
     void redo() Q_DECL_OVERRIDE;
 
 private:
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    void onReleasePayload() Q_DECL_OVERRIDE;
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
     osg::observer_ptr<entity::UserScene> m_scene;
     osg::observer_ptr<entity::Canvas> m_canvas;
     osg::ref_ptr<entity::Entity2D> m_entity;
@@ -142,7 +231,7 @@ private:
 /*! \class AddPolygonCommand
  * \brief QUndoCommand that perform addition of a entity::Polygon to entity::UserScene
 */
-class AddPolygonCommand : public QUndoCommand
+class AddPolygonCommand : public QUndoCommand, public UndoPayload
 {
 public:
     /*! \param scene is the scene graph to add to, \param polygon is the entity::Polygon to be added to entity::UserScene, \param parent is normally 0. */
@@ -154,12 +243,16 @@ public:
 #endif // DOXYGEN_SHOULD_SKIP_THIS
 
 private:
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    void onReleasePayload() Q_DECL_OVERRIDE;
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
     osg::observer_ptr<entity::UserScene> m_scene;
     osg::observer_ptr<entity::Canvas> m_canvas;
     osg::ref_ptr<entity::Polygon> m_polygon;
 };
 
-class AddLineSegmentCommand : public QUndoCommand
+class AddLineSegmentCommand : public QUndoCommand, public UndoPayload
 {
 public:
     AddLineSegmentCommand(entity::UserScene* scene, entity::LineSegment* segment, QUndoCommand* parent = 0);
@@ -168,6 +261,10 @@ public:
     void redo() Q_DECL_OVERRIDE;
 
 private:
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    void onReleasePayload() Q_DECL_OVERRIDE;
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
     osg::observer_ptr<entity::UserScene> m_scene;
     osg::observer_ptr<entity::Canvas> m_canvas;
     osg::ref_ptr<entity::LineSegment> m_segment;
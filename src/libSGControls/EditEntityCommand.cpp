@@ -24,8 +24,22 @@ void fur::EditCanvasOffsetCommand::redo()
     m_canvas->translate(osg::Matrix::translate(m_translate.x(), m_translate.y(), m_translate.z()));
     m_scene->updateWidgets();
 }
+
+int fur::EditCanvasOffsetCommand::id() const
+{
+    return fur::MERGE_CANVAS_OFFSET;
+}
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
+bool fur::EditCanvasOffsetCommand::mergeWith(const QUndoCommand *other)
+{
+    if (other->id() != this->id()) return false;
+    const EditCanvasOffsetCommand* cmd = static_cast<const EditCanvasOffsetCommand*>(other);
+    if (!m_canvas.valid() || cmd->m_canvas.get() != m_canvas.get()) return false;
+    m_translate += cmd->m_translate;
+    return true;
+}
+
 fur::EditCanvasRotateCommand::EditCanvasRotateCommand(entity::UserScene *scene, const osg::Quat &rotate, QUndoCommand *parent)
     : QUndoCommand(parent)
     , m_scene(scene)
@@ -52,8 +66,23 @@ void fur::EditCanvasRotateCommand::redo()
     m_canvas->rotate(osg::Matrix::rotate(m_rotate), m_center);
     m_scene->updateWidgets();
 }
+
+int fur::EditCanvasRotateCommand::id() const
+{
+    return fur::MERGE_CANVAS_ROTATE;
+}
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
+bool fur::EditCanvasRotateCommand::mergeWith(const QUndoCommand *other)
+{
+    if (other->id() != this->id()) return false;
+    const EditCanvasRotateCommand* cmd = static_cast<const EditCanvasRotateCommand*>(other);
+    if (!m_canvas.valid() || cmd->m_canvas.get() != m_canvas.get() || cmd->m_center != m_center) return false;
+    /* OSG quaternion product applies the left rotation first */
+    m_rotate = m_rotate * cmd->m_rotate;
+    return true;
+}
+
 /* only works for strokes, any photos remain unchanged */
 fur::EditStrokesPushCommand::EditStrokesPushCommand(entity::UserScene *scene, const std::vector<entity::Entity2D *> &entities,
                                                entity::Canvas *current, entity::Canvas *target,
@@ -128,14 +157,26 @@ this->setText(QObject::tr("Delete %1")
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 void fur::EditCanvasDeleteCommand::undo()
 {
+    if (this->isReleased()) return;
+    m_snapshot.restore();
+    this->setPayloadBytes(0);
     if (!m_scene->addCanvas(m_canvas.get()))
         qFatal("EditCanvasDelete::undo() - failed adding canvas to scene graph");
 }
 
 void fur::EditCanvasDeleteCommand::redo()
 {
+    if (this->isReleased()) return;
     if (!m_scene->removeCanvas(m_canvas.get()))
         qFatal("EditCanvasDelete::redo() - failed removing canvas from scene graph");
+    m_snapshot.capture(m_canvas.get());
+    this->setPayloadBytes(m_snapshot.getBytes());
+}
+
+void fur::EditCanvasDeleteCommand::onReleasePayload()
+{
+    m_snapshot.clear();
+    m_canvas = 0;
 }
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
@@ -147,18 +188,26 @@ fur::EditStrokeDeleteCommand::EditStrokeDeleteCommand(entity::UserScene *scene,
 {
     this->setText(QObject::tr("Delete stroke from %1")
                   .arg(QString(m_canvas->getName().c_str())));
+    this->setPayloadBytes(UndoPayload::getNodeBytes(stroke));
 }
 
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 void fur::EditStrokeDeleteCommand::undo()
 {
+    if (this->isReleased()) return;
     m_scene->addEntity(m_canvas.get(), m_stroke.get());
 }
 
 void fur::EditStrokeDeleteCommand::redo()
 {
+    if (this->isReleased()) return;
     m_scene->removeEntity(m_canvas.get(), m_stroke.get());
 }
+
+void fur::EditStrokeDeleteCommand::onReleasePayload()
+{
+    m_stroke = 0;
+}
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
 fur::EditPhotoDeleteCommand::EditPhotoDeleteCommand(entity::UserScene *scene, entity::Canvas *canvas, entity::Photo *photo, QUndoCommand *parent)
@@ -170,20 +219,28 @@ fur::EditPhotoDeleteCommand::EditPhotoDeleteCommand(entity::UserScene *scene, en
 {
 this->setText(QObject::tr("Delete photo from %1")
               .arg(QString(m_canvas->getName().c_str())));
+    this->setPayloadBytes(UndoPayload::getNodeBytes(photo));
 }
 
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 void fur::EditPhotoDeleteCommand::undo()
 {
+    if (this->isReleased()) return;
     if (!m_scene->addEntity(m_canvas.get(), m_photo.get()))
         qFatal("EditPhotoDeleteCommand:: undo() failed");
 }
 
 void fur::EditPhotoDeleteCommand::redo()
 {
+    if (this->isReleased()) return;
     if (!m_scene->removeEntity(m_canvas.get(), m_photo.get()))
         qFatal("EditPhotoDeleteCommand:: redo() failed");
 }
+
+void fur::EditPhotoDeleteCommand::onReleasePayload()
+{
+    m_photo = 0;
+}
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
 fur::EditEntitiesMoveCommand::EditEntitiesMoveCommand(entity::UserScene *scene, const std::vector<entity::Entity2D *> &entities, entity::Canvas *canvas, double du, double dv, QUndoCommand *parent)
@@ -212,8 +269,23 @@ void fur::EditEntitiesMoveCommand::redo()
     m_canvas->updateFrame(m_scene->getCanvasPrevious());
     m_scene->updateWidgets();
 }
+
+int fur::EditEntitiesMoveCommand::id() const
+{
+    return fur::MERGE_ENTITIES_MOVE;
+}
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
+bool fur::EditEntitiesMoveCommand::mergeWith(const QUndoCommand *other)
+{
+    if (other->id() != this->id()) return false;
+    const EditEntitiesMoveCommand* cmd = static_cast<const EditEntitiesMoveCommand*>(other);
+    if (!m_canvas.valid() || cmd->m_canvas.get() != m_canvas.get() || cmd->m_entities != m_entities) return false;
+    m_du += cmd->m_du;
+    m_dv += cmd->m_dv;
+    return true;
+}
+
 fur::EditEntitiesScaleCommand::EditEntitiesScaleCommand(entity::UserScene *scene, const std::vector<entity::Entity2D *> &entities, entity::Canvas *canvas, double scaleX, double scaleY, osg::Vec3f center, QUndoCommand *parent)
     : QUndoCommand(parent)
     , m_scene(scene)
@@ -241,8 +313,24 @@ void fur::EditEntitiesScaleCommand::redo()
     m_canvas->updateFrame(m_scene->getCanvasPrevious());
     m_scene->updateWidgets();
 }
+
+int fur::EditEntitiesScaleCommand::id() const
+{
+    return fur::MERGE_ENTITIES_SCALE;
+}
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
+bool fur::EditEntitiesScaleCommand::mergeWith(const QUndoCommand *other)
+{
+    if (other->id() != this->id()) return false;
+    const EditEntitiesScaleCommand* cmd = static_cast<const EditEntitiesScaleCommand*>(other);
+    if (!m_canvas.valid() || cmd->m_canvas.get() != m_canvas.get() || cmd->m_entities != m_entities
+            || cmd->m_center != m_center) return false;
+    m_scaleX *= cmd->m_scaleX;
+    m_scaleY *= cmd->m_scaleY;
+    return true;
+}
+
 fur::EditEntitiesRotateCommand::EditEntitiesRotateCommand(entity::UserScene *scene, const std::vector<entity::Entity2D *> &entities, entity::Canvas *canvas, double theta, osg::Vec3f center, QUndoCommand *parent)
     : QUndoCommand(parent)
     , m_scene(scene)
@@ -269,8 +357,23 @@ void fur::EditEntitiesRotateCommand::redo()
     m_canvas->updateFrame(m_scene->getCanvasPrevious());
     m_scene->updateWidgets();
 }
+
+int fur::EditEntitiesRotateCommand::id() const
+{
+    return fur::MERGE_ENTITIES_ROTATE;
+}
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
+bool fur::EditEntitiesRotateCommand::mergeWith(const QUndoCommand *other)
+{
+    if (other->id() != this->id()) return false;
+    const EditEntitiesRotateCommand* cmd = static_cast<const EditEntitiesRotateCommand*>(other);
+    if (!m_canvas.valid() || cmd->m_canvas.get() != m_canvas.get() || cmd->m_entities != m_entities
+            || cmd->m_center != m_center) return false;
+    m_theta += cmd->m_theta;
+    return true;
+}
+
 fur::EditPasteCommand::EditPasteCommand(entity::UserScene *scene, entity::Canvas *target, const std::vector<osg::ref_ptr<entity::Entity2D> > &buffer, QUndoCommand *parent)
     : QUndoCommand(parent)
     , m_scene(scene)
@@ -438,20 +541,30 @@ fur::EditEntityDeleteCommand::EditEntityDeleteCommand(entity::UserScene *scene,
     this->setText(QObject::tr("Delete entity %1 from %2")
                   .arg(QString(entity->getName().c_str()))
                   .arg(QString(canvas->getName().c_str())));
+    this->setPayloadBytes(UndoPayload::getNodeBytes(entity));
 }
 
 void fur::EditEntityDeleteCommand::undo()
 {
+    if (this->isReleased()) return;
     if (!m_scene->addEntity(m_canvas.get(), m_entity.get()))
         qFatal("EditEntityDeleteCommand::undo() failed");
 }
 
 void fur::EditEntityDeleteCommand::redo()
 {
+    if (this->isReleased()) return;
     if (!m_scene->removeEntity(m_canvas.get(), m_entity.get()))
         qFatal("EditEntityDeleteCommand: redo() failed");
 }
 
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+void fur::EditEntityDeleteCommand::onReleasePayload()
+{
+    m_entity = 0;
+}
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
 fur::EditSelectedEntitiesDeleteCommand::EditSelectedEntitiesDeleteCommand(entity::UserScene *scene, entity::Canvas *canvas, const std::vector<osg::ref_ptr<entity::Entity2D> > &entities)
     : UndoCommand(scene, canvas)
     , m_entities(entities)
@@ -459,10 +572,15 @@ fur::EditSelectedEntitiesDeleteCommand::EditSelectedEntitiesDeleteCommand(entity
     this->setText(QObject::tr("Delete selected group of entities from %1")
                   .arg(QString(canvas->getName().c_str()))
                   );
+    quint64 bytes = 0;
+    for (unsigned int i=0; i<m_entities.size(); ++i)
+        bytes += UndoPayload::getNodeBytes(m_entities.at(i).get());
+    this->setPayloadBytes(bytes);
 }
 
 void fur::EditSelectedEntitiesDeleteCommand::undo()
 {
+    if (this->isReleased()) return;
     for (unsigned int i=0; i<m_entities.size(); ++i){
         if (!m_scene->addEntity(m_canvas.get(), m_entities.at(i).get()))
             qFatal("EditSelectedEntitiesDeleteCommand(): undo failed");
@@ -471,8 +589,16 @@ void fur::EditSelectedEntitiesDeleteCommand::undo()
 
 void fur::EditSelectedEntitiesDeleteCommand::redo()
 {
+    if (this->isReleased()) return;
     for (unsigned int i=0; i<m_entities.size(); ++i){
         if (!m_scene->removeEntity(m_canvas.get(), m_entities.at(i).get()))
             qFatal("EditSelectedEntitiesDeleteCommand(): redo failed");
     }
 }
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+void fur::EditSelectedEntitiesDeleteCommand::onReleasePayload()
+{
+    m_entities.clear();
+}
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
@@ -14,6 +14,8 @@
 #include "ShaderedEntity2D.h"
 #include "Bookmarks.h"
 #include "SceneState.h"
+#include "UndoHistory.h"
+#include "CanvasSnapshot.h"
 
 namespace entity {
 class UserScene;
@@ -22,6 +24,17 @@ class Bookmarks;
 
 namespace fur{
 
+/*! Ids of the commands which QUndoStack merges when they are pushed one after another,
+ * see QUndoCommand::mergeWith(). */
+enum MERGE_ID
+{
+    MERGE_CANVAS_OFFSET = 1,
+    MERGE_CANVAS_ROTATE,
+    MERGE_ENTITIES_MOVE,
+    MERGE_ENTITIES_SCALE,
+    MERGE_ENTITIES_ROTATE
+};
+
 /*! \class UndoCommand
  * \brief Base virtual class for undo/redo commands.
  */
@@ -51,8 +64,12 @@ public:
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
     void undo() Q_DECL_OVERRIDE;
     void redo() Q_DECL_OVERRIDE;
+    int id() const Q_DECL_OVERRIDE;
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
+    /*! Merges the following offset of the same canvas, so that consecutive offsets are undone at once. */
+    bool mergeWith(const QUndoCommand* other) Q_DECL_OVERRIDE;
+
 protected:
     osg::observer_ptr<entity::UserScene> m_scene;
     osg::observer_ptr<entity::Canvas> m_canvas;
@@ -71,8 +88,12 @@ public:
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
     void undo() Q_DECL_OVERRIDE;
     void redo() Q_DECL_OVERRIDE;
+    int id() const Q_DECL_OVERRIDE;
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
+    /*! Merges the following rotation of the same canvas around the same center, so that consecutive rotations are undone at once. */
+    bool mergeWith(const QUndoCommand* other) Q_DECL_OVERRIDE;
+
 protected:
     osg::observer_ptr<entity::UserScene> m_scene;
     osg::observer_ptr<entity::Canvas> m_canvas;
@@ -83,7 +104,7 @@ protected:
 /*! \class EditCanvasDeleteCommand
   * \brief QUndoCommand that performs deletion of a canvas.
 */
-class EditCanvasDeleteCommand : public QUndoCommand
+class EditCanvasDeleteCommand : public QUndoCommand, public UndoPayload
 {
 public:
     /*! \param scene is the scene graph to edit, \param canvas is a canvas to delete, \param parent is normally 0. */
@@ -95,15 +116,20 @@ public:
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
 protected:
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    void onReleasePayload() Q_DECL_OVERRIDE;
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
     osg::observer_ptr<entity::UserScene> m_scene;
     osg::ref_ptr<entity::Canvas> m_canvas;
     osg::observer_ptr<entity::Bookmarks> m_bookmarks;
+    entity::CanvasSnapshot m_snapshot; /*!< data of the canvas while it is deleted */
 };
 
 /*! \class EditPhotoDeleteCommand
  * \brief QUndoCommand that performs deletion of a photo.
 */
-class EditPhotoDeleteCommand : public QUndoCommand
+class EditPhotoDeleteCommand : public QUndoCommand, public UndoPayload
 {
 public:
     /*! \param scene is the scene graph to edit, \param canvas is a canvas to delete from, \param photo is a photo to delete, \param parent is normally 0. */
@@ -115,13 +141,17 @@ public:
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
 protected:
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    void onReleasePayload() Q_DECL_OVERRIDE;
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
     osg::observer_ptr<entity::UserScene> m_scene;
     osg::observer_ptr<entity::Canvas> m_canvas;
     osg::ref_ptr<entity::Photo> m_photo;
     osg::observer_ptr<entity::Bookmarks> m_bookmarks;
 };
 
-class EditEntityDeleteCommand : public UndoCommand
+class EditEntityDeleteCommand : public UndoCommand, public UndoPayload
 {
 public:
     EditEntityDeleteCommand(entity::UserScene* scene, entity::Canvas* canvas, entity::Entity2D* entity);
@@ -130,10 +160,14 @@ public:
     void redo();
 
 private:
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    void onReleasePayload() Q_DECL_OVERRIDE;
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
     osg::ref_ptr<entity::Entity2D> m_entity;
 };
 
-class EditSelectedEntitiesDeleteCommand : public UndoCommand
+class EditSelectedEntitiesDeleteCommand : public UndoCommand, public UndoPayload
 {
 public:
     EditSelectedEntitiesDeleteCommand(entity::UserScene* scene,
@@ -144,7 +178,11 @@ public:
     void redo() Q_DECL_OVERRIDE;
 
 protected:
-    const std::vector<osg::ref_ptr<entity::Entity2D>> m_entities;
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    void onReleasePayload() Q_DECL_OVERRIDE;
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
+    std::vector<osg::ref_ptr<entity::Entity2D>> m_entities;
 };
 
 /*! \class EditStrokesPushCommand
@@ -187,8 +225,12 @@ public:
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
     void undo() Q_DECL_OVERRIDE;
     void redo() Q_DECL_OVERRIDE;
+    int id() const Q_DECL_OVERRIDE;
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
+    /*! Merges the following move of the same selection, so that consecutive moves are undone at once. */
+    bool mergeWith(const QUndoCommand* other) Q_DECL_OVERRIDE;
+
 protected:
     osg::observer_ptr<entity::UserScene> m_scene;
     std::vector<entity::Entity2D*> m_entities;
@@ -213,8 +255,12 @@ public:
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
     void undo() Q_DECL_OVERRIDE;
     void redo() Q_DECL_OVERRIDE;
+    int id() const Q_DECL_OVERRIDE;
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
+    /*! Merges the following scaling of the same selection around the same center, so that consecutive scalings are undone at once. */
+    bool mergeWith(const QUndoCommand* other) Q_DECL_OVERRIDE;
+
 protected:
     osg::observer_ptr<entity::UserScene> m_scene;
     std::vector<entity::Entity2D*> m_entities;
@@ -236,8 +282,12 @@ public:
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
     void undo() Q_DECL_OVERRIDE;
     void redo() Q_DECL_OVERRIDE;
+    int id() const Q_DECL_OVERRIDE;
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
+    /*! Merges the following rotation of the same selection around the same center, so that consecutive rotations are undone at once. */
+    bool mergeWith(const QUndoCommand* other) Q_DECL_OVERRIDE;
+
 protected:
     osg::observer_ptr<entity::UserScene> m_scene;
     std::vector<entity::Entity2D*> m_entities;
@@ -249,7 +299,7 @@ protected:
 /*! \class EditStrokeDeleteCommand
  * Serves for stroke deletion.
 */
-class EditStrokeDeleteCommand : public QUndoCommand
+class EditStrokeDeleteCommand : public QUndoCommand, public UndoPayload
 {
 public:
     EditStrokeDeleteCommand(entity::UserScene* scene, entity::Canvas* canvas, entity::Stroke* stroke, QUndoCommand* parent = 0);
@@ -259,6 +309,10 @@ public:
     void redo() Q_DECL_OVERRIDE;
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 protected:
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    void onReleasePayload() Q_DECL_OVERRIDE;
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
     osg::observer_ptr<entity::UserScene> m_scene;
     osg::observer_ptr<entity::Canvas> m_canvas;
     osg::ref_ptr<entity::Stroke> m_stroke;
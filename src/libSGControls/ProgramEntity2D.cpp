@@ -10,7 +10,10 @@ ProgramEntity2D::ProgramEntity2D()
     , m_state(0)
     , m_camera(0)
     , m_transform(0)
+    , m_phantom(new osg::StateSet)
 {
+    m_phantom->setAttributeAndModes(new osg::Program, osg::StateAttribute::PROTECTED);
+    m_phantom->setDataVariance(osg::Object::STATIC);
 }
 
 void ProgramEntity2D::initialize(osg::StateSet *state, osg::Camera *camera, osg::MatrixTransform *t)
@@ -47,6 +50,11 @@ osg::Camera *ProgramEntity2D::getCamera() const
     return m_camera.get();
 }
 
+osg::StateSet *ProgramEntity2D::getPhantomStateSet() const
+{
+    return m_phantom.get();
+}
+
 bool ProgramEntity2D::addUniformCanvasMatrix()
 {
     /* canvas matrix transform */
@@ -3,6 +3,7 @@
 
 #include <osg/Program>
 #include <osg/StateSet>
+#include <osg/ref_ptr>
 #include <osg/observer_ptr>
 #include <osg/Camera>
 #include <osg/MatrixTransform>
@@ -27,6 +28,12 @@ public:
 
     osg::Camera* getCamera() const;
 
+    /*! \return state set which is shared by all the entities of the program that are not shadered yet, e.g., while
+     * they are being sketched. It contains a single empty program which overrides the program of the canvas geode.
+     * The state set is owned by the program, so it lives as long as the canvas or an entity refers to it; it is
+     * static, i.e., it must not be changed per entity. \sa entity::ShaderedEntity2D::initializeProgram() */
+    osg::StateSet* getPhantomStateSet() const;
+
 protected:
     virtual bool addPresetShaders() = 0;
     virtual bool addPresetUniforms() = 0;
@@ -62,6 +69,7 @@ protected:
     osg::observer_ptr<osg::StateSet> m_state; // of entity::Canvas::m_geodeStrokes
     osg::observer_ptr<osg::Camera> m_camera; // of GLWidget::getCamera()
     osg::observer_ptr<osg::MatrixTransform> m_transform; // of Canvas::m_transform
+    osg::ref_ptr<osg::StateSet> m_phantom; // shared by the entities which are not shadered yet
 };
 
 #endif // PROGRAMENTITY2D_H
@@ -0,0 +1,229 @@
+#include "UndoHistory.h"
+
+#include <vector>
+
+#include <QUndoCommand>
+
+#include <osg/NodeVisitor>
+#include <osg/Geometry>
+
+#include "Settings.h"
+#include "Photo.h"
+#include "PhotoImage.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+namespace {
+
+/* Sums up the array, index and photo image memory of the geometries. */
+class PayloadSizeVisitor : public osg::NodeVisitor
+{
+public:
+    PayloadSizeVisitor()
+        : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN)
+        , m_bytes(0)
+    {
+    }
+
+    void apply(osg::Geometry& geometry)
+    {
+        this->addArray(geometry.getVertexArray());
+        this->addArray(geometry.getNormalArray());
+        this->addArray(geometry.getColorArray());
+        for (unsigned int i=0; i<geometry.getNumTexCoordArrays(); ++i)
+            this->addArray(geometry.getTexCoordArray(i));
+        for (unsigned int i=0; i<geometry.getNumPrimitiveSets(); ++i)
+            m_bytes += geometry.getPrimitiveSet(i)->getTotalDataSize();
+
+        entity::Photo* photo = dynamic_cast<entity::Photo*>(&geometry);
+        if (photo && photo->getPhotoImage())
+            m_bytes += photo->getPhotoImage()->getHostBytes();
+    }
+
+    quint64 m_bytes;
+
+private:
+    void addArray(const osg::Array* array)
+    {
+        if (array) m_bytes += array->getTotalDataSize();
+    }
+};
+
+/* Command payload together with the payloads of its children, e.g., of a macro. */
+quint64 getCommandBytes(const QUndoCommand* cmd)
+{
+    if (!cmd) return 0;
+    quint64 bytes = 0;
+    const fur::UndoPayload* payload = dynamic_cast<const fur::UndoPayload*>(cmd);
+    if (payload) bytes += payload->getPayloadBytes();
+    for (int i=0; i<cmd->childCount(); ++i)
+        bytes += getCommandBytes(cmd->child(i));
+    return bytes;
+}
+
+/* QUndoStack only gives access to the const commands; releasing the payload does not change the command text
+ * nor its id, so the stack is not affected. */
+void releaseCommand(const QUndoCommand* cmd)
+{
+    if (!cmd) return;
+    fur::UndoPayload* payload = dynamic_cast<fur::UndoPayload*>(const_cast<QUndoCommand*>(cmd));
+    if (payload) payload->releasePayload();
+    for (int i=0; i<cmd->childCount(); ++i)
+        releaseCommand(cmd->child(i));
+}
+
+} // namespace
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
+fur::UndoPayload::UndoPayload()
+    : m_bytes(0)
+    , m_released(false)
+{
+}
+
+fur::UndoPayload::~UndoPayload()
+{
+}
+
+quint64 fur::UndoPayload::getPayloadBytes() const
+{
+    return m_released? 0 : m_bytes;
+}
+
+void fur::UndoPayload::releasePayload()
+{
+    if (m_released) return;
+    this->onReleasePayload();
+    m_released = true;
+}
+
+bool fur::UndoPayload::isReleased() const
+{
+    return m_released;
+}
+
+void fur::UndoPayload::setPayloadBytes(quint64 bytes)
+{
+    m_bytes = bytes;
+}
+
+quint64 fur::UndoPayload::getNodeBytes(const osg::Node *node)
+{
+    if (!node) return 0;
+    PayloadSizeVisitor visitor;
+    const_cast<osg::Node*>(node)->accept(visitor);
+    return visitor.m_bytes;
+}
+
+fur::UndoHistory::UndoHistory(QUndoStack *stack, QObject *parent)
+    : QObject(parent)
+    , m_stack(stack)
+    , m_budget(cher::UNDO_HISTORY_BUDGET)
+    , m_usage(0)
+    , m_indexMin(0)
+    , m_canUndo(false)
+{
+    if (!stack){
+        qWarning("UndoHistory: undo stack is NULL");
+        return;
+    }
+    QObject::connect(stack, SIGNAL(indexChanged(int)), this, SLOT(onIndexChanged(int)),
+                     Qt::UniqueConnection);
+}
+
+void fur::UndoHistory::setBudget(quint64 budget)
+{
+    m_budget = budget;
+    this->applyBudget();
+    this->updateUndoAction();
+}
+
+quint64 fur::UndoHistory::getBudget() const
+{
+    return m_budget;
+}
+
+quint64 fur::UndoHistory::getMemoryUsage() const
+{
+    return m_usage;
+}
+
+int fur::UndoHistory::getIndexMinimum() const
+{
+    return m_indexMin;
+}
+
+bool fur::UndoHistory::canUndo() const
+{
+    return m_stack && m_stack->canUndo() && m_stack->index() > m_indexMin;
+}
+
+QAction *fur::UndoHistory::createUndoAction(QObject *parent, const QString &prefix)
+{
+    if (m_actionUndo){
+        qWarning("UndoHistory: undo action is already created");
+        return m_actionUndo;
+    }
+    m_actionUndo = new QAction(parent);
+    m_undoPrefix = prefix;
+    QObject::connect(m_actionUndo, SIGNAL(triggered(bool)), this, SLOT(undo()), Qt::UniqueConnection);
+    this->updateUndoAction();
+    return m_actionUndo;
+}
+
+void fur::UndoHistory::undo()
+{
+    if (!this->canUndo()) return;
+    m_stack->undo();
+}
+
+void fur::UndoHistory::onIndexChanged(int index)
+{
+    if (!m_stack) return;
+
+    /* the stack was cleared, nothing is dropped anymore */
+    if (m_stack->count() < m_indexMin) m_indexMin = 0;
+
+    /* the dropped commands are only undone by calling the stack directly, they stay no-ops */
+    if (index >= m_indexMin) this->applyBudget();
+    this->updateUndoAction();
+}
+
+void fur::UndoHistory::applyBudget()
+{
+    if (!m_stack) return;
+
+    std::vector<quint64> bytes(m_stack->count(), 0);
+    quint64 usage = 0;
+    for (int i=m_indexMin; i<m_stack->count(); ++i){
+        bytes[i] = getCommandBytes(m_stack->command(i));
+        usage += bytes[i];
+    }
+
+    /* the most recent done command is always kept so that the last edit can be undone */
+    while (m_budget > 0 && usage > m_budget && m_indexMin < m_stack->index()-1){
+        releaseCommand(m_stack->command(m_indexMin));
+        usage -= bytes[m_indexMin];
+        m_indexMin++;
+    }
+
+    if (usage != m_usage){
+        m_usage = usage;
+        emit this->memoryUsageChanged(m_usage, m_budget);
+    }
+}
+
+void fur::UndoHistory::updateUndoAction()
+{
+    bool enabled = this->canUndo();
+    if (m_actionUndo){
+        QString text = m_undoPrefix;
+        if (enabled && !m_stack->undoText().isEmpty())
+            text += " " + m_stack->undoText();
+        m_actionUndo->setText(text);
+        m_actionUndo->setEnabled(enabled);
+    }
+    if (enabled != m_canUndo){
+        m_canUndo = enabled;
+        emit this->canUndoChanged(enabled);
+    }
+}
@@ -0,0 +1,126 @@
+#ifndef UNDOHISTORY_H
+#define UNDOHISTORY_H
+
+#include <QtGlobal>
+#include <QObject>
+#include <QUndoStack>
+#include <QPointer>
+#include <QAction>
+#include <QString>
+
+#include <osg/Node>
+
+namespace fur{
+
+/*! \class UndoPayload
+ * \brief Interface of the undo commands which keep scene data alive while they are within the history,
+ * e.g., the deleted canvases, photos and strokes. It lets UndoHistory estimate and bound the history memory.
+ * The commands which add entities report no memory, since their entities are part of the scene while the commands
+ * are done, but they still drop their references once released.
+*/
+class UndoPayload
+{
+public:
+    UndoPayload();
+    virtual ~UndoPayload();
+
+    /*! \return approximate memory kept alive by the command, in bytes, or zero once the payload is released. */
+    quint64 getPayloadBytes() const;
+
+    /*! A method to release the payload when the command is dropped from the history by UndoHistory.
+     * Afterwards undo() and redo() of the command do nothing. */
+    void releasePayload();
+
+    /*! \return true if the payload was released by releasePayload(). */
+    bool isReleased() const;
+
+    /*! \return approximate memory of the geometries and photo images of the node and its children, in bytes. */
+    static quint64 getNodeBytes(const osg::Node* node);
+
+protected:
+    /*! A method to set the memory of the payload whenever it changes, e.g., once by the command constructor,
+     * or when the payload is captured into a compact snapshot. \sa getNodeBytes(). */
+    void setPayloadBytes(quint64 bytes);
+
+    /*! A method to drop the references on the payload, called once by releasePayload(). */
+    virtual void onReleasePayload() = 0;
+
+private:
+    quint64 m_bytes;
+    bool m_released;
+};
+
+/*! \class UndoHistory
+ * \brief Keeps the memory of an undo stack within a budget.
+ *
+ * QUndoStack does not allow to remove single commands, that is why the oldest done commands are dropped in place
+ * when the payloads of the history exceed the budget: their payloads are released (see UndoPayload) and the stack
+ * cannot be undone past them by the undo action of the history, see createUndoAction(). The dropped commands stay
+ * within the stack as no-ops until the stack is cleared or they are replaced by new commands.
+*/
+class UndoHistory : public QObject
+{
+    Q_OBJECT
+public:
+    /*! Constructor. \param stack is the undo stack to follow, the history memory budget is set to
+     * cher::UNDO_HISTORY_BUDGET by default. */
+    UndoHistory(QUndoStack* stack, QObject* parent = 0);
+
+    /*! \param budget is the memory budget of the history payloads, in bytes. Zero means no budget.
+     * The budget is applied right away. */
+    void setBudget(quint64 budget);
+
+    /*! \return the memory budget of the history payloads, in bytes. */
+    quint64 getBudget() const;
+
+    /*! \return approximate memory kept alive by the commands of the history, in bytes. */
+    quint64 getMemoryUsage() const;
+
+    /*! \return index of the oldest command which can still be undone, i.e., the number of dropped commands. */
+    int getIndexMinimum() const;
+
+    /*! \return true if the stack can be undone without undoing a dropped command. */
+    bool canUndo() const;
+
+    /*! A method to create the undo action of the stack, it is used in place of QUndoStack::createUndoAction().
+     * The action is disabled once the stack reaches the dropped commands.
+     * \param prefix is the action text, followed by the text of the command to be undone. */
+    QAction* createUndoAction(QObject* parent, const QString& prefix);
+
+public slots:
+    /*! Slot undoes the last done command unless it is dropped, see canUndo(). */
+    void undo();
+
+    /*! Slot is called whenever the index of the stack changes, e.g., a command was pushed, undone or redone.
+     * It drops the oldest commands if the budget is exceeded and updates the undo action. */
+    void onIndexChanged(int index);
+
+signals:
+    /*! Signal is emitted when the memory usage of the history changes.
+     * \param usage is the memory kept by the history, in bytes,
+     * \param budget is the memory budget of the history, in bytes. */
+    void memoryUsageChanged(quint64 usage, quint64 budget);
+
+    /*! Signal is emitted when the result of canUndo() changes. */
+    void canUndoChanged(bool enabled);
+
+protected:
+    /*! A method to drop the oldest done commands until the history payloads are within the budget. */
+    void applyBudget();
+
+    /*! A method to update the undo action and to emit canUndoChanged() if needed. */
+    void updateUndoAction();
+
+private:
+    QPointer<QUndoStack> m_stack;
+    QPointer<QAction> m_actionUndo;
+    QString m_undoPrefix;
+    quint64 m_budget;
+    quint64 m_usage;
+    int m_indexMin;
+    bool m_canUndo;
+};
+
+} // namespace fur
+
+#endif // UNDOHISTORY_H
@@ -1,17 +1,51 @@
 #include "Bookmarks.h"
 
+#include <algorithm>
+
 #include <QDir>
 #include <QDebug>
 #include <QtGlobal>
+#include <QBuffer>
+#include <QByteArray>
+#include <QCryptographicHash>
 
 #include "Settings.h"
 #include "MainWindow.h"
+#include "UserScene.h"
+#include "Canvas.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+namespace {
+
+std::string encodeThumbnail(const QPixmap& pmap)
+{
+    if (pmap.isNull()) return "";
+    QByteArray bytes;
+    QBuffer buffer(&bytes);
+    buffer.open(QIODevice::WriteOnly);
+    if (!pmap.save(&buffer, "PNG")) return "";
+    return bytes.toBase64().constData();
+}
+
+QPixmap decodeThumbnail(const std::string& data)
+{
+    QPixmap pmap;
+    if (!data.empty())
+        pmap.loadFromData(QByteArray::fromBase64(QByteArray(data.c_str(), data.size())), "PNG");
+    return pmap;
+}
+
+} // namespace
+#endif // DOXYGEN_SHOULD_SKIP_THIS
 
 entity::Bookmarks::Bookmarks()
     : QObject()
     , osg::Group()
     , m_row(0)
+    , m_refreshNext(-1)
 {
+    m_refreshTimer.setSingleShot(true);
+    QObject::connect(&m_refreshTimer, SIGNAL(timeout()), this, SLOT(onRefreshTimeout()));
     this->setName("Bookmarks");
     // TODO make sure this mask transfers after the scene is saved to file,
     // and then opened from the file.
@@ -26,8 +60,13 @@ entity::Bookmarks::Bookmarks(const Bookmarks &parent, osg::CopyOp copyop)
     , m_ups(parent.m_ups)
     , m_names(parent.m_names)
     , m_fovs(parent.m_fovs)
+    , m_thumbnails(parent.m_thumbnails)
+    , m_fingerprints(parent.m_fingerprints)
     , m_row(parent.m_row)
+    , m_refreshNext(-1)
 {
+    m_refreshTimer.setSingleShot(true);
+    QObject::connect(&m_refreshTimer, SIGNAL(timeout()), this, SLOT(onRefreshTimeout()));
 }
 
 void entity::Bookmarks::setEyes(const std::vector<osg::Vec3d> &eyes)
@@ -80,6 +119,53 @@ const std::vector<double> &entity::Bookmarks::getFovs() const
     return m_fovs;
 }
 
+void entity::Bookmarks::setThumbnails(const std::vector<std::string> &thumbnails)
+{
+    m_thumbnails = thumbnails;
+}
+
+const std::vector<std::string> &entity::Bookmarks::getThumbnails() const
+{
+    return m_thumbnails;
+}
+
+void entity::Bookmarks::setFingerprints(const std::vector<std::string> &fingerprints)
+{
+    m_fingerprints = fingerprints;
+}
+
+const std::vector<std::string> &entity::Bookmarks::getFingerprints() const
+{
+    return m_fingerprints;
+}
+
+QPixmap entity::Bookmarks::getThumbnail(int row) const
+{
+    if (row < 0 || row >= static_cast<int>(m_thumbnails.size())) return QPixmap();
+    return decodeThumbnail(m_thumbnails[row]);
+}
+
+std::string entity::Bookmarks::computeFingerprint(int row, entity::UserScene *scene) const
+{
+    std::map<const entity::Canvas*, std::string> canvases;
+    return this->computeFingerprint(row, scene, canvases);
+}
+
+int entity::Bookmarks::refreshThumbnails(BookmarkWidget *widget)
+{
+    m_refreshTimer.stop();
+    m_canvasFingerprints.clear();
+    int num = this->refreshThumbnails(widget, 0, this->getNumBookmarks());
+    m_canvasFingerprints.clear();
+    m_refreshNext = -1;
+    return num;
+}
+
+bool entity::Bookmarks::isRefreshPending() const
+{
+    return m_refreshNext >= 0;
+}
+
 const entity::SceneState *entity::Bookmarks::getSceneState(int row) const
 {
     if (row <0 || row >= static_cast<int>(this->getNumChildren())){
@@ -143,9 +229,10 @@ void entity::Bookmarks::addBookmark(BookmarkWidget *widget, const osg::Vec3d &ey
     item->setFlags(item->flags() | Qt::ItemIsEditable);
 
     // take snapshot of the bookmark
+    this->resizeThumbnails();
     int idx = m_eyes.size()-1;
     QPixmap pmap = MainWindow::instance().getScreenshot(m_eyes[idx], m_centers[idx], m_ups[idx]);
-    item->setIcon(QIcon(pmap));
+    this->setThumbnail(widget, idx, pmap, this->computeFingerprint(idx, this->getUserScene()));
 }
 
 /* update the look of the bookmakr's screenshot */
@@ -156,11 +243,16 @@ void entity::Bookmarks::updateBookmark(BookmarkWidget *widget, int row)
         return;
     }
     if (row >=0 && row < static_cast<int>(m_eyes.size())){
-        QListWidgetItem* item = widget->item(row);
         emit this->requestSceneStateSet(this->getSceneState(row));
-        QPixmap pmap = MainWindow::instance().getScreenshot(m_eyes[row], m_centers[row], m_ups[row]);
-        item->setIcon(QIcon(pmap));
-        qDebug("Screenshot was updated");
+
+        // only re-render if what the screenshot depends on has changed
+        this->resizeThumbnails();
+        std::string fingerprint = this->computeFingerprint(row, this->getUserScene());
+        if (fingerprint.empty() || fingerprint != m_fingerprints[row] || m_thumbnails[row].empty()){
+            QPixmap pmap = MainWindow::instance().getScreenshot(m_eyes[row], m_centers[row], m_ups[row]);
+            this->setThumbnail(widget, row, pmap, fingerprint);
+            qDebug("Screenshot was updated");
+        }
     }
 }
 
@@ -180,14 +272,19 @@ void entity::Bookmarks::resetModel(BookmarkWidget *widget)
     // to load old version data successfully, have to set FOV to deafult since it's missing
     if (m_fovs.size() != m_names.size()) m_fovs.resize(m_names.size(), 60.);
 
+    this->resizeThumbnails();
+
     for (unsigned int i=0; i<m_names.size(); ++i){
         widget->addItem(QString((m_names[i]).c_str()));
         QListWidgetItem* item = widget->item(i);
         item->setFlags(item->flags() | Qt::ItemIsEditable);
-        emit requestSceneStateSet(this->getSceneState(i));
-        QPixmap pmap = MainWindow::instance().getScreenshot(m_eyes[i], m_centers[i], m_ups[i]);
-        item->setIcon(QIcon(pmap));
+        item->setIcon(QIcon(this->getThumbnail(i)));
     }
+
+    // the saved screenshots are checked against the loaded scene in the background
+    m_canvasFingerprints.clear();
+    m_refreshNext = 0;
+    m_refreshTimer.start(0);
 }
 
 void entity::Bookmarks::clearModel()
@@ -197,7 +294,12 @@ void entity::Bookmarks::clearModel()
     m_ups.clear();
     m_names.clear();
     m_fovs.clear();
+    m_thumbnails.clear();
+    m_fingerprints.clear();
     m_row = -1;
+    m_refreshTimer.stop();
+    m_refreshNext = -1;
+    m_canvasFingerprints.clear();
     this->removeChildren(0, this->getNumChildren()-1);
 }
 
@@ -265,6 +367,9 @@ void entity::Bookmarks::onRowsMoved(const QModelIndex &, int start, int end, con
     this->moveItem<osg::Vec3d>(start, row, m_ups);
     this->moveItem<std::string>(start, row, m_names);
     this->moveItem<double>(start, row, m_fovs);
+    this->resizeThumbnails();
+    this->moveItem<std::string>(start, row, m_thumbnails);
+    this->moveItem<std::string>(start, row, m_fingerprints);
 
     // get pointer in the state to move
     entity::SceneState* state = this->getSceneState(start);
@@ -278,6 +383,118 @@ void entity::Bookmarks::onRowsRemoved(const QModelIndex &, int first, int last)
     this->deleteBookmarkData(first, last);
 }
 
+void entity::Bookmarks::onSceneChanged()
+{
+    if (m_names.empty()) return;
+    m_canvasFingerprints.clear();
+    m_refreshNext = 0;
+    m_refreshTimer.start(cher::BOOKMARK_REFRESH_DELAY);
+}
+
+void entity::Bookmarks::onRefreshTimeout()
+{
+    if (m_refreshNext < 0) return;
+    int last = std::min(m_refreshNext + cher::BOOKMARK_REFRESH_BATCH, this->getNumBookmarks());
+    this->refreshThumbnails(MainWindow::instance().getBookmarkWidget(), m_refreshNext, last);
+    if (last < this->getNumBookmarks()){
+        m_refreshNext = last;
+        m_refreshTimer.start(0);
+    }
+    else{
+        m_refreshNext = -1;
+        m_canvasFingerprints.clear();
+    }
+}
+
+int entity::Bookmarks::refreshThumbnails(BookmarkWidget *widget, int first, int last)
+{
+    this->resizeThumbnails();
+    entity::UserScene* scene = this->getUserScene();
+    std::vector<int> rows;
+    std::vector<std::string> fingerprints;
+    std::vector<osg::Vec3d> eyes, centers, ups;
+    std::vector<entity::SceneState*> states;
+    for (int i=std::max(first, 0); i<last && i<this->getNumBookmarks(); ++i){
+        std::string fingerprint = this->computeFingerprint(i, scene, m_canvasFingerprints);
+        if (!fingerprint.empty() && fingerprint == m_fingerprints[i] && !m_thumbnails[i].empty()) continue;
+        rows.push_back(i);
+        fingerprints.push_back(fingerprint);
+        eyes.push_back(m_eyes[i]);
+        centers.push_back(m_centers[i]);
+        ups.push_back(m_ups[i]);
+        states.push_back(this->getSceneState(i));
+    }
+    if (rows.empty()) return 0;
+
+    QList<QPixmap> pmaps = MainWindow::instance().getScreenshots(eyes, centers, ups, states);
+    for (int j=0; j<pmaps.size() && j<static_cast<int>(rows.size()); ++j)
+        this->setThumbnail(widget, rows[j], pmaps[j], fingerprints[j]);
+    return rows.size();
+}
+
+void entity::Bookmarks::setThumbnail(BookmarkWidget *widget, int row, const QPixmap &pmap, const std::string &fingerprint)
+{
+    if (row < 0 || row >= static_cast<int>(m_thumbnails.size())) return;
+    m_thumbnails[row] = encodeThumbnail(pmap);
+    m_fingerprints[row] = m_thumbnails[row].empty()? "" : fingerprint;
+    if (widget && row < widget->count())
+        widget->item(row)->setIcon(QIcon(pmap));
+}
+
+void entity::Bookmarks::resizeThumbnails()
+{
+    m_thumbnails.resize(m_names.size());
+    m_fingerprints.resize(m_names.size());
+}
+
+std::string entity::Bookmarks::computeFingerprint(int row, entity::UserScene *scene,
+                                                  std::map<const entity::Canvas *, std::string> &canvases) const
+{
+    if (!scene || row < 0 || row >= static_cast<int>(m_eyes.size())) return "";
+    const entity::SceneState* state = this->getSceneState(row);
+    if (!state) return "";
+
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    double fov = row < static_cast<int>(m_fovs.size())? m_fovs[row] : 60.;
+    double camera[] = {m_eyes[row].x(), m_eyes[row].y(), m_eyes[row].z(),
+                       m_centers[row].x(), m_centers[row].y(), m_centers[row].z(),
+                       m_ups[row].x(), m_ups[row].y(), m_ups[row].z(), fov};
+    hash.addData(reinterpret_cast<const char*>(camera), sizeof(camera));
+
+    /* the content of the visible canvases only */
+    int numCanvases = scene->getNumCanvases();
+    hash.addData(reinterpret_cast<const char*>(&numCanvases), sizeof(numCanvases));
+    for (int i=0; i<numCanvases; ++i){
+        const entity::Canvas* canvas = scene->getCanvas(i);
+        if (!canvas) continue;
+        char visible = state->getCanvasDataFlag(canvas->getId())? 1 : 0;
+        hash.addData(&visible, 1);
+        if (!visible) continue;
+        std::map<const entity::Canvas*, std::string>::iterator it = canvases.find(canvas);
+        if (it == canvases.end())
+            it = canvases.insert(std::make_pair(canvas, canvas->getContentFingerprint())).first;
+        hash.addData(it->second.c_str(), it->second.size());
+
+        for (size_t j=0; j<canvas->getNumPhotos(); ++j){
+            const entity::Photo* photo = canvas->getPhoto(j);
+            if (!photo) continue;
+            float t = state->getPhotoTransparency(photo->getId());
+            hash.addData(reinterpret_cast<const char*>(&t), sizeof(t));
+        }
+    }
+
+    return hash.result().toHex().constData();
+}
+
+entity::UserScene *entity::Bookmarks::getUserScene()
+{
+    for (unsigned int i=0; i<this->getNumParents(); ++i){
+        entity::UserScene* scene = dynamic_cast<entity::UserScene*>(this->getParent(i));
+        if (scene) return scene;
+    }
+    return 0;
+}
+
 void entity::Bookmarks::deleteBookmarkData(int first, int last)
 {
     qDebug() << "deleting bookmark data at idx " << first;
@@ -289,11 +506,14 @@ void entity::Bookmarks::deleteBookmarkData(int first, int last)
         qWarning("deleteBookmark: last is out of range");
         return;
     }
+    this->resizeThumbnails();
     m_eyes.erase(m_eyes.begin()+first, m_eyes.begin()+last+1);
     m_centers.erase(m_centers.begin()+first, m_centers.begin()+last+1);
     m_ups.erase(m_ups.begin()+first, m_ups.begin()+last+1);
     m_names.erase(m_names.begin()+first, m_names.begin()+last+1);
     m_fovs.erase(m_fovs.begin()+first, m_fovs.begin()+last+1);
+    m_thumbnails.erase(m_thumbnails.begin()+first, m_thumbnails.begin()+last+1);
+    m_fingerprints.erase(m_fingerprints.begin()+first, m_fingerprints.begin()+last+1);
 
     if (first >= static_cast<int>(this->getNumChildren()) || first < 0){
         qWarning("deleteBookmarkData: first index is out of range");
@@ -331,4 +551,6 @@ REGISTER_OBJECT_WRAPPER(Bookmarks_Wrapper
     ADD_LIST_SERIALIZER(Ups, std::vector<osg::Vec3d>);
     ADD_LIST_SERIALIZER(Names, std::vector<std::string>);
     ADD_LIST_SERIALIZER(Fovs, std::vector<double>);
+    ADD_LIST_SERIALIZER(Thumbnails, std::vector<std::string>);
+    ADD_LIST_SERIALIZER(Fingerprints, std::vector<std::string>);
 }
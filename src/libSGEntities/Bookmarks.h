@@ -7,12 +7,14 @@
 #include <vector>
 #include <list>
 #include <string>
+#include <map>
 
 #include <QObject>
 #include <QModelIndex>
 #include <QListWidgetItem>
 #include <QPixmap>
 #include <QVector>
+#include <QTimer>
 
 #include "../libGUI/ListWidget.h"
 #include "SceneState.h"
@@ -20,6 +22,8 @@
 class BookmarkWidget;
 namespace entity {
 class SceneState;
+class UserScene;
+class Canvas;
 }
 
 namespace entity {
@@ -44,6 +48,11 @@ namespace entity {
  * Note: there can only be one entity::Bookmarks object in a scene graph, a child of entity::UserScene. This
  * class servers as a container for a list of entity::SceneState -s and a list of camera parameters for each
  * scene state.
+ *
+ * The bookmark thumbnails are saved together with the bookmarks, as well as a fingerprint of what each thumbnail
+ * depends on, see computeFingerprint(). When the scene is loaded, the saved thumbnails are shown right away; after
+ * that and after each scene edit, see onSceneChanged(), the fingerprints are checked step by step in the background,
+ * and only the bookmarks whose visible content has changed are re-rendered.
 */
 class Bookmarks : public QObject, public osg::Group
 {
@@ -86,6 +95,32 @@ public:
     /*! A getter method to be used within OSG serialization procedures. */
     const std::vector<double>& getFovs() const;
 
+    /*! A setter method to be used within OSG serialization procedures. The thumbnails are PNG images in base64. */
+    void setThumbnails(const std::vector<std::string>& thumbnails);
+    /*! A getter method to be used within OSG serialization procedures. */
+    const std::vector<std::string>& getThumbnails() const;
+
+    /*! A setter method to be used within OSG serialization procedures. */
+    void setFingerprints(const std::vector<std::string>& fingerprints);
+    /*! A getter method to be used within OSG serialization procedures. */
+    const std::vector<std::string>& getFingerprints() const;
+
+    /*! \return the thumbnail of the bookmark, or null pixmap if it was not rendered yet. */
+    QPixmap getThumbnail(int row) const;
+
+    /*! A method to compute what the thumbnail of the bookmark depends on: the camera parameters, the canvas data
+     * flags and photo transparencies of the bookmark's scene state, and the content of each canvas that is visible
+     * within the state, see Canvas::getContentFingerprint().
+     * \return the fingerprint, or empty string if the row or the scene is not valid. */
+    std::string computeFingerprint(int row, entity::UserScene* scene) const;
+
+    /*! A method to re-render the thumbnails of all the bookmarks whose fingerprint has changed, right away.
+     * \return number of the re-rendered thumbnails. */
+    int refreshThumbnails(BookmarkWidget* widget);
+
+    /*! \return true if the background refresh of the thumbnails is scheduled or in progress. */
+    bool isRefreshPending() const;
+
     /*! \param row is the index of SceneState
      * \return Pointer on the corresponding SceneState. */
     const entity::SceneState* getSceneState(int row) const;
@@ -173,7 +208,33 @@ public slots:
      * item inclusive. */
     void onRowsRemoved(const QModelIndex&, int first, int last);
 
+    /*! A slot is called whenever the scene content is edited, e.g., on each change of the undo stack. It schedules the
+     * background refresh of the thumbnails after cher::BOOKMARK_REFRESH_DELAY. */
+    void onSceneChanged();
+
+protected slots:
+    /*! A slot to perform a step of the background refresh: up to cher::BOOKMARK_REFRESH_BATCH bookmarks are checked
+     * and the changed ones are re-rendered in one batch. */
+    void onRefreshTimeout();
+
 private:
+    /*! A method to check the bookmarks [first, last) and re-render the thumbnails of the changed ones.
+     * \return number of the re-rendered thumbnails. */
+    int refreshThumbnails(BookmarkWidget* widget, int first, int last);
+
+    /*! A method to store the thumbnail and its fingerprint, and to set it as the widget item icon. */
+    void setThumbnail(BookmarkWidget* widget, int row, const QPixmap& pmap, const std::string& fingerprint);
+
+    /*! A method to make sure there are as many thumbnails and fingerprints as bookmarks, e.g., for the older files. */
+    void resizeThumbnails();
+
+    /*! computeFingerprint() with the canvas fingerprints looked up in, and added to, the given map. */
+    std::string computeFingerprint(int row, entity::UserScene* scene,
+                                   std::map<const entity::Canvas*, std::string>& canvases) const;
+
+    /*! \return the user scene the bookmarks belong to. */
+    entity::UserScene* getUserScene();
+
     template <typename T>
     bool moveItem(size_t from, size_t to, std::vector<T>& list);
 
@@ -184,8 +245,14 @@ private:
     std::vector<osg::Vec3d> m_ups;
     std::vector<std::string> m_names;
     std::vector<double> m_fovs;
+    std::vector<std::string> m_thumbnails;
+    std::vector<std::string> m_fingerprints;
 
     int m_row;
+
+    QTimer m_refreshTimer;
+    int m_refreshNext; /*!< next bookmark to be checked by the background refresh, or -1 */
+    std::map<const entity::Canvas*, std::string> m_canvasFingerprints; /*!< computed within the current refresh */
 };
 }
 
@@ -21,6 +21,21 @@
 
 #include <QtGlobal>
 #include <QDebug>
+#include <QCryptographicHash>
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+namespace {
+
+/* transform revisions are unique among all the canvases, so that a cached intersection can never be matched
+ * against another canvas which happens to have the same id */
+unsigned int getNextTransformRevision()
+{
+    static unsigned int revision = 0;
+    return ++revision;
+}
+
+} // namespace
+#endif // DOXYGEN_SHOULD_SKIP_THIS
 
 entity::Canvas::Canvas()
     : osg::ProtectedGroup()
@@ -45,6 +60,9 @@ entity::Canvas::Canvas()
     , m_center(osg::Vec3f(0.f,0.f,0.f)) // moves only when strokes are introduced so that to define it as centroid
     , m_normal(cher::NORMAL)
     , m_edit(false)
+    , m_id(0)
+    , m_revision(getNextTransformRevision())
+    , m_contentRevision(0)
 {
     qDebug("New Canvas ctor complete");
 }
@@ -74,6 +92,9 @@ entity::Canvas::Canvas(const entity::Canvas& cnv, const osg::CopyOp& copyop)
     , m_center(cnv.m_center)
     , m_normal(cnv.m_normal)
     , m_edit(cnv.m_edit)
+    , m_id(cnv.m_id)
+    , m_revision(cnv.m_revision)
+    , m_contentRevision(cnv.m_contentRevision)
 {
     qDebug("new Canvas by copy ctor complete");
 }
@@ -348,6 +369,117 @@ const osg::Vec3f& entity::Canvas::getNormal() const
 }
 #endif
 
+void entity::Canvas::setId(unsigned int id)
+{
+    m_id = id;
+}
+
+unsigned int entity::Canvas::getId() const
+{
+    return m_id;
+}
+
+unsigned int entity::Canvas::getTransformRevision() const
+{
+    return m_revision;
+}
+
+void entity::Canvas::setContentRevision(unsigned int revision)
+{
+    m_contentRevision = revision;
+}
+
+unsigned int entity::Canvas::getContentRevision() const
+{
+    return m_contentRevision;
+}
+
+void entity::Canvas::increaseContentRevision()
+{
+    m_contentRevision++;
+}
+
+bool entity::Canvas::getIntersection(entity::Canvas *against, osg::Vec3f &p1, osg::Vec3f &p2, osg::Vec3f &p3, osg::Vec3f &p4)
+{
+    if (!against) return false;
+    const osg::Vec3Array* vertices = this->getFrameVertices();
+    if (!vertices || vertices->size() < 4) return false;
+
+    Intersection& intersection = m_intersections[against->getId()];
+    bool cached = intersection.revision == m_revision
+            && intersection.revisionAgainst == against->getTransformRevision();
+    for (int i=0; i<4 && cached; ++i)
+        cached = intersection.frame[i] == (*vertices)[i];
+
+    if (!cached){
+        intersection.revision = m_revision;
+        intersection.revisionAgainst = against->getTransformRevision();
+        for (int i=0; i<4; ++i)
+            intersection.frame[i] = (*vertices)[i];
+        intersection.valid = Utilities::getCanvasesIntersection(this, against, intersection.points[0], intersection.points[1],
+                                                                intersection.points[2], intersection.points[3]) == 2;
+    }
+
+    p1 = intersection.points[0];
+    p2 = intersection.points[1];
+    p3 = intersection.points[2];
+    p4 = intersection.points[3];
+    return intersection.valid;
+}
+
+void entity::Canvas::removeIntersection(unsigned int id)
+{
+    m_intersections.erase(id);
+}
+
+void entity::Canvas::removeIntersections(const std::set<unsigned int> &ids)
+{
+    if (ids.empty()) return;
+    for (std::map<unsigned int, Intersection>::iterator it = m_intersections.begin(); it != m_intersections.end();){
+        if (ids.find(it->first) != ids.end())
+            m_intersections.erase(it++);
+        else
+            ++it;
+    }
+}
+
+void entity::Canvas::clearIntersections()
+{
+    m_intersections.clear();
+}
+
+void entity::Canvas::setNeighbourIntersections(const std::vector<entity::Canvas *> &neighbours)
+{
+    std::vector<osg::Vec3f> points;
+    for (size_t i=0; i<neighbours.size(); ++i){
+        entity::Canvas* against = neighbours.at(i);
+        if (!against || against == this) continue;
+        osg::Vec3f P1, P2, P3, P4;
+        if (!this->getIntersection(against, P1, P2, P3, P4)) continue;
+        if (P1.isNaN() || P2.isNaN() || P3.isNaN() || P4.isNaN()) continue;
+
+        /* the points are the frame corners projected on the intersection line, the two most distant ones span it */
+        const osg::Vec3f P[] = {P1, P2, P3, P4};
+        int first = 0, last = 1;
+        for (int j=0; j<4; ++j){
+            for (int k=j+1; k<4; ++k){
+                if ((P[k]-P[j]).length2() > (P[last]-P[first]).length2()){
+                    first = j;
+                    last = k;
+                }
+            }
+        }
+        points.push_back(P[first]);
+        points.push_back(P[last]);
+    }
+    m_toolFrame->setNeighbourIntersections(points);
+}
+
+unsigned int entity::Canvas::getNumIntersections() const
+{
+    return m_intersections.size();
+}
+
 void entity::Canvas::setColor(const osg::Vec4f &color, const osg::Vec4f &colorIntersection)
 {
     m_toolFrame->setColor(color, colorIntersection);
@@ -681,31 +813,37 @@ osg::BoundingBox entity::Canvas::getBoundingBox() const
 void entity::Canvas::moveEntities(std::vector<entity::Entity2D *>& entities, double du, double dv)
 {
     m_selectedGroup.move(entities, du, dv);
+    this->increaseContentRevision();
 }
 
 void entity::Canvas::moveEntitiesSelected(double du, double dv)
 {
     m_selectedGroup.move(du, dv);
+    this->increaseContentRevision();
 }
 
 void entity::Canvas::scaleEntities(std::vector<Entity2D *> &entities, double sx, double sy, osg::Vec3f center)
 {
     m_selectedGroup.scale(entities, sx,sy,center);
+    this->increaseContentRevision();
 }
 
 void entity::Canvas::scaleEntitiesSelected(double sx, double sy)
 {
     m_selectedGroup.scale(sx,sy);
+    this->increaseContentRevision();
 }
 
 void entity::Canvas::rotateEntities(std::vector<Entity2D *> entities, double theta, osg::Vec3f center)
 {
     m_selectedGroup.rotate(entities, theta, center);
+    this->increaseContentRevision();
 }
 
 void entity::Canvas::rotateEntitiesSelected(double theta)
 {
     m_selectedGroup.rotate(theta);
+    this->increaseContentRevision();
 //    m_toolFrame->rotate(theta, m_selectedGroup.getCenter2DCustom());
 }
 
@@ -804,6 +942,29 @@ bool entity::Canvas::addToMeshGroup(osg::Group *group, osg::Node *mesh)
     return added;
 }
 
+bool entity::Canvas::attachPhotoBatch(osg::Geode *batch)
+{
+    if (!batch || m_groupData->containsNode(batch)) return false;
+    return m_groupData->addChild(batch);
+}
+
+bool entity::Canvas::detachPhotoBatch(osg::Geode *batch)
+{
+    return m_groupData->removeChild(batch);
+}
+
+bool entity::Canvas::attachStrokeBatch(osg::Geode *batch)
+{
+    if (!batch || m_groupData->containsNode(batch)) return false;
+    batch->setStateSet(m_geodeStrokes->getOrCreateStateSet());
+    return m_groupData->addChild(batch);
+}
+
+bool entity::Canvas::detachStrokeBatch(osg::Geode *batch)
+{
+    return m_groupData->removeChild(batch);
+}
+
 void entity::Canvas::setModeEdit(bool on)
 {
     m_edit = on;
@@ -930,6 +1091,7 @@ void entity::Canvas::updateTransforms()
     /* update how the drawables look */
     osg::Matrix M = m_mR * m_mT;
     m_transform->setMatrix(M);
+    m_revision = getNextTransformRevision();
 
     /* update plane parameters */
     m_normal = cher::NORMAL;
@@ -952,6 +1114,7 @@ void entity::Canvas::resetTransforms()
     m_mR = osg::Matrix::rotate(0, cher::NORMAL);
     m_mT = osg::Matrix::translate(0,0,0);
     m_transform->setMatrix(m_mR * m_mT);
+    m_revision = getNextTransformRevision();
 
     /* reset plane params */
     m_normal = cher::NORMAL;
@@ -984,7 +1147,7 @@ void entity::Canvas::setIntersection(entity::Canvas *against)
 {
     osg::Vec3f P1=cher::CENTER, P2=cher::CENTER, P3=cher::CENTER, P4=cher::CENTER;
     if (against){
-        if (Utilities::getCanvasesIntersection(this, against, P1,P2,P3,P4) != 2) return;
+        if (!this->getIntersection(against, P1,P2,P3,P4)) return;
     }
     m_toolFrame->setIntersection(P1,P2,P3,P4);
 }
@@ -1057,6 +1220,26 @@ unsigned int entity::Canvas::getNumEntities() const
             m_geodeLineSegments->getNumChildren();
 }
 
+std::string entity::Canvas::getContentFingerprint() const
+{
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    const osg::Matrix& matrix = m_transform->getMatrix();
+    hash.addData(reinterpret_cast<const char*>(matrix.ptr()), 16*sizeof(osg::Matrix::value_type));
+    unsigned int data[] = {m_id, m_contentRevision, this->getNumStrokes(), this->getNumPolygons(),
+                           this->getNumLineSegments(), this->getNumPhotos()};
+    hash.addData(reinterpret_cast<const char*>(data), sizeof(data));
+
+    /* the photo images are decoded asynchronously, so the image data is identified by its content hash */
+    for (unsigned int i=0; i<this->getNumPhotos(); ++i){
+        const entity::Photo* photo = this->getPhoto(i);
+        if (photo && photo->getPhotoImage()){
+            std::string image = photo->getPhotoImage()->getHash();
+            hash.addData(image.c_str(), image.size());
+        }
+    }
+    return hash.result().toHex().constData();
+}
+
 /* returnds total number of photos that belong to the canvas */
 unsigned int entity::Canvas::getNumPhotos() const
 {
@@ -1207,5 +1390,7 @@ REGISTER_OBJECT_WRAPPER(Canvas_Wrapper
 
     ADD_VEC3F_SERIALIZER(Center, osg::Vec3f());
     ADD_VEC3F_SERIALIZER(Normal, osg::Vec3f());
+    ADD_UINT_SERIALIZER(Id, 0);
+    ADD_UINT_SERIALIZER(ContentRevision, 0);
 }
 
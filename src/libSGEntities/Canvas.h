@@ -1,6 +1,9 @@
 #ifndef CANVAS
 #define CANVAS
 
+#include <map>
+#include <set>
+
 #include "Settings.h"
 #include "ShaderedEntity2D.h"
 #include "Stroke.h"
@@ -106,6 +109,55 @@ public:
 
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
+    /*! A method to set the canvas id, it is done by entity::UserScene when the canvas is added to the scene. */
+    void setId(unsigned int id);
+    /*! \return the id of the canvas which is unique within the scene, or 0 if the canvas was never added
+     * to the scene. Unlike the name, the id does not change, so it is used to refer to the canvas from
+     * entity::SceneState. */
+    unsigned int getId() const;
+
+    /*! \return revision of the canvas transform; it is unique within the application and is renewed each time
+     * the canvas is rotated or translated, e.g., by setMatrixRotation(), translate() or rotate(). */
+    unsigned int getTransformRevision() const;
+
+    /*! A method to set the content revision, it is done when the canvas is read from file. */
+    void setContentRevision(unsigned int revision);
+    /*! \return revision of the canvas content; it is saved with the canvas, and it is increased by
+     * increaseContentRevision() whenever the entities of the canvas are edited. */
+    unsigned int getContentRevision() const;
+
+    /*! A method to mark an edit of the canvas entities, e.g., an entity was added, removed, moved or its
+     * transparency was changed; it is called by the edit entry points of entity::UserScene, by the
+     * entity transforms of the undo commands and by the interactive transforms of the selection.
+     * Selection itself is not an edit. \sa getContentFingerprint() */
+    void increaseContentRevision();
+
+    /*! A method to obtain the intersection of the canvas frame with another canvas. The results are kept within
+     * an intersection table and are re-calculated only when the transform of either canvas or the canvas frame
+     * has changed. \param against is the other canvas, \param p1, \param p2, \param p3, \param p4 are the
+     * local intersection points. \return true if the intersection exists. \sa Utilities::getCanvasesIntersection() */
+    bool getIntersection(entity::Canvas* against, osg::Vec3f& p1, osg::Vec3f& p2, osg::Vec3f& p3, osg::Vec3f& p4);
+
+    /*! A method to remove the intersection with the canvas of the given id from the intersection table, it is done
+     * by entity::UserScene::removeCanvas() for the remaining canvases. \sa getIntersection() */
+    void removeIntersection(unsigned int id);
+
+    /*! A method to remove the intersections with all the canvases of the given ids at once, it is done by
+     * entity::UserScene::removeCanvases() so that the table is walked only once per a batch. */
+    void removeIntersections(const std::set<unsigned int>& ids);
+
+    /*! A method to clear the intersection table, e.g., when the canvas itself is removed from the scene. */
+    void clearIntersections();
+
+    /*! A method to show the intersection lines with the neighbouring canvases within the canvas frame. The lines
+     * are taken from the intersection table, so only the entries of the canvases which were moved since are
+     * calculated anew. \param neighbours are the canvases to intersect with, the canvas itself is skipped; empty to
+     * hide the lines. \sa getIntersection(), entity::UserScene::updateIntersections() */
+    void setNeighbourIntersections(const std::vector<entity::Canvas*>& neighbours);
+
+    /*! \return number of entries within the intersection table. */
+    unsigned int getNumIntersections() const;
+
     /*! A method to set up canvas frame color. \sa getColor */
     void setColor(const osg::Vec4f& color, const osg::Vec4f& colorIntersection = cher::CANVAS_CLR_PREVIOUS);
     /*! \return color of canvas frame. \sa setColor */
@@ -296,6 +348,25 @@ public:
      * \return true if mesh was added sucessfully. */
     bool addToMeshGroup(osg::Group* group, osg::Node* mesh);
 
+    /*! A method to add the batch of the atlased photos to the group data, see PhotoAtlas. The batch is not a part
+     * of the canvas content, so it must be detached before the canvas is written.
+     * \return true if the batch was added successfully. */
+    bool attachPhotoBatch(osg::Geode* batch);
+
+    /*! A method to remove the batch of the atlased photos from the group data.
+     * \return true if the batch was removed successfully. */
+    bool detachPhotoBatch(osg::Geode* batch);
+
+    /*! A method to add the batch of the merged strokes to the group data, see StrokeBatcher. The batch shares the
+     * state set of the stroke geode, i.e., the stroke program. Same as the photo batch, it must be detached before
+     * the canvas is written.
+     * \return true if the batch was added successfully. */
+    bool attachStrokeBatch(osg::Geode* batch);
+
+    /*! A method to remove the batch of the merged strokes from the group data.
+     * \return true if the batch was removed successfully. */
+    bool detachStrokeBatch(osg::Geode* batch);
+
     /*! Method to switch the normal canvas mode to edit mode, used for editing canvas position and rotation.
      * \param on is true when the canvas is in the process of editing, and false otherwise.
      * \sa setFrameEditable(). */
@@ -324,6 +395,11 @@ public:
     /*! \return total number of entities like strokes and photos that canvas contains. */
     unsigned int getNumEntities() const;
 
+    /*! \return fingerprint of the canvas content as it is rendered: the canvas id, transform and content revision,
+     * and the photo images. It does not depend on the size of the content, it changes whenever the content is edited
+     * and it is the same after the scene is saved and re-opened, see Bookmarks::computeFingerprint(). */
+    std::string getContentFingerprint() const;
+
     /*! \return total number of photos that canvas contains. */
     unsigned int getNumPhotos() const;
 
@@ -397,7 +473,19 @@ private:
     osg::Vec3f m_normal; /* 3D global - virtual plane parameter*/
 
     bool m_edit;
-
+    unsigned int m_id; /*!< unique id within the scene, see entity::UserScene::addCanvas(). */
+    unsigned int m_revision; /*!< transform revision, see getTransformRevision() */
+    unsigned int m_contentRevision; /*!< see getContentRevision() */
+
+    /* intersection with another canvas as it was calculated at the given transform revisions and frame */
+    struct Intersection {
+        unsigned int revision;
+        unsigned int revisionAgainst;
+        osg::Vec3f frame[4];
+        bool valid;
+        osg::Vec3f points[4];
+    };
+    std::map<unsigned int, Intersection> m_intersections; /*!< intersection table by id of the other canvas */
 };
 }
 
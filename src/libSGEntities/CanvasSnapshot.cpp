@@ -0,0 +1,140 @@
+#include "CanvasSnapshot.h"
+
+#include <QDataStream>
+#include <QtGlobal>
+
+#include "ShaderedEntity2D.h"
+#include "Photo.h"
+#include "PhotoImage.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+namespace {
+
+/* Arrays of the geometry in a fixed order, so that they can be matched on restore. */
+void getArrays(osg::Geometry* geometry, std::vector<osg::Array*>& arrays)
+{
+    arrays.push_back(geometry->getVertexArray());
+    arrays.push_back(geometry->getNormalArray());
+    arrays.push_back(geometry->getColorArray());
+    for (unsigned int i=0; i<geometry->getNumTexCoordArrays(); ++i)
+        arrays.push_back(geometry->getTexCoordArray(i));
+}
+
+/* Number of references the geometry itself holds to the array, e.g., the shadered entities bind their vertex and
+ * color arrays as the vertex attributes as well. */
+int getNumOwnReferences(const osg::Geometry* geometry, const osg::Array* array)
+{
+    int num = 0;
+    if (geometry->getVertexArray() == array) num++;
+    if (geometry->getNormalArray() == array) num++;
+    if (geometry->getColorArray() == array) num++;
+    if (geometry->getSecondaryColorArray() == array) num++;
+    if (geometry->getFogCoordArray() == array) num++;
+    for (unsigned int i=0; i<geometry->getNumTexCoordArrays(); ++i)
+        if (geometry->getTexCoordArray(i) == array) num++;
+    for (unsigned int i=0; i<geometry->getNumVertexAttribArrays(); ++i)
+        if (geometry->getVertexAttribArray(i) == array) num++;
+    return num;
+}
+
+} // namespace
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
+entity::CanvasSnapshot::CanvasSnapshot()
+    : m_captured(false)
+{
+}
+
+bool entity::CanvasSnapshot::capture(entity::Canvas *canvas)
+{
+    if (!canvas || m_captured) return false;
+
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    for (unsigned int i=0; i<canvas->getNumEntities(); ++i){
+        entity::Entity2D* entity = canvas->getEntity(i);
+        if (!entity) continue;
+
+        /* the cached mesh refers to the vertex array as well */
+        entity::ShaderedEntity2D* shadered = dynamic_cast<entity::ShaderedEntity2D*>(entity);
+        if (shadered) shadered->releaseMesh();
+
+        /* the image is kept by hash, only its resident levels are released if they can be paged in again */
+        entity::Photo* photo = dynamic_cast<entity::Photo*>(entity);
+        if (photo){
+            photo->releaseTiles();
+            entity::PhotoImage* image = photo->getPhotoImage();
+            if (image && image->referenceCount() == 1 && !image->getStoreKey().empty())
+                image->evict();
+        }
+
+        std::vector<osg::Array*> arrays;
+        getArrays(entity, arrays);
+        bool exclusive = true;
+        for (size_t j=0; j<arrays.size(); ++j){
+            osg::Array* array = arrays[j];
+            if (!array) continue;
+            /* the array is shared if anyone but the geometry itself holds it */
+            bool shared = array->referenceCount() > getNumOwnReferences(entity, array);
+            exclusive = exclusive && !shared;
+            if (shared || array->getNumElements() == 0) continue;
+            out << static_cast<quint32>(array->getNumElements()) << static_cast<quint32>(array->getTotalDataSize());
+            out.writeRawData(static_cast<const char*>(array->getDataPointer()), static_cast<int>(array->getTotalDataSize()));
+            array->resizeArray(0);
+            array->trim();
+            m_arrays.push_back(array);
+        }
+        /* the buffers of the shared arrays are still drawn by the other geometries, as well as the shared
+         * photo texture within the photo state set */
+        if (exclusive && !photo) entity->releaseGLObjects();
+        m_geometries.push_back(entity);
+    }
+
+    m_data = qCompress(data);
+    m_captured = true;
+    return true;
+}
+
+bool entity::CanvasSnapshot::restore()
+{
+    if (!m_captured) return false;
+
+    QByteArray data = qUncompress(m_data);
+    QDataStream in(data);
+    for (size_t i=0; i<m_arrays.size(); ++i){
+        quint32 num = 0, bytes = 0;
+        in >> num >> bytes;
+        osg::Array* array = m_arrays[i].get();
+        array->resizeArray(num);
+        if (in.status() != QDataStream::Ok || array->getTotalDataSize() != bytes){
+            qWarning("CanvasSnapshot: snapshot data is corrupted");
+            array->resizeArray(0);
+            continue;
+        }
+        in.readRawData(static_cast<char*>(const_cast<GLvoid*>(array->getDataPointer())), static_cast<int>(bytes));
+        array->dirty();
+    }
+    for (size_t i=0; i<m_geometries.size(); ++i)
+        m_geometries[i]->dirtyBound();
+
+    this->clear();
+    return true;
+}
+
+void entity::CanvasSnapshot::clear()
+{
+    m_arrays.clear();
+    m_geometries.clear();
+    m_data.clear();
+    m_captured = false;
+}
+
+bool entity::CanvasSnapshot::isCaptured() const
+{
+    return m_captured;
+}
+
+unsigned int entity::CanvasSnapshot::getBytes() const
+{
+    return static_cast<unsigned int>(m_data.size());
+}
@@ -0,0 +1,59 @@
+#ifndef CANVASSNAPSHOT_H
+#define CANVASSNAPSHOT_H
+
+#include <vector>
+
+#include <QByteArray>
+
+#include <osg/ref_ptr>
+#include <osg/Array>
+#include <osg/Geometry>
+
+#include "Canvas.h"
+
+namespace entity {
+
+/*! \class CanvasSnapshot
+ * \brief Compact binary snapshot of the canvas data, it is kept by the canvas-level undo commands while the canvas
+ * is out of the scene, e.g., a deleted canvas, or a cloned or separated canvas whose creation was undone.
+ *
+ * The canvas and its entities stay alive, since other undo commands refer to them by pointer, but their geometry
+ * arrays are serialized into a compressed byte array and released together with the GPU buffers and cached meshes.
+ * Photo images are not copied: they stay shared by their content hash, see ImageCache, and an image which is used
+ * by no other photo and is stored within the project container is evicted down to its coarsest level, see
+ * entity::PhotoImage::evict(). The arrays that are shared with other geometries, e.g., after a shallow copy,
+ * are left as they are.
+*/
+class CanvasSnapshot
+{
+public:
+    /*! Constructor of an empty snapshot. */
+    CanvasSnapshot();
+
+    /*! A method to move the geometry data of the canvas entities into the snapshot.
+     * \return false if the canvas is NULL or the snapshot already holds data. */
+    bool capture(entity::Canvas* canvas);
+
+    /*! A method to re-materialize the data into the same entities it was captured from; the snapshot becomes empty.
+     * \return false if there is nothing to restore. */
+    bool restore();
+
+    /*! A method to drop the snapshot data without restoring it. */
+    void clear();
+
+    /*! \return true if the snapshot holds the data of a canvas. */
+    bool isCaptured() const;
+
+    /*! \return size of the compressed snapshot data, in bytes. */
+    unsigned int getBytes() const;
+
+private:
+    std::vector< osg::ref_ptr<osg::Array> > m_arrays; /*!< captured arrays in the order of m_data */
+    std::vector< osg::ref_ptr<osg::Geometry> > m_geometries; /*!< geometries whose bounds are to be updated */
+    QByteArray m_data;
+    bool m_captured;
+};
+
+} // namespace entity
+
+#endif // CANVASSNAPSHOT_H
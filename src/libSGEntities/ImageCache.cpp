@@ -0,0 +1,91 @@
+#include "ImageCache.h"
+
+#include <QMutexLocker>
+#include <QCryptographicHash>
+#include <QByteArray>
+
+#include <osg/ValueObject>
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+namespace {
+const std::string HASH_KEY = "ContentHash";
+}
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+ImageCache &ImageCache::instance()
+{
+    static ImageCache cache;
+    return cache;
+}
+
+std::string ImageCache::computeHash(osg::Image *image)
+{
+    if (!image || !image->data()) return "";
+    std::string hash = getHash(image);
+    if (!hash.empty()) return hash;
+
+    QCryptographicHash md5(QCryptographicHash::Md5);
+    int header[] = {image->s(), image->t(), image->r(), static_cast<int>(image->getPixelFormat()),
+                    static_cast<int>(image->getDataType()), static_cast<int>(image->getPacking())};
+    md5.addData(reinterpret_cast<const char*>(header), sizeof(header));
+    for (osg::Image::DataIterator it(image); it.valid(); ++it)
+        md5.addData(reinterpret_cast<const char*>(it.data()), it.size());
+
+    hash = md5.result().toHex().constData();
+    image->setUserValue(HASH_KEY, hash);
+    return hash;
+}
+
+std::string ImageCache::getHash(const osg::Image *image)
+{
+    std::string hash;
+    if (image) image->getUserValue(HASH_KEY, hash);
+    return hash;
+}
+
+bool ImageCache::find(const std::string &hash, osg::ref_ptr<entity::PhotoImage> &image)
+{
+    if (hash.empty()) return false;
+    QMutexLocker locker(&m_mutex);
+    std::map< std::string, osg::observer_ptr<entity::PhotoImage> >::iterator it = m_images.find(hash);
+    if (it == m_images.end()) return false;
+    if (!it->second.lock(image)){
+        m_images.erase(it);
+        return false;
+    }
+    return true;
+}
+
+entity::PhotoImage *ImageCache::insert(entity::PhotoImage *image)
+{
+    if (!image) return 0;
+    std::string hash = image->getHash();
+    if (hash.empty()) return image;
+
+    QMutexLocker locker(&m_mutex);
+    osg::ref_ptr<entity::PhotoImage> existing;
+    if (m_images[hash].lock(existing)) return existing.get();
+    m_images[hash] = image;
+    return image;
+}
+
+int ImageCache::getNumImages()
+{
+    QMutexLocker locker(&m_mutex);
+    int num = 0;
+    std::map< std::string, osg::observer_ptr<entity::PhotoImage> >::iterator it = m_images.begin();
+    while (it != m_images.end()){
+        if (it->second.valid()){
+            num++;
+            ++it;
+        }
+        else
+            m_images.erase(it++);
+    }
+    return num;
+}
+
+ImageCache::ImageCache()
+    : m_mutex()
+{
+}
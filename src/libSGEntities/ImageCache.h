@@ -0,0 +1,61 @@
+#ifndef IMAGECACHE_H
+#define IMAGECACHE_H
+
+#include <string>
+#include <map>
+
+#include <QMutex>
+
+#include <osg/ref_ptr>
+#include <osg/observer_ptr>
+#include <osg/Image>
+
+#include "PhotoImage.h"
+
+/*! \class ImageCache
+ * \brief Process-wide registry of photo images by their content hash, so that photos with identical image
+ * content, e.g., the same file imported twice, share a single entity::PhotoImage: one host pyramid and one
+ * GPU texture.
+ *
+ * The cache does not own the images: an entry expires as soon as the last photo which uses the image is
+ * deleted. It can be accessed from any thread, e.g., from ImageDecoder workers.
+*/
+class ImageCache
+{
+public:
+    /*! \return process-wide cache. */
+    static ImageCache& instance();
+
+    /*! A method to compute content hash of the image, i.e., MD5 of its dimensions, pixel format and data. The
+     * hash is stored within the image user values, so it is computed only once, it is copied to the pyramid
+     * levels and it is saved together with the image.
+     * \return the hash, or empty string if there is no image data. */
+    static std::string computeHash(osg::Image* image);
+
+    /*! \return the content hash that was previously computed for the image, or empty string. */
+    static std::string getHash(const osg::Image* image);
+
+    /*! A method to look up an image by its content hash.
+     * \param hash is the content hash, see computeHash(),
+     * \param image is the output image, it is only set if the image is still used by some photo.
+     * \return true if the image was found. */
+    bool find(const std::string& hash, osg::ref_ptr<entity::PhotoImage>& image);
+
+    /*! A method to register an image which already has its content hash computed; an image without the hash,
+     * e.g., the one read from an older project file, is not registered.
+     * \return the image that was registered before with the same hash if it is still alive, otherwise the
+     * passed image. */
+    entity::PhotoImage* insert(entity::PhotoImage* image);
+
+    /*! \return number of registered images that are still alive. */
+    int getNumImages();
+
+protected:
+    ImageCache();
+
+private:
+    QMutex m_mutex;
+    std::map< std::string, osg::observer_ptr<entity::PhotoImage> > m_images; /*!< guarded by m_mutex. */
+};
+
+#endif // IMAGECACHE_H
@@ -0,0 +1,182 @@
+#include "ImageDecoder.h"
+
+#include <QRunnable>
+#include <QMutexLocker>
+#include <QCoreApplication>
+#include <QDebug>
+
+#include "ImageCache.h"
+#include "ImageLoader.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+/* A single decode job; it runs on one of the pool threads. */
+class DecodeTask : public QRunnable
+{
+public:
+    DecodeTask(entity::Photo* photo, const std::string& fname, entity::ProjectContainer* container, const std::string& key,
+               int level, int x = -1, int y = -1)
+        : QRunnable()
+        , m_photo(photo)
+        , m_fname(fname)
+        , m_container(container)
+        , m_key(key)
+        , m_level(level)
+        , m_x(x)
+        , m_y(y)
+    {
+    }
+
+    void run()
+    {
+        ImageDecoder::Result result;
+        result.photo = m_photo;
+        result.reshape = !m_container.get();
+        result.level = m_level;
+        result.tileX = m_x;
+        result.tileY = m_y;
+        result.source = m_container.get()? entity::ProjectContainer::getLevelKey(m_key, m_level<0? 0 : m_level) : m_fname;
+        if (m_x >= 0)
+            result.source = entity::ProjectContainer::getTileKey(m_key, m_level, m_x, m_y);
+
+        /* do not waste time on photos that were deleted while in the queue; the photo is not locked, so that its
+         * last reference is never dropped on a pool thread, the result is checked again in onDecoded() */
+        if (m_photo.valid()){
+            result.image = m_container.get()? m_container->readPhotoImage(result.source) : ImageLoader::read(m_fname);
+            /* no need to compute the pyramid of an imported image that is already used by another photo */
+            if (m_level < 0 && (m_container.get() || !ImageCache::instance().find(ImageCache::computeHash(result.image.get()), result.shared)))
+                entity::PhotoImage::createPyramid(result.image.get(), result.levels);
+        }
+        ImageDecoder::instance().pushDecoded(result);
+    }
+
+private:
+    osg::observer_ptr<entity::Photo> m_photo;
+    std::string m_fname;
+    osg::ref_ptr<entity::ProjectContainer> m_container;
+    std::string m_key;
+    int m_level;
+    int m_x, m_y;
+};
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+ImageDecoder &ImageDecoder::instance()
+{
+    static ImageDecoder decoder;
+    return decoder;
+}
+
+void ImageDecoder::decode(entity::Photo *photo, const std::string &fname)
+{
+    if (!photo) return;
+    m_pending.ref();
+    m_pool.start(new DecodeTask(photo, fname, 0, "", -1));
+}
+
+void ImageDecoder::decode(entity::Photo *photo, entity::ProjectContainer *container, const std::string &key)
+{
+    if (!photo || !container) return;
+    m_pending.ref();
+    m_pool.start(new DecodeTask(photo, "", container, key, -1));
+}
+
+void ImageDecoder::decode(entity::Photo *photo, entity::ProjectContainer *container, const std::string &key, unsigned int level)
+{
+    if (!photo || !container) return;
+    m_pending.ref();
+    m_pool.start(new DecodeTask(photo, "", container, key, static_cast<int>(level)));
+}
+
+void ImageDecoder::decode(entity::Photo *photo, entity::ProjectContainer *container, const std::string &key, unsigned int level,
+                          int x, int y)
+{
+    if (!photo || !container || x < 0 || y < 0) return;
+    m_pending.ref();
+    m_pool.start(new DecodeTask(photo, "", container, key, static_cast<int>(level), x, y));
+}
+
+void ImageDecoder::waitForDone()
+{
+    m_pool.waitForDone();
+    this->onDecoded();
+}
+
+int ImageDecoder::getNumPending() const
+{
+    return m_pending.load();
+}
+
+unsigned int ImageDecoder::getRevision() const
+{
+    return m_revision;
+}
+
+void ImageDecoder::onDecoded()
+{
+    std::vector<Result> decoded;
+    {
+        QMutexLocker locker(&m_mutex);
+        decoded.swap(m_decoded);
+    }
+    if (decoded.empty()) return;
+    m_revision++;
+
+    for (size_t i=0; i<decoded.size(); ++i){
+        m_pending.deref();
+        osg::ref_ptr<entity::Photo> photo;
+        if (!decoded[i].photo.lock(photo)) continue;
+        if (!decoded[i].image.get()){
+            qWarning() << "ImageDecoder: could not decode image" << decoded[i].source.c_str();
+            continue;
+        }
+        if (decoded[i].tileX >= 0){
+            photo->getPhotoImage()->setTileImage(decoded[i].level, decoded[i].tileX, decoded[i].tileY, decoded[i].image.get());
+            continue;
+        }
+        if (decoded[i].level >= 0){
+            photo->getPhotoImage()->setLevelImage(decoded[i].level, decoded[i].image.get());
+            continue;
+        }
+
+        /* the same image may have been imported by another photo since the decode started; the images of a
+         * loaded scene are not shared with the ones of the previous scene which are stored in another container */
+        osg::ref_ptr<entity::PhotoImage> image = decoded[i].shared;
+        if (!image.get() && decoded[i].reshape)
+            ImageCache::instance().find(ImageCache::getHash(decoded[i].image.get()), image);
+        if (!image.get()){
+            image = photo->detachImage();
+            image->setPyramid(decoded[i].levels);
+            ImageCache::instance().insert(image.get());
+        }
+        photo->setPhotoImage(image.get());
+        if (decoded[i].reshape)
+            photo->setDecodedImage(decoded[i].image.get());
+    }
+
+    emit this->imagesAttached();
+    if (m_pending.load() == 0)
+        emit this->finished();
+}
+
+ImageDecoder::ImageDecoder()
+    : QObject()
+    , m_pending(0)
+    , m_revision(0)
+{
+    /* make sure the images are always attached on the GUI thread */
+    if (QCoreApplication::instance())
+        this->moveToThread(QCoreApplication::instance()->thread());
+    m_pool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+void ImageDecoder::pushDecoded(const ImageDecoder::Result &result)
+{
+    bool first = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        first = m_decoded.empty();
+        m_decoded.push_back(result);
+    }
+    /* results that arrive before the previous batch was attached are attached together with it */
+    if (first)
+        QMetaObject::invokeMethod(this, "onDecoded", Qt::QueuedConnection);
+}
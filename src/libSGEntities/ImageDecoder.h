@@ -0,0 +1,106 @@
+#ifndef IMAGEDECODER_H
+#define IMAGEDECODER_H
+
+#include <string>
+#include <vector>
+
+#include <QObject>
+#include <QThreadPool>
+#include <QMutex>
+#include <QAtomicInt>
+
+#include <osg/ref_ptr>
+#include <osg/observer_ptr>
+#include <osg/Image>
+
+#include "Photo.h"
+#include "ProjectContainer.h"
+
+/*! \class ImageDecoder
+ * \brief A thread pool which decodes photo images in parallel and attaches them to their entity::Photo
+ * as soon as each decode is complete.
+ *
+ * The image sources are either image files (photo import) or photo chunks of entity::ProjectContainer
+ * (scene loading and paging of the photo pyramid levels and tiles). The decoding, as well as computation of the photo
+ * pyramid, see entity::PhotoImage::createPyramid(), runs on the pool threads, while attachment of the decoded images is always
+ * performed on the thread the decoder lives within, i.e., the GUI thread, so that the rendered scene graph
+ * is never modified concurrently.
+ *
+ * If a photo is deleted before its image is decoded, the decoded image is simply discarded. If the decoded image
+ * content is already used by another photo, see ImageCache, the photo shares it instead of computing a new pyramid.
+*/
+class ImageDecoder : public QObject
+{
+    Q_OBJECT
+public:
+    /*! \return process-wide decoder. */
+    static ImageDecoder& instance();
+
+    /*! A method to queue decoding of an image file for a newly imported photo. When the image is attached,
+     * the photo quad is re-shaped to match the image aspect ratio, see entity::Photo::setDecodedImage(). */
+    void decode(entity::Photo* photo, const std::string& fname);
+
+    /*! A method to queue decoding of a photo image which is stored within project container without
+     * pyramid, i.e., the pyramid is computed after decoding. The photo geometry is not changed when the
+     * image is attached. */
+    void decode(entity::Photo* photo, entity::ProjectContainer* container, const std::string& key);
+
+    /*! A method to queue paging in of a single pyramid level of a photo from project container. When the
+     * level is decoded, it is passed to entity::PhotoImage::setLevelImage(). */
+    void decode(entity::Photo* photo, entity::ProjectContainer* container, const std::string& key, unsigned int level);
+
+    /*! A method to queue paging in of a single tile of a tiled pyramid level from project container, see
+     * entity::ProjectContainer::getTileKey(). When the tile is decoded, it is passed to
+     * entity::PhotoImage::setTileImage(). */
+    void decode(entity::Photo* photo, entity::ProjectContainer* container, const std::string& key, unsigned int level,
+                int x, int y);
+
+    /*! A method to wait until all the queued images are decoded and attached to their photos. Must be called
+     * from the decoder's thread. */
+    void waitForDone();
+
+    /*! \return number of images that are queued or being decoded. */
+    int getNumPending() const;
+
+    /*! \return number of the batches of decoded images attached so far; it changes whenever the decoder
+     * modifies the photo images, e.g., see RootScene::updatePhotoLevels(). */
+    unsigned int getRevision() const;
+
+signals:
+    /*! Signal is emitted on the decoder's thread when a batch of decoded images was attached to photos. */
+    void imagesAttached();
+
+    /*! Signal is emitted when there are no more pending decodes. */
+    void finished();
+
+protected slots:
+    /*! A slot to attach all the decoded images to their photos. */
+    void onDecoded();
+
+protected:
+    ImageDecoder();
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    struct Result{
+        osg::observer_ptr<entity::Photo> photo;
+        osg::ref_ptr<osg::Image> image;
+        std::vector< osg::ref_ptr<osg::Image> > levels;
+        osg::ref_ptr<entity::PhotoImage> shared;
+        std::string source;
+        bool reshape;
+        int level;
+        int tileX, tileY; /*!< -1 if the result is not a tile. */
+    };
+    friend class DecodeTask;
+    void pushDecoded(const Result& result);
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+private:
+    QThreadPool m_pool;
+    mutable QMutex m_mutex;
+    std::vector<Result> m_decoded; /*!< decoded, but not yet attached images; guarded by m_mutex. */
+    QAtomicInt m_pending; /*!< decodes may be queued from a worker thread, e.g., by SceneLoader. */
+    unsigned int m_revision; /*!< see getRevision(), it is only changed on the decoder's thread. */
+};
+
+#endif // IMAGEDECODER_H
@@ -0,0 +1,224 @@
+#include "ImageLoader.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <QFile>
+#include <QString>
+#include <QImageReader>
+#include <QtEndian>
+#include <QDebug>
+
+#include <osg/ref_ptr>
+#include <osgDB/ReadFile>
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+namespace {
+
+/* Image whose pixel data lives within a private (copy-on-write) mapping of its file. */
+class MappedImage : public osg::Image
+{
+public:
+    explicit MappedImage(const std::string& fname)
+        : osg::Image()
+        , m_file(QString::fromStdString(fname))
+        , m_memory(0)
+    {
+    }
+
+    bool map()
+    {
+        if (!m_file.open(QIODevice::ReadOnly)) return false;
+        m_memory = m_file.map(0, m_file.size(), QFileDevice::MapPrivateOption);
+        return m_memory != 0;
+    }
+
+    uchar* getMemory() const { return m_memory; }
+    qint64 getMemorySize() const { return m_file.size(); }
+
+protected:
+    ~MappedImage()
+    {
+        /* the data is not owned by osg::Image, see NO_DELETE */
+        if (m_memory) m_file.unmap(m_memory);
+    }
+
+private:
+    QFile m_file;
+    uchar* m_memory;
+};
+
+/* Layout of the pixel data of an uncompressed 24 bit BMP. */
+struct BMPInfo
+{
+    qint64 offset;
+    int width;
+    int height;
+    int stride;
+    bool topDown;
+};
+
+bool parseBMP(const uchar* data, qint64 size, BMPInfo& info)
+{
+    if (size < 54 || data[0] != 'B' || data[1] != 'M') return false;
+    quint32 offset = qFromLittleEndian<quint32>(data + 10);
+    quint32 headerSize = qFromLittleEndian<quint32>(data + 14);
+    qint32 width = qFromLittleEndian<qint32>(data + 18);
+    qint32 height = qFromLittleEndian<qint32>(data + 22);
+    quint16 bits = qFromLittleEndian<quint16>(data + 28);
+    quint32 compression = qFromLittleEndian<quint32>(data + 30);
+    if (headerSize < 40 || bits != 24 || compression != 0 || width <= 0 || height == 0) return false;
+
+    info.offset = offset;
+    info.width = width;
+    info.height = height < 0? -height : height;
+    info.stride = (width*3 + 3) & ~3;
+    info.topDown = height < 0;
+    return info.offset + static_cast<qint64>(info.stride) * info.height <= size;
+}
+
+unsigned int getValidScale(unsigned int scale)
+{
+    if (scale >= 8) return 8;
+    if (scale >= 4) return 4;
+    if (scale >= 2) return 2;
+    return 1;
+}
+
+osg::Image* fromQImage(const QImage& source)
+{
+    if (source.isNull()) return 0;
+    bool alpha = source.hasAlphaChannel();
+    QImage qimage = source.convertToFormat(alpha? QImage::Format_RGBA8888 : QImage::Format_RGB888);
+    int bytesPerLine = qimage.width() * (alpha? 4 : 3);
+
+    /* osg::Image rows go from bottom to top */
+    osg::ref_ptr<osg::Image> image = new osg::Image;
+    image->allocateImage(qimage.width(), qimage.height(), 1, alpha? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE);
+    image->setInternalTextureFormat(alpha? GL_RGBA : GL_RGB);
+    for (int y=0; y<qimage.height(); ++y)
+        std::memcpy(image->data(0, qimage.height()-1-y), qimage.constScanLine(y), bytesPerLine);
+    return image.release();
+}
+
+} // namespace
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+osg::Image *ImageLoader::read(const std::string &fname, unsigned int scale)
+{
+    scale = getValidScale(scale);
+    osg::ref_ptr<osg::Image> image = readBMP(fname, scale);
+    if (image.get()) return image.release();
+
+    if (scale > 1){
+        image = readScaled(fname, scale);
+        if (image.get()) return image.release();
+    }
+
+    image = osgDB::readImageFile(fname);
+    if (!image.get()) return 0;
+    if (scale > 1 && !image->isCompressed())
+        image->scaleImage(std::max(1, image->s() / static_cast<int>(scale)),
+                          std::max(1, image->t() / static_cast<int>(scale)), 1);
+    return image.release();
+}
+
+bool ImageLoader::readSize(const std::string &fname, int &width, int &height)
+{
+    QImageReader reader(QString::fromStdString(fname));
+    QSize size = reader.size();
+    if (!size.isValid()) return false;
+    width = size.width();
+    height = size.height();
+    return true;
+}
+
+unsigned int ImageLoader::getScaleForSize(int width, int height, int minWidth, int minHeight)
+{
+    unsigned int scale = 1;
+    while (scale < 8 && width / static_cast<int>(scale*2) >= minWidth && height / static_cast<int>(scale*2) >= minHeight)
+        scale *= 2;
+    return scale;
+}
+
+QImage ImageLoader::toQImage(const osg::Image *image)
+{
+    if (!image || !image->data() || image->getDataType() != GL_UNSIGNED_BYTE) return QImage();
+    GLenum format = image->getPixelFormat();
+    int channels = 0;
+    bool bgr = format == GL_BGR || format == GL_BGRA;
+    if (format == GL_RGB || format == GL_BGR) channels = 3;
+    else if (format == GL_RGBA || format == GL_BGRA) channels = 4;
+    else return QImage();
+
+    QImage qimage(image->s(), image->t(), channels == 4? QImage::Format_RGBA8888 : QImage::Format_RGB888);
+    for (int y=0; y<image->t(); ++y){
+        const unsigned char* src = image->data(0, image->t()-1-y);
+        uchar* dst = qimage.scanLine(y);
+        for (int x=0; x<image->s(); ++x){
+            dst[0] = src[bgr? 2 : 0];
+            dst[1] = src[1];
+            dst[2] = src[bgr? 0 : 2];
+            if (channels == 4) dst[3] = src[3];
+            src += channels;
+            dst += channels;
+        }
+    }
+    return qimage;
+}
+
+osg::Image *ImageLoader::readBMP(const std::string &fname, unsigned int scale)
+{
+    osg::ref_ptr<MappedImage> mapped = new MappedImage(fname);
+    if (!mapped->map()) return 0;
+    BMPInfo info;
+    if (!parseBMP(mapped->getMemory(), mapped->getMemorySize(), info)) return 0;
+
+    /* bottom-up rows of BGR pixels padded to 4 bytes is a valid OpenGL pixel layout */
+    if (scale == 1 && !info.topDown){
+        mapped->setImage(info.width, info.height, 1, GL_RGB, GL_BGR, GL_UNSIGNED_BYTE,
+                         mapped->getMemory() + info.offset, osg::Image::NO_DELETE, 4);
+        mapped->setFileName(fname);
+        return mapped.release();
+    }
+
+    /* strided read of every n-th pixel of every n-th row, only the touched pages are loaded */
+    int width = std::max(1, info.width / static_cast<int>(scale));
+    int height = std::max(1, info.height / static_cast<int>(scale));
+    osg::ref_ptr<osg::Image> image = new osg::Image;
+    image->allocateImage(width, height, 1, GL_BGR, GL_UNSIGNED_BYTE);
+    image->setInternalTextureFormat(GL_RGB);
+    for (int y=0; y<height; ++y){
+        int row = y * scale;
+        if (info.topDown) row = info.height-1 - row;
+        const uchar* src = mapped->getMemory() + info.offset + static_cast<qint64>(row) * info.stride;
+        unsigned char* dst = image->data(0, y);
+        for (int x=0; x<width; ++x){
+            const uchar* pixel = src + static_cast<qint64>(x) * scale * 3;
+            dst[0] = pixel[0];
+            dst[1] = pixel[1];
+            dst[2] = pixel[2];
+            dst += 3;
+        }
+    }
+    image->setFileName(fname);
+    return image.release();
+}
+
+osg::Image *ImageLoader::readScaled(const std::string &fname, unsigned int scale)
+{
+    QImageReader reader(QString::fromStdString(fname));
+    if (!reader.supportsOption(QImageIOHandler::ScaledSize)) return 0;
+    QSize size = reader.size();
+    if (!size.isValid()) return 0;
+    reader.setScaledSize(QSize(std::max(1, size.width() / static_cast<int>(scale)),
+                               std::max(1, size.height() / static_cast<int>(scale))));
+    QImage qimage;
+    if (!reader.read(&qimage)){
+        qWarning() << "ImageLoader: could not read" << fname.c_str() << reader.errorString();
+        return 0;
+    }
+    osg::Image* image = fromQImage(qimage);
+    if (image) image->setFileName(fname);
+    return image;
+}
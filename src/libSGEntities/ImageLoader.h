@@ -0,0 +1,52 @@
+#ifndef IMAGELOADER_H
+#define IMAGELOADER_H
+
+#include <string>
+
+#include <QImage>
+
+#include <osg/Image>
+
+/*! \class ImageLoader
+ * \brief Reads image files either at full resolution or directly at a reduced scale of 1/2, 1/4 or 1/8, so that
+ * memory and decode time are proportional to the output size rather than to the source size.
+ *
+ * * Uncompressed 24 bit BMP files are memory-mapped: at full resolution the osg::Image refers to the pixel data
+ * within the mapping without any copy; at a reduced scale only every n-th pixel of every n-th row is read.
+ * * The formats whose Qt readers can decode at a reduced size, e.g. JPEG by means of its DCT scaling, are read
+ * at the reduced scale by QImageReader.
+ * * Any other file is read by the OSG plugins and scaled afterwards.
+ *
+ * All the methods are thread-safe, so that they can be used by ImageDecoder and PhotoModel workers.
+*/
+class ImageLoader
+{
+public:
+    /*! A method to read an image file.
+     * \param fname is the image file name,
+     * \param scale is the reduction factor: 1, 2, 4 or 8; any other value is rounded down to one of those.
+     * \return the image with origin at the bottom left, or NULL if the file could not be read. */
+    static osg::Image* read(const std::string& fname, unsigned int scale = 1);
+
+    /*! A method to read the image dimensions from the file header without decoding the pixels.
+     * \return true if the dimensions could be read. */
+    static bool readSize(const std::string& fname, int& width, int& height);
+
+    /*! \return the largest reduction factor with which an image of the given size is still at least
+     * the given size along both sides. */
+    static unsigned int getScaleForSize(int width, int height, int minWidth, int minHeight);
+
+    /*! \return copy of an 8 bit per channel image as QImage, e.g., for thumbnails; null image if the pixel
+     * format is not supported. */
+    static QImage toQImage(const osg::Image* image);
+
+protected:
+    /*! A method to read an uncompressed 24 bit BMP file by mapping it into memory.
+     * \return the image, or NULL if the file is not an uncompressed 24 bit BMP. */
+    static osg::Image* readBMP(const std::string& fname, unsigned int scale);
+
+    /*! A method to read a file by means of QImageReader at a reduced scale. */
+    static osg::Image* readScaled(const std::string& fname, unsigned int scale);
+};
+
+#endif // IMAGELOADER_H
@@ -57,7 +57,7 @@ void entity::LineSegment::editLastPoint(float u, float v)
     this->dirtyBound();
 }
 
-osg::Node *entity::LineSegment::getMeshRepresentation() const
+osg::Node *entity::LineSegment::getMeshRepresentation(float chordalError) const
 {
     const osg::Vec3Array* vertices = static_cast<const osg::Vec3Array*>(this->getVertexArray());
     if (!vertices){
@@ -73,7 +73,9 @@ osg::Node *entity::LineSegment::getMeshRepresentation() const
     path.push_back(vertices->at(1));
     path.push_back(vertices->at(1) - dir * delta);
 
-    PTFTube extrusion(path, cher::SEGMENT_MESH_RADIUS, cher::EXTRUSION_MESH_SHAPE);
+    /* the path is straight already, only the cross-section is adapted */
+    PTFTube extrusion(path, cher::SEGMENT_MESH_RADIUS,
+                      ShaderedEntity2D::getExtrusionSides(cher::SEGMENT_MESH_RADIUS, chordalError));
     extrusion.build();
 
     return extrusion.generateTriMesh();
@@ -95,10 +97,8 @@ bool entity::LineSegment::redefineToShader(osg::MatrixTransform *t)
     Q_CHECK_PTR(colors);
     this->setVertexAttribArray(1, colors, osg::Array::BIND_PER_VERTEX);
 
-    /* apply shader to the state set */
-    Q_ASSERT(this->getOrCreateStateSet());
-    this->getOrCreateStateSet()->setAttributeAndModes(m_program.get(),
-                                                      osg::StateAttribute::ON);
+    /* the shader is applied by the state set of the line segment geode */
+    this->inheritProgram();
 
     m_isShadered = true;
     return true;
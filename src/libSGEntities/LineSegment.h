@@ -31,7 +31,7 @@ public:
 
     void editLastPoint(float u, float v);
 
-    osg::Node* getMeshRepresentation() const;
+    virtual osg::Node* getMeshRepresentation(float chordalError = 0.f) const;
 
 protected:
     virtual bool redefineToShader(osg::MatrixTransform *t);
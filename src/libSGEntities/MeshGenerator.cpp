@@ -0,0 +1,267 @@
+#include "MeshGenerator.h"
+
+#include <map>
+#include <cmath>
+
+#include <QThreadPool>
+#include <QRunnable>
+#include <QDebug>
+
+#include <osg/NodeVisitor>
+#include <osg/TriangleIndexFunctor>
+
+#include "Stroke.h"
+#include "LineSegment.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+/* Generates mesh of a single entity; the result slot is owned by the task until the pool is done. */
+class MeshTask : public QRunnable
+{
+public:
+    MeshTask(entity::ShaderedEntity2D* entity, osg::ref_ptr<osg::Node>* result, bool cached, float chordalError)
+        : QRunnable()
+        , m_entity(entity)
+        , m_result(result)
+        , m_cached(cached)
+        , m_chordalError(chordalError)
+    {
+    }
+
+    void run()
+    {
+        if (m_cached){
+            *m_result = m_entity->getMesh(m_chordalError);
+            return;
+        }
+        /* a valid cached mesh is reused, a new one is not stored */
+        *m_result = m_entity->getCachedMesh(m_chordalError);
+        if (!m_result->get())
+            *m_result = m_entity->getMeshRepresentation(m_chordalError);
+    }
+
+private:
+    entity::ShaderedEntity2D* m_entity;
+    osg::ref_ptr<osg::Node>* m_result;
+    bool m_cached;
+    float m_chordalError;
+};
+
+/* Gathers all the geometries of a mesh node. */
+class GeometryCollector : public osg::NodeVisitor
+{
+public:
+    GeometryCollector()
+        : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN)
+    {
+    }
+
+    void apply(osg::Geometry& geometry)
+    {
+        m_geometries.push_back(&geometry);
+    }
+
+    std::vector<osg::Geometry*> m_geometries;
+};
+
+/* Receives triangles of any primitive type as vertex index triplets. */
+struct TriangleIndices
+{
+    std::vector<unsigned int> m_indices;
+
+    void operator() (unsigned int i1, unsigned int i2, unsigned int i3)
+    {
+        m_indices.push_back(i1);
+        m_indices.push_back(i2);
+        m_indices.push_back(i3);
+    }
+};
+
+/* Accumulates welded triangles of one or more source geometries. */
+class WeldedMesh
+{
+public:
+    explicit WeldedMesh(float tolerance)
+        : m_tolerance(tolerance > 0.f? tolerance : cher::MESH_WELD_TOLERANCE)
+        , m_vertices(new osg::Vec3Array)
+        , m_normals(new osg::Vec3Array)
+        , m_triangles(new osg::DrawElementsUInt(GL_TRIANGLES))
+    {
+    }
+
+    void add(const osg::Node* mesh)
+    {
+        if (!mesh) return;
+        GeometryCollector collector;
+        const_cast<osg::Node*>(mesh)->accept(collector);
+        for (size_t i=0; i<collector.m_geometries.size(); ++i)
+            this->add(collector.m_geometries[i]);
+    }
+
+    osg::Geometry* createGeometry(const std::string& name)
+    {
+        if (m_triangles->empty()) return 0;
+        for (size_t i=0; i<m_normals->size(); ++i)
+            (*m_normals)[i].normalize();
+
+        osg::Geometry* geometry = new osg::Geometry;
+        geometry->setName(name);
+        geometry->setVertexArray(m_vertices.get());
+        geometry->setNormalArray(m_normals.get(), osg::Array::BIND_PER_VERTEX);
+        geometry->addPrimitiveSet(m_triangles.get());
+        return geometry;
+    }
+
+protected:
+    void add(osg::Geometry* geometry)
+    {
+        const osg::Vec3Array* vertices = dynamic_cast<const osg::Vec3Array*>(geometry->getVertexArray());
+        if (!vertices || vertices->empty()) return;
+        const osg::Vec3Array* normals = dynamic_cast<const osg::Vec3Array*>(geometry->getNormalArray());
+        bool perVertex = normals && normals->size() == vertices->size();
+
+        /* map the source vertices to the welded ones */
+        std::vector<unsigned int> remap(vertices->size());
+        for (size_t i=0; i<vertices->size(); ++i){
+            const osg::Vec3f& v = (*vertices)[i];
+            int index = this->find(v);
+            if (index < 0){
+                remap[i] = m_vertices->size();
+                m_lookup[Key(Cell(v.x()), Cell(v.y()), Cell(v.z()))].push_back(remap[i]);
+                m_vertices->push_back(v);
+                m_normals->push_back(osg::Vec3f(0,0,0));
+            }
+            else
+                remap[i] = index;
+            if (perVertex)
+                (*m_normals)[remap[i]] += (*normals)[i];
+        }
+
+        osg::TriangleIndexFunctor<TriangleIndices> functor;
+        geometry->accept(functor);
+        for (size_t i=0; i+2<functor.m_indices.size(); i+=3){
+            unsigned int i1 = remap[functor.m_indices[i]];
+            unsigned int i2 = remap[functor.m_indices[i+1]];
+            unsigned int i3 = remap[functor.m_indices[i+2]];
+            /* welding may collapse thin triangles */
+            if (i1 == i2 || i2 == i3 || i1 == i3) continue;
+            m_triangles->push_back(i1);
+            m_triangles->push_back(i2);
+            m_triangles->push_back(i3);
+            if (!perVertex){
+                osg::Vec3f n = ((*m_vertices)[i2]-(*m_vertices)[i1]) ^ ((*m_vertices)[i3]-(*m_vertices)[i1]);
+                (*m_normals)[i1] += n;
+                (*m_normals)[i2] += n;
+                (*m_normals)[i3] += n;
+            }
+        }
+    }
+
+    /* The cells are as large as the tolerance, so that a vertex within the tolerance of the given one is always
+     * within one of the 27 cells around it; the nearest such vertex is returned, or -1 if there is none. */
+    int find(const osg::Vec3f& v) const
+    {
+        long long x = Cell(v.x()), y = Cell(v.y()), z = Cell(v.z());
+        float best = m_tolerance * m_tolerance;
+        int index = -1;
+        for (long long dx=-1; dx<=1; ++dx){
+            for (long long dy=-1; dy<=1; ++dy){
+                for (long long dz=-1; dz<=1; ++dz){
+                    std::map<Key, std::vector<unsigned int> >::const_iterator it = m_lookup.find(Key(x+dx, y+dy, z+dz));
+                    if (it == m_lookup.end()) continue;
+                    for (size_t k=0; k<it->second.size(); ++k){
+                        float distance = ((*m_vertices)[it->second[k]] - v).length2();
+                        if (distance > best) continue;
+                        best = distance;
+                        index = static_cast<int>(it->second[k]);
+                    }
+                }
+            }
+        }
+        return index;
+    }
+
+    long long Cell(float x) const
+    {
+        return static_cast<long long>(std::floor(x / m_tolerance));
+    }
+
+    struct Key{
+        Key(long long x_, long long y_, long long z_) : x(x_), y(y_), z(z_) {}
+        bool operator<(const Key& other) const {
+            if (x != other.x) return x < other.x;
+            if (y != other.y) return y < other.y;
+            return z < other.z;
+        }
+        long long x, y, z;
+    };
+
+private:
+    float m_tolerance;
+    osg::ref_ptr<osg::Vec3Array> m_vertices;
+    osg::ref_ptr<osg::Vec3Array> m_normals;
+    osg::ref_ptr<osg::DrawElementsUInt> m_triangles;
+    std::map<Key, std::vector<unsigned int> > m_lookup;
+};
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+void MeshGenerator::collectEntities(const entity::Canvas *canvas, std::vector<entity::ShaderedEntity2D *> &entities)
+{
+    if (!canvas) return;
+    for (unsigned int j=0; j<canvas->getNumStrokes(); ++j){
+        entity::Stroke* stroke = canvas->getStroke(j);
+        if (stroke) entities.push_back(stroke);
+    }
+    for (unsigned int j=0; j<canvas->getNumLineSegments(); ++j){
+        entity::LineSegment* segment = canvas->getLineSegment(j);
+        if (segment) entities.push_back(segment);
+    }
+}
+
+int MeshGenerator::generate(const std::vector<entity::ShaderedEntity2D *> &entities,
+                            std::vector<osg::ref_ptr<osg::Node> > &meshes, bool cached, float chordalError)
+{
+    meshes.assign(entities.size(), osg::ref_ptr<osg::Node>(0));
+
+    /* a dedicated pool, so that waiting does not depend on unrelated tasks */
+    QThreadPool pool;
+    for (size_t i=0; i<entities.size(); ++i){
+        if (!entities[i]) continue;
+        pool.start(new MeshTask(entities[i], &meshes[i], cached, chordalError));
+    }
+    pool.waitForDone();
+
+    int numGenerated = 0;
+    for (size_t i=0; i<meshes.size(); ++i){
+        if (!entities[i]) continue;
+        if (meshes[i].get()) numGenerated++;
+        else qWarning() << "MeshGenerator: could not obtain mesh representation of" << entities[i]->getName().c_str();
+    }
+    return numGenerated;
+}
+
+osg::Geode *MeshGenerator::merge(const std::vector<osg::ref_ptr<osg::Node> > &meshes,
+                                 const std::vector<std::string> &names, const std::string &name,
+                                 bool perMeshGroups, float tolerance)
+{
+    osg::ref_ptr<osg::Geode> geode = new osg::Geode;
+    geode->setName(name);
+
+    if (perMeshGroups){
+        for (size_t i=0; i<meshes.size(); ++i){
+            WeldedMesh welded(tolerance);
+            welded.add(meshes[i].get());
+            osg::Geometry* geometry = welded.createGeometry(i<names.size()? names[i] : name);
+            if (geometry) geode->addDrawable(geometry);
+        }
+    }
+    else{
+        WeldedMesh welded(tolerance);
+        for (size_t i=0; i<meshes.size(); ++i)
+            welded.add(meshes[i].get());
+        osg::Geometry* geometry = welded.createGeometry(name);
+        if (geometry) geode->addDrawable(geometry);
+    }
+
+    if (geode->getNumDrawables() == 0) return 0;
+    return geode.release();
+}
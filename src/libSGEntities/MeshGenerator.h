@@ -0,0 +1,61 @@
+#ifndef MESHGENERATOR_H
+#define MESHGENERATOR_H
+
+#include <vector>
+#include <string>
+
+#include <osg/ref_ptr>
+#include <osg/Node>
+#include <osg/Geode>
+#include <osg/Geometry>
+
+#include "ShaderedEntity2D.h"
+#include "Canvas.h"
+
+/*! \class MeshGenerator
+ * \brief Generates mesh representations of scene entities in parallel for the scene export.
+ *
+ * Each entity is processed by a single pool thread which calls entity::ShaderedEntity2D::getMesh(), so
+ * only the entities whose geometry changed since the previous export are re-generated. The streaming export
+ * (see MeshWriter) reads the valid cached meshes, but it does not store the new ones in order to keep the
+ * memory bounded. The generator never
+ * modifies the scene graph; it is up to the caller to attach or write the obtained meshes.
+*/
+class MeshGenerator
+{
+public:
+    /*! A method to collect all the entities of the canvas which have mesh representation.
+     * \param canvas is the canvas to collect the strokes and line segments from,
+     * \param entities is the list the entities are appended to. */
+    static void collectEntities(const entity::Canvas* canvas, std::vector<entity::ShaderedEntity2D*>& entities);
+
+    /*! A method to generate meshes of the given entities on a thread pool. It returns when all the meshes
+     * are generated.
+     * \param entities is the list of entities to generate meshes for,
+     * \param meshes is the output list of meshes in the same order as entities; it contains NULL for each entity
+     * which mesh could not be generated,
+     * \param cached if false, only the valid cached meshes are reused, see entity::ShaderedEntity2D::getCachedMesh();
+     * the others are generated but not stored within the entity cache, so that they are released as soon as the
+     * caller drops them,
+     * \param chordalError is the adaptive tessellation tolerance, zero means the fixed tessellation.
+     * \return number of successfully generated meshes. */
+    static int generate(const std::vector<entity::ShaderedEntity2D*>& entities,
+                        std::vector< osg::ref_ptr<osg::Node> >& meshes, bool cached = true,
+                        float chordalError = 0.f);
+
+    /*! A method to merge a set of meshes, e.g., all the tubes of a canvas, into indexed triangle meshes. The
+     * triangles are extracted from any primitive sets of the source meshes, and the vertices whose positions
+     * coincide within the given tolerance are welded together; their normals are averaged.
+     * \param meshes is the list of source meshes, NULL entries are skipped,
+     * \param names is the list of names of the source meshes, e.g., stroke names,
+     * \param name is the name of the merged mesh,
+     * \param perMeshGroups if true, each source mesh results in a separate named geometry of the output, e.g.,
+     * in a separate OBJ group; otherwise all the meshes are merged into a single geometry,
+     * \param tolerance is the welding distance.
+     * \return geode containing the merged geometry (or geometries), or NULL if there was nothing to merge. */
+    static osg::Geode* merge(const std::vector< osg::ref_ptr<osg::Node> >& meshes,
+                             const std::vector<std::string>& names, const std::string& name,
+                             bool perMeshGroups, float tolerance = cher::MESH_WELD_TOLERANCE);
+};
+
+#endif // MESHGENERATOR_H
@@ -0,0 +1,209 @@
+#include "MeshWriter.h"
+
+#include <QDebug>
+#include <QtGlobal>
+
+#include <osgDB/FileNameUtils>
+
+namespace {
+const int PLY_COUNT_WIDTH = 10; /* header counts are zero-padded, so that they can be patched in place */
+
+QByteArray getPlyCount(unsigned int count)
+{
+    return QString("%1").arg(count, PLY_COUNT_WIDTH, 10, QChar('0')).toLatin1();
+}
+}
+
+MeshWriter::MeshWriter()
+    : m_format(FORMAT_UNKNOWN)
+    , m_offsetNumVertices(0)
+    , m_offsetNumTriangles(0)
+    , m_numVertices(0)
+    , m_numTriangles(0)
+    , m_ok(false)
+{
+}
+
+MeshWriter::~MeshWriter()
+{
+    if (m_file.isOpen()){
+        qWarning("MeshWriter: file was not closed properly, the output is incomplete");
+        m_file.close();
+    }
+}
+
+MeshWriter::FORMAT MeshWriter::getFormat(const std::string &path)
+{
+    std::string ext = osgDB::getLowerCaseFileExtension(path);
+    if (ext == "obj") return FORMAT_OBJ;
+    if (ext == "ply") return FORMAT_PLY;
+    return FORMAT_UNKNOWN;
+}
+
+bool MeshWriter::isStreamingFormat(const std::string &path)
+{
+    return getFormat(path) != FORMAT_UNKNOWN;
+}
+
+bool MeshWriter::open(const std::string &path)
+{
+    m_format = getFormat(path);
+    if (m_format == FORMAT_UNKNOWN){
+        qWarning() << "MeshWriter: unsupported file format" << path.c_str();
+        return false;
+    }
+    m_numVertices = 0;
+    m_numTriangles = 0;
+
+    m_file.setFileName(QString::fromStdString(path));
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)){
+        qWarning() << "MeshWriter: could not open file for writing" << path.c_str();
+        return false;
+    }
+
+    if (m_format == FORMAT_OBJ){
+        m_text.setDevice(&m_file);
+        m_text << "# Cherish scene export\n";
+    }
+    else{
+        if (!m_faces.open()){
+            qWarning("MeshWriter: could not create temporary file for faces");
+            m_file.close();
+            return false;
+        }
+        m_file.write("ply\n"
+                     "format binary_little_endian 1.0\n"
+                     "comment Cherish scene export\n"
+                     "element vertex ");
+        m_offsetNumVertices = m_file.pos();
+        m_file.write(getPlyCount(0));
+        m_file.write("\n"
+                     "property float x\n"
+                     "property float y\n"
+                     "property float z\n"
+                     "property float nx\n"
+                     "property float ny\n"
+                     "property float nz\n"
+                     "element face ");
+        m_offsetNumTriangles = m_file.pos();
+        m_file.write(getPlyCount(0));
+        m_file.write("\n"
+                     "property list uchar int vertex_indices\n"
+                     "end_header\n");
+
+        m_data.setDevice(&m_file);
+        m_data.setByteOrder(QDataStream::LittleEndian);
+        m_data.setFloatingPointPrecision(QDataStream::SinglePrecision);
+        m_dataFaces.setDevice(&m_faces);
+        m_dataFaces.setByteOrder(QDataStream::LittleEndian);
+    }
+
+    m_ok = true;
+    return true;
+}
+
+void MeshWriter::beginObject(const std::string &name)
+{
+    if (m_format == FORMAT_OBJ && m_file.isOpen())
+        m_text << "o " << QString::fromStdString(name) << "\n";
+}
+
+bool MeshWriter::write(const osg::Geometry *geometry, const osg::Matrix &matrix, const std::string &group)
+{
+    if (!m_file.isOpen() || !geometry) return false;
+    const osg::Vec3Array* vertices = dynamic_cast<const osg::Vec3Array*>(geometry->getVertexArray());
+    if (!vertices){
+        qWarning("MeshWriter: geometry has no vertices");
+        return false;
+    }
+    const osg::Vec3Array* normals = dynamic_cast<const osg::Vec3Array*>(geometry->getNormalArray());
+    bool hasNormals = normals && normals->size() == vertices->size();
+
+    if (m_format == FORMAT_OBJ && !group.empty())
+        m_text << "g " << QString::fromStdString(group) << "\n";
+
+    /* vertices in world coordinates */
+    for (size_t i=0; i<vertices->size(); ++i){
+        osg::Vec3f v = (*vertices)[i] * matrix;
+        osg::Vec3f n(0,0,0);
+        if (hasNormals){
+            n = osg::Matrix::transform3x3((*normals)[i], matrix);
+            n.normalize();
+        }
+        if (m_format == FORMAT_OBJ){
+            m_text << "v " << v.x() << " " << v.y() << " " << v.z() << "\n";
+            if (hasNormals)
+                m_text << "vn " << n.x() << " " << n.y() << " " << n.z() << "\n";
+        }
+        else
+            m_data << v.x() << v.y() << v.z() << n.x() << n.y() << n.z();
+    }
+
+    /* triangles, indexed from the first vertex of the geometry */
+    unsigned int base = m_numVertices;
+    for (unsigned int p=0; p<geometry->getNumPrimitiveSets(); ++p){
+        const osg::PrimitiveSet* primitives = geometry->getPrimitiveSet(p);
+        if (!primitives || primitives->getMode() != GL_TRIANGLES){
+            qWarning("MeshWriter: only triangle primitive sets are written");
+            continue;
+        }
+        for (unsigned int i=0; i+2<primitives->getNumIndices(); i+=3){
+            unsigned int a = base + primitives->index(i);
+            unsigned int b = base + primitives->index(i+1);
+            unsigned int c = base + primitives->index(i+2);
+            if (m_format == FORMAT_OBJ){
+                if (hasNormals)
+                    m_text << "f " << a+1 << "//" << a+1 << " " << b+1 << "//" << b+1 << " " << c+1 << "//" << c+1 << "\n";
+                else
+                    m_text << "f " << a+1 << " " << b+1 << " " << c+1 << "\n";
+            }
+            else
+                m_dataFaces << quint8(3) << qint32(a) << qint32(b) << qint32(c);
+            m_numTriangles++;
+        }
+    }
+    m_numVertices += vertices->size();
+
+    if (m_format == FORMAT_OBJ)
+        m_ok = m_ok && m_text.status() == QTextStream::Ok;
+    else
+        m_ok = m_ok && m_data.status() == QDataStream::Ok && m_dataFaces.status() == QDataStream::Ok;
+    return m_ok;
+}
+
+bool MeshWriter::close()
+{
+    if (!m_file.isOpen()) return false;
+
+    if (m_format == FORMAT_OBJ){
+        m_text.flush();
+        m_ok = m_ok && m_text.status() == QTextStream::Ok;
+    }
+    else{
+        /* patch the header counts */
+        m_ok = m_ok && m_file.seek(m_offsetNumVertices) && m_file.write(getPlyCount(m_numVertices)) == PLY_COUNT_WIDTH;
+        m_ok = m_ok && m_file.seek(m_offsetNumTriangles) && m_file.write(getPlyCount(m_numTriangles)) == PLY_COUNT_WIDTH;
+        m_ok = m_ok && m_file.seek(m_file.size());
+
+        /* append the buffered faces */
+        m_ok = m_ok && m_faces.seek(0);
+        while (m_ok && !m_faces.atEnd()){
+            QByteArray chunk = m_faces.read(1 << 20);
+            m_ok = m_file.write(chunk) == chunk.size();
+        }
+        m_faces.close();
+    }
+    m_file.close();
+    if (!m_ok) qWarning() << "MeshWriter: error while writing" << m_file.fileName();
+    return m_ok;
+}
+
+unsigned int MeshWriter::getNumVertices() const
+{
+    return m_numVertices;
+}
+
+unsigned int MeshWriter::getNumTriangles() const
+{
+    return m_numTriangles;
+}
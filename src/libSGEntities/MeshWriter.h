@@ -0,0 +1,88 @@
+#ifndef MESHWRITER_H
+#define MESHWRITER_H
+
+#include <string>
+
+#include <QFile>
+#include <QTemporaryFile>
+#include <QDataStream>
+#include <QTextStream>
+
+#include <osg/Geometry>
+#include <osg/Matrix>
+
+/*! \class MeshWriter
+ * \brief Streaming writer of triangle meshes into Wavefront OBJ or binary little-endian PLY files.
+ *
+ * The meshes are written one by one as soon as they are passed to write(), so that the caller does not need
+ * to keep all the scene meshes in memory, nor to attach them to the scene graph. The meshes are expected to
+ * be indexed GL_TRIANGLES geometries with per-vertex normals, as produced by MeshGenerator::merge().
+ *
+ * Since PLY requires all the vertices to precede all the faces, the faces are buffered in a temporary file
+ * and are appended to the output file by close(); the element counts of the PLY header are patched in place.
+ *
+ * Usage example:
+ * \code
+ * MeshWriter writer;
+ * if (writer.open("scene.ply")){
+ *     writer.beginObject("Canvas0");
+ *     writer.write(geometry, canvas->getMatrix());
+ *     writer.close();
+ * }
+ * \endcode
+*/
+class MeshWriter
+{
+public:
+    /*! Supported file formats. */
+    enum FORMAT{
+        FORMAT_UNKNOWN,
+        FORMAT_OBJ,
+        FORMAT_PLY
+    };
+
+    MeshWriter();
+    ~MeshWriter();
+
+    /*! \return format the file will be written in judging by its extension. */
+    static FORMAT getFormat(const std::string& path);
+
+    /*! \return true if the file can be written by MeshWriter. */
+    static bool isStreamingFormat(const std::string& path);
+
+    /*! A method to open the file for writing and to write the file header. */
+    bool open(const std::string& path);
+
+    /*! A method to start a new named object, e.g., a canvas; it is an `o` statement for OBJ and is ignored
+     * for PLY which does not support objects. */
+    void beginObject(const std::string& name);
+
+    /*! A method to append triangles of the geometry to the file.
+     * \param geometry is indexed triangle mesh,
+     * \param matrix is transform from the geometry local coordinates to world coordinates,
+     * \param group is name of OBJ group (`g` statement) to write the triangles to; empty means no new group.
+     * \return true upon success. */
+    bool write(const osg::Geometry* geometry, const osg::Matrix& matrix, const std::string& group = "");
+
+    /*! A method to complete and close the file. \return true if the whole file was written successfully. */
+    bool close();
+
+    /*! \return number of vertices written so far. */
+    unsigned int getNumVertices() const;
+
+    /*! \return number of triangles written so far. */
+    unsigned int getNumTriangles() const;
+
+private:
+    FORMAT m_format;
+    QFile m_file;
+    QTemporaryFile m_faces; /*!< PLY faces buffer */
+    QTextStream m_text; /*!< OBJ output */
+    QDataStream m_data; /*!< PLY vertices output */
+    QDataStream m_dataFaces; /*!< PLY faces output */
+    qint64 m_offsetNumVertices, m_offsetNumTriangles; /*!< position of PLY header counts */
+    unsigned int m_numVertices, m_numTriangles;
+    bool m_ok;
+};
+
+#endif // MESHWRITER_H
@@ -3,10 +3,14 @@
 #include "Utilities.h"
 #include "DraggableWire.h"
 #include "MainWindow.h"
+#include "ImageCache.h"
+#include "ImageLoader.h"
 
 #include <QDebug>
 #include <QtGlobal>
 
+#include <algorithm>
+
 #include <osg/Texture2D>
 #include <osgDB/ReadFile>
 #include <osg/Image>
@@ -14,15 +18,22 @@
 #include <osg/TexMat>
 #include <osg/BlendFunc>
 #include <osg/Material>
+#include <osg/PolygonOffset>
 
 entity::Photo::Photo()
     : entity::Entity2D()
-    , m_texture(new osg::Texture2D)
+    , m_image(new entity::PhotoImage)
     , m_center(osg::Vec3f(0.f,0.f,0.f))
     , m_width(0)
     , m_height(0)
     , m_angle(0)
     , m_color(cher::PHOTO_CLR_REST)
+    , m_id(0)
+    , m_tileLevel(-1)
+    , m_tileVertices(0)
+    , m_tileTexcoords(0)
+    , m_tileVertexRevision(0)
+    , m_tileTexcoordRevision(0)
 {
     qDebug("New Photo ctor complete");
     this->setName("Photo");
@@ -33,23 +44,29 @@ entity::Photo::Photo()
 
 entity::Photo::Photo(const entity::Photo& photo, const osg::CopyOp& copyop)
     : entity::Entity2D(photo, copyop)
-    , m_texture(photo.m_texture)
+    , m_image(photo.m_image)
     , m_center(photo.m_center)
     , m_width(photo.m_width)
     , m_height(photo.m_height)
     , m_angle(photo.m_angle)
+    , m_id(photo.m_id)
+    , m_tileLevel(-1)
+    , m_tileVertices(0)
+    , m_tileTexcoords(0)
+    , m_tileVertexRevision(0)
+    , m_tileTexcoordRevision(0)
 {
     qDebug("New Photo ctor by copy complete");
 }
 
 void entity::Photo::setTexture(osg::Texture2D* texture)
 {
-    m_texture = texture;
+    m_image->setTexture(texture);
 }
 
 const osg::Texture2D*entity::Photo::getTexture() const
 {
-    return m_texture.get();
+    return m_image->getTexture();
 }
 
 void entity::Photo::setWidth(float w)
@@ -96,18 +113,42 @@ float entity::Photo::getAngle() const
     return m_angle;
 }
 
+void entity::Photo::setId(unsigned int id)
+{
+    m_id = id;
+}
+
+unsigned int entity::Photo::getId() const
+{
+    return m_id;
+}
+
 /* width and height represent half size width and height
 */
 void entity::Photo::loadImage(const std::string& fname)
 {
     qDebug() << "Trying to load image data...";
-    osg::Image* image = osgDB::readImageFile(fname);
-    if (!image) return;
+    osg::ref_ptr<osg::Image> image = ImageLoader::read(fname);
+    if (!image.get()) return;
     qDebug() << "DONE: Image read from file name";
-    m_texture->setImage(image);
+
+    /* share the image data with other photos of the same content */
+    osg::ref_ptr<entity::PhotoImage> shared;
+    if (ImageCache::instance().find(ImageCache::computeHash(image.get()), shared))
+        this->setPhotoImage(shared.get());
+    else{
+        m_image->setImage(image.get());
+        m_image->buildPyramid();
+        ImageCache::instance().insert(m_image.get());
+    }
     qDebug() << "DONE: Texure extracted from image";
 
     float aspectRatio = static_cast<float>(image->s()) / static_cast<float>(image->t());
+    this->initializeQuad(aspectRatio);
+}
+
+void entity::Photo::initializeQuad(float aspectRatio)
+{
     m_width = cher::PHOTO_MINW;
     m_height = m_width / aspectRatio;
 
@@ -134,9 +175,58 @@ void entity::Photo::loadImage(const std::string& fname)
     this->setColorArray(colors, osg::Array::BIND_OVERALL);
 }
 
+void entity::Photo::setDecodedImage(osg::Image *image)
+{
+    if (!image || image->t() == 0) return;
+
+    /* fit the image aspect ratio within the current quad box */
+    float aspectRatio = static_cast<float>(image->s()) / static_cast<float>(image->t());
+    if (aspectRatio >= m_width / m_height)
+        m_height = m_width / aspectRatio;
+    else
+        m_width = m_height * aspectRatio;
+    this->updateVertices();
+}
+
 osg::StateAttribute* entity::Photo::getTextureAsAttribute() const
 {
-    return dynamic_cast<osg::StateAttribute*>(m_texture.get());
+    return dynamic_cast<osg::StateAttribute*>(m_image->getTexture());
+}
+
+void entity::Photo::setImage(osg::Image *image)
+{
+    m_image->setImage(image);
+}
+
+osg::Image *entity::Photo::getImage() const
+{
+    return m_image->getImage();
+}
+
+entity::PhotoImage *entity::Photo::getPhotoImage() const
+{
+    return m_image.get();
+}
+
+void entity::Photo::setPhotoImage(entity::PhotoImage *image)
+{
+    if (!image) return;
+    m_image = image;
+    this->getOrCreateStateSet()->setTextureAttributeAndModes(0, this->getTextureAsAttribute());
+}
+
+bool entity::Photo::isImageShared() const
+{
+    return m_image->referenceCount() > 1;
+}
+
+entity::PhotoImage *entity::Photo::detachImage()
+{
+    if (this->isImageShared()){
+        osg::ref_ptr<entity::PhotoImage> copy = m_image->clone();
+        this->setPhotoImage(copy.get());
+    }
+    return m_image.get();
 }
 
 void entity::Photo::move(const double u, const double v)
@@ -180,6 +270,7 @@ void entity::Photo::flipH()
     }
     std::swap((*texcoords)[0], (*texcoords)[1]);
     std::swap((*texcoords)[2], (*texcoords)[3]);
+    texcoords->dirty();
     this->dirtyDisplayList();
     this->dirtyBound();
 }
@@ -193,6 +284,7 @@ void entity::Photo::flipV()
     }
     std::swap((*texcoords)[0], (*texcoords)[3]);
     std::swap((*texcoords)[1], (*texcoords)[2]);
+    texcoords->dirty();
     this->dirtyDisplayList();
     this->dirtyBound();
 }
@@ -430,6 +522,131 @@ cher::ENTITY_TYPE entity::Photo::getEntityType() const
     return cher::ENTITY_PHOTO;
 }
 
+osg::Vec3f entity::Photo::getPoint(float u, float v) const
+{
+    const osg::Vec3Array* verts = static_cast<const osg::Vec3Array*>(this->getVertexArray());
+    const osg::Vec2Array* texcoords = static_cast<const osg::Vec2Array*>(this->getTexCoordArray(0));
+    if (!verts || !texcoords || verts->size() < 4 || texcoords->size() < 4) return m_center;
+
+    /* the quad corners are found by their texture coordinates, since flips only permute them */
+    float half = 0.f;
+    for (unsigned int i=0; i<4; ++i)
+        half = std::max(half, 0.5f * std::max((*texcoords)[i].x(), (*texcoords)[i].y()));
+    osg::Vec3f P00, P10, P01;
+    for (unsigned int i=0; i<4; ++i){
+        bool right = (*texcoords)[i].x() > half;
+        bool top = (*texcoords)[i].y() > half;
+        if (!right && !top) P00 = (*verts)[i];
+        else if (right && !top) P10 = (*verts)[i];
+        else if (!right && top) P01 = (*verts)[i];
+    }
+    return P00 + (P10-P00)*u + (P01-P00)*v;
+}
+
+void entity::Photo::clearTiles()
+{
+    m_tiles.clear();
+    m_tileTextures.clear();
+}
+
+void entity::Photo::releaseTiles()
+{
+    this->clearTiles();
+    m_tileQuads.clear();
+    m_tileLevel = -1;
+}
+
+void entity::Photo::addTile(osg::Texture2D *texture, unsigned int level, int x, int y, float u0, float v0, float u1, float v1)
+{
+    if (!texture) return;
+
+    /* the kept quads are of another level, or the photo quad was moved or flipped since they were built */
+    const osg::Array* vertices = this->getVertexArray();
+    const osg::Array* texcoords = this->getTexCoordArray(0);
+    unsigned int vertexRevision = vertices? vertices->getModifiedCount() : 0;
+    unsigned int texcoordRevision = texcoords? texcoords->getModifiedCount() : 0;
+    if (m_tileLevel != static_cast<int>(level) || m_tileVertices != vertices || m_tileTexcoords != texcoords
+            || m_tileVertexRevision != vertexRevision || m_tileTexcoordRevision != texcoordRevision){
+        m_tileQuads.clear();
+        m_tileLevel = static_cast<int>(level);
+        m_tileVertices = vertices;
+        m_tileTexcoords = texcoords;
+        m_tileVertexRevision = vertexRevision;
+        m_tileTexcoordRevision = texcoordRevision;
+    }
+    osg::ref_ptr<osg::Geometry>& tile = m_tileQuads[std::make_pair(x, y)];
+    if (tile.get()){
+        m_tiles.push_back(tile);
+        m_tileTextures.push_back(texture);
+        return;
+    }
+
+    tile = new osg::Geometry;
+    tile->setUseDisplayList(false);
+    tile->setUseVertexBufferObjects(false);
+
+    osg::Vec3Array* verts = new osg::Vec3Array;
+    verts->push_back(this->getPoint(u0, v0));
+    verts->push_back(this->getPoint(u1, v0));
+    verts->push_back(this->getPoint(u1, v1));
+    verts->push_back(this->getPoint(u0, v1));
+    tile->setVertexArray(verts);
+    tile->addPrimitiveSet(new osg::DrawArrays(GL_QUADS, 0, 4));
+
+    osg::Vec2Array* texcoords = new osg::Vec2Array;
+    texcoords->push_back(osg::Vec2(0, 0));
+    texcoords->push_back(osg::Vec2(1, 0));
+    texcoords->push_back(osg::Vec2(1, 1));
+    texcoords->push_back(osg::Vec2(0, 1));
+    tile->setTexCoordArray(0, texcoords);
+
+    /* the photo color and transparency are shared */
+    tile->setNormalArray(const_cast<osg::Array*>(this->getNormalArray()));
+    tile->setNormalBinding(osg::Geometry::BIND_OVERALL);
+    tile->setColorArray(const_cast<osg::Array*>(this->getColorArray()), osg::Array::BIND_OVERALL);
+
+    /* the display list of the photo would not include the tiles */
+    if (this->getUseDisplayList()){
+        this->setUseDisplayList(false);
+        this->dirtyDisplayList();
+    }
+    m_tiles.push_back(tile);
+    m_tileTextures.push_back(texture);
+}
+
+unsigned int entity::Photo::getNumTilesDrawn() const
+{
+    return m_tiles.size();
+}
+
+unsigned int entity::Photo::getNumTileQuads() const
+{
+    return m_tileQuads.size();
+}
+
+void entity::Photo::drawImplementation(osg::RenderInfo &renderInfo) const
+{
+    if (m_tiles.empty()){
+        osg::Geometry::drawImplementation(renderInfo);
+        return;
+    }
+
+    osg::State* state = renderInfo.getState();
+    for (size_t i=0; i<m_tiles.size(); ++i){
+        state->applyTextureAttribute(0, m_tileTextures[i].get());
+        m_tiles[i]->drawImplementation(renderInfo);
+    }
+
+    /* the photo quad is pushed behind the tiles, so that it only fills in the parts which are not covered
+     * by the tiles and the semi-transparent photo is not blended twice; the state changes are reverted by
+     * the next state set applied */
+    static osg::ref_ptr<osg::PolygonOffset> offset = new osg::PolygonOffset(1.f, 1.f);
+    state->applyTextureAttribute(0, m_image->getTexture());
+    state->applyAttribute(offset.get());
+    state->applyMode(GL_POLYGON_OFFSET_FILL, true);
+    osg::Geometry::drawImplementation(renderInfo);
+}
+
 /* Since the Photo is represented by Quad, we can use parameters
  * such as width, height, center and angle to control its position
  * in local coordinates (canvas coordinates)
@@ -450,6 +667,7 @@ void entity::Photo::updateVertices()
                                         m_width * std::sin(m_angle) + m_height * std::cos(m_angle), 0);
     (*verts)[3] = m_center +  osg::Vec3(-m_width * std::cos(m_angle) - m_height * std::sin(m_angle),
                                         -m_width * std::sin(m_angle) + m_height * std::cos(m_angle), 0);
+    verts->dirty();
     this->dirtyDisplayList();
     this->dirtyBound();
 }
@@ -464,4 +682,5 @@ REGISTER_OBJECT_WRAPPER(Photo_Wrapper
     ADD_FLOAT_SERIALIZER(Width, 0.f);
     ADD_FLOAT_SERIALIZER(Height, 0.f);
     ADD_FLOAT_SERIALIZER(Angle, 0.f);
+    ADD_UINT_SERIALIZER(Id, 0);
 }
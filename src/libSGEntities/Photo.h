@@ -11,13 +11,23 @@
 #include <osg/Geometry>
 #include <osg/ref_ptr>
 #include <osg/Texture2D>
+#include <osg/Image>
 #include <osgDB/ObjectWrapper>
+
+#include <string>
+#include <vector>
+#include <map>
 #include <SVMData.h>
 
+#include "PhotoImage.h"
+
 namespace entity {
 
 /*! \class Photo
  * \brief Quad that uses texture to represent a 2D photo in 3D space.
+ *
+ * The photo texture and its image pyramid are kept by entity::PhotoImage. Photos with identical image content
+ * share a single entity::PhotoImage, see ImageCache.
 */
 class Photo: public entity::Entity2D{
 public:
@@ -44,9 +54,48 @@ public:
     void setAngle(float a);
     float getAngle() const;
 
+    /*! A method to set the photo id, it is done by entity::UserScene when the photo is added to the scene. */
+    void setId(unsigned int id);
+    /*! \return the id of the photo which is unique within the scene, or 0 if the photo was never added to
+     * the scene, see entity::SceneState. */
+    unsigned int getId() const;
+
     void loadImage(const std::string& fname);
     osg::StateAttribute* getTextureAsAttribute() const;
 
+    /*! A method to (re-)attach image data to the photo texture directly, see entity::PhotoImage::setImage().
+     * The photo geometry is not changed. */
+    void setImage(osg::Image* image);
+
+    /*! \return image data attached to the photo texture, see entity::PhotoImage::getImage(). */
+    osg::Image* getImage() const;
+
+    /*! \return image data of the photo: the texture and the image pyramid. It may be shared with other photos
+     * of the same image content, see isImageShared(). */
+    entity::PhotoImage* getPhotoImage() const;
+
+    /*! A method to replace image data of the photo, e.g., to share it with another photo of the same image
+     * content, see ImageCache. The new texture is also attached to the photo state set. */
+    void setPhotoImage(entity::PhotoImage* image);
+
+    /*! \return true if the image data is used by other photos as well. */
+    bool isImageShared() const;
+
+    /*! A method to make the image data private to this photo, i.e., copy-on-write: if the data is shared, it is
+     * replaced by a deep copy. Must be called before any modification of the photo image content.
+     * \return the private image data. */
+    entity::PhotoImage* detachImage();
+
+    /*! A method to create the photo quad geometry without image data, e.g., as a placeholder while the image
+     * is being decoded by ImageDecoder.
+     * \param aspectRatio is the quad's width to height ratio. */
+    void initializeQuad(float aspectRatio);
+
+    /*! A method to re-shape a photo created by initializeQuad() once its image is decoded asynchronously and
+     * attached by setPhotoImage(). The quad is shrunk so that it matches the image aspect ratio within its
+     * current box. */
+    void setDecodedImage(osg::Image* image);
+
     /*! A method to change location of the Photo center.
      * \param u is a new local U coordinate,
      * \param v is a new local V coordinate. */
@@ -106,15 +155,53 @@ public:
     /*! \return type of entity::Entity2D. */
     cher::ENTITY_TYPE getEntityType() const;
 
+    /*! \return local point of the photo quad which is mapped to the given normalized image coordinates, e.g.,
+     * (0,0) is the bottom left corner of the image, (1,1) is the top right corner. Flips are taken into account. */
+    osg::Vec3f getPoint(float u, float v) const;
+
+    /*! A method to stop drawing the tiles over the photo texture, see addTile(). The tile quads are kept, so that
+     * the tiles drawn again by the next frame reuse them. */
+    void clearTiles();
+
+    /*! A method to stop drawing the tiles and to release their quads, e.g., when the photo is out of the scene. */
+    void releaseTiles();
+
+    /*! A method to draw a tile of a tiled pyramid level over the photo texture within the current frame, see
+     * entity::PhotoImage::requestTile(). The tile is a sub-quad which covers the given part of the image. The quads
+     * are kept per tile of a single level, and they are built anew only when the level or the photo quad changes.
+     * \param texture is the tile texture,
+     * \param level is the pyramid level, \param x is the tile column, \param y is the tile row,
+     * \param u0 is the left side, \param v0 is the bottom side, \param u1 is the right side, \param v1 is the top
+     * side of the tile, in normalized image coordinates. */
+    void addTile(osg::Texture2D* texture, unsigned int level, int x, int y, float u0, float v0, float u1, float v1);
+
+    /*! \return number of the tiles drawn over the photo texture. */
+    unsigned int getNumTilesDrawn() const;
+
+    /*! \return number of the tile quads kept by the photo, see addTile(). */
+    unsigned int getNumTileQuads() const;
+
+    /*! A method to draw the tiles, if any, and the photo quad with its texture which fills in the parts of the
+     * photo not covered by the tiles. */
+    virtual void drawImplementation(osg::RenderInfo& renderInfo) const;
+
 protected:
     void updateVertices();
 
 private:
-    osg::ref_ptr<osg::Texture2D> m_texture; /*!< Photo texture container. */
+    osg::ref_ptr<entity::PhotoImage> m_image; /*!< Photo texture and image pyramid, possibly shared. */
     osg::Vec3f m_center; /*!< local center. */
     float m_width, m_height; /*!< half-width and half-height of the photo quad. */
     float m_angle;
     osg::Vec4f m_color;
+    unsigned int m_id; /*!< unique id within the scene, see entity::UserScene::addEntity(). */
+    std::vector< osg::ref_ptr<osg::Geometry> > m_tiles; /*!< tile quads drawn over the photo texture. */
+    std::vector< osg::ref_ptr<osg::Texture2D> > m_tileTextures;
+    std::map< std::pair<int,int>, osg::ref_ptr<osg::Geometry> > m_tileQuads; /*!< quads of m_tileLevel by tile. */
+    int m_tileLevel; /*!< level of the kept tile quads, or -1 if none. */
+    const osg::Array* m_tileVertices; /*!< photo arrays the tile quads were built from, and their revisions. */
+    const osg::Array* m_tileTexcoords;
+    unsigned int m_tileVertexRevision, m_tileTexcoordRevision;
 };
 }
 
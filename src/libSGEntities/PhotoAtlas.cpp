@@ -0,0 +1,518 @@
+#include "PhotoAtlas.h"
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+
+#include <QDebug>
+
+#include <osg/BlendFunc>
+#include <osg/StateSet>
+#include <osg/ValueObject>
+
+#include "Settings.h"
+#include "Photo.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+namespace {
+
+/* Excludes the batched photos from rendering, they are drawn by the batch of their canvas. */
+class SkipCullCallback : public osg::Drawable::CullCallback
+{
+public:
+    bool cull(osg::NodeVisitor*, osg::Drawable*, osg::RenderInfo*) const
+    {
+        return true;
+    }
+};
+
+osg::Drawable::CullCallback* getSkipCallback()
+{
+    static osg::ref_ptr<osg::Drawable::CullCallback> callback = new SkipCullCallback;
+    return callback.get();
+}
+
+/* Copies the image into the page rectangle, which is one pixel larger on each side; the gutter repeats the
+ * edge pixels. */
+void copyImage(const osg::Image* source, osg::Image* page, int left, int bottom)
+{
+    for (int y=-1; y<=source->t(); ++y){
+        int t = std::min(std::max(y, 0), source->t()-1);
+        for (int x=-1; x<=source->s(); ++x){
+            int s = std::min(std::max(x, 0), source->s()-1);
+            osg::Vec4 color = source->getColor(s, t);
+            unsigned char* pixel = page->data(left+1+x, bottom+1+y);
+            for (int c=0; c<4; ++c)
+                pixel[c] = static_cast<unsigned char>(std::min(std::max(color[c], 0.f), 1.f) * 255.f + 0.5f);
+        }
+    }
+}
+
+} // namespace
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+PhotoAtlas::PhotoAtlas()
+    : m_frame(0)
+    , m_enabled(true)
+    , m_detached(false)
+{
+}
+
+void PhotoAtlas::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+    if (enabled) return;
+    this->detach();
+    m_pages.clear();
+    m_slots.clear();
+    m_statistics = Statistics();
+}
+
+bool PhotoAtlas::isEnabled() const
+{
+    return m_enabled;
+}
+
+bool PhotoAtlas::isCandidate(const entity::PhotoImage *image)
+{
+    if (!image || image->getNumLevels() == 0) return false;
+    int width = 0, height = 0;
+    image->getLevelSize(0, width, height);
+    const osg::Image* level = image->getLevelImage(0);
+    return width > 0 && height > 0 && width <= cher::PHOTO_ATLAS_MAX && height <= cher::PHOTO_ATLAS_MAX
+            && !(level && level->isCompressed());
+}
+
+bool PhotoAtlas::isPacked(const entity::PhotoImage *image) const
+{
+    std::map<const entity::PhotoImage*, Slot>::const_iterator it = m_slots.find(image);
+    return it != m_slots.end() && it->second.image.get() == image;
+}
+
+bool PhotoAtlas::update(entity::UserScene *scene)
+{
+    if (!scene || !m_enabled) return false;
+    m_frame++;
+    m_detached = false;
+
+    /* the canvases which photos have changed since the previous update */
+    std::vector<Batch*> changed;
+    for (int i=0; i<scene->getNumCanvases(); ++i){
+        entity::Canvas* canvas = scene->getCanvas(i);
+        if (!canvas) continue;
+        Batch& batch = m_batches[canvas];
+        if (batch.canvas.get() != canvas){
+            /* a new canvas, or a new one at the address of a deleted one */
+            batch = Batch();
+            batch.canvas = canvas;
+        }
+        batch.frame = m_frame;
+        if (this->updateRecords(batch, canvas)) changed.push_back(&batch);
+    }
+
+    /* forget the batches of the canvases which are no longer within the scene */
+    bool removed = false;
+    for (std::map<const entity::Canvas*, Batch>::iterator it = m_batches.begin(); it != m_batches.end(); ){
+        if (it->second.frame == m_frame){
+            ++it;
+            continue;
+        }
+        this->releaseBatch(it->second);
+        m_batches.erase(it++);
+        removed = true;
+    }
+    if (changed.empty() && !removed) return false;
+
+    bool repacked = false;
+    bool modified = this->updatePages(scene, repacked);
+    if (repacked){
+        changed.clear();
+        for (std::map<const entity::Canvas*, Batch>::iterator it = m_batches.begin(); it != m_batches.end(); ++it)
+            changed.push_back(&it->second);
+    }
+    for (size_t b=0; b<changed.size(); ++b)
+        this->updateBatch(*changed[b]);
+    this->updateStatistics(scene);
+    return modified;
+}
+
+void PhotoAtlas::detach()
+{
+    for (std::map<const entity::Canvas*, Batch>::iterator it = m_batches.begin(); it != m_batches.end(); ++it)
+        this->releaseBatch(it->second);
+    m_batches.clear();
+    m_detached = true;
+}
+
+bool PhotoAtlas::isDetached() const
+{
+    return m_enabled && m_detached;
+}
+
+const PhotoAtlas::Statistics &PhotoAtlas::getStatistics() const
+{
+    return m_statistics;
+}
+
+unsigned int PhotoAtlas::getNumPages() const
+{
+    return m_pages.size();
+}
+
+osg::Texture2D *PhotoAtlas::getPageTexture(unsigned int page) const
+{
+    if (page >= m_pages.size()) return 0;
+    return m_pages[page].texture.get();
+}
+
+osg::Geode *PhotoAtlas::getBatch(const entity::Canvas *canvas) const
+{
+    std::map<const entity::Canvas*, Batch>::const_iterator it = m_batches.find(canvas);
+    if (it == m_batches.end() || it->second.canvas.get() != canvas) return 0;
+    return it->second.geode.get();
+}
+
+unsigned int PhotoAtlas::addPage()
+{
+    Page page;
+    page.image = new osg::Image;
+    page.image->allocateImage(cher::PHOTO_ATLAS_SIZE, cher::PHOTO_ATLAS_SIZE, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+    page.image->setInternalTextureFormat(GL_RGBA);
+    std::memset(page.image->data(), 0, page.image->getTotalSizeInBytes());
+    page.image->setDataVariance(osg::Object::DYNAMIC);
+
+    /* no mipmaps, so that the images do not bleed into each other beyond the gutter */
+    page.texture = new osg::Texture2D(page.image.get());
+    page.texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR);
+    page.texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+    page.texture->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+    page.texture->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+    page.texture->setDataVariance(osg::Object::DYNAMIC);
+    page.usedArea = 0;
+    m_pages.push_back(page);
+    return m_pages.size()-1;
+}
+
+bool PhotoAtlas::allocate(PhotoAtlas::Page &page, int width, int height, PhotoAtlas::Rect &rect)
+{
+    bool found = false;
+
+    /* a released slot, otherwise a shelf of about the same height, otherwise a new shelf */
+    for (size_t i=0; i<page.free.size() && !found; ++i){
+        if (page.free[i].w < width || page.free[i].h < height) continue;
+        rect = Rect(page.free[i].x, page.free[i].y, width, height);
+        page.free.erase(page.free.begin() + i);
+        found = true;
+    }
+    for (int pass=0; pass<2 && !found; ++pass){
+        for (size_t i=0; i<page.shelves.size() && !found; ++i){
+            Shelf& shelf = page.shelves[i];
+            if (height > shelf.height || (pass == 0 && height*2 < shelf.height)) continue;
+            if (shelf.width + width > cher::PHOTO_ATLAS_SIZE) continue;
+            rect = Rect(shelf.width, shelf.y, width, height);
+            shelf.width += width;
+            found = true;
+        }
+    }
+    if (!found){
+        int top = page.shelves.empty()? 0 : page.shelves.back().y + page.shelves.back().height;
+        if (top + height > cher::PHOTO_ATLAS_SIZE || width > cher::PHOTO_ATLAS_SIZE) return false;
+        Shelf shelf;
+        shelf.y = top;
+        shelf.height = height;
+        shelf.width = width;
+        page.shelves.push_back(shelf);
+        rect = Rect(0, top, width, height);
+    }
+    page.usedArea += width * height;
+    return true;
+}
+
+void PhotoAtlas::place(int width, int height, PhotoAtlas::Slot &slot)
+{
+    for (unsigned int p=0; p<m_pages.size(); ++p){
+        if (this->allocate(m_pages[p], width, height, slot.rect)){
+            slot.page = p;
+            return;
+        }
+    }
+    slot.page = this->addPage();
+    if (!this->allocate(m_pages[slot.page], width, height, slot.rect))
+        qWarning("PhotoAtlas: image does not fit into an empty page");
+}
+
+void PhotoAtlas::repack()
+{
+    std::vector<Page> pages;
+    pages.swap(m_pages);
+
+    /* the tallest slots first, the pixels are copied from the previous pages */
+    std::vector<Slot*> slots;
+    for (std::map<const entity::PhotoImage*, Slot>::iterator it = m_slots.begin(); it != m_slots.end(); ++it)
+        slots.push_back(&it->second);
+    std::stable_sort(slots.begin(), slots.end(), PhotoAtlas::isTaller);
+    for (size_t i=0; i<slots.size(); ++i){
+        Rect from = slots[i]->rect;
+        const osg::Image* source = pages[slots[i]->page].image.get();
+        this->place(from.w, from.h, *slots[i]);
+        osg::Image* target = m_pages[slots[i]->page].image.get();
+        for (int row=0; row<from.h; ++row)
+            std::memcpy(target->data(slots[i]->rect.x, slots[i]->rect.y + row), source->data(from.x, from.y + row), from.w * 4);
+    }
+    for (size_t p=0; p<m_pages.size(); ++p)
+        m_pages[p].image->dirty();
+
+    /* the batches refer to the previous page textures */
+    for (std::map<const entity::Canvas*, Batch>::iterator it = m_batches.begin(); it != m_batches.end(); ++it){
+        if (it->second.geode.get())
+            it->second.geode->removeDrawables(0, it->second.geode->getNumDrawables());
+    }
+}
+
+bool PhotoAtlas::isTaller(const PhotoAtlas::Slot *a, const PhotoAtlas::Slot *b)
+{
+    return a->rect.h > b->rect.h;
+}
+
+bool PhotoAtlas::Record::operator==(const PhotoAtlas::Record &other) const
+{
+    return photo == other.photo && image == other.image && vertices == other.vertices && texcoords == other.texcoords
+            && colors == other.colors && vertexRevision == other.vertexRevision
+            && texcoordRevision == other.texcoordRevision && colorRevision == other.colorRevision
+            && packable == other.packable;
+}
+
+PhotoAtlas::Record PhotoAtlas::getRecord(const entity::Photo *photo)
+{
+    Record record;
+    if (!photo) return record;
+    record.photo = photo;
+    record.image = photo->getPhotoImage();
+    record.vertices = photo->getVertexArray();
+    record.texcoords = photo->getTexCoordArray(0);
+    record.colors = photo->getColorArray();
+    record.vertexRevision = record.vertices? record.vertices->getModifiedCount() : 0;
+    record.texcoordRevision = record.texcoords? record.texcoords->getModifiedCount() : 0;
+    record.colorRevision = record.colors? record.colors->getModifiedCount() : 0;
+    record.packable = isCandidate(record.image) && record.image->getLevelImage(0);
+    return record;
+}
+
+bool PhotoAtlas::updateRecords(PhotoAtlas::Batch &batch, const entity::Canvas *canvas)
+{
+    bool changed = batch.visible != canvas->getVisibilityAll() || batch.records.size() != canvas->getNumPhotos();
+    batch.visible = canvas->getVisibilityAll();
+    batch.records.resize(canvas->getNumPhotos());
+    for (unsigned int j=0; j<canvas->getNumPhotos(); ++j){
+        Record record = getRecord(canvas->getPhoto(j));
+        if (record == batch.records[j]) continue;
+        batch.records[j] = record;
+        changed = true;
+    }
+    return changed;
+}
+
+bool PhotoAtlas::updatePages(entity::UserScene *scene, bool &repacked)
+{
+    bool modified = false;
+
+    /* release the slots of the images which are no longer used by any photo */
+    std::set<const entity::PhotoImage*> used;
+    for (int i=0; i<scene->getNumCanvases(); ++i){
+        const entity::Canvas* canvas = scene->getCanvas(i);
+        for (unsigned int j=0; canvas && j<canvas->getNumPhotos(); ++j){
+            if (canvas->getPhoto(j)) used.insert(canvas->getPhoto(j)->getPhotoImage());
+        }
+    }
+    for (std::map<const entity::PhotoImage*, Slot>::iterator it = m_slots.begin(); it != m_slots.end(); ){
+        if (it->second.image.valid() && used.find(it->first) != used.end() && isCandidate(it->first)){
+            ++it;
+            continue;
+        }
+        Page& page = m_pages[it->second.page];
+        page.free.push_back(it->second.rect);
+        page.usedArea -= it->second.rect.w * it->second.rect.h;
+        m_slots.erase(it++);
+        modified = true;
+    }
+
+    /* compact the pages when at least one of them could be saved */
+    unsigned int usedArea = 0;
+    for (size_t p=0; p<m_pages.size(); ++p)
+        usedArea += m_pages[p].usedArea;
+    if (m_slots.empty() && !m_pages.empty()){
+        m_pages.clear();
+        modified = true;
+    }
+    else if (m_pages.size() > 1 && usedArea <= (m_pages.size()-1) * cher::PHOTO_ATLAS_SIZE * cher::PHOTO_ATLAS_SIZE / 2){
+        this->repack();
+        repacked = true;
+        modified = true;
+    }
+
+    /* pack the new images, the ones which full resolution is not resident yet are drawn by their photos */
+    std::set<unsigned int> dirty;
+    for (std::set<const entity::PhotoImage*>::const_iterator it = used.begin(); it != used.end(); ++it){
+        const entity::PhotoImage* image = *it;
+        if (this->isPacked(image) || !isCandidate(image) || !image->getLevelImage(0)) continue;
+        const osg::Image* level = image->getLevelImage(0);
+        Slot slot;
+        slot.image = const_cast<entity::PhotoImage*>(image);
+        this->place(level->s()+2, level->t()+2, slot);
+        copyImage(level, m_pages[slot.page].image.get(), slot.rect.x, slot.rect.y);
+        m_slots[image] = slot;
+        dirty.insert(slot.page);
+    }
+    for (std::set<unsigned int>::const_iterator it = dirty.begin(); it != dirty.end(); ++it)
+        m_pages[*it].image->dirty();
+    return modified || !dirty.empty();
+}
+
+void PhotoAtlas::updateBatch(PhotoAtlas::Batch &batch)
+{
+    osg::ref_ptr<entity::Canvas> canvas;
+    if (!batch.canvas.lock(canvas)) return;
+
+    /* a quad per packed photo, grouped by atlas pages */
+    std::map< unsigned int, osg::ref_ptr<osg::Vec3Array> > vertices;
+    std::map< unsigned int, osg::ref_ptr<osg::Vec2Array> > texcoords;
+    std::map< unsigned int, osg::ref_ptr<osg::Vec4Array> > colors;
+    std::set<const entity::Photo*> batched;
+    for (unsigned int j=0; j<canvas->getNumPhotos(); ++j){
+        const entity::Photo* photo = canvas->getPhoto(j);
+        if (!photo || !this->isPacked(photo->getPhotoImage())) continue;
+        const osg::Vec3Array* verts = dynamic_cast<const osg::Vec3Array*>(photo->getVertexArray());
+        const osg::Vec2Array* coords = dynamic_cast<const osg::Vec2Array*>(photo->getTexCoordArray(0));
+        if (!verts || !coords || verts->size() < 4 || coords->size() < 4) continue;
+        const Slot& slot = m_slots[photo->getPhotoImage()];
+        if (!vertices[slot.page].get()){
+            vertices[slot.page] = new osg::Vec3Array;
+            texcoords[slot.page] = new osg::Vec2Array;
+            colors[slot.page] = new osg::Vec4Array;
+        }
+
+        /* the photo texture coordinates span the unit square, the flips permute them */
+        float extent = 0.f;
+        for (unsigned int k=0; k<4; ++k)
+            extent = std::max(extent, std::max((*coords)[k].x(), (*coords)[k].y()));
+        if (extent <= 0.f) extent = 1.f;
+        const osg::Vec4Array* photoColors = dynamic_cast<const osg::Vec4Array*>(photo->getColorArray());
+        osg::Vec4f color = photoColors && !photoColors->empty()? (*photoColors)[0] : photo->getColor();
+        for (unsigned int k=0; k<4; ++k){
+            float u = (slot.rect.x + 1 + (*coords)[k].x() / extent * (slot.rect.w-2)) / cher::PHOTO_ATLAS_SIZE;
+            float v = (slot.rect.y + 1 + (*coords)[k].y() / extent * (slot.rect.h-2)) / cher::PHOTO_ATLAS_SIZE;
+            vertices[slot.page]->push_back((*verts)[k]);
+            texcoords[slot.page]->push_back(osg::Vec2(u, v));
+            colors[slot.page]->push_back(color);
+        }
+        batched.insert(photo);
+    }
+    if (batched.empty()){
+        this->releaseBatch(batch);
+        return;
+    }
+
+    if (!batch.geode.get()){
+        osg::ref_ptr<osg::Geode> geode = new osg::Geode;
+        geode->setName("PhotoAtlasBatch");
+        geode->setNodeMask(cher::MASK_PHOTOATLAS_IN);
+        osg::StateSet* stateset = geode->getOrCreateStateSet();
+        stateset->setMode(GL_BLEND, osg::StateAttribute::ON);
+        stateset->setRenderingHint(osg::StateSet::TRANSPARENT_BIN);
+        stateset->setAttributeAndModes(new osg::BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+        if (!canvas->attachPhotoBatch(geode.get())){
+            qWarning("PhotoAtlas: could not attach batch to the canvas");
+            return;
+        }
+        batch.geode = geode;
+    }
+    osg::Geode* geode = batch.geode.get();
+
+    /* a geometry per page, the geometries of the pages which are still in use are kept */
+    std::map< unsigned int, osg::ref_ptr<osg::Geometry> > geometries;
+    for (unsigned int d=0; d<geode->getNumDrawables(); ++d){
+        osg::Geometry* geometry = geode->getDrawable(d)->asGeometry();
+        unsigned int page = 0;
+        if (geometry && geometry->getUserValue("AtlasPage", page)) geometries[page] = geometry;
+    }
+    for (std::map< unsigned int, osg::ref_ptr<osg::Geometry> >::const_iterator it = geometries.begin(); it != geometries.end(); ++it){
+        if (vertices.find(it->first) == vertices.end()) geode->removeDrawable(it->second.get());
+    }
+    for (std::map< unsigned int, osg::ref_ptr<osg::Vec3Array> >::const_iterator it = vertices.begin(); it != vertices.end(); ++it){
+        unsigned int page = it->first;
+        osg::ref_ptr<osg::Geometry> geometry = geometries[page];
+        if (!geometry.get()){
+            geometry = new osg::Geometry;
+            geometry->setUserValue("AtlasPage", page);
+            geometry->setUseDisplayList(false);
+            geometry->setUseVertexBufferObjects(true);
+            geometry->getOrCreateStateSet()->setTextureAttributeAndModes(0, m_pages[page].texture.get());
+            osg::Vec3Array* normals = new osg::Vec3Array;
+            normals->push_back(cher::NORMAL);
+            geometry->setNormalArray(normals, osg::Array::BIND_OVERALL);
+            geode->addDrawable(geometry.get());
+        }
+        geometry->setVertexArray(it->second.get());
+        geometry->setTexCoordArray(0, texcoords[page].get());
+        geometry->setColorArray(colors[page].get(), osg::Array::BIND_PER_VERTEX);
+        geometry->removePrimitiveSet(0, geometry->getNumPrimitiveSets());
+        geometry->addPrimitiveSet(new osg::DrawArrays(GL_QUADS, 0, it->second->size()));
+        geometry->dirtyBound();
+    }
+
+    /* the batched photos are not drawn on their own */
+    for (unsigned int j=0; j<canvas->getNumPhotos(); ++j){
+        entity::Photo* photo = canvas->getPhoto(j);
+        if (!photo) continue;
+        if (batched.find(photo) != batched.end())
+            photo->setCullCallback(getSkipCallback());
+        else if (photo->getCullCallback() == getSkipCallback())
+            photo->setCullCallback(0);
+    }
+}
+
+void PhotoAtlas::updateStatistics(entity::UserScene *scene)
+{
+    Statistics statistics;
+    std::set<const osg::Texture*> textures, texturesUnbatched;
+    for (int i=0; i<scene->getNumCanvases(); ++i){
+        const entity::Canvas* canvas = scene->getCanvas(i);
+        if (!canvas || !canvas->getVisibilityAll()) continue;
+        std::set<unsigned int> pages;
+        for (unsigned int j=0; j<canvas->getNumPhotos(); ++j){
+            const entity::Photo* photo = canvas->getPhoto(j);
+            if (!photo) continue;
+            statistics.numDrawCallsUnbatched++;
+            texturesUnbatched.insert(photo->getTexture());
+            if (this->isPacked(photo->getPhotoImage())){
+                pages.insert(m_slots[photo->getPhotoImage()].page);
+                statistics.numPhotos++;
+                continue;
+            }
+            statistics.numDrawCalls++;
+            textures.insert(photo->getTexture());
+        }
+        statistics.numDrawCalls += pages.size();
+        for (std::set<unsigned int>::const_iterator it = pages.begin(); it != pages.end(); ++it)
+            textures.insert(m_pages[*it].texture.get());
+    }
+    statistics.numPages = m_pages.size();
+    statistics.numImages = m_slots.size();
+    statistics.numTextureBinds = textures.size();
+    statistics.numTextureBindsUnbatched = texturesUnbatched.size();
+    m_statistics = statistics;
+}
+
+void PhotoAtlas::releaseBatch(PhotoAtlas::Batch &batch)
+{
+    osg::ref_ptr<entity::Canvas> canvas;
+    osg::ref_ptr<osg::Geode> geode = batch.geode;
+    batch.geode = 0;
+    if (!batch.canvas.lock(canvas)) return;
+    if (geode.get()) canvas->detachPhotoBatch(geode.get());
+    for (unsigned int j=0; j<canvas->getNumPhotos(); ++j){
+        entity::Photo* photo = canvas->getPhoto(j);
+        if (photo && photo->getCullCallback() == getSkipCallback())
+            photo->setCullCallback(0);
+    }
+}
@@ -0,0 +1,183 @@
+#ifndef PHOTOATLAS_H
+#define PHOTOATLAS_H
+
+#include <vector>
+#include <map>
+
+#include <osg/ref_ptr>
+#include <osg/observer_ptr>
+#include <osg/Image>
+#include <osg/Texture2D>
+#include <osg/Geode>
+#include <osg/Geometry>
+
+#include "UserScene.h"
+#include "Canvas.h"
+#include "PhotoImage.h"
+
+/*! \class PhotoAtlas
+ * \brief Packs the images of small photos into shared atlas textures, so that the small photos of a canvas are
+ * drawn by a single draw call per atlas page with a single texture bind.
+ *
+ * An image is packed when its full resolution level is at most cher::PHOTO_ATLAS_MAX pixels along either side
+ * and the level is resident. Each atlas page is a cher::PHOTO_ATLAS_SIZE texture packed by shelves; every image
+ * is surrounded by a one pixel gutter of its edge pixels, so that the linear filtering does not bleed between the
+ * images. The packing is incremental: a new image takes a freed slot or the next place on a shelf, and a deleted
+ * image frees its slot. The pages are compacted only when at least one page could be saved.
+ *
+ * For each canvas with packed photos, a batch geode with one quad geometry per atlas page is attached to the
+ * canvas group data; its texture coordinates are remapped into the atlas slots, and its colors follow the photo
+ * colors. The photos themselves stay within the scene graph, e.g., for selection and serialization, but they are
+ * skipped by the cull traversal. The batches are never written, see detach().
+ *
+ * Each update only compares the photos of every canvas with the records of the previous update, i.e., the photo,
+ * image and array pointers and the array modification counts. The packing, the batch of a canvas and the
+ * statistics are updated only when a photo of the canvas was added, removed, moved, flipped, recolored or its full
+ * resolution was paged in.
+*/
+class PhotoAtlas
+{
+public:
+    /*! Draw statistics of the visible photos as of the last update. */
+    struct Statistics{
+        Statistics() : numPages(0), numImages(0), numPhotos(0), numDrawCalls(0), numTextureBinds(0)
+          , numDrawCallsUnbatched(0), numTextureBindsUnbatched(0) {}
+        unsigned int numPages; /*!< number of atlas pages. */
+        unsigned int numImages; /*!< number of images packed into the pages. */
+        unsigned int numPhotos; /*!< number of photos drawn by the batches. */
+        unsigned int numDrawCalls; /*!< photo draw calls per frame. */
+        unsigned int numTextureBinds; /*!< photo texture binds per frame. */
+        unsigned int numDrawCallsUnbatched; /*!< photo draw calls per frame if there were no atlas. */
+        unsigned int numTextureBindsUnbatched; /*!< photo texture binds per frame if there were no atlas. */
+    };
+
+    /*! Constructor, the atlas is enabled. */
+    PhotoAtlas();
+
+    /*! A method to enable or disable the atlas. When it is disabled, all the pages and batches are released and
+     * the photos are drawn one by one. */
+    void setEnabled(bool enabled);
+
+    /*! \return true if the atlas is enabled. */
+    bool isEnabled() const;
+
+    /*! \return true if the image is small enough to be packed into the atlas. */
+    static bool isCandidate(const entity::PhotoImage* image);
+
+    /*! \return true if the image is packed into the atlas. */
+    bool isPacked(const entity::PhotoImage* image) const;
+
+    /*! A method to pack the images of the newly added photos, to release the slots of the deleted ones, and to
+     * update the batches of all the canvases. It is called before each frame, see RootScene::updatePhotoLevels().
+     * \return true if any atlas page was modified. */
+    bool update(entity::UserScene* scene);
+
+    /*! A method to remove the batches from their canvases and to let the photos draw themselves, e.g., before
+     * the scene is written to file. The pages are kept, so the batches are restored by the next update(). */
+    void detach();
+
+    /*! \return true if the enabled atlas was detached and its batches are not restored by update() yet. */
+    bool isDetached() const;
+
+    /*! \return draw statistics as of the last update. */
+    const Statistics& getStatistics() const;
+
+    /*! \return number of atlas pages. */
+    unsigned int getNumPages() const;
+
+    /*! \return texture of the atlas page. */
+    osg::Texture2D* getPageTexture(unsigned int page) const;
+
+    /*! \return the batch geode of the canvas, or NULL if the canvas has no packed photos. */
+    osg::Geode* getBatch(const entity::Canvas* canvas) const;
+
+protected:
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    struct Rect{
+        Rect(int x_=0, int y_=0, int w_=0, int h_=0) : x(x_), y(y_), w(w_), h(h_) {}
+        int x, y, w, h;
+    };
+    struct Shelf{
+        int y, height, width;
+    };
+    struct Page{
+        osg::ref_ptr<osg::Image> image;
+        osg::ref_ptr<osg::Texture2D> texture;
+        std::vector<Shelf> shelves;
+        std::vector<Rect> free;
+        unsigned int usedArea;
+    };
+    struct Slot{
+        osg::observer_ptr<entity::PhotoImage> image;
+        unsigned int page;
+        Rect rect; /*!< the slot including its gutter. */
+    };
+    struct Record{
+        Record() : photo(0), image(0), vertices(0), texcoords(0), colors(0)
+          , vertexRevision(0), texcoordRevision(0), colorRevision(0), packable(false) {}
+        bool operator==(const Record& other) const;
+        const entity::Photo* photo;
+        const entity::PhotoImage* image;
+        const osg::Array* vertices;
+        const osg::Array* texcoords;
+        const osg::Array* colors;
+        unsigned int vertexRevision, texcoordRevision, colorRevision;
+        bool packable; /*!< the image is a candidate and its full resolution is resident. */
+    };
+    struct Batch{
+        Batch() : visible(false), frame(0) {}
+        osg::observer_ptr<entity::Canvas> canvas;
+        osg::ref_ptr<osg::Geode> geode; /*!< NULL while the canvas has no packed photos. */
+        std::vector<Record> records; /*!< the canvas photos as of the last update. */
+        bool visible;
+        unsigned int frame; /*!< the last update the canvas was found within the scene. */
+    };
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+    /*! \return index of the new page. */
+    unsigned int addPage();
+
+    /*! A method to find a place for the rectangle within the page. \return true if the place was found. */
+    bool allocate(Page& page, int width, int height, Rect& rect);
+
+    /*! A method to place the slot of the given size within any page, a new page is added if necessary. */
+    void place(int width, int height, Slot& slot);
+
+    /*! A method to pack all the slots anew, e.g., when too many slots were released. */
+    void repack();
+
+    /*! \return true if the first slot is taller than the second one, the packing order of repack(). */
+    static bool isTaller(const Slot* a, const Slot* b);
+
+    /*! \return the record of the photo to compare with the previous update. */
+    static Record getRecord(const entity::Photo* photo);
+
+    /*! A method to compare the photos of the canvas with the records of the batch and to replace the records.
+     * \return true if any photo or the canvas visibility has changed. */
+    bool updateRecords(Batch& batch, const entity::Canvas* canvas);
+
+    /*! A method to release the slots of the images which are no longer used, to compact the pages and to pack the
+     * new images. \param repacked is set to true if all the slots were packed anew, see repack().
+     * \return true if any atlas page was modified. */
+    bool updatePages(entity::UserScene* scene, bool& repacked);
+
+    /*! A method to rebuild the batch geode of the canvas from its packed photos. */
+    void updateBatch(Batch& batch);
+
+    /*! A method to count the draw calls and texture binds of the visible photos. */
+    void updateStatistics(entity::UserScene* scene);
+
+    /*! A method to release the batch of the canvas and let its photos draw themselves. */
+    void releaseBatch(Batch& batch);
+
+private:
+    std::vector<Page> m_pages;
+    std::map<const entity::PhotoImage*, Slot> m_slots;
+    std::map<const entity::Canvas*, Batch> m_batches;
+    Statistics m_statistics;
+    unsigned int m_frame;
+    bool m_enabled;
+    bool m_detached;
+};
+
+#endif // PHOTOATLAS_H
@@ -0,0 +1,376 @@
+#include "PhotoImage.h"
+
+#include <algorithm>
+
+#include <QDebug>
+#include <QtGlobal>
+
+#include <osg/DisplaySettings>
+
+#include "Settings.h"
+#include "ImageCache.h"
+#include "PhotoTiler.h"
+
+entity::PhotoImage::PhotoImage()
+    : osg::Referenced()
+    , m_texture(new osg::Texture2D)
+    , m_level(0)
+    , m_levelAttached(-1)
+    , m_levelPending(-1)
+    , m_frame(0)
+{
+}
+
+entity::PhotoImage *entity::PhotoImage::clone() const
+{
+    osg::ref_ptr<entity::PhotoImage> copy = new entity::PhotoImage;
+    copy->m_texture = new osg::Texture2D(*m_texture, osg::CopyOp::SHALLOW_COPY);
+    copy->m_texture->setImage(0);
+    copy->m_levels.resize(m_levels.size());
+    for (size_t i=0; i<m_levels.size(); ++i){
+        if (m_levels[i].get())
+            copy->m_levels[i] = new osg::Image(*m_levels[i], osg::CopyOp::DEEP_COPY_ALL);
+    }
+    copy->setLevel(m_level);
+    /* until the copy is modified, its non-resident levels are the same as the stored ones */
+    copy->setStoreKey(m_storeKey);
+    return copy.release();
+}
+
+void entity::PhotoImage::setTexture(osg::Texture2D *texture)
+{
+    m_texture = texture;
+    m_levelAttached = -1;
+}
+
+osg::Texture2D *entity::PhotoImage::getTexture() const
+{
+    return m_texture.get();
+}
+
+void entity::PhotoImage::setImage(osg::Image *image)
+{
+    if (!m_texture.get()) return;
+    m_texture->setImage(image);
+    m_levelAttached = -1;
+}
+
+osg::Image *entity::PhotoImage::getImage() const
+{
+    if (!m_texture.get()) return 0;
+    return m_texture->getImage();
+}
+
+void entity::PhotoImage::createPyramid(osg::Image *image, std::vector<osg::ref_ptr<osg::Image> > &levels)
+{
+    levels.clear();
+    if (!image) return;
+    ImageCache::computeHash(image);
+    levels.push_back(image);
+
+    /* compressed images cannot be re-scaled on the host */
+    if (image->isCompressed()) return;
+
+    /* the deep copies keep the content hash of the full resolution image */
+    osg::ref_ptr<osg::Image> level = image;
+    while (std::max(level->s(), level->t()) > cher::PHOTO_PYRAMID_MIN){
+        osg::ref_ptr<osg::Image> next = new osg::Image(*level, osg::CopyOp::DEEP_COPY_ALL);
+        next->scaleImage(std::max(1, level->s()/2), std::max(1, level->t()/2), 1);
+        if (next->s() == level->s() && next->t() == level->t()){
+            qWarning("PhotoImage: could not scale image pyramid level");
+            break;
+        }
+        levels.push_back(next);
+        level = next;
+    }
+}
+
+void entity::PhotoImage::setPyramid(const std::vector<osg::ref_ptr<osg::Image> > &levels)
+{
+    m_levels = levels;
+    m_levelAttached = -1;
+    m_levelPending = -1;
+    this->setLevel(m_level);
+}
+
+void entity::PhotoImage::buildPyramid()
+{
+    if (!m_levels.empty()) return;
+    std::vector< osg::ref_ptr<osg::Image> > levels;
+    createPyramid(this->getImage(), levels);
+    if (!levels.empty()) this->setPyramid(levels);
+}
+
+std::string entity::PhotoImage::getHash() const
+{
+    for (size_t i=0; i<m_levels.size(); ++i){
+        if (m_levels[i].get()) return ImageCache::getHash(m_levels[i].get());
+    }
+    return ImageCache::getHash(this->getImage());
+}
+
+unsigned int entity::PhotoImage::getNumLevels() const
+{
+    return m_levels.size();
+}
+
+void entity::PhotoImage::setNumLevels(unsigned int num)
+{
+    m_levels.resize(num);
+    m_levelAttached = -1;
+    if (m_level >= num) m_level = num>0? num-1 : 0;
+}
+
+osg::Image *entity::PhotoImage::getLevelImage(unsigned int level) const
+{
+    if (level >= m_levels.size()) return 0;
+    return m_levels[level].get();
+}
+
+void entity::PhotoImage::setLevelImage(unsigned int level, osg::Image *image)
+{
+    if (level >= m_levels.size()) return;
+    m_levels[level] = image;
+    if (m_levelPending == static_cast<int>(level)) m_levelPending = -1;
+    this->setLevel(m_level);
+}
+
+bool entity::PhotoImage::setLevel(unsigned int level)
+{
+    if (m_levels.empty()) return false;
+    m_level = std::min(level, static_cast<unsigned int>(m_levels.size()-1));
+    unsigned int target = this->getTextureLevel(m_level);
+
+    /* the texture level, otherwise the closest coarser one, otherwise the closest finer one */
+    int attached = -1;
+    for (unsigned int i=target; i<m_levels.size() && attached<0; ++i)
+        if (m_levels[i].get()) attached = i;
+    for (unsigned int i=target; i>0 && attached<0; --i)
+        if (m_levels[i-1].get()) attached = i-1;
+    if (attached < 0) return false;
+
+    /* the texture may have already released its image after the upload */
+    if (attached != m_levelAttached){
+        m_levels[attached]->setDataVariance(osg::Object::STATIC);
+        this->setImage(m_levels[attached].get());
+        m_levelAttached = attached;
+    }
+    return attached == static_cast<int>(target);
+}
+
+unsigned int entity::PhotoImage::getLevel() const
+{
+    return m_level;
+}
+
+void entity::PhotoImage::getLevelSize(unsigned int level, int &width, int &height) const
+{
+    width = height = 0;
+    if (level >= m_levels.size()) return;
+
+    /* each level is half the size of the previous one */
+    for (unsigned int d=0; d<m_levels.size(); ++d){
+        unsigned int finer = level>=d? level-d : m_levels.size();
+        unsigned int coarser = level+d;
+        if (finer < m_levels.size() && m_levels[finer].get()){
+            width = std::max(1, m_levels[finer]->s() >> d);
+            height = std::max(1, m_levels[finer]->t() >> d);
+            return;
+        }
+        if (coarser < m_levels.size() && m_levels[coarser].get()){
+            width = m_levels[coarser]->s() << d;
+            height = m_levels[coarser]->t() << d;
+            return;
+        }
+    }
+}
+
+bool entity::PhotoImage::isLevelTiled(unsigned int level) const
+{
+    int width = 0, height = 0;
+    this->getLevelSize(level, width, height);
+    return PhotoTiler::isTiled(width, height);
+}
+
+unsigned int entity::PhotoImage::getBaseLevel() const
+{
+    for (unsigned int i=0; i<m_levels.size(); ++i){
+        if (!this->isLevelTiled(i)) return i;
+    }
+    return m_levels.empty()? 0 : m_levels.size()-1;
+}
+
+unsigned int entity::PhotoImage::getTextureLevel(unsigned int level) const
+{
+    return std::max(level, this->getBaseLevel());
+}
+
+quint64 entity::PhotoImage::getLevelBytes(unsigned int level) const
+{
+    if (this->isLevelTiled(level))
+        return this->getLevelBytes(this->getBaseLevel())
+                + static_cast<quint64>(cher::PHOTO_TILE_CACHE) * cher::PHOTO_TILE_SIZE * cher::PHOTO_TILE_SIZE * 4;
+    const osg::Image* image = this->getLevelImage(level);
+    if (image) return image->getTotalSizeInBytes();
+    int width = 0, height = 0;
+    this->getLevelSize(level, width, height);
+    return static_cast<quint64>(width) * height * 4;
+}
+
+unsigned int entity::PhotoImage::getLevelForSize(float pixels) const
+{
+    unsigned int result = 0;
+    for (unsigned int i=1; i<m_levels.size(); ++i){
+        int width = 0, height = 0;
+        this->getLevelSize(i, width, height);
+        if (std::max(width, height) < pixels) break;
+        result = i;
+    }
+    return result;
+}
+
+void entity::PhotoImage::releaseLevels()
+{
+    if (m_storeKey.empty() || m_levels.empty()) return;
+    const osg::Image* notUploaded = this->getImage();
+    for (unsigned int i=0; i+1<m_levels.size(); ++i){
+        if (m_levels[i].get() != notUploaded) m_levels[i] = 0;
+    }
+}
+
+bool entity::PhotoImage::requestTile(unsigned int level, int x, int y)
+{
+    unsigned int id = getTileId(level, x, y);
+    std::map<unsigned int, Tile>::iterator it = m_tiles.find(id);
+    if (it == m_tiles.end()){
+        osg::ref_ptr<osg::Image> tile = PhotoTiler::createTile(this->getLevelImage(level), x, y);
+        if (!tile.get()) return false;
+        this->setTileImage(level, x, y, tile.get());
+        it = m_tiles.find(id);
+    }
+    it->second.frame = m_frame;
+    return true;
+}
+
+void entity::PhotoImage::setTileImage(unsigned int level, int x, int y, osg::Image *image)
+{
+    unsigned int id = getTileId(level, x, y);
+    m_tilesPending.erase(id);
+    if (!image) return;
+
+    Tile tile;
+    tile.texture = new osg::Texture2D(image);
+    tile.texture->setResizeNonPowerOfTwoHint(false);
+    tile.texture->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+    tile.texture->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+    tile.texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR);
+    tile.texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+    /* a tile can always be cut or paged in again */
+    tile.texture->setUnRefImageDataAfterApply(true);
+    tile.frame = m_frame;
+    m_tiles[id] = tile;
+}
+
+osg::Texture2D *entity::PhotoImage::getTileTexture(unsigned int level, int x, int y) const
+{
+    std::map<unsigned int, Tile>::const_iterator it = m_tiles.find(getTileId(level, x, y));
+    return it == m_tiles.end()? 0 : it->second.texture.get();
+}
+
+void entity::PhotoImage::setTilePending(unsigned int level, int x, int y)
+{
+    m_tilesPending.insert(getTileId(level, x, y));
+}
+
+bool entity::PhotoImage::isTilePending(unsigned int level, int x, int y) const
+{
+    return m_tilesPending.find(getTileId(level, x, y)) != m_tilesPending.end();
+}
+
+void entity::PhotoImage::releaseTiles(unsigned int maxTiles)
+{
+    while (m_tiles.size() > maxTiles){
+        std::map<unsigned int, Tile>::iterator oldest = m_tiles.begin();
+        for (std::map<unsigned int, Tile>::iterator it = m_tiles.begin(); it != m_tiles.end(); ++it){
+            if (it->second.frame < oldest->second.frame) oldest = it;
+        }
+        if (oldest->second.frame == m_frame) break;
+        oldest->second.texture->releaseGLObjects();
+        m_tiles.erase(oldest);
+    }
+    m_frame++;
+}
+
+unsigned int entity::PhotoImage::getNumTiles() const
+{
+    return m_tiles.size();
+}
+
+void entity::PhotoImage::evict()
+{
+    for (std::map<unsigned int, Tile>::iterator it = m_tiles.begin(); it != m_tiles.end(); ++it)
+        it->second.texture->releaseGLObjects();
+    m_tiles.clear();
+    if (m_levels.empty()) return;
+    m_texture->releaseGLObjects();
+    m_levelAttached = -1;
+    this->setLevel(m_levels.size()-1);
+    this->releaseLevels();
+}
+
+quint64 entity::PhotoImage::getHostBytes() const
+{
+    quint64 bytes = 0;
+    for (unsigned int i=0; i<m_levels.size(); ++i){
+        if (m_levels[i].get()) bytes += m_levels[i]->getTotalSizeInBytes();
+    }
+    if (m_levels.empty() && this->getImage()) bytes = this->getImage()->getTotalSizeInBytes();
+    for (std::map<unsigned int, Tile>::const_iterator it = m_tiles.begin(); it != m_tiles.end(); ++it){
+        if (it->second.texture->getImage()) bytes += it->second.texture->getImage()->getTotalSizeInBytes();
+    }
+    return bytes;
+}
+
+quint64 entity::PhotoImage::getTextureBytes() const
+{
+    quint64 bytes = 0;
+    for (unsigned int i=0; i<osg::DisplaySettings::instance()->getMaxNumberOfGraphicsContexts(); ++i){
+        const osg::Texture::TextureObject* object = m_texture->getTextureObject(i);
+        if (object) bytes += object->size();
+        for (std::map<unsigned int, Tile>::const_iterator it = m_tiles.begin(); it != m_tiles.end(); ++it){
+            object = it->second.texture->getTextureObject(i);
+            if (object) bytes += object->size();
+        }
+    }
+    return bytes;
+}
+
+void entity::PhotoImage::setStoreKey(const std::string &key)
+{
+    m_storeKey = key;
+    m_texture->setUnRefImageDataAfterApply(!key.empty());
+}
+
+const std::string &entity::PhotoImage::getStoreKey() const
+{
+    return m_storeKey;
+}
+
+void entity::PhotoImage::setLevelPending(int level)
+{
+    m_levelPending = level;
+}
+
+int entity::PhotoImage::getLevelPending() const
+{
+    return m_levelPending;
+}
+
+entity::PhotoImage::~PhotoImage()
+{
+}
+
+unsigned int entity::PhotoImage::getTileId(unsigned int level, int x, int y)
+{
+    return (level << 24) | ((static_cast<unsigned int>(y) & 0xfff) << 12) | (static_cast<unsigned int>(x) & 0xfff);
+}
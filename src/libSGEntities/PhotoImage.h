@@ -0,0 +1,198 @@
+#ifndef PHOTOIMAGE_H
+#define PHOTOIMAGE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
+#include <QtGlobal>
+
+#include <osg/Referenced>
+#include <osg/ref_ptr>
+#include <osg/Image>
+#include <osg/Texture2D>
+
+namespace entity {
+
+/*! \class PhotoImage
+ * \brief Image data of entity::Photo: the texture and the image pyramid which is attached to it.
+ *
+ * The pyramid consists of levels: level 0 is the full resolution image and each next level is half the size of
+ * the previous one, down to cher::PHOTO_PYRAMID_MIN pixels. Only one level is attached to the texture at a time,
+ * it is chosen by RootScene::updatePhotoLevels() to match the projected on-screen size of the photo. The levels
+ * of an image that was loaded from entity::ProjectContainer may be non-resident, i.e., NULL; they are paged in
+ * from the container by their store key when requested.
+ *
+ * The levels larger than cher::PHOTO_TILED_MIN are never attached to the texture, see PhotoTiler. When such a
+ * level is requested, the texture holds the finest level which is not tiled, see getBaseLevel(), and the visible
+ * parts of the requested level are attached as separate tile textures which are drawn over it by entity::Photo.
+ * At most cher::PHOTO_TILE_CACHE tiles are kept, the least recently used ones are released first.
+ *
+ * Photos with identical image content share a single PhotoImage, see ImageCache. A photo which is about to
+ * modify its image must make a private copy first, see entity::Photo::detachImage().
+*/
+class PhotoImage : public osg::Referenced
+{
+public:
+    /*! Constructor, creates an empty texture. */
+    PhotoImage();
+
+    /*! A method to create a deep copy of the resident image data, e.g., for copy-on-write. The copy keeps the
+     * store key, so it is up to the modifying code to reset it together with the pyramid. */
+    PhotoImage* clone() const;
+
+    /*! A method to set the texture, e.g., when it is read from file together with the photo. */
+    void setTexture(osg::Texture2D* texture);
+
+    /*! \return the texture the pyramid levels are attached to. */
+    osg::Texture2D* getTexture() const;
+
+    /*! A method to (re-)attach image data to the texture directly, bypassing the pyramid. The requested level
+     * is attached again by the next call of setLevel(). */
+    void setImage(osg::Image* image);
+
+    /*! \return image data attached to the texture, or NULL if the image is not resident, e.g., when the
+     * image has a store key and it was already uploaded, see releaseLevels(). */
+    osg::Image* getImage() const;
+
+    /*! A method to compute the pyramid levels of an image. It does not modify any photo, so it can be called
+     * from a worker thread, e.g., by ImageDecoder. The content hash of the image is stored with all the levels,
+     * see ImageCache::getHash().
+     * \param image is the full resolution image, it becomes level 0,
+     * \param levels is the output list of levels, from the finest to the coarsest. */
+    static void createPyramid(osg::Image* image, std::vector< osg::ref_ptr<osg::Image> >& levels);
+
+    /*! A method to replace all the pyramid levels; the currently requested level is attached. */
+    void setPyramid(const std::vector< osg::ref_ptr<osg::Image> >& levels);
+
+    /*! A method to compute the pyramid from the attached image if there is none, e.g., when the photo was
+     * read from an `.osgt` file. */
+    void buildPyramid();
+
+    /*! \return content hash of the image, or empty string if it is not known, see ImageCache::getHash(). */
+    std::string getHash() const;
+
+    /*! \return number of the pyramid levels, both resident and non-resident. */
+    unsigned int getNumLevels() const;
+
+    /*! A method to set the number of pyramid levels without their image data, e.g., when the photo is
+     * loaded from entity::ProjectContainer and its levels are paged in on demand. */
+    void setNumLevels(unsigned int num);
+
+    /*! \return image of the given pyramid level, or NULL if the level is not resident. */
+    osg::Image* getLevelImage(unsigned int level) const;
+
+    /*! A method to make the level resident, e.g., when it was paged in by ImageDecoder. If it is the
+     * requested level, it is attached to the texture. */
+    void setLevelImage(unsigned int level, osg::Image* image);
+
+    /*! A method to request the pyramid level to be attached to the texture. If the level is tiled, the base level
+     * is attached instead, see getTextureLevel(). If that level is not resident, the closest resident level is
+     * attached, preferably a coarser one.
+     * \return true if the texture level of the requested level is attached. */
+    bool setLevel(unsigned int level);
+
+    /*! \return the requested pyramid level. */
+    unsigned int getLevel() const;
+
+    /*! \return width and height of the given level in pixels; for a non-resident level they are
+     * estimated from the closest resident one. */
+    void getLevelSize(unsigned int level, int& width, int& height) const;
+
+    /*! \return true if the level is too large to be attached to the texture as a whole, see PhotoTiler. */
+    bool isLevelTiled(unsigned int level) const;
+
+    /*! \return the finest level which is not tiled. */
+    unsigned int getBaseLevel() const;
+
+    /*! \return the level which is attached to the texture when the given level is requested. */
+    unsigned int getTextureLevel(unsigned int level) const;
+
+    /*! \return approximate texture memory the level takes when it is attached, in bytes. For a tiled level, it
+     * includes the base level and the full tile cache. */
+    quint64 getLevelBytes(unsigned int level) const;
+
+    /*! \return the coarsest level which is still at least the given number of pixels along its longer side. */
+    unsigned int getLevelForSize(float pixels) const;
+
+    /*! A method to drop the host copies of all the levels but the coarsest one and the one which is waiting
+     * to be uploaded to the GPU. It has effect only if the image has a store key, so that the levels can be
+     * paged in again. */
+    void releaseLevels();
+
+    /*! A method to make the tile of a tiled level resident. If the level itself is resident on the host, the tile
+     * is cut out of it right away; otherwise the tile has to be paged in, see setTileImage().
+     * \param level is the tiled level, \param x is the tile column, \param y is the tile row.
+     * \return true if the tile is resident; it is then marked as used within the current frame. */
+    bool requestTile(unsigned int level, int x, int y);
+
+    /*! A method to make the tile resident, e.g., when it was paged in by ImageDecoder. */
+    void setTileImage(unsigned int level, int x, int y, osg::Image* image);
+
+    /*! \return texture of the resident tile, or NULL if the tile is not resident. */
+    osg::Texture2D* getTileTexture(unsigned int level, int x, int y) const;
+
+    /*! A method to mark the tile as being paged in, so that it is not requested twice. */
+    void setTilePending(unsigned int level, int x, int y);
+
+    /*! \return true if the tile is being paged in. */
+    bool isTilePending(unsigned int level, int x, int y) const;
+
+    /*! A method to release the least recently used tiles beyond the given number, and to start the next frame. The
+     * tiles used within the current frame are never released. */
+    void releaseTiles(unsigned int maxTiles);
+
+    /*! \return number of the resident tiles. */
+    unsigned int getNumTiles() const;
+
+    /*! A method to release the GPU texture, the tiles and the host copies of all the levels but the coarsest one,
+     * which is attached instead; it is uploaded once the photo is rendered again. Used by TextureResidency. */
+    void evict();
+
+    /*! \return host memory taken by the resident pyramid levels and tiles, in bytes. */
+    quint64 getHostBytes() const;
+
+    /*! \return GPU memory taken by the texture and the tile textures, in bytes. */
+    quint64 getTextureBytes() const;
+
+    /*! A method to set the key under which the levels are stored within entity::ProjectContainer,
+     * see entity::ProjectContainer::getLevelKey(). Empty key means the levels are kept only in memory. The
+     * texture of an image with a store key does not keep its image after it is uploaded. */
+    void setStoreKey(const std::string& key);
+
+    /*! \return the key of the levels within entity::ProjectContainer. */
+    const std::string& getStoreKey() const;
+
+    /*! A method to mark the level as being paged in, so that it is not requested twice. */
+    void setLevelPending(int level);
+
+    /*! \return the level that is being paged in, or -1 if there is none. */
+    int getLevelPending() const;
+
+protected:
+    ~PhotoImage();
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    struct Tile{
+        osg::ref_ptr<osg::Texture2D> texture;
+        unsigned int frame; /*!< the last frame the tile was requested within. */
+    };
+    static unsigned int getTileId(unsigned int level, int x, int y);
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+private:
+    osg::ref_ptr<osg::Texture2D> m_texture;
+    std::vector< osg::ref_ptr<osg::Image> > m_levels; /*!< image pyramid, NULL for non-resident levels. */
+    unsigned int m_level; /*!< requested pyramid level. */
+    int m_levelAttached; /*!< level attached to the texture, -1 if none. */
+    int m_levelPending; /*!< level being paged in. */
+    std::string m_storeKey; /*!< key of the levels within project container. */
+    std::map<unsigned int, Tile> m_tiles; /*!< resident tiles by their id. */
+    std::set<unsigned int> m_tilesPending; /*!< ids of the tiles being paged in. */
+    unsigned int m_frame; /*!< tile usage counter, see releaseTiles(). */
+};
+
+} // namespace entity
+
+#endif // PHOTOIMAGE_H
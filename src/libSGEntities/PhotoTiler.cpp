@@ -0,0 +1,133 @@
+#include "PhotoTiler.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <QThreadPool>
+#include <QRunnable>
+#include <QDebug>
+
+#include "Settings.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+/* Cuts a single tile; the result slot is owned by the task until the pool is done. */
+class TileTask : public QRunnable
+{
+public:
+    TileTask(const osg::Image* level, int x, int y, osg::ref_ptr<osg::Image>* result)
+        : QRunnable()
+        , m_level(level)
+        , m_x(x)
+        , m_y(y)
+        , m_result(result)
+    {
+    }
+
+    void run()
+    {
+        *m_result = PhotoTiler::createTile(m_level, m_x, m_y);
+    }
+
+private:
+    const osg::Image* m_level;
+    int m_x, m_y;
+    osg::ref_ptr<osg::Image>* m_result;
+};
+
+namespace {
+/* Copies a block of rows between images of the same pixel format. */
+void copyBlock(const osg::Image* source, int sourceX, int sourceY, osg::Image* target, int targetX, int targetY,
+               int width, int height)
+{
+    unsigned int bytes = width * source->getPixelSizeInBits() / 8;
+    for (int row=0; row<height; ++row)
+        std::memcpy(target->data(targetX, targetY+row), source->data(sourceX, sourceY+row), bytes);
+}
+} // namespace
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+bool PhotoTiler::isTiled(int width, int height)
+{
+    return std::max(width, height) > cher::PHOTO_TILED_MIN;
+}
+
+void PhotoTiler::getGrid(int width, int height, int &cols, int &rows)
+{
+    cols = (width + cher::PHOTO_TILE_SIZE - 1) / cher::PHOTO_TILE_SIZE;
+    rows = (height + cher::PHOTO_TILE_SIZE - 1) / cher::PHOTO_TILE_SIZE;
+}
+
+void PhotoTiler::getTileRect(int width, int height, int x, int y, float &u0, float &v0, float &u1, float &v1)
+{
+    u0 = v0 = u1 = v1 = 0.f;
+    if (width <= 0 || height <= 0) return;
+    u0 = static_cast<float>(x * cher::PHOTO_TILE_SIZE) / width;
+    v0 = static_cast<float>(y * cher::PHOTO_TILE_SIZE) / height;
+    u1 = static_cast<float>(std::min(width, (x+1) * cher::PHOTO_TILE_SIZE)) / width;
+    v1 = static_cast<float>(std::min(height, (y+1) * cher::PHOTO_TILE_SIZE)) / height;
+}
+
+osg::Image *PhotoTiler::createTile(const osg::Image *level, int x, int y)
+{
+    if (!level || !level->data() || level->isCompressed() || level->getPixelSizeInBits() % 8 != 0) return 0;
+    int cols = 0, rows = 0;
+    getGrid(level->s(), level->t(), cols, rows);
+    if (x < 0 || y < 0 || x >= cols || y >= rows) return 0;
+
+    int left = x * cher::PHOTO_TILE_SIZE;
+    int bottom = y * cher::PHOTO_TILE_SIZE;
+    int width = std::min(cher::PHOTO_TILE_SIZE, level->s() - left);
+    int height = std::min(cher::PHOTO_TILE_SIZE, level->t() - bottom);
+
+    osg::ref_ptr<osg::Image> tile = new osg::Image;
+    tile->allocateImage(width, height, 1, level->getPixelFormat(), level->getDataType());
+    tile->setInternalTextureFormat(level->getInternalTextureFormat());
+    copyBlock(level, left, bottom, tile.get(), 0, 0, width, height);
+    return tile.release();
+}
+
+void PhotoTiler::createTiles(const osg::Image *level, std::vector<osg::ref_ptr<osg::Image> > &tiles)
+{
+    tiles.clear();
+    if (!level) return;
+    int cols = 0, rows = 0;
+    getGrid(level->s(), level->t(), cols, rows);
+    tiles.assign(cols * rows, osg::ref_ptr<osg::Image>(0));
+
+    /* a dedicated pool, so that waiting does not depend on unrelated tasks */
+    QThreadPool pool;
+    for (int y=0; y<rows; ++y){
+        for (int x=0; x<cols; ++x)
+            pool.start(new TileTask(level, x, y, &tiles[y*cols + x]));
+    }
+    pool.waitForDone();
+}
+
+osg::Image *PhotoTiler::merge(const std::vector<osg::ref_ptr<osg::Image> > &tiles, int cols, int rows)
+{
+    if (cols <= 0 || rows <= 0 || static_cast<int>(tiles.size()) != cols * rows) return 0;
+    for (size_t i=0; i<tiles.size(); ++i){
+        if (!tiles[i].get() || !tiles[i]->data()) return 0;
+    }
+
+    const osg::Image* first = tiles[0].get();
+    int width = 0, height = 0;
+    for (int x=0; x<cols; ++x) width += tiles[x]->s();
+    for (int y=0; y<rows; ++y) height += tiles[y*cols]->t();
+
+    osg::ref_ptr<osg::Image> level = new osg::Image;
+    level->allocateImage(width, height, 1, first->getPixelFormat(), first->getDataType());
+    level->setInternalTextureFormat(first->getInternalTextureFormat());
+    for (int y=0; y<rows; ++y){
+        for (int x=0; x<cols; ++x){
+            const osg::Image* tile = tiles[y*cols + x].get();
+            if (tile->getPixelFormat() != first->getPixelFormat() || tile->getDataType() != first->getDataType()
+                    || x*cher::PHOTO_TILE_SIZE + tile->s() > width || y*cher::PHOTO_TILE_SIZE + tile->t() > height){
+                qWarning("PhotoTiler: tiles do not match each other");
+                return 0;
+            }
+            copyBlock(tile, 0, 0, level.get(), x*cher::PHOTO_TILE_SIZE, y*cher::PHOTO_TILE_SIZE, tile->s(), tile->t());
+        }
+    }
+    return level.release();
+}
@@ -0,0 +1,50 @@
+#ifndef PHOTOTILER_H
+#define PHOTOTILER_H
+
+#include <vector>
+
+#include <osg/ref_ptr>
+#include <osg/Image>
+
+/*! \class PhotoTiler
+ * \brief Cuts the large photo pyramid levels into tiles and assembles them back.
+ *
+ * The pyramid levels which exceed cher::PHOTO_TILED_MIN pixels along either side are neither attached to a single
+ * texture nor stored as a single chunk of entity::ProjectContainer. Instead, they are split into a grid of
+ * cher::PHOTO_TILE_SIZE tiles which go in row-major order starting from the bottom left corner of the image.
+ * The edge tiles are smaller if the level size is not a multiple of the tile size. The tiling runs on the CPU,
+ * e.g., when the project is written, and each tile is paged in separately when it is seen, see
+ * RootScene::updatePhotoLevels().
+*/
+class PhotoTiler
+{
+public:
+    /*! \return true if the level of the given size is split into tiles. */
+    static bool isTiled(int width, int height);
+
+    /*! A method to compute the tile grid of a level.
+     * \param width is the level width, in pixels,
+     * \param height is the level height, in pixels,
+     * \param cols is the number of tile columns,
+     * \param rows is the number of tile rows. */
+    static void getGrid(int width, int height, int& cols, int& rows);
+
+    /*! A method to compute the part of the level a tile covers, in normalized texture coordinates.
+     * \param x is the tile column,
+     * \param y is the tile row,
+     * \param u0 is the left side, \param v0 is the bottom side, \param u1 is the right side, \param v1 is the top side. */
+    static void getTileRect(int width, int height, int x, int y, float& u0, float& v0, float& u1, float& v1);
+
+    /*! \return a copy of the tile of an uncompressed level, or NULL if the tile is outside of the level. */
+    static osg::Image* createTile(const osg::Image* level, int x, int y);
+
+    /*! A method to cut all the tiles of a level on a thread pool. It returns when all the tiles are created.
+     * \param tiles is the output list of tiles in row-major order. */
+    static void createTiles(const osg::Image* level, std::vector< osg::ref_ptr<osg::Image> >& tiles);
+
+    /*! A method to assemble a level from its tiles, e.g., when the full resolution image is exported.
+     * \return the level image, or NULL if any tile is missing or the tiles do not match each other. */
+    static osg::Image* merge(const std::vector< osg::ref_ptr<osg::Image> >& tiles, int cols, int rows);
+};
+
+#endif // PHOTOTILER_H
@@ -124,10 +124,8 @@ bool entity::Polygon::redefineToShader(osg::MatrixTransform *t)
     Q_CHECK_PTR(colors);
     this->setVertexAttribArray(1, colors, osg::Array::BIND_PER_VERTEX);
 
-    /* apply shader to the state set */
-    Q_ASSERT(this->getOrCreateStateSet());
-    this->getOrCreateStateSet()->setAttributeAndModes(m_program.get(),
-                                                      osg::StateAttribute::ON);
+    /* the shader is applied by the state set of the polygon geode */
+    this->inheritProgram();
 
     m_isShadered = true;
     return true;
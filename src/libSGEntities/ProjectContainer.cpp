@@ -0,0 +1,694 @@
+#include "ProjectContainer.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <streambuf>
+
+#include <QDataStream>
+#include <QSaveFile>
+#include <QByteArray>
+#include <QtEndian>
+#include <QString>
+#include <QDebug>
+
+#include <osgDB/ReadFile>
+#include <osgDB/ReaderWriter>
+#include <osgDB/Registry>
+#include <osgDB/Options>
+#include <osgDB/FileNameUtils>
+
+#include "Settings.h"
+#include "UserScene.h"
+#include "Canvas.h"
+#include "Photo.h"
+#include "ImageCache.h"
+#include "PhotoTiler.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+namespace {
+
+const std::string CHUNK_SCENE_NAME = "UserScene";
+const qint64 HEADER_SIZE = 8 + 4 + 4 + 8;
+const qint64 CHUNK_ALIGNMENT = 8;
+
+/* Read-only stream buffer over the mapped file memory, so that the osgb reader decodes
+ * the chunk in place without copying it into an intermediate buffer. */
+class MappedStreamBuf : public std::streambuf
+{
+public:
+    MappedStreamBuf(char* data, std::size_t size)
+    {
+        this->setg(data, data, data + size);
+    }
+
+protected:
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+    {
+        if (!(which & std::ios_base::in)) return pos_type(off_type(-1));
+        char* target = 0;
+        if (dir == std::ios_base::beg) target = this->eback() + off;
+        else if (dir == std::ios_base::cur) target = this->gptr() + off;
+        else target = this->egptr() + off;
+        if (target < this->eback() || target > this->egptr()) return pos_type(off_type(-1));
+        this->setg(this->eback(), target, this->egptr());
+        return pos_type(target - this->eback());
+    }
+
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which)
+    {
+        return this->seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+};
+
+/* Little-endian reader over the mapped file memory with 64-bit offsets, so that the header and TOC of a container
+ * larger than 2 GB are parsed in place as well. */
+class MappedReader
+{
+public:
+    MappedReader(const uchar* data, quint64 size)
+        : m_data(data), m_size(size), m_pos(0), m_ok(true)
+    {
+    }
+
+    bool seek(quint64 pos)
+    {
+        m_ok = m_ok && pos <= m_size;
+        if (m_ok) m_pos = pos;
+        return m_ok;
+    }
+
+    bool readRaw(void* target, quint64 length)
+    {
+        m_ok = m_ok && length <= m_size - m_pos;
+        if (!m_ok) return false;
+        std::copy(m_data + m_pos, m_data + m_pos + length, static_cast<uchar*>(target));
+        m_pos += length;
+        return true;
+    }
+
+    quint32 readUInt32()
+    {
+        uchar bytes[4] = {0, 0, 0, 0};
+        this->readRaw(bytes, sizeof(bytes));
+        return qFromLittleEndian<quint32>(bytes);
+    }
+
+    quint64 readUInt64()
+    {
+        uchar bytes[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        this->readRaw(bytes, sizeof(bytes));
+        return qFromLittleEndian<quint64>(bytes);
+    }
+
+    bool isOk() const
+    {
+        return m_ok;
+    }
+
+private:
+    const uchar* m_data;
+    quint64 m_size;
+    quint64 m_pos;
+    bool m_ok;
+};
+
+osgDB::ReaderWriter* getBinaryReaderWriter()
+{
+    osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension("osgb");
+    if (!rw) qWarning("ProjectContainer: could not obtain osgb reader-writer plugin");
+    return rw;
+}
+
+void writeHeader(QDataStream& out, quint32 numChunks, quint64 tocOffset)
+{
+    out.writeRawData(cher::PROJECT_MAGIC, sizeof(cher::PROJECT_MAGIC));
+    out << static_cast<quint32>(cher::PROJECT_VERSION) << numChunks << tocOffset;
+}
+
+bool writeChunk(QFileDevice& file, const std::string& bytes, entity::ProjectContainer::ChunkType type,
+                const std::string& name, std::vector<entity::ProjectContainer::Chunk>& toc)
+{
+    entity::ProjectContainer::Chunk chunk;
+    chunk.type = type;
+    chunk.name = name;
+    chunk.offset = static_cast<quint64>(file.pos());
+    chunk.size = static_cast<quint64>(bytes.size());
+    if (file.write(bytes.data(), bytes.size()) != static_cast<qint64>(bytes.size())){
+        qWarning() << "ProjectContainer: could not write chunk" << name.c_str();
+        return false;
+    }
+
+    /* keep every chunk aligned */
+    qint64 padding = (CHUNK_ALIGNMENT - file.pos() % CHUNK_ALIGNMENT) % CHUNK_ALIGNMENT;
+    if (padding > 0) file.write(QByteArray(static_cast<int>(padding), '\0'));
+
+    toc.push_back(chunk);
+    return true;
+}
+
+bool writeNodeChunk(QFileDevice& file, osgDB::ReaderWriter* rw, const osg::Node& node, entity::ProjectContainer::ChunkType type,
+                    const std::string& name, std::vector<entity::ProjectContainer::Chunk>& toc)
+{
+    std::stringstream ss(std::ios::in | std::ios::out | std::ios::binary);
+    osgDB::ReaderWriter::WriteResult result = rw->writeNode(node, ss);
+    if (!result.success()){
+        qWarning() << "ProjectContainer: could not serialize chunk" << name.c_str();
+        return false;
+    }
+    return writeChunk(file, ss.str(), type, name, toc);
+}
+
+bool writeImageChunk(QFileDevice& file, osgDB::ReaderWriter* rw, const osg::Image& image,
+                     const std::string& name, std::vector<entity::ProjectContainer::Chunk>& toc)
+{
+    std::stringstream ss(std::ios::in | std::ios::out | std::ios::binary);
+    osg::ref_ptr<osgDB::Options> options = new osgDB::Options("WriteImageHint=IncludeData");
+    osgDB::ReaderWriter::WriteResult result = rw->writeImage(image, ss, options.get());
+    if (!result.success()){
+        qWarning() << "ProjectContainer: could not serialize image chunk" << name.c_str();
+        return false;
+    }
+    return writeChunk(file, ss.str(), entity::ProjectContainer::CHUNK_PHOTO, name, toc);
+}
+
+/* Writes a pyramid level either as a single chunk, or as a chunk per tile if the level is too large. */
+bool writeLevelChunks(QFileDevice& file, osgDB::ReaderWriter* rw, const osg::Image& level, const std::string& key,
+                      unsigned int index, std::vector<entity::ProjectContainer::Chunk>& toc)
+{
+    if (!PhotoTiler::isTiled(level.s(), level.t()) || level.isCompressed())
+        return writeImageChunk(file, rw, level, entity::ProjectContainer::getLevelKey(key, index), toc);
+
+    std::vector< osg::ref_ptr<osg::Image> > tiles;
+    PhotoTiler::createTiles(&level, tiles);
+    int cols = 0, rows = 0;
+    PhotoTiler::getGrid(level.s(), level.t(), cols, rows);
+    for (int y=0; y<rows; ++y){
+        for (int x=0; x<cols; ++x){
+            const osg::Image* tile = tiles[y*cols + x].get();
+            if (!tile || !writeImageChunk(file, rw, *tile, entity::ProjectContainer::getTileKey(key, index, x, y), toc)){
+                qWarning() << "ProjectContainer: could not write photo tile" << key.c_str();
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/* Whether the chunk name is the photo key itself, or a key of one of its levels or tiles. */
+bool isPhotoChunkOf(const std::string& name, const std::string& key)
+{
+    if (name.compare(0, key.size(), key) != 0) return false;
+    return name.size() == key.size() || name[key.size()] == '#' || name[key.size()] == '@';
+}
+
+} // namespace
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+entity::ProjectContainer::ProjectContainer()
+    : osg::Referenced()
+    , m_data(0)
+    , m_size(0)
+    , m_version(0)
+    , m_filePath("")
+{
+}
+
+bool entity::ProjectContainer::isContainerFile(const std::string &path)
+{
+    return osgDB::getLowerCaseFileExtension(path) == cher::PROJECT_EXTENSION;
+}
+
+bool entity::ProjectContainer::open(const std::string &path)
+{
+    this->close();
+
+    m_file.setFileName(QString::fromStdString(path));
+    if (!m_file.open(QIODevice::ReadOnly)){
+        qWarning() << "ProjectContainer: could not open file" << path.c_str();
+        return false;
+    }
+    m_size = m_file.size();
+    if (m_size < HEADER_SIZE){
+        qWarning("ProjectContainer: file is too small to contain a header");
+        this->close();
+        return false;
+    }
+    m_data = m_file.map(0, m_size);
+    if (!m_data){
+        qWarning("ProjectContainer: could not map file into memory");
+        this->close();
+        return false;
+    }
+
+    /* header and TOC are parsed in place */
+    MappedReader in(m_data, static_cast<quint64>(m_size));
+
+    char magic[sizeof(cher::PROJECT_MAGIC)];
+    in.readRaw(magic, sizeof(magic));
+    if (!std::equal(magic, magic + sizeof(magic), cher::PROJECT_MAGIC)){
+        qWarning("ProjectContainer: file is not a project container");
+        this->close();
+        return false;
+    }
+    quint32 version = in.readUInt32();
+    quint32 numChunks = in.readUInt32();
+    quint64 tocOffset = in.readUInt64();
+    if (version > cher::PROJECT_VERSION){
+        qWarning() << "ProjectContainer: unsupported container version" << version;
+        this->close();
+        return false;
+    }
+    if (tocOffset < static_cast<quint64>(HEADER_SIZE) || tocOffset >= static_cast<quint64>(m_size)){
+        qWarning("ProjectContainer: table of contents is out of file range");
+        this->close();
+        return false;
+    }
+
+    in.seek(tocOffset);
+    for (quint32 i=0; i<numChunks && in.isOk(); ++i){
+        quint32 type = in.readUInt32();
+        quint32 nameLength = in.readUInt32();
+        std::string name(nameLength <= static_cast<quint64>(m_size)? nameLength : 0, '\0');
+        in.readRaw(&name[0], nameLength);
+        Chunk chunk;
+        chunk.type = static_cast<ChunkType>(type);
+        chunk.name = name;
+        chunk.offset = in.readUInt64();
+        chunk.size = in.readUInt64();
+        if (!in.isOk() || chunk.offset > static_cast<quint64>(m_size) || chunk.size > static_cast<quint64>(m_size) - chunk.offset){
+            qWarning("ProjectContainer: table of contents is corrupted");
+            this->close();
+            return false;
+        }
+        m_chunks.push_back(chunk);
+    }
+
+    m_filePath = path;
+    m_version = version;
+    return true;
+}
+
+void entity::ProjectContainer::close()
+{
+    if (m_data) m_file.unmap(m_data);
+    if (m_file.isOpen()) m_file.close();
+    m_data = 0;
+    m_size = 0;
+    m_version = 0;
+    m_filePath = "";
+    m_chunks.clear();
+}
+
+bool entity::ProjectContainer::isOpen() const
+{
+    return m_data != 0;
+}
+
+const std::string &entity::ProjectContainer::getFilePath() const
+{
+    return m_filePath;
+}
+
+const std::vector<entity::ProjectContainer::Chunk> &entity::ProjectContainer::getChunks() const
+{
+    return m_chunks;
+}
+
+int entity::ProjectContainer::findChunk(entity::ProjectContainer::ChunkType type, const std::string &name) const
+{
+    for (size_t i=0; i<m_chunks.size(); ++i){
+        if (m_chunks[i].type == type && m_chunks[i].name == name)
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
+entity::UserScene *entity::ProjectContainer::readScene(bool withImages) const
+{
+    osg::ref_ptr<osg::Node> node = this->readNode(this->findChunk(CHUNK_SCENE, CHUNK_SCENE_NAME));
+    osg::ref_ptr<entity::UserScene> scene = dynamic_cast<entity::UserScene*>(node.get());
+    if (!scene.get()){
+        qWarning("ProjectContainer: could not read the scene chunk");
+        return 0;
+    }
+
+    /* canvases are stored in the TOC in the same order as within the scene */
+    std::map< std::string, osg::ref_ptr<entity::PhotoImage> > images;
+    for (size_t i=0; i<m_chunks.size(); ++i){
+        if (m_chunks[i].type != CHUNK_CANVAS) continue;
+        osg::ref_ptr<osg::Node> cnode = this->readNode(static_cast<int>(i));
+        osg::ref_ptr<entity::Canvas> canvas = dynamic_cast<entity::Canvas*>(cnode.get());
+        if (!canvas.get()){
+            qWarning() << "ProjectContainer: could not read canvas chunk" << m_chunks[i].name.c_str();
+            return 0;
+        }
+        if (!scene->m_groupCanvases->addChild(canvas.get())){
+            qWarning("ProjectContainer: could not add canvas to the scene");
+            return 0;
+        }
+        if (!withImages) continue;
+
+        for (unsigned int j=0; j<canvas->getNumPhotos(); ++j){
+            entity::Photo* photo = canvas->getPhoto(j);
+            if (!photo) continue;
+            std::string key = this->getSharedPhotoKey(this->getStoredPhotoKey(canvas.get(), j));
+            std::map< std::string, osg::ref_ptr<entity::PhotoImage> >::const_iterator it = images.find(key);
+            if (it != images.end()){
+                photo->setPhotoImage(it->second.get());
+                continue;
+            }
+            /* the tiled levels are paged in tile by tile, so the finest whole level is read instead */
+            unsigned int numLevels = this->getNumPhotoLevels(key);
+            unsigned int base = 0;
+            while (base+1 < numLevels && this->findChunk(CHUNK_PHOTO, getLevelKey(key, base)) < 0)
+                base++;
+            osg::ref_ptr<osg::Image> image = this->readPhotoImage(getLevelKey(key, base));
+            if (!image.get()){
+                qWarning() << "ProjectContainer: could not page in photo" << photo->getName().c_str();
+                continue;
+            }
+            entity::PhotoImage* photoImage = photo->getPhotoImage();
+            photoImage->setImage(image.get());
+            if (numLevels > 1){
+                photoImage->setStoreKey(key);
+                photoImage->setNumLevels(numLevels);
+                photoImage->setLevelImage(base, image.get());
+            }
+            else
+                photoImage->buildPyramid();
+            images[key] = photoImage;
+        }
+    }
+
+    return scene.release();
+}
+
+entity::Canvas *entity::ProjectContainer::readCanvas(const std::string &key) const
+{
+    osg::ref_ptr<osg::Node> node = this->readNode(this->findChunk(CHUNK_CANVAS, key));
+    osg::ref_ptr<entity::Canvas> canvas = dynamic_cast<entity::Canvas*>(node.get());
+    return canvas.release();
+}
+
+osg::Image *entity::ProjectContainer::readPhotoImage(const std::string &key) const
+{
+    return this->readImage(this->findChunk(CHUNK_PHOTO, key));
+}
+
+osg::Image *entity::ProjectContainer::readPhotoLevel(const std::string &key, unsigned int level) const
+{
+    int index = this->findChunk(CHUNK_PHOTO, getLevelKey(key, level));
+    if (index >= 0) return this->readImage(index);
+
+    int cols = 0, rows = 0;
+    while (this->findChunk(CHUNK_PHOTO, getTileKey(key, level, cols, 0)) >= 0)
+        cols++;
+    while (this->findChunk(CHUNK_PHOTO, getTileKey(key, level, 0, rows)) >= 0)
+        rows++;
+    if (cols == 0 || rows == 0) return 0;
+
+    std::vector< osg::ref_ptr<osg::Image> > tiles(cols * rows);
+    for (int y=0; y<rows; ++y){
+        for (int x=0; x<cols; ++x)
+            tiles[y*cols + x] = this->readImage(this->findChunk(CHUNK_PHOTO, getTileKey(key, level, x, y)));
+    }
+    return PhotoTiler::merge(tiles, cols, rows);
+}
+
+std::string entity::ProjectContainer::getCanvasKey(const entity::Canvas *canvas)
+{
+    if (!canvas) return "";
+    return QString("canvas%1").arg(canvas->getId()).toStdString();
+}
+
+std::string entity::ProjectContainer::getPhotoKey(const entity::Canvas *canvas, unsigned int photoIndex)
+{
+    if (!canvas) return "";
+    return QString("%1/%2").arg(QString::fromStdString(getCanvasKey(canvas))).arg(photoIndex).toStdString();
+}
+
+std::string entity::ProjectContainer::getStoredPhotoKey(const entity::Canvas *canvas, unsigned int photoIndex) const
+{
+    /* the first version keyed the photos by the canvas names */
+    if (m_version < 2 && canvas)
+        return QString("%1/%2").arg(QString::fromStdString(canvas->getName())).arg(photoIndex).toStdString();
+    return getPhotoKey(canvas, photoIndex);
+}
+
+std::string entity::ProjectContainer::getLevelKey(const std::string &key, unsigned int level)
+{
+    if (level == 0) return key;
+    return QString("%1#%2").arg(QString::fromStdString(key)).arg(level).toStdString();
+}
+
+std::string entity::ProjectContainer::getTileKey(const std::string &key, unsigned int level, int x, int y)
+{
+    return QString("%1@%2_%3").arg(QString::fromStdString(getLevelKey(key, level))).arg(x).arg(y).toStdString();
+}
+
+unsigned int entity::ProjectContainer::getNumPhotoLevels(const std::string &key) const
+{
+    unsigned int num = 0;
+    while (this->findChunk(CHUNK_PHOTO, getLevelKey(key, num)) >= 0
+           || this->findChunk(CHUNK_PHOTO, getTileKey(key, num, 0, 0)) >= 0)
+        num++;
+    return num;
+}
+
+std::string entity::ProjectContainer::getSharedPhotoKey(const std::string &key) const
+{
+    /* the full resolution level of a large image is only stored as tiles */
+    int index = this->findChunk(CHUNK_PHOTO, key);
+    if (index < 0) index = this->findChunk(CHUNK_PHOTO, getTileKey(key, 0, 0, 0));
+    for (int i=0; i<index; ++i){
+        if (m_chunks[i].type == CHUNK_PHOTO && m_chunks[i].offset == m_chunks[index].offset)
+            return m_chunks[i].name.substr(0, m_chunks[i].name.find('@'));
+    }
+    return key;
+}
+
+bool entity::ProjectContainer::write(entity::UserScene *scene, const std::string &path, entity::ProjectContainer *source)
+{
+    if (!scene || path == "") return false;
+    osgDB::ReaderWriter* rw = getBinaryReaderWriter();
+    if (!rw) return false;
+
+    /* write into a temporary file which atomically replaces the target on commit, so that the previous version
+     * stays intact on failure */
+    QString target = QString::fromStdString(path);
+    QSaveFile file(target);
+    if (!file.open(QIODevice::WriteOnly)){
+        qWarning() << "ProjectContainer: could not open file for writing" << file.fileName();
+        return false;
+    }
+    QDataStream out(&file);
+    out.setByteOrder(QDataStream::LittleEndian);
+    writeHeader(out, 0, 0);
+
+    std::vector<Chunk> toc;
+    bool result = true;
+    /* keys of the image data that is already written */
+    std::map<const entity::PhotoImage*, std::string> written;
+
+    /* scene chunk: a shell scene which shares bookmarks and counters, but has no canvases */
+    {
+        osg::ref_ptr<entity::UserScene> shell = new entity::UserScene;
+        shell->setBookmarks(scene->getBookmarksModel());
+        shell->setIdCanvas(scene->getIdCanvas());
+        shell->setIdPhoto(scene->getIdPhoto());
+        shell->setIdBookmark(scene->getIdBookmark());
+        shell->setIdUnique(scene->getIdUnique());
+        shell->setFilePath(scene->getFilePath());
+        shell->initializeSG();
+        result = writeNodeChunk(file, rw, *shell, CHUNK_SCENE, CHUNK_SCENE_NAME, toc);
+    }
+
+    /* canvas chunks, each followed by the chunks of its photo images; the chunks are keyed by the canvas ids,
+     * since the names are edited by the user and do not have to be unique */
+    std::set<unsigned int> ids;
+    for (int i=0; i<scene->getNumCanvases() && result; ++i){
+        entity::Canvas* canvas = scene->getCanvas(i);
+        if (!canvas) continue;
+        if (canvas->getId() == 0 || !ids.insert(canvas->getId()).second){
+            qWarning() << "ProjectContainer: canvas id is not assigned or not unique" << canvas->getName().c_str();
+            result = false;
+            break;
+        }
+
+        std::vector< osg::ref_ptr<osg::Image> > images;
+        for (unsigned int j=0; j<canvas->getNumPhotos(); ++j){
+            entity::Photo* photo = canvas->getPhoto(j);
+            images.push_back(photo? photo->getImage() : 0);
+            if (photo) photo->setImage(0);
+        }
+
+        result = writeNodeChunk(file, rw, *canvas, CHUNK_CANVAS, getCanvasKey(canvas), toc);
+
+        for (unsigned int j=0; j<canvas->getNumPhotos(); ++j){
+            entity::Photo* photo = canvas->getPhoto(j);
+            if (!photo) continue;
+            /* the shared image was detached by the first of its photos */
+            if (images[j].get()) photo->setImage(images[j].get());
+            if (!result) continue;
+            std::string key = getPhotoKey(canvas, j);
+            const entity::PhotoImage* image = photo->getPhotoImage();
+
+            /* the image data of a shared image is referred to by the TOC records of the first photo */
+            std::map<const entity::PhotoImage*, std::string>::const_iterator it = written.find(image);
+            if (it != written.end()){
+                size_t numChunks = toc.size();
+                for (size_t c=0; c<numChunks; ++c){
+                    if (toc[c].type != CHUNK_PHOTO || !isPhotoChunkOf(toc[c].name, it->second)) continue;
+                    Chunk alias = toc[c];
+                    alias.name = key + toc[c].name.substr(it->second.size());
+                    toc.push_back(alias);
+                }
+                continue;
+            }
+            written[image] = key;
+
+            if (image->getNumLevels() == 0){
+                if (images[j].get()) result = writeImageChunk(file, rw, *images[j], key, toc);
+                continue;
+            }
+
+            /* pyramid levels, the non-resident ones are copied from the source container as they are, either
+             * whole or tile by tile */
+            for (unsigned int k=0; k<image->getNumLevels() && result; ++k){
+                const osg::Image* level = image->getLevelImage(k);
+                if (level){
+                    result = writeLevelChunks(file, rw, *level, key, k, toc);
+                    continue;
+                }
+                std::string stored = getLevelKey(image->getStoreKey(), k);
+                std::vector<int> indices;
+                if (source && source->isOpen() && !image->getStoreKey().empty()){
+                    for (size_t c=0; c<source->m_chunks.size(); ++c){
+                        const std::string& name = source->m_chunks[c].name;
+                        if (source->m_chunks[c].type == CHUNK_PHOTO
+                                && (name == stored || name.compare(0, stored.size()+1, stored + "@") == 0))
+                            indices.push_back(static_cast<int>(c));
+                    }
+                }
+                if (indices.empty()){
+                    qWarning() << "ProjectContainer: photo level is neither resident nor stored" << photo->getName().c_str();
+                    result = false;
+                    break;
+                }
+                for (size_t c=0; c<indices.size() && result; ++c){
+                    const Chunk& chunk = source->m_chunks[indices[c]];
+                    std::string bytes(reinterpret_cast<const char*>(source->m_data + chunk.offset), static_cast<size_t>(chunk.size));
+                    result = writeChunk(file, bytes, CHUNK_PHOTO, getLevelKey(key, k) + chunk.name.substr(stored.size()), toc);
+                }
+            }
+        }
+    }
+
+    /* table of contents */
+    quint64 tocOffset = static_cast<quint64>(file.pos());
+    for (size_t i=0; i<toc.size(); ++i){
+        out << static_cast<quint32>(toc[i].type) << static_cast<quint32>(toc[i].name.size());
+        out.writeRawData(toc[i].name.data(), static_cast<int>(toc[i].name.size()));
+        out << toc[i].offset << toc[i].size;
+    }
+    result = result && file.seek(0);
+    writeHeader(out, static_cast<quint32>(toc.size()), tocOffset);
+    result = result && out.status() == QDataStream::Ok;
+
+    if (!result){
+        qWarning("ProjectContainer: failed to write project container");
+        file.cancelWriting();
+        return false;
+    }
+
+    /* the mapped source cannot be replaced while it is open; if the replacement fails, the previous version is
+     * still in place and it is opened again */
+    bool reopen = source && source->getFilePath() == path;
+    if (reopen) source->close();
+    if (!file.commit()){
+        qWarning() << "ProjectContainer: could not replace file" << target << file.errorString();
+        if (reopen && !source->open(path))
+            qWarning() << "ProjectContainer: could not reopen the previous version of" << target;
+        return false;
+    }
+
+    /* the photo levels are now stored within the new file */
+    for (std::map<const entity::PhotoImage*, std::string>::const_iterator it = written.begin(); it != written.end(); ++it){
+        entity::PhotoImage* image = const_cast<entity::PhotoImage*>(it->first);
+        if (image->getNumLevels() > 0)
+            image->setStoreKey(it->second);
+    }
+    return true;
+}
+
+bool entity::ProjectContainer::convert(const std::string &source, const std::string &destination)
+{
+    osg::ref_ptr<osg::Node> node = osgDB::readNodeFile(source);
+    osg::ref_ptr<entity::UserScene> scene = dynamic_cast<entity::UserScene*>(node.get());
+    if (!scene.get()){
+        qWarning() << "ProjectContainer: could not read scene from" << source.c_str();
+        return false;
+    }
+    scene->setFilePath(destination);
+    scene->initializeIds();
+
+    /* photos of the same image content share their image data, so that it is written only once */
+    std::map< std::string, osg::ref_ptr<entity::PhotoImage> > images;
+    for (int i=0; i<scene->getNumCanvases(); ++i){
+        entity::Canvas* canvas = scene->getCanvas(i);
+        if (!canvas) continue;
+        for (unsigned int j=0; j<canvas->getNumPhotos(); ++j){
+            entity::Photo* photo = canvas->getPhoto(j);
+            if (!photo) continue;
+            std::string hash = ImageCache::computeHash(photo->getImage());
+            if (!hash.empty() && images.find(hash) != images.end()){
+                photo->setPhotoImage(images[hash].get());
+                continue;
+            }
+            photo->getPhotoImage()->buildPyramid();
+            if (!hash.empty()) images[hash] = photo->getPhotoImage();
+        }
+    }
+    return write(scene.get(), destination);
+}
+
+entity::ProjectContainer::~ProjectContainer()
+{
+    this->close();
+}
+
+osg::Node *entity::ProjectContainer::readNode(int index) const
+{
+    if (!this->isOpen() || index < 0 || index >= static_cast<int>(m_chunks.size())) return 0;
+    osgDB::ReaderWriter* rw = getBinaryReaderWriter();
+    if (!rw) return 0;
+
+    const Chunk& chunk = m_chunks[index];
+    MappedStreamBuf buffer(reinterpret_cast<char*>(m_data + chunk.offset), static_cast<std::size_t>(chunk.size));
+    std::istream in(&buffer);
+    osgDB::ReaderWriter::ReadResult result = rw->readNode(in);
+    if (!result.validNode()){
+        qWarning() << "ProjectContainer: could not decode chunk" << chunk.name.c_str();
+        return 0;
+    }
+    return result.takeNode();
+}
+
+osg::Image *entity::ProjectContainer::readImage(int index) const
+{
+    if (!this->isOpen() || index < 0 || index >= static_cast<int>(m_chunks.size())) return 0;
+    osgDB::ReaderWriter* rw = getBinaryReaderWriter();
+    if (!rw) return 0;
+
+    const Chunk& chunk = m_chunks[index];
+    MappedStreamBuf buffer(reinterpret_cast<char*>(m_data + chunk.offset), static_cast<std::size_t>(chunk.size));
+    std::istream in(&buffer);
+    osgDB::ReaderWriter::ReadResult result = rw->readImage(in);
+    if (!result.validImage()){
+        qWarning() << "ProjectContainer: could not decode image chunk" << chunk.name.c_str();
+        return 0;
+    }
+    return result.takeImage();
+}
@@ -0,0 +1,166 @@
+#ifndef PROJECTCONTAINER_H
+#define PROJECTCONTAINER_H
+
+#include <string>
+#include <vector>
+
+#include <QFile>
+#include <QtGlobal>
+
+#include <osg/Referenced>
+#include <osg/ref_ptr>
+#include <osg/Node>
+#include <osg/Image>
+
+namespace entity {
+class UserScene;
+class Canvas;
+
+/*! \class ProjectContainer
+ * \brief A chunked, memory-mappable project file that is used as an alternative to the plain `.osgt` scene file.
+ *
+ * The file consists of a fixed-size header, a sequence of chunks and a table of contents (TOC) which is written
+ * at the end of the file:
+ *
+ * * The header contains the magic string, the format version, the number of chunks and the TOC offset.
+ * * The scene chunk contains entity::UserScene without any canvases: bookmarks, scene states and id counters.
+ * * Each canvas chunk contains one entity::Canvas with its strokes, polygons, line segments and photo geometries,
+ * but without photo image data. The canvas chunks and the photo chunks are keyed by the canvas ids, see
+ * getCanvasKey(), since the canvas names are edited by the user and do not have to be unique.
+ * * Each photo chunk contains the image data of one level of entity::Photo pyramid, see getLevelKey(). Photos
+ * which share their image data, see entity::PhotoImage, refer to the same chunks: the TOC contains a record for
+ * each photo key, but the records of the later photos point at the chunks of the first one. The levels which are
+ * too large to be attached to a single texture are stored as a chunk per tile, see getTileKey() and PhotoTiler, so
+ * that only the visible tiles are paged in.
+ *
+ * All the chunks are stored in OSG binary (`osgb`) format. When the container is opened, the file is mapped into
+ * memory and only the header and TOC are parsed. A chunk is decoded only when it is requested, directly
+ * from the mapped memory, e.g. by readCanvas() or readPhotoImage().
+ *
+ * \sa RootScene::loadSceneFromFile(), RootScene::writeScenetoFile().
+*/
+class ProjectContainer : public osg::Referenced
+{
+public:
+    /*! Type of data stored within a chunk. */
+    enum ChunkType {
+        CHUNK_SCENE = 0,
+        CHUNK_CANVAS = 1,
+        CHUNK_PHOTO = 2
+    };
+
+    /*! A TOC record which describes location of a chunk within the file. */
+    struct Chunk {
+        ChunkType type;
+        std::string name;
+        quint64 offset;
+        quint64 size;
+    };
+
+    /*! Constructor. Creates a container which is not attached to any file. */
+    ProjectContainer();
+
+    /*! \return true if the given file name has a project container extension, see cher::PROJECT_EXTENSION. */
+    static bool isContainerFile(const std::string& path);
+
+    /*! A method to map the container file into memory and parse its header and table of contents.
+     * \return true if the file was mapped and the TOC was read successfully. */
+    bool open(const std::string& path);
+
+    /*! A method to unmap and close the container file. */
+    void close();
+
+    /*! \return true if the container is mapped into memory. */
+    bool isOpen() const;
+
+    /*! \return path of the file the container is attached to. */
+    const std::string& getFilePath() const;
+
+    /*! \return table of contents of the opened container. */
+    const std::vector<Chunk>& getChunks() const;
+
+    /*! \return index of the chunk within TOC with the given type and name, or -1 if there is no such chunk. */
+    int findChunk(ChunkType type, const std::string& name) const;
+
+    /*! A method to decode the scene chunk and all the canvas chunks. Photo image data is paged in from the
+     * corresponding photo chunks only if the withImages flag is set.
+     * \return pointer on the new scene, or NULL if the scene could not be read. */
+    entity::UserScene* readScene(bool withImages = true) const;
+
+    /*! A method to decode a single canvas chunk. \param key is the canvas key as returned by getCanvasKey(). */
+    entity::Canvas* readCanvas(const std::string& key) const;
+
+    /*! A method to decode image data of a photo.
+     * \param key is the photo key as returned by getPhotoKey(), or a key of its level or tile as returned by
+     * getLevelKey() or getTileKey(). */
+    osg::Image* readPhotoImage(const std::string& key) const;
+
+    /*! A method to decode a whole pyramid level of a photo; a tiled level is assembled from all its tiles.
+     * \return the level image, or NULL if the level is not stored. */
+    osg::Image* readPhotoLevel(const std::string& key, unsigned int level) const;
+
+    /*! \return the key under which the canvas is stored within the container, it is based on the canvas id. */
+    static std::string getCanvasKey(const entity::Canvas* canvas);
+
+    /*! \return the key under which the photo image is stored within the container. */
+    static std::string getPhotoKey(const entity::Canvas* canvas, unsigned int photoIndex);
+
+    /*! \return the key under which the photo image is stored within this container; it is getPhotoKey() unless the
+     * container was written by the first format version, which keyed the photos by the canvas names. */
+    std::string getStoredPhotoKey(const entity::Canvas* canvas, unsigned int photoIndex) const;
+
+    /*! \return the key under which the given pyramid level of the photo is stored. Level 0 is stored under
+     * the photo key itself, so that the files written before the pyramids were introduced are still read. */
+    static std::string getLevelKey(const std::string& key, unsigned int level);
+
+    /*! \return the key under which the given tile of a tiled pyramid level is stored, see PhotoTiler. */
+    static std::string getTileKey(const std::string& key, unsigned int level, int x, int y);
+
+    /*! \return number of the pyramid levels stored for the photo key, tiled or not; 1 for a photo without
+     * pyramid, or 0 if there is no such photo. */
+    unsigned int getNumPhotoLevels(const std::string& key) const;
+
+    /*! \return key of the first photo whose image is stored within the same chunk as the image of the given
+     * photo key, i.e., the key itself unless the image data is shared with a preceding photo. */
+    std::string getSharedPhotoKey(const std::string& key) const;
+
+    /*! A method to write the user scene into a container file. The scene is expected to have its canvas
+     * tools already detached, see entity::Canvas::detachFrame(). Photo images are detached from their textures
+     * only for the time the corresponding canvas chunk is written. The image data which is shared by several
+     * photos is written only once. The large levels are cut into tiles on a thread pool. On success, the photos are assigned their keys within the new file, see
+     * entity::PhotoImage::setStoreKey().
+     * \param source is the container the scene was loaded from, if any. The photo levels which are not
+     * resident are copied from it chunk by chunk without decoding. If the source is the file to be replaced,
+     * it is closed before the replacement, and it is reopened if the replacement fails. The file is replaced
+     * atomically, see QSaveFile, so that the previous version is kept whenever the write fails.
+     * \return true if the file was written successfully. */
+    static bool write(entity::UserScene* scene, const std::string& path, entity::ProjectContainer* source = 0);
+
+    /*! A method to convert the existing OSG scene file (e.g., `.osgt`) into the project container format.
+     * \param source is the file name of the scene to convert,
+     * \param destination is the container file name.
+     * \return true if the conversion was successful. */
+    static bool convert(const std::string& source, const std::string& destination);
+
+protected:
+    /*! Destructor unmaps the file, if it is still mapped. */
+    ~ProjectContainer();
+
+    /*! A method to decode a node from the specified chunk directly from the mapped memory. */
+    osg::Node* readNode(int index) const;
+
+    /*! A method to decode an image from the specified chunk directly from the mapped memory. */
+    osg::Image* readImage(int index) const;
+
+private:
+    QFile m_file;
+    uchar* m_data; /*!< pointer on the mapped file memory. */
+    qint64 m_size;
+    quint32 m_version; /*!< format version of the opened container. */
+    std::string m_filePath;
+    std::vector<Chunk> m_chunks;
+};
+
+} // namespace entity
+
+#endif // PROJECTCONTAINER_H
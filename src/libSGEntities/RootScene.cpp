@@ -3,30 +3,95 @@
 #include "iostream"
 #include <sstream>
 #include <stdlib.h>
+#include <algorithm>
+#include <map>
+#include <queue>
+#include <cfloat>
 
 #include <QtGlobal>
 #include <QDebug>
 #include <QMessageBox>
+#include <QThread>
 
 #include <osgDB/ReadFile>
 #include <osgDB/WriteFile>
 #include <osgDB/ReaderWriter>
 #include <osgDB/Registry>
 #include <osgDB/Options>
+#include <osg/BoundingBox>
+#include <osg/Viewport>
 
 #include "Settings.h"
 #include "Utilities.h"
 #include "EditEntityCommand.h"
 #include "MainWindow.h"
+#include "SceneLoader.h"
+#include "ImageDecoder.h"
+#include "MeshGenerator.h"
+#include "MeshWriter.h"
+#include "PhotoTiler.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+namespace {
+
+/* Longest side of the photo quad on screen, in pixels; zero if the quad is outside of the viewport. */
+float getProjectedSize(const entity::Photo* photo, const osg::Matrix& MVPW, const osg::Viewport* viewport)
+{
+    const osg::Vec3Array* verts = dynamic_cast<const osg::Vec3Array*>(photo->getVertexArray());
+    if (!verts || verts->size() < 4) return 0.f;
+    osg::Vec2f corners[4];
+    osg::BoundingBox box;
+    for (unsigned int i=0; i<4; ++i){
+        osg::Vec4f clip = osg::Vec4f((*verts)[i], 1.f) * MVPW;
+        /* the quad crosses the camera plane, i.e., it is as close as it can get */
+        if (clip.w() <= 0.f) return FLT_MAX;
+        corners[i] = osg::Vec2f(clip.x() / clip.w(), clip.y() / clip.w());
+        box.expandBy(corners[i].x(), corners[i].y(), 0.f);
+    }
+    if (box.xMax() < viewport->x() || box.xMin() > viewport->x() + viewport->width() ||
+            box.yMax() < viewport->y() || box.yMin() > viewport->y() + viewport->height())
+        return 0.f;
+
+    float size = 0.f;
+    for (unsigned int i=0; i<4; ++i)
+        size = std::max(size, (corners[(i+1)%4] - corners[i]).length());
+    return size;
+}
+
+/* Whether any part of the photo region lies within the viewport. */
+bool isRegionVisible(const entity::Photo* photo, float u0, float v0, float u1, float v1, const osg::Matrix& MVPW,
+                     const osg::Viewport* viewport)
+{
+    const osg::Vec3f points[4] = {photo->getPoint(u0, v0), photo->getPoint(u1, v0),
+                                  photo->getPoint(u1, v1), photo->getPoint(u0, v1)};
+    osg::BoundingBox box;
+    for (unsigned int i=0; i<4; ++i){
+        osg::Vec4f clip = osg::Vec4f(points[i], 1.f) * MVPW;
+        /* the region crosses the camera plane, it is kept to be on the safe side */
+        if (clip.w() <= 0.f) return true;
+        box.expandBy(clip.x() / clip.w(), clip.y() / clip.w(), 0.f);
+    }
+    return !(box.xMax() < viewport->x() || box.xMin() > viewport->x() + viewport->width() ||
+             box.yMax() < viewport->y() || box.yMin() > viewport->y() + viewport->height());
+}
+
+} // namespace
+#endif // DOXYGEN_SHOULD_SKIP_THIS
 
 RootScene::RootScene(QUndoStack *undoStack)
     : osg::ProtectedGroup()
     , m_userScene(new entity::UserScene)
     , m_axisTool(new entity::AxisGlobalTool)
     , m_bookmarkTools(new osg::Group)
+    , m_container(0)
     , m_undoStack(undoStack)
     , m_saved(false)
     , m_visibilityBookmarkTool(true)
+    , m_visibilityIntersections(false)
+    , m_photoBudget(cher::PHOTO_TEXTURE_BUDGET)
+    , m_photoDecodes(0)
+    , m_photoDirty(true)
+    , m_photoTotal(0)
 {
     // child #0
     m_userScene->initializeSG();
@@ -85,6 +150,8 @@ void RootScene::clearUserData()
 {
     m_userScene->clearUserData();
     m_buffer.clear();
+    m_container = 0;
+    m_photoDirty = true;
 }
 
 void RootScene::setToolsVisibility(bool vis)
@@ -128,20 +195,42 @@ bool RootScene::writeScenetoFile()
     bool result = true;
     if (m_userScene->getFilePath() == "") return false;
 
+    /* make sure all the photo images are attached before they are written */
+    ImageDecoder::instance().waitForDone();
+
     /* save current scene state */
     osg::ref_ptr<entity::SceneState> state = new entity::SceneState;
     state->stripDataFrom(this);
     Q_ASSERT(!state->isEmpty());
 
-    /* for each canvas, detach its tools */
+    /* for each canvas, detach its tools, photo and stroke batches */
+    m_atlas.detach();
+    m_strokeBatcher.detach();
     for (int i=0; i<m_userScene->getNumCanvases(); ++i){
         entity::Canvas* canvas = m_userScene->getCanvas(i);
         if (!canvas) continue;
         canvas->detachFrame();
     }
 
-    if (!osgDB::writeNodeFile(*(m_userScene.get()), m_userScene->getFilePath(), new osgDB::Options("WriteImageHint=IncludeData")))
-        result = false;
+    const std::string& path = m_userScene->getFilePath();
+    if (entity::ProjectContainer::isContainerFile(path)){
+        /* the non-resident photo levels are copied from the current container; the new file becomes the
+         * store of the photo levels */
+        if (!entity::ProjectContainer::write(m_userScene.get(), path, m_container.get()))
+            result = false;
+        osg::ref_ptr<entity::ProjectContainer> container = new entity::ProjectContainer;
+        if (container->open(path))
+            m_container = container;
+        else if (m_container.get() && !m_container->isOpen())
+            m_container = 0;
+    }
+    else{
+        /* the file stores only the full resolution images */
+        this->setPhotosFullResolution(true);
+        if (!osgDB::writeNodeFile(*(m_userScene.get()), path, new osgDB::Options("WriteImageHint=IncludeData")))
+            result = false;
+        this->setPhotosFullResolution(false);
+    }
 
     /* for each canvas, attach its tools back */
     for (int i=0; i<m_userScene->getNumCanvases(); ++i){
@@ -161,17 +250,33 @@ bool RootScene::writeScenetoFile()
     return result;
 }
 
-bool RootScene::exportSceneToFile(const std::string &name)
+bool RootScene::exportSceneToFile(const std::string &name, cher::MESH_EXPORT layout, float chordalError)
 {
     if (name == "") return false;
+    ImageDecoder::instance().waitForDone();
+    if (MeshWriter::isStreamingFormat(name))
+        return this->exportSceneToStream(name, layout, chordalError);
 
     /* save current scene state */
     osg::ref_ptr<entity::SceneState> state = new entity::SceneState;
     state->stripDataFrom(this);
     Q_ASSERT(!state->isEmpty());
 
+    /* generate (or take from cache) the meshes of all the canvases at once */
+    std::vector<entity::ShaderedEntity2D*> entities;
+    std::vector<size_t> canvasOffsets;
+    for (int i=0; i<m_userScene->getNumCanvases(); ++i){
+        canvasOffsets.push_back(entities.size());
+        MeshGenerator::collectEntities(m_userScene->getCanvas(i), entities);
+    }
+    canvasOffsets.push_back(entities.size());
+    std::vector< osg::ref_ptr<osg::Node> > entityMeshes;
+    MeshGenerator::generate(entities, entityMeshes, true, chordalError);
+
     std::vector< osg::ref_ptr<osg::Group> > meshes;
-    /* for each canvas, detach its tools */
+    /* for each canvas, detach its tools, photo and stroke batches */
+    m_atlas.detach();
+    m_strokeBatcher.detach();
     for (int i=0; i<m_userScene->getNumCanvases(); ++i){
         entity::Canvas* canvas = m_userScene->getCanvas(i);
         if (!canvas) continue;
@@ -180,36 +285,29 @@ bool RootScene::exportSceneToFile(const std::string &name)
         /* attach mesh group */
         meshes.push_back(canvas->attachMeshGroup());
 
-        // for all the strokes within canvas, add the correspondig mesh to the mesh group
-        for (unsigned int j=0; j<canvas->getNumStrokes(); ++j){
-            entity::Stroke* stroke = canvas->getStroke(j);
-            if (!stroke) continue;
-            osg::ref_ptr<osg::Node> mesh = stroke->getMeshRepresentation();
-            if (!mesh.get()){
-                qWarning("Could not obtain mesh represenation from the stroke.");
-                continue;
-            }
-            bool added = meshes.back()->addChild(mesh.get());
-            if (!added){
-                qWarning("Could not attach mesh to the mesh group.");
-                continue;
-            }
+        if (layout != cher::MESH_EXPORT_TUBES){
+            /* weld all the tubes of canvas into a single mesh */
+            std::vector< osg::ref_ptr<osg::Node> > canvasMeshes(entityMeshes.begin() + canvasOffsets[i],
+                                                                entityMeshes.begin() + canvasOffsets[i+1]);
+            std::vector<std::string> names;
+            for (size_t j=canvasOffsets[i]; j<canvasOffsets[i+1]; ++j)
+                names.push_back(entities[j]->getName());
+            osg::ref_ptr<osg::Geode> merged = MeshGenerator::merge(canvasMeshes, names, canvas->getName(),
+                                                                   layout == cher::MESH_EXPORT_MERGED_GROUPS);
+            if (merged.get() && !meshes.back()->addChild(merged.get()))
+                qWarning("Could not attach merged mesh to the mesh group.");
+            continue;
         }
-        for (unsigned int j=0; j<canvas->getNumLineSegments(); ++j){
-            entity::LineSegment* segment = canvas->getLineSegment(j);
-            if (!segment) continue;
-            osg::ref_ptr<osg::Node> mesh = segment->getMeshRepresentation();
-            if (!mesh.get()){
-                qWarning("Could not obtain mesh represenation from the line segment.");
-                continue;
-            }
-            bool added = meshes.back()->addChild(mesh.get());
+
+        // for all the strokes and line segments within canvas, add the correspondig mesh to the mesh group
+        for (size_t j=canvasOffsets[i]; j<canvasOffsets[i+1]; ++j){
+            if (!entityMeshes[j].get()) continue;
+            bool added = meshes.back()->addChild(entityMeshes[j].get());
             if (!added){
                 qWarning("Could not attach mesh to the mesh group.");
                 continue;
             }
         }
-
     }
 
     Q_CHECK_PTR(m_userScene->getGroupCanvases());
@@ -237,42 +335,358 @@ bool RootScene::exportSceneToFile(const std::string &name)
     return result;
 }
 
-bool RootScene::loadSceneFromFile()
+quint64 RootScene::updatePhotoLevels(const osg::Camera *camera)
 {
-    if (!m_undoStack){
-        qWarning("loadSceneFromFile(): undo stack is NULL. "
-                 "Restart the program to ensure undo stack initialization.");
-        return false;
+    if (!camera || !camera->getViewport()) return 0;
+    osg::Matrix VPW = camera->getViewMatrix() * camera->getProjectionMatrix() *
+            camera->getViewport()->computeWindowMatrix();
+
+    /* nothing to choose anew, only the canvases which are not seen for long are evicted */
+    if (!this->isPhotoViewChanged(VPW)){
+        if (m_residency.update(m_userScene.get(), m_photoSeen)){
+            m_photoDirty = true;
+            for (int i=0; i<m_userScene->getNumCanvases(); ++i){
+                TextureResidency::Usage usage = m_residency.getUsage(m_userScene->getCanvas(i));
+                emit m_userScene->canvasMemoryUsage(i, usage.host, usage.texture);
+            }
+        }
+        return m_photoTotal;
+    }
+
+    /* the level each image needs judging by the on-screen size of its photos; the photos which are hidden or
+     * outside of the viewport take their coarsest level, and a shared image takes the finest level any of its
+     * photos needs */
+    std::vector<entity::PhotoImage*> images;
+    std::vector<entity::Photo*> photos; /* one photo per image, it receives the paged in levels */
+    std::vector<unsigned int> levels;
+    std::map<entity::PhotoImage*, size_t> indices;
+    std::vector<entity::Photo*> seenPhotos; /* the photos on screen, they may need tiles */
+    std::vector<osg::Matrix> seenMatrices;
+    std::vector<bool> seen(m_userScene->getNumCanvases(), false);
+    for (int i=0; i<m_userScene->getNumCanvases(); ++i){
+        entity::Canvas* canvas = m_userScene->getCanvas(i);
+        if (!canvas) continue;
+        osg::Matrix MVPW = canvas->getMatrix() * VPW;
+        for (unsigned int j=0; j<canvas->getNumPhotos(); ++j){
+            entity::Photo* photo = canvas->getPhoto(j);
+            if (!photo || photo->getPhotoImage()->getNumLevels() == 0) continue;
+            entity::PhotoImage* image = photo->getPhotoImage();
+            unsigned int level = image->getNumLevels()-1;
+            photo->clearTiles();
+            float size = canvas->getVisibilityAll()? getProjectedSize(photo, MVPW, camera->getViewport()) : 0.f;
+            if (size > 0.f){
+                level = image->getLevelForSize(size);
+                seen[i] = true;
+                seenPhotos.push_back(photo);
+                seenMatrices.push_back(MVPW);
+            }
+            std::map<entity::PhotoImage*, size_t>::const_iterator it = indices.find(image);
+            if (it != indices.end()){
+                levels[it->second] = std::min(levels[it->second], level);
+                continue;
+            }
+            indices[image] = images.size();
+            images.push_back(image);
+            photos.push_back(photo);
+            levels.push_back(level);
+        }
+    }
+    quint64 total = 0;
+    for (size_t k=0; k<images.size(); ++k)
+        total += images[k]->getLevelBytes(levels[k]);
+
+    /* coarsen the largest textures until the budget is met; the heap holds the images which can still be
+     * coarsened, keyed by the size of their chosen level */
+    if (total > m_photoBudget){
+        std::priority_queue< std::pair<quint64, size_t> > largest;
+        for (size_t k=0; k<images.size(); ++k){
+            if (levels[k]+1 < images[k]->getNumLevels())
+                largest.push(std::make_pair(images[k]->getLevelBytes(levels[k]), k));
+        }
+        while (total > m_photoBudget && !largest.empty()){
+            size_t k = largest.top().second;
+            quint64 bytes = largest.top().first;
+            largest.pop();
+            levels[k]++;
+            total = total - bytes + images[k]->getLevelBytes(levels[k]);
+            if (levels[k]+1 < images[k]->getNumLevels())
+                largest.push(std::make_pair(images[k]->getLevelBytes(levels[k]), k));
+        }
+    }
+
+    /* the full resolution of a small photo is needed until it is packed into the atlas, the photos of the packed
+     * ones are not drawn at all */
+    for (size_t k=0; k<images.size() && m_atlas.isEnabled(); ++k){
+        if (m_atlas.isPacked(images[k]))
+            levels[k] = images[k]->getNumLevels()-1;
+        else if (PhotoAtlas::isCandidate(images[k]))
+            levels[k] = 0;
+    }
+
+    /* the tiled levels are drawn over the base level by the visible tiles only; the resident tiles are
+     * attached right away, the missing ones are paged in */
+    for (size_t p=0; p<seenPhotos.size(); ++p){
+        entity::Photo* photo = seenPhotos[p];
+        entity::PhotoImage* image = photo->getPhotoImage();
+        unsigned int level = levels[indices[image]];
+        if (!image->isLevelTiled(level)) continue;
+        int width = 0, height = 0, cols = 0, rows = 0;
+        image->getLevelSize(level, width, height);
+        PhotoTiler::getGrid(width, height, cols, rows);
+        for (int y=0; y<rows; ++y){
+            for (int x=0; x<cols; ++x){
+                float u0, v0, u1, v1;
+                PhotoTiler::getTileRect(width, height, x, y, u0, v0, u1, v1);
+                if (!isRegionVisible(photo, u0, v0, u1, v1, seenMatrices[p], camera->getViewport())) continue;
+                if (image->requestTile(level, x, y))
+                    photo->addTile(image->getTileTexture(level, x, y), level, x, y, u0, v0, u1, v1);
+                else if (m_container.get() && !image->getStoreKey().empty() && !image->isTilePending(level, x, y)){
+                    image->setTilePending(level, x, y);
+                    ImageDecoder::instance().decode(photo, m_container.get(), image->getStoreKey(), level, x, y);
+                }
+            }
+        }
+    }
+
+    /* attach the resident levels, page in the missing ones; a tiled level needs its base level */
+    for (size_t k=0; k<images.size(); ++k){
+        entity::PhotoImage* image = images[k];
+        unsigned int level = image->getTextureLevel(levels[k]);
+        if (!image->setLevel(levels[k]) && m_container.get() && !image->getStoreKey().empty()
+                && image->getLevelPending() != static_cast<int>(level)){
+            image->setLevelPending(level);
+            ImageDecoder::instance().decode(photos[k], m_container.get(), image->getStoreKey(), level);
+        }
+        image->releaseLevels();
+        image->releaseTiles(cher::PHOTO_TILE_CACHE);
+    }
+
+    /* the packed photos take another level by the next frame */
+    if (m_atlas.update(m_userScene.get())) m_photoDirty = true;
+
+    /* evict the canvases which are not seen for long, report memory usage per canvas */
+    if (m_residency.update(m_userScene.get(), seen)){
+        m_photoDirty = true;
+        for (int i=0; i<m_userScene->getNumCanvases(); ++i){
+            TextureResidency::Usage usage = m_residency.getUsage(m_userScene->getCanvas(i));
+            emit m_userScene->canvasMemoryUsage(i, usage.host, usage.texture);
+        }
     }
+    m_photoSeen.swap(seen);
+    m_photoTotal = total;
+    return total;
+}
+
+TextureResidency &RootScene::getTextureResidency()
+{
+    return m_residency;
+}
+
+PhotoAtlas &RootScene::getPhotoAtlas()
+{
+    return m_atlas;
+}
+
+bool RootScene::updateStrokeBatches()
+{
+    return m_strokeBatcher.update(m_userScene.get());
+}
+
+void RootScene::setCanvasIntersectionsVisibility(bool visible)
+{
+    m_visibilityIntersections = visible;
+}
+
+bool RootScene::getCanvasIntersectionsVisibility() const
+{
+    return m_visibilityIntersections;
+}
+
+bool RootScene::updateCanvasIntersections()
+{
+    return m_userScene->updateIntersections(m_visibilityIntersections);
+}
+
+StrokeBatcher &RootScene::getStrokeBatcher()
+{
+    return m_strokeBatcher;
+}
+
+void RootScene::setPhotoTextureBudget(quint64 bytes)
+{
+    m_photoBudget = bytes;
+    m_photoDirty = true;
+}
+
+quint64 RootScene::getPhotoTextureBudget() const
+{
+    return m_photoBudget;
+}
+
+bool RootScene::exportSceneToStream(const std::string &name, cher::MESH_EXPORT layout, float chordalError)
+{
+    MeshWriter writer;
+    if (!writer.open(name)) return false;
+
+    /* keep at most one mesh per pool thread in memory at a time */
+    const size_t batchSize = static_cast<size_t>(std::max(1, QThread::idealThreadCount()));
+    for (int i=0; i<m_userScene->getNumCanvases(); ++i){
+        const entity::Canvas* canvas = m_userScene->getCanvas(i);
+        if (!canvas) continue;
+        const osg::Matrix M = canvas->getMatrix();
+        writer.beginObject(canvas->getName());
+
+        std::vector<entity::ShaderedEntity2D*> entities;
+        MeshGenerator::collectEntities(canvas, entities);
+        std::vector< osg::ref_ptr<osg::Node> > canvasMeshes;
+        std::vector<std::string> canvasNames;
+        for (size_t b=0; b<entities.size(); b+=batchSize){
+            std::vector<entity::ShaderedEntity2D*> batch(entities.begin() + b,
+                                                         entities.begin() + std::min(b+batchSize, entities.size()));
+            std::vector< osg::ref_ptr<osg::Node> > meshes;
+            MeshGenerator::generate(batch, meshes, false, chordalError);
+            for (size_t k=0; k<batch.size(); ++k){
+                if (!meshes[k].get()) continue;
+                /* the whole canvas is welded at once; memory is bounded by the canvas then */
+                if (layout == cher::MESH_EXPORT_MERGED){
+                    canvasMeshes.push_back(meshes[k]);
+                    canvasNames.push_back(batch[k]->getName());
+                    continue;
+                }
+                std::vector< osg::ref_ptr<osg::Node> > single(1, meshes[k]);
+                std::vector<std::string> names(1, batch[k]->getName());
+                osg::ref_ptr<osg::Geode> welded = MeshGenerator::merge(single, names, batch[k]->getName(), false);
+                if (welded.get())
+                    writer.write(welded->getDrawable(0)->asGeometry(), M, batch[k]->getName());
+            }
+        }
+        if (!canvasMeshes.empty()){
+            osg::ref_ptr<osg::Geode> welded = MeshGenerator::merge(canvasMeshes, canvasNames, canvas->getName(), false);
+            if (welded.get())
+                writer.write(welded->getDrawable(0)->asGeometry(), M);
+        }
+
+        /* photos are written as plain quads */
+        for (unsigned int j=0; j<canvas->getNumPhotos(); ++j){
+            entity::Photo* photo = canvas->getPhoto(j);
+            if (!photo) continue;
+            std::vector< osg::ref_ptr<osg::Node> > single(1, osg::ref_ptr<osg::Node>(photo));
+            std::vector<std::string> names(1, photo->getName());
+            osg::ref_ptr<osg::Geode> quad = MeshGenerator::merge(single, names, photo->getName(), false);
+            if (quad.get())
+                writer.write(quad->getDrawable(0)->asGeometry(), M, photo->getName());
+        }
+    }
+
+    qDebug() << "Exported vertices:" << writer.getNumVertices() << ", triangles:" << writer.getNumTriangles();
+    return writer.close();
+}
+
+void RootScene::setPhotosFullResolution(bool full)
+{
+    m_photoDirty = true;
+    for (int i=0; i<m_userScene->getNumCanvases(); ++i){
+        entity::Canvas* canvas = m_userScene->getCanvas(i);
+        if (!canvas) continue;
+        for (unsigned int j=0; j<canvas->getNumPhotos(); ++j){
+            entity::Photo* photo = canvas->getPhoto(j);
+            if (!photo || photo->getPhotoImage()->getNumLevels() == 0) continue;
+            entity::PhotoImage* image = photo->getPhotoImage();
+            /* the requested levels are chosen again before the next frame, see updatePhotoLevels() */
+            if (!full){
+                image->releaseLevels();
+                continue;
+            }
+            if (!image->getLevelImage(0) && m_container.get() && !image->getStoreKey().empty()){
+                osg::ref_ptr<osg::Image> level = m_container->readPhotoLevel(image->getStoreKey(), 0);
+                if (level.get()) image->setLevelImage(0, level.get());
+            }
+            /* the tiled level is attached bypassing the pyramid */
+            if (image->getLevelImage(0))
+                image->setImage(image->getLevelImage(0));
+            else
+                qWarning() << "Could not obtain full resolution image of" << photo->getName().c_str();
+        }
+    }
+}
+
+bool RootScene::isPhotoViewChanged(const osg::Matrix &VPW)
+{
+    unsigned int decodes = ImageDecoder::instance().getRevision();
+    bool changed = m_photoDirty || VPW != m_photoView || decodes != m_photoDecodes || m_atlas.isDetached();
+    m_photoCanvases.resize(m_userScene->getNumCanvases());
+    for (int i=0; i<m_userScene->getNumCanvases(); ++i){
+        const entity::Canvas* canvas = m_userScene->getCanvas(i);
+        PhotoCanvasState state;
+        if (canvas){
+            state.canvas = canvas;
+            state.transform = canvas->getTransformRevision();
+            state.content = canvas->getContentRevision();
+            state.numPhotos = canvas->getNumPhotos();
+            state.visible = canvas->getVisibilityAll();
+        }
+        if (state == m_photoCanvases[i]) continue;
+        m_photoCanvases[i] = state;
+        changed = true;
+    }
+    m_photoView = VPW;
+    m_photoDecodes = decodes;
+    m_photoDirty = false;
+    return changed;
+}
+
+bool RootScene::PhotoCanvasState::operator==(const RootScene::PhotoCanvasState &other) const
+{
+    return canvas == other.canvas && transform == other.transform && content == other.content
+            && numPhotos == other.numPhotos && visible == other.visible;
+}
+
+bool RootScene::loadSceneFromFile()
+{
     if (m_userScene->getFilePath() == "")
         return false;
-    osg::Node* node = osgDB::readNodeFile(m_userScene->getFilePath());
-    if (!node){
-        qWarning("loadSceneFromFile: node is NULL");
+
+    /* parse and prepare the scene on the calling thread */
+    SceneLoader loader(m_userScene->getFilePath());
+    loader.process();
+    if (!loader.getScene()){
+        qWarning("loadSceneFromFile: could not load the scene");
         return false;
     }
+    ImageDecoder::instance().waitForDone();
+    return this->setLoadedScene(loader.getScene(), loader.getContainer());
+}
 
-    osg::ref_ptr<entity::UserScene> newscene = dynamic_cast<entity::UserScene*>(node);
+bool RootScene::setLoadedScene(entity::UserScene *scene, entity::ProjectContainer *container)
+{
+    if (!m_undoStack){
+        qWarning("setLoadedScene(): undo stack is NULL. "
+                 "Restart the program to ensure undo stack initialization.");
+        return false;
+    }
+    osg::ref_ptr<entity::UserScene> newscene = scene;
     if (!newscene.get()){
-        qWarning("loadSceneFromFile: could not load from file, or could not perform the dynamic_cast<osg::Group*>");
+        qWarning("setLoadedScene: scene is NULL");
         return false;
     }
+    m_photoDirty = true;
     qDebug() << "Loaded scene, number of children: " << newscene->getNumChildren();
     qDebug() << "Loaded scene, number of canvases: " << newscene->getNumCanvases();
 
     /* replace the original */
     if (!this->replaceChild(m_userScene.get(), newscene.get())){
-        qWarning("loadSceneFromFile: could not replace the original child");
+        qWarning("setLoadedScene: could not replace the original child");
         return false;
     }
 
     /* update pointer */
     m_userScene = newscene.get();
+    m_container = container;
 
     /* load the construction tools, set photo textures */
     for (int i=0; i<m_userScene->getNumCanvases(); ++i){
         entity::Canvas* cnv = m_userScene->getCanvas(i);
-        if (!cnv) qFatal("RootScene::loadSceneFromFile() canvas is NULL");
+        if (!cnv) qFatal("RootScene::setLoadedScene() canvas is NULL");
         cnv->initializeTools();
         cnv->initializeStateMachine();
         cnv->initializeMasks();
@@ -327,15 +741,23 @@ bool RootScene::loadSceneFromFile()
     /* update current/previous canvases */
     for (int i=0; i<m_userScene->getNumCanvases(); ++i){
         entity::Canvas* cnv = m_userScene->getCanvas(i);
-        if (!cnv) qFatal("RootScene::loadSceneFromFile() canvas is NULL");
+        if (!cnv) qFatal("RootScene::setLoadedScene() canvas is NULL");
         cnv->setColor(cher::CANVAS_CLR_REST);
         m_userScene->setCanvasCurrent(cnv);
     }
+
+    /* ids of the files saved before they were introduced, the bookmark states refer to them */
+    m_userScene->initializeIds();
     newscene = 0;
     m_saved = true;
     return true;
 }
 
+const entity::ProjectContainer *RootScene::getProjectContainer() const
+{
+    return m_container.get();
+}
+
 int RootScene::getStrokeLevel() const
 {
     return m_userScene->getStrokeLevel();
@@ -369,6 +791,12 @@ void RootScene::addCanvas(const osg::Matrix& R, const osg::Matrix& T, const std:
     m_saved = false;
 }
 
+void RootScene::addCanvases(const std::vector<osg::Matrix> &R, const std::vector<osg::Matrix> &T)
+{
+    m_userScene->addCanvases(m_undoStack, R, T);
+    m_saved = false;
+}
+
 void RootScene::addStroke(float u, float v, cher::EVENT event)
 {
     m_userScene->addStroke(m_undoStack, u, v, event);
@@ -399,6 +827,12 @@ void RootScene::addPhoto(const std::string& fname)
     m_saved = false;
 }
 
+void RootScene::addPhotos(const std::vector<std::string> &fnames)
+{
+    m_userScene->addPhotos(m_undoStack, fnames);
+    m_saved = false;
+}
+
 void RootScene::addBookmark(BookmarkWidget *widget, const osg::Vec3d &eye, const osg::Vec3d &center, const osg::Vec3d &up, const double &fov)
 {
     m_userScene->addBookmark(widget, eye, center, up, fov);
@@ -915,16 +1349,18 @@ entity::SceneState *RootScene::createSceneState() const
     state->setAxisFlag(this->getAxesVisibility());
     state->setBookmarksFlag(this->getBookmarkToolVisibility());
 
-    size_t sz = m_userScene->getNumCanvases();
-    for (size_t i=0; i<sz; ++i){
+    int sz = m_userScene->getNumCanvases();
+    if (sz == 0) return state.release();
+    state->setIdLimit(m_userScene->getIdUnique());
+    for (int i=0; i<sz; ++i){
         entity::Canvas* cnv = m_userScene->getCanvas(i);
         if (!cnv) continue;
-        state->pushDataFlag(cnv->getVisibilityAll());
-        state->pushToolFlag(cnv->getVisibilityFrameInternal());
+        state->setCanvasDataFlag(cnv->getId(), cnv->getVisibilityAll());
+        state->setCanvasToolFlag(cnv->getId(), cnv->getVisibilityFrameInternal());
         for (size_t j=0; j<cnv->getNumPhotos(); ++j){
             entity::Photo* photo = cnv->getPhoto(j);
             if (!photo) continue;
-            state->pushTransparency(photo->getTransparency());
+            state->setPhotoTransparency(photo->getId(), photo->getTransparency());
         }
     }
     return state.release();
@@ -933,33 +1369,35 @@ entity::SceneState *RootScene::createSceneState() const
 bool RootScene::setSceneState(const entity::SceneState *state)
 {
     if (!state) return false;
+    m_photoDirty = true;
 
-    this->setAxesVisibility(state->getAxisFlag());
-    this->setBookmarkToolVisibility(state->getBookmarksFlag());
+    if (this->getAxesVisibility() != state->getAxisFlag())
+        this->setAxesVisibility(state->getAxisFlag());
+    if (this->getBookmarkToolVisibility() != state->getBookmarksFlag())
+        this->setBookmarkToolVisibility(state->getBookmarksFlag());
 
     if (state->isEmpty()) return false;
 
-    const std::vector<bool>& cdf = state->getCanvasDataFlags();
-    const std::vector<bool>& ctf = state->getCanvasToolFlags();
-    const std::vector<float>& pt = state->getPhotoTransparencies();
-    size_t sz = m_userScene->getNumCanvases();
-    size_t szP = m_userScene->getNumPhotos();
-
-    if (cdf.size() != ctf.size()) return false;
-    if (cdf.size() != sz || pt.size() != szP) return false;
-
-    int idx = 0;
-    for (size_t i=0; i<sz; ++i){
+    /* only the values that differ from the current ones are set, so that the switches, the widgets and
+     * the photo geometries of the unchanged canvases are not dirtied; the canvases and photos that are
+     * not known to the state take the default values */
+    for (int i=0; i<m_userScene->getNumCanvases(); ++i){
         entity::Canvas* cnv = m_userScene->getCanvas(i);
         if (!cnv) continue;
-        cnv->setVisibilityAll(cdf[i]);
-        emit m_userScene->canvasVisibilitySet(m_userScene->getCanvasIndex(cnv) , cdf[i]);
-        cnv->setVisibilityFrameInternal(ctf[i]);
+        bool data = state->getCanvasDataFlag(cnv->getId());
+        if (cnv->getVisibilityAll() != data){
+            cnv->setVisibilityAll(data);
+            emit m_userScene->canvasVisibilitySet(i, data);
+        }
+        bool tool = state->getCanvasToolFlag(cnv->getId());
+        if (cnv->getVisibilityFrameInternal() != tool)
+            cnv->setVisibilityFrameInternal(tool);
         for (size_t j=0; j<cnv->getNumPhotos(); ++j){
             entity::Photo* photo = cnv->getPhoto(j);
             if (!photo) continue;
-            photo->setTransparency(pt[idx]);
-            idx++;
+            float t = state->getPhotoTransparency(photo->getId());
+            if (photo->getTransparency() != t)
+                photo->setTransparency(t);
         }
     }
 
@@ -23,6 +23,10 @@
 #include "SVMData.h"
 #include "CamPoseData.h"
 #include "DraggableWire.h"
+#include "ProjectContainer.h"
+#include "TextureResidency.h"
+#include "PhotoAtlas.h"
+#include "StrokeBatcher.h"
 
 #include <QUndoStack>
 #include <QModelIndex>
@@ -90,16 +94,36 @@ public:
     /*! \return true if canvas visible. */
     bool getCanvasVisibilityAll(entity::Canvas* canvas) const;
 
-    /*! A method to write the user scene to file. */
+    /*! A method to write the user scene to file. If the file has cher::PROJECT_EXTENSION extension, the scene is
+     * written as entity::ProjectContainer, otherwise it is written by means of osgDB plugins, e.g., as `.osgt`. */
     bool writeScenetoFile();
 
-    /*! A method to export the user scene to OBJ or 3DS format. It uses Parallel Transport Frame algorithm
-     * in order to convert shadered strokes into triangular meshes. */
-    bool exportSceneToFile(const std::string& name);
-
-    /*! \return true if scene was loaded successfully from file. */
+    /*! A method to export the user scene to OBJ, PLY or 3DS format. It uses Parallel Transport Frame algorithm
+     * in order to convert shadered strokes into triangular meshes. OBJ and PLY are streamed, see
+     * exportSceneToStream(); other formats are written by osgDB plugins.
+     * \param name is the file name to export to,
+     * \param layout defines whether the tubes are written as separate meshes or are welded per canvas,
+     * \param chordalError is the adaptive tessellation tolerance of the tubes; zero means the fixed
+     * tessellation, see entity::ShaderedEntity2D::getMeshRepresentation(). */
+    bool exportSceneToFile(const std::string& name, cher::MESH_EXPORT layout = cher::MESH_EXPORT_TUBES,
+                           float chordalError = 0.f);
+
+    /*! A method to load the user scene from file; both entity::ProjectContainer and osgDB supported formats are accepted.
+     * \return true if scene was loaded successfully from file. */
     bool loadSceneFromFile();
 
+    /*! A method to replace the current user scene by the scene which was read and prepared by SceneLoader.
+     * It performs only the part of scene loading which must be done on the GUI thread: the graph swap and
+     * initialization of canvas tools and shader programs.
+     * \param scene is the loaded scene, see SceneLoader::getScene(),
+     * \param container is the project container the scene was read from, if any.
+     * \return true if scene was set successfully. */
+    bool setLoadedScene(entity::UserScene* scene, entity::ProjectContainer* container);
+
+    /*! \return pointer on the project container the scene was loaded from, or NULL if the scene was not
+     * loaded from a container file. */
+    const entity::ProjectContainer* getProjectContainer() const;
+
     /*! \return the depth of where entity::Stroke geometries are located. */
     int getStrokeLevel() const;
 
@@ -118,6 +142,9 @@ public:
     /*! A method to add canvas to scene with provided rotation and translation matrices, as well as a name. */
     void addCanvas(const osg::Matrix& R, const osg::Matrix& T, const std::string& name);
 
+    /*! A method to add a set of canvases to scene as a single undo step, see UserScene::addCanvases(). */
+    void addCanvases(const std::vector<osg::Matrix>& R, const std::vector<osg::Matrix>& T);
+
     /*! A method to add/contribute to a stroke given local coordinates. */
     void addStroke(float u, float v, cher::EVENT event);
 
@@ -133,6 +160,9 @@ public:
     /*! A method to add specified photo to the current canvas. */
     void addPhoto(const std::string& fname);
 
+    /*! A method to add several photos to the current canvas as one undo step. */
+    void addPhotos(const std::vector<std::string>& fnames);
+
     /*! A method to add a new camera position as a bookmark to the BookmarkWidget, and also to the scene graph as entity::SceneState. */
     void addBookmark(BookmarkWidget* widget, const osg::Vec3d& eye, const osg::Vec3d& center, const osg::Vec3d& up, const double& fov);
 
@@ -238,24 +268,106 @@ public:
      * \sa entity::SceneState::stripDataFrom() */
     entity::SceneState* createSceneState() const;
 
-    /*! \param A pointer on SceneState instance which is served as a source for RootScene settings.
-     * \return Whether the operation was performed successfully (no size discrepancies found) or not. */
+    /*! A method to apply the scene state. Only the canvases and photos whose values differ from the state
+     * are changed, e.g., when switching between the bookmarks.
+     * \param A pointer on SceneState instance which is served as a source for RootScene settings.
+     * \return Whether the operation was performed successfully (the state is not empty) or not. */
     bool setSceneState(const entity::SceneState* state);
 
     /*! A method to obtain a bookmark tool associated with the entity::Bookmarks.
      * \param index is the tool index associated with the bookmark data. */
     entity::BookmarkTool* getBookmarkTool(int index);
 
+    /*! A method to choose the pyramid level of each photo texture so that it matches the projected on-screen
+     * size of the photo quad, while the total texture memory stays within the budget. When the budget is exceeded,
+     * the largest textures are coarsened first; the photos of invisible canvases and the photos outside of the
+     * viewport always take their coarsest level. The chosen levels which are not resident are paged in
+     * asynchronously from the project container. If the chosen level is tiled, only the tiles which overlap the
+     * viewport are attached to the photo, see entity::PhotoImage::requestTile(). The small photos are packed
+     * into the atlas as soon as their full resolution is resident, see PhotoAtlas. Then the canvases which are not seen are evicted as
+     * necessary, see TextureResidency. It is called before each frame, see GLWidget::paintGL(); the levels are
+     * only chosen again when the view, the canvases or the photo images have changed since the previous call.
+     * \param camera is the camera the scene is rendered with.
+     * \return texture memory of the chosen levels, in bytes. */
+    quint64 updatePhotoLevels(const osg::Camera* camera);
+
+    /*! A method to set the photo texture memory budget, in bytes. \sa updatePhotoLevels(). */
+    void setPhotoTextureBudget(quint64 bytes);
+
+    /*! \return the photo texture memory budget, in bytes. */
+    quint64 getPhotoTextureBudget() const;
+
+    /*! \return residency manager of the photo images, it is updated by updatePhotoLevels(). */
+    TextureResidency& getTextureResidency();
+
+    /*! \return atlas of the small photo images, it is updated by updatePhotoLevels(). */
+    PhotoAtlas& getPhotoAtlas();
+
+    /*! A method to merge the settled strokes of each canvas into a single batch and to lift the edited strokes out
+     * of it, see StrokeBatcher. It is called before each frame, see GLWidget::paintGL().
+     * \return true if any batch was rebuilt. */
+    bool updateStrokeBatches();
+
+    /*! A method to show or hide the intersection lines of the current canvas with all the other canvases, see
+     * updateCanvasIntersections(). */
+    void setCanvasIntersectionsVisibility(bool visible);
+
+    /*! \return true if the intersection lines with all the canvases are shown. */
+    bool getCanvasIntersectionsVisibility() const;
+
+    /*! A method to update the intersection lines of the current canvas with all the other canvases, see
+     * entity::UserScene::updateIntersections(). It is called before each frame, see GLWidget::paintGL().
+     * \return true if the lines were rebuilt. */
+    bool updateCanvasIntersections();
+
+    /*! \return batcher of the canvas strokes, it is updated by updateStrokeBatches(). */
+    StrokeBatcher& getStrokeBatcher();
+
 protected:
+    /*! A method to export the user scene into OBJ or PLY file by streaming the meshes one by one through
+     * MeshWriter. The meshes are generated in small parallel batches and are released right after they are
+     * written; the scene graph is not modified. */
+    bool exportSceneToStream(const std::string& name, cher::MESH_EXPORT layout, float chordalError);
+
+    /*! A method to attach the full resolution images to all the photo textures, e.g., before the scene is
+     * written to a file which does not store the photo pyramids; or to release them afterwards. */
+    void setPhotosFullResolution(bool full);
+
+    /*! \return true if the view, the canvas transforms and contents, or the photo images have changed since
+     * the photo levels were last chosen, see updatePhotoLevels(). The new state is remembered. */
+    bool isPhotoViewChanged(const osg::Matrix& VPW);
 
 private:
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    struct PhotoCanvasState{
+        PhotoCanvasState() : canvas(0), transform(0), content(0), numPhotos(0), visible(false) {}
+        bool operator==(const PhotoCanvasState& other) const;
+        const entity::Canvas* canvas;
+        unsigned int transform, content, numPhotos;
+        bool visible;
+    };
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
     osg::ref_ptr<entity::UserScene> m_userScene;
     osg::ref_ptr<entity::AxisGlobalTool> m_axisTool;
     osg::ref_ptr<osg::Group> m_bookmarkTools;
+    osg::ref_ptr<entity::ProjectContainer> m_container; /* mapped project file, if any */
     std::vector< osg::ref_ptr<entity::Entity2D> > m_buffer; /* copy-paste buffer */
     QUndoStack* m_undoStack;
     bool m_saved;
     bool m_visibilityBookmarkTool;
+    bool m_visibilityIntersections; /* intersection lines with all the canvases, see updateCanvasIntersections() */
+    quint64 m_photoBudget; /* photo texture memory budget, in bytes */
+    /* state of the view and the canvases the photo levels were last chosen for, see isPhotoViewChanged() */
+    osg::Matrix m_photoView;
+    std::vector<PhotoCanvasState> m_photoCanvases;
+    unsigned int m_photoDecodes;
+    bool m_photoDirty;
+    quint64 m_photoTotal;
+    std::vector<bool> m_photoSeen;
+    TextureResidency m_residency;
+    PhotoAtlas m_atlas;
+    StrokeBatcher m_strokeBatcher;
 };
 
 #endif // SCENE
@@ -0,0 +1,169 @@
+#include "SceneLoader.h"
+
+#include <QDebug>
+#include <QtGlobal>
+
+#include <osgDB/ReadFile>
+
+#include "ImageDecoder.h"
+#include "ImageCache.h"
+
+SceneLoader::SceneLoader(const std::string &path, QObject *parent)
+    : QObject(parent)
+    , m_filePath(path)
+    , m_scene(0)
+    , m_container(0)
+    , m_targetThread(this->thread())
+    , m_canceled(0)
+{
+}
+
+const std::string &SceneLoader::getFilePath() const
+{
+    return m_filePath;
+}
+
+entity::UserScene *SceneLoader::getScene() const
+{
+    return m_scene.get();
+}
+
+entity::ProjectContainer *SceneLoader::getContainer() const
+{
+    return m_container.get();
+}
+
+bool SceneLoader::isCanceled() const
+{
+    return m_canceled.load() != 0;
+}
+
+void SceneLoader::process()
+{
+    emit this->progressRangeChanged(0, 0);
+
+    bool success = this->readScene();
+    if (success){
+        int numCanvases = m_scene->getNumCanvases();
+        emit this->progressRangeChanged(0, numCanvases+1);
+        emit this->progressValueChanged(1);
+        for (int i=0; i<numCanvases && success; ++i){
+            success = !this->isCanceled() && this->prepareCanvas(m_scene->getCanvas(i));
+            emit this->progressValueChanged(i+2);
+        }
+    }
+
+    if (!success || this->isCanceled()){
+        if (this->isCanceled()) qInfo("SceneLoader: loading was canceled");
+        m_scene = 0;
+        m_container = 0;
+        success = false;
+    }
+    else{
+        /* QObjects of the scene were created on this thread; pass them to the GUI thread */
+        m_scene->moveToThread(m_targetThread);
+        m_scene->getBookmarksModel()->moveToThread(m_targetThread);
+    }
+    /* the photos keep their images, so that they can tell whether an image is shared, see entity::Photo::isImageShared() */
+    m_images.clear();
+    this->moveToThread(m_targetThread);
+
+    emit this->finished(success);
+}
+
+void SceneLoader::cancel()
+{
+    m_canceled.store(1);
+}
+
+bool SceneLoader::readScene()
+{
+    if (m_filePath == "") return false;
+
+    osg::ref_ptr<osg::Node> node;
+    if (entity::ProjectContainer::isContainerFile(m_filePath)){
+        m_container = new entity::ProjectContainer;
+        if (!m_container->open(m_filePath)){
+            qWarning("SceneLoader: could not open project container");
+            return false;
+        }
+        /* photos are paged in canvas by canvas, see prepareCanvas() */
+        node = m_container->readScene(false);
+    }
+    else
+        node = osgDB::readNodeFile(m_filePath);
+    if (!node.get()){
+        qWarning("SceneLoader: node is NULL");
+        return false;
+    }
+
+    m_scene = dynamic_cast<entity::UserScene*>(node.get());
+    if (!m_scene.get()){
+        qWarning("SceneLoader: could not load from file, or could not perform the dynamic_cast<entity::UserScene*>");
+        return false;
+    }
+    qDebug() << "Loaded scene, number of canvases: " << m_scene->getNumCanvases();
+    return true;
+}
+
+bool SceneLoader::prepareCanvas(entity::Canvas *canvas)
+{
+    if (!canvas){
+        qWarning("SceneLoader: canvas is NULL");
+        return false;
+    }
+
+    for (unsigned int j=0; j<canvas->getNumPhotos(); ++j){
+        entity::Photo* photo = canvas->getPhoto(j);
+        if (!photo) continue;
+        if (!m_container.get()){
+            /* the image was read together with the scene, the photos of the same content share it */
+            std::string hash = ImageCache::computeHash(photo->getImage());
+            if (!hash.empty() && m_images.find(hash) != m_images.end()){
+                photo->setPhotoImage(m_images[hash].get());
+                continue;
+            }
+            photo->getPhotoImage()->buildPyramid();
+            if (!hash.empty()) m_images[hash] = photo->getPhotoImage();
+            ImageCache::instance().insert(photo->getPhotoImage());
+            continue;
+        }
+
+        /* photos which share their image data refer to the same chunks, see entity::ProjectContainer::write() */
+        std::string key = m_container->getSharedPhotoKey(m_container->getStoredPhotoKey(canvas, j));
+        if (m_images.find(key) != m_images.end()){
+            photo->setPhotoImage(m_images[key].get());
+            continue;
+        }
+
+        /* only the coarsest pyramid level is paged in, the finer ones are requested when the photo is rendered,
+         * see RootScene::updatePhotoLevels() */
+        unsigned int numLevels = m_container->getNumPhotoLevels(key);
+        if (numLevels > 1){
+            entity::PhotoImage* image = photo->getPhotoImage();
+            image->setStoreKey(key);
+            image->setNumLevels(numLevels);
+            image->setLevel(numLevels-1);
+            osg::ref_ptr<osg::Image> level = m_container->readPhotoImage(entity::ProjectContainer::getLevelKey(key, numLevels-1));
+            if (level.get()) image->setLevelImage(numLevels-1, level.get());
+            else qWarning() << "SceneLoader: could not page in photo" << photo->getName().c_str();
+            m_images[key] = image;
+            ImageCache::instance().insert(image);
+        }
+        /* a project written without pyramids: the photo images are decoded in parallel and attached on the
+         * GUI thread as they complete */
+        else
+            ImageDecoder::instance().decode(photo, m_container.get(), key);
+    }
+
+    /* stroke curves */
+    for (unsigned int k=0; k<canvas->getNumStrokes(); ++k){
+        if (this->isCanceled()) return false;
+        entity::Stroke* stroke = canvas->getStroke(k);
+        if (!stroke) continue;
+        if (!stroke->redefineToCurve())
+            qWarning("SceneLoader: could not redefine stroke as curve");
+    }
+
+    return true;
+}
@@ -0,0 +1,93 @@
+#ifndef SCENELOADER_H
+#define SCENELOADER_H
+
+#include <string>
+#include <map>
+
+#include <QObject>
+#include <QThread>
+#include <QAtomicInt>
+
+#include <osg/ref_ptr>
+
+#include "UserScene.h"
+#include "ProjectContainer.h"
+#include "PhotoImage.h"
+
+/*! \class SceneLoader
+ * \brief Performs the GL-independent part of scene loading, so that it can be run on a worker thread.
+ *
+ * The loader parses the scene file (either entity::ProjectContainer or any osgDB supported format), queues
+ * decoding of the container photo images to ImageDecoder and fits stroke points to curves. It never touches the live scene graph; the loaded scene
+ * must be passed to RootScene::setLoadedScene() on the GUI thread which performs the graph swap and the
+ * initialization of tools and shader programs.
+ *
+ * Asynchronous usage example:
+ * \code
+ * QThread* thread = new QThread;
+ * SceneLoader* loader = new SceneLoader(path);
+ * loader->moveToThread(thread);
+ * QObject::connect(thread, SIGNAL(started()), loader, SLOT(process()));
+ * QObject::connect(loader, SIGNAL(finished(bool)), receiver, SLOT(onSceneLoaded(bool)));
+ * thread->start();
+ * \endcode
+ *
+ * When process() is done, the loader and the loaded scene are moved to the thread the loader was created
+ * within, so that they can be safely used and deleted there.
+*/
+class SceneLoader : public QObject
+{
+    Q_OBJECT
+public:
+    /*! Constructor.
+     * \param path is the file name to load the scene from. */
+    explicit SceneLoader(const std::string& path, QObject* parent = 0);
+
+    /*! \return file name the scene is loaded from. */
+    const std::string& getFilePath() const;
+
+    /*! \return pointer on the loaded scene, or NULL if the loading is not finished, failed or was canceled. */
+    entity::UserScene* getScene() const;
+
+    /*! \return pointer on the project container, if the scene was loaded from one. */
+    entity::ProjectContainer* getContainer() const;
+
+    /*! \return true if the loading was requested to be canceled. */
+    bool isCanceled() const;
+
+public slots:
+    /*! A method that performs loading. Normally it is triggered by QThread::started() signal. */
+    void process();
+
+    /*! A method to request cancellation of the loading. It is thread-safe and can be called directly from the
+     * GUI thread while process() is running. */
+    void cancel();
+
+signals:
+    /*! Signal is emitted when number of loading steps is known; (0, 0) range means the number is not known yet. */
+    void progressRangeChanged(int minimum, int maximum);
+
+    /*! Signal is emitted when a loading step is done. */
+    void progressValueChanged(int value);
+
+    /*! Signal is emitted when the loading is finished.
+     * \param success is true if the scene is ready to be set by RootScene::setLoadedScene(). */
+    void finished(bool success);
+
+protected:
+    /*! A method to parse the file into a scene with no photo images paged in (for the project container). */
+    bool readScene();
+
+    /*! A method to queue photo image decodes and to fit stroke curves of the given canvas. */
+    bool prepareCanvas(entity::Canvas* canvas);
+
+private:
+    std::string m_filePath;
+    osg::ref_ptr<entity::UserScene> m_scene;
+    osg::ref_ptr<entity::ProjectContainer> m_container;
+    std::map< std::string, osg::ref_ptr<entity::PhotoImage> > m_images; /*!< shared images by content hash or key. */
+    QThread* m_targetThread;
+    QAtomicInt m_canceled;
+};
+
+#endif // SCENELOADER_H
@@ -1,9 +1,29 @@
 #include "SceneState.h"
 
+#include <algorithm>
+
+#include "UserScene.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+namespace {
+/* keeps the sorted vector of ids unique */
+void setHidden(std::vector<unsigned int>& ids, unsigned int id, bool hidden)
+{
+    std::vector<unsigned int>::iterator it = std::lower_bound(ids.begin(), ids.end(), id);
+    bool found = it != ids.end() && *it == id;
+    if (hidden && !found)
+        ids.insert(it, id);
+    else if (!hidden && found)
+        ids.erase(it);
+}
+} // namespace
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
 entity::SceneState::SceneState()
     : osg::ProtectedGroup()
     , m_axisFlag(true)
     , m_bookmarksFlag(true)
+    , m_idLimit(0)
 {
 }
 
@@ -11,6 +31,11 @@ entity::SceneState::SceneState(const entity::SceneState &parent, osg::CopyOp cop
     : osg::ProtectedGroup(parent, copyop)
     , m_axisFlag(parent.m_axisFlag)
     , m_bookmarksFlag(parent.m_bookmarksFlag)
+    , m_canvasDataHidden(parent.m_canvasDataHidden)
+    , m_canvasToolHidden(parent.m_canvasToolHidden)
+    , m_photoIds(parent.m_photoIds)
+    , m_photoValues(parent.m_photoValues)
+    , m_idLimit(parent.m_idLimit)
     , m_canvasDataFlags(parent.m_canvasDataFlags)
     , m_canvasToolFlags(parent.m_canvasToolFlags)
     , m_photoTransparencies(parent.m_photoTransparencies)
@@ -37,6 +62,59 @@ bool entity::SceneState::getBookmarksFlag() const
     return m_bookmarksFlag;
 }
 
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+void entity::SceneState::setCanvasDataHidden(const std::vector<unsigned int> &ids)
+{
+    m_canvasDataHidden = ids;
+    std::sort(m_canvasDataHidden.begin(), m_canvasDataHidden.end());
+}
+
+const std::vector<unsigned int> &entity::SceneState::getCanvasDataHidden() const
+{
+    return m_canvasDataHidden;
+}
+
+void entity::SceneState::setCanvasToolHidden(const std::vector<unsigned int> &ids)
+{
+    m_canvasToolHidden = ids;
+    std::sort(m_canvasToolHidden.begin(), m_canvasToolHidden.end());
+}
+
+const std::vector<unsigned int> &entity::SceneState::getCanvasToolHidden() const
+{
+    return m_canvasToolHidden;
+}
+
+void entity::SceneState::setPhotoIds(const std::vector<unsigned int> &ids)
+{
+    m_photoIds = ids;
+}
+
+const std::vector<unsigned int> &entity::SceneState::getPhotoIds() const
+{
+    return m_photoIds;
+}
+
+void entity::SceneState::setPhotoValues(const std::vector<float> &transparencies)
+{
+    m_photoValues = transparencies;
+}
+
+const std::vector<float> &entity::SceneState::getPhotoValues() const
+{
+    return m_photoValues;
+}
+
+void entity::SceneState::setIdLimit(unsigned int id)
+{
+    m_idLimit = id;
+}
+
+unsigned int entity::SceneState::getIdLimit() const
+{
+    return m_idLimit;
+}
+
 void entity::SceneState::setCanvasDataFlags(const std::vector<bool> &flags)
 {
     m_canvasDataFlags = flags;
@@ -66,6 +144,7 @@ const std::vector<float> &entity::SceneState::getPhotoTransparencies() const
 {
     return m_photoTransparencies;
 }
+#endif // DOXYGEN_SHOULD_SKIP_THIS
 
 void entity::SceneState::stripDataFrom(RootScene *scene)
 {
@@ -73,139 +152,127 @@ void entity::SceneState::stripDataFrom(RootScene *scene)
     m_axisFlag = scene->getAxesVisibility();
     m_bookmarksFlag = scene->getBookmarkToolVisibility();
 
-    size_t sz = scene->getUserScene()->getNumCanvases();
-    m_canvasDataFlags.resize(sz);
-    m_canvasToolFlags.resize(sz);
-    for (size_t i=0; i<sz; ++i){
-        entity::Canvas* cnv = scene->getUserScene()->getCanvas(i);
+    entity::UserScene* user = scene->getUserScene();
+    int sz = user->getNumCanvases();
+    if (sz == 0) return;
+    m_idLimit = user->getIdUnique();
+    for (int i=0; i<sz; ++i){
+        entity::Canvas* cnv = user->getCanvas(i);
         if (!cnv) continue;
-        m_canvasDataFlags[i] = cnv->getVisibilityAll();
-        m_canvasToolFlags[i] = cnv->getVisibilityFrameInternal();
+        this->setCanvasDataFlag(cnv->getId(), cnv->getVisibilityAll());
+        this->setCanvasToolFlag(cnv->getId(), cnv->getVisibilityFrameInternal());
         for (size_t j=0; j < cnv->getNumPhotos(); ++j){
             entity::Photo* photo = cnv->getPhoto(j);
             if (!photo) continue;
-            float t = photo->getTransparency();
-            m_photoTransparencies.push_back(t);
+            this->setPhotoTransparency(photo->getId(), photo->getTransparency());
         }
     }
 }
 
 bool entity::SceneState::isEmpty() const
 {
-    if (m_canvasDataFlags.size() == 0 || m_canvasToolFlags.size() == 0)
-        return true;
-    return false;
+    return m_idLimit == 0 && !this->hasLegacyData();
 }
 
 void entity::SceneState::clear()
 {
+    m_canvasDataHidden.clear();
+    m_canvasToolHidden.clear();
+    m_photoIds.clear();
+    m_photoValues.clear();
+    m_idLimit = 0;
     m_canvasDataFlags.clear();
     m_canvasToolFlags.clear();
     m_photoTransparencies.clear();
 }
 
-void entity::SceneState::pushDataFlag(bool flag)
+bool entity::SceneState::getCanvasDataFlag(unsigned int id) const
 {
-    m_canvasDataFlags.push_back(flag);
+    return !std::binary_search(m_canvasDataHidden.begin(), m_canvasDataHidden.end(), id);
 }
 
-void entity::SceneState::popBackDataFlag()
+void entity::SceneState::setCanvasDataFlag(unsigned int id, bool flag)
 {
-    m_canvasDataFlags.pop_back();
+    setHidden(m_canvasDataHidden, id, !flag);
 }
 
-void entity::SceneState::pushToolFlag(bool flag)
+bool entity::SceneState::getCanvasToolFlag(unsigned int id) const
 {
-    m_canvasToolFlags.push_back(flag);
+    return !std::binary_search(m_canvasToolHidden.begin(), m_canvasToolHidden.end(), id);
 }
 
-void entity::SceneState::popBackToolFlag()
+void entity::SceneState::setCanvasToolFlag(unsigned int id, bool flag)
 {
-    m_canvasToolFlags.pop_back();
+    setHidden(m_canvasToolHidden, id, !flag);
 }
 
-void entity::SceneState::pushTransparency(float t)
+float entity::SceneState::getPhotoTransparency(unsigned int id) const
 {
-    m_photoTransparencies.push_back(t);
+    std::vector<unsigned int>::const_iterator it = std::lower_bound(m_photoIds.begin(), m_photoIds.end(), id);
+    if (it != m_photoIds.end() && *it == id && m_photoIds.size() == m_photoValues.size())
+        return m_photoValues[it - m_photoIds.begin()];
+    return this->getPhotoTransparencyDefault(id);
 }
 
-void entity::SceneState::popBackTransparency()
+void entity::SceneState::setPhotoTransparency(unsigned int id, float t)
 {
-    m_photoTransparencies.pop_back();
-}
-
-void entity::SceneState::insertDataFlag(int index, bool flag)
-{
-    if (index<0 || index>static_cast<int>(m_canvasDataFlags.size())){
-        qFatal("insertDataFlag called: index is out of range. "
-               "No insert will be performed. Scene state data is out of sync.");
-        return;
+    if (m_photoIds.size() != m_photoValues.size()){
+        qWarning("setPhotoTransparency: photo data is out of sync, it will be reset");
+        m_photoIds.clear();
+        m_photoValues.clear();
     }
-    m_canvasDataFlags.insert(m_canvasDataFlags.begin()+index, flag);
-
-}
-
-void entity::SceneState::eraseDataFlag(int index)
-{
-    if (index<0 || index>=static_cast<int>(m_canvasDataFlags.size())){
-        qFatal("eraseDataFlag called: index is out of range. "
-               "No erase will be performed. Scene state data is out of sync.");
-        return;
+    std::vector<unsigned int>::iterator it = std::lower_bound(m_photoIds.begin(), m_photoIds.end(), id);
+    size_t index = it - m_photoIds.begin();
+    bool found = it != m_photoIds.end() && *it == id;
+    if (t == this->getPhotoTransparencyDefault(id)){
+        if (!found) return;
+        m_photoIds.erase(it);
+        m_photoValues.erase(m_photoValues.begin() + index);
     }
-
-    m_canvasDataFlags.erase(m_canvasDataFlags.begin() + index);
-}
-
-void entity::SceneState::insertToolFlag(int index, bool flag)
-{
-    if (index<0 || index>static_cast<int>(m_canvasToolFlags.size())){
-        qFatal("insertToolFlag called: index is out of range. "
-               "No insert will be performed. Scene state data is out of sync.");
-        return;
+    else if (found)
+        m_photoValues[index] = t;
+    else {
+        m_photoIds.insert(it, id);
+        m_photoValues.insert(m_photoValues.begin() + index, t);
     }
-    m_canvasToolFlags.insert(m_canvasToolFlags.begin()+index, flag);
 }
 
-void entity::SceneState::eraseToolFlag(int index)
+float entity::SceneState::getPhotoTransparencyDefault(unsigned int id) const
 {
-    if (index<0 || index>=static_cast<int>(m_canvasToolFlags.size())){
-        qFatal("eraseToolFlag called: index is out of range. "
-               "No erase will be performed. Scene state data is out of sync.");
-        return;
-    }
-    m_canvasToolFlags.erase(m_canvasToolFlags.begin()+index);
+    /* the photos that were added after the state was taken, are not shown */
+    return (m_idLimit != 0 && id >= m_idLimit)? 0.f : 1.f;
 }
 
-void entity::SceneState::insertTransparency(int index, float t)
+bool entity::SceneState::hasLegacyData() const
 {
-    if (index<0 || index>static_cast<int>(m_photoTransparencies.size())){
-        qFatal("insertTransparency called: index is out of range. "
-               "No insert will be performed. Scene state data is out of sync.");
-        return;
-    }
-    m_photoTransparencies.insert(m_photoTransparencies.begin()+index, t);
+    return !m_canvasDataFlags.empty() || !m_canvasToolFlags.empty() || !m_photoTransparencies.empty();
 }
 
-void entity::SceneState::eraseTransparency(int start, int number)
+void entity::SceneState::convertLegacyData(entity::UserScene *scene)
 {
-    if (start<0 || start>=static_cast<int>(m_photoTransparencies.size()) ||
-            number<0 || number>static_cast<int>(m_photoTransparencies.size()) ||
-            start+number>static_cast<int>(m_photoTransparencies.size()) ){
-        qFatal("eraseTransparency called: index is out of range. "
-               "No erase will be performed. Scene state data is out of sync.");
-        return;
-    }
-    m_photoTransparencies.erase(m_photoTransparencies.begin()+start, m_photoTransparencies.begin()+start+number);
-}
+    if (!scene || !this->hasLegacyData()) return;
 
-void entity::SceneState::resetTransparency(int index, float t)
-{
-    if (index<0 || index>=static_cast<int>(m_photoTransparencies.size())){
-        qFatal("insertTransparency called: index is out of range. "
-               "No insert will be performed. Scene state data is out of sync.");
-        return;
+    m_idLimit = scene->getIdUnique();
+    size_t idx = 0;
+    for (int i=0; i<scene->getNumCanvases(); ++i){
+        entity::Canvas* cnv = scene->getCanvas(i);
+        if (!cnv) continue;
+        if (i < static_cast<int>(m_canvasDataFlags.size()))
+            this->setCanvasDataFlag(cnv->getId(), m_canvasDataFlags[i]);
+        if (i < static_cast<int>(m_canvasToolFlags.size()))
+            this->setCanvasToolFlag(cnv->getId(), m_canvasToolFlags[i]);
+        for (size_t j=0; j<cnv->getNumPhotos(); ++j, ++idx){
+            entity::Photo* photo = cnv->getPhoto(j);
+            if (!photo || idx >= m_photoTransparencies.size()) continue;
+            this->setPhotoTransparency(photo->getId(), m_photoTransparencies[idx]);
+        }
     }
-    m_photoTransparencies[index] = t;
+    if (m_canvasDataFlags.size() != static_cast<size_t>(scene->getNumCanvases()) || idx != m_photoTransparencies.size())
+        qWarning("convertLegacyData: scene state does not match the scene, the rest of the data is skipped");
+
+    m_canvasDataFlags.clear();
+    m_canvasToolFlags.clear();
+    m_photoTransparencies.clear();
 }
 
 bool entity::SceneState::addSVMData(const osg::Matrix &wall, const osg::Matrix &floor)
@@ -256,6 +323,12 @@ REGISTER_OBJECT_WRAPPER(SceneState_Wrapper
 {
     ADD_BOOL_SERIALIZER(AxisFlag, true);
     ADD_BOOL_SERIALIZER(BookmarksFlag, true);
+    ADD_LIST_SERIALIZER(CanvasDataHidden, std::vector<unsigned int>);
+    ADD_LIST_SERIALIZER(CanvasToolHidden, std::vector<unsigned int>);
+    ADD_LIST_SERIALIZER(PhotoIds, std::vector<unsigned int>);
+    ADD_LIST_SERIALIZER(PhotoValues, std::vector<float>);
+    ADD_UINT_SERIALIZER(IdLimit, 0);
+    /* legacy positional data, empty unless read from an older file */
     ADD_LIST_SERIALIZER(CanvasDataFlags, std::vector<bool>);
     ADD_LIST_SERIALIZER(CanvasToolFlags, std::vector<bool>);
     ADD_LIST_SERIALIZER(PhotoTransparencies, std::vector<float>);
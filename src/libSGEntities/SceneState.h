@@ -12,6 +12,7 @@
 class RootScene;
 
 namespace entity{
+class UserScene;
 
 /*! \class SceneState
  * \brief A class to describe the current state of the scene, e.g., state of switches.
@@ -20,6 +21,11 @@ namespace entity{
  * The scene state helps to preserve and use later values like switches values that define
  * visibility flags for data, construction tools; and also photo transparencies.
  *
+ * The canvases and photos are referred to by their ids, see entity::Canvas::getId() and entity::Photo::getId(),
+ * and only the values which differ from the defaults are stored, i.e., the hidden canvases and the photos which
+ * are not opaque. This way the states do not need to be updated when canvases or photos are added or removed,
+ * and a state of a scene which is mostly visible takes only a few bytes.
+ *
  * It inherits osg::ProtectedGroup so that to be able to take advantage of OSG serialization since
  * the scene state is saved together with each bookmark data.
  *
@@ -50,20 +56,32 @@ public:
     /*! A getter method to be used within OSG serialization procedures. */
     bool getBookmarksFlag() const;
 
-    /*! A setter method to be used within OSG serialization procedures. */
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    void setCanvasDataHidden(const std::vector<unsigned int>& ids);
+    const std::vector<unsigned int>& getCanvasDataHidden() const;
+
+    void setCanvasToolHidden(const std::vector<unsigned int>& ids);
+    const std::vector<unsigned int>& getCanvasToolHidden() const;
+
+    void setPhotoIds(const std::vector<unsigned int>& ids);
+    const std::vector<unsigned int>& getPhotoIds() const;
+
+    void setPhotoValues(const std::vector<float>& transparencies);
+    const std::vector<float>& getPhotoValues() const;
+
+    void setIdLimit(unsigned int id);
+    unsigned int getIdLimit() const;
+
+    /* positional data of the files saved before the ids were introduced, see convertLegacyData() */
     void setCanvasDataFlags(const std::vector<bool>& flags);
-    /*! A getter method to be used within OSG serialization procedures. */
     const std::vector<bool>& getCanvasDataFlags() const;
 
-    /*! A setter method to be used within OSG serialization procedures. */
     void setCanvasToolFlags(const std::vector<bool>& flags);
-    /*! A getter method to be used within OSG serialization procedures. */
     const std::vector<bool>& getCanvasToolFlags() const;
 
-    /*! A setter method to be used within OSG serialization procedures. */
     void setPhotoTransparencies(const std::vector<float>& transparencies);
-    /*! A getter method to be used within OSG serialization procedures. */
     const std::vector<float>& getPhotoTransparencies() const;
+#endif // DOXYGEN_SHOULD_SKIP_THIS
 
     /*! A method that translates all the necessary RootScene settings into internals of SceneState.
      * \param scene is the pointer on RootScene variable
@@ -77,59 +95,42 @@ public:
     /*! A method that clear all the vector containers. */
     void clear();
 
-    /*! A method to push into vector container a canvas data flag.
+    /*! \param id is the canvas id, see entity::Canvas::getId().
+     * \return true if the canvas content is visible within the state. Canvases are visible by default. */
+    bool getCanvasDataFlag(unsigned int id) const;
+
+    /*! A method to set the canvas content visibility within the state.
+     * \param id is the canvas id, see entity::Canvas::getId()
      * \param flag is true for visible and false for invisible */
-    void pushDataFlag(bool flag);
+    void setCanvasDataFlag(unsigned int id, bool flag);
 
-    /*! A method to pop out from vector with canvas data flags.*/
-    void popBackDataFlag();
+    /*! \param id is the canvas id, see entity::Canvas::getId().
+     * \return true if the canvas frame is visible within the state. Frames are visible by default. */
+    bool getCanvasToolFlag(unsigned int id) const;
 
-    /*! A method to push into vector container a canvas tool flag.
+    /*! A method to set the canvas frame visibility within the state.
+     * \param id is the canvas id, see entity::Canvas::getId()
      * \param flag is true for visible and false for invisible */
-    void pushToolFlag(bool flag);
+    void setCanvasToolFlag(unsigned int id, bool flag);
 
-    /*! A method to pop out from vector with canvas tool flags.*/
-    void popBackToolFlag();
+    /*! \param id is the photo id, see entity::Photo::getId().
+     * \return the photo transparency within the state. By default the photos are opaque, except for the
+     * photos added after the state was taken, which are hidden, see getIdLimit(). */
+    float getPhotoTransparency(unsigned int id) const;
 
-    /*! A method to push into vector container a photo transparency value.
+    /*! A method to set the photo transparency within the state. Only the values that differ from the
+     * default are stored.
+     * \param id is the photo id, see entity::Photo::getId()
      * \param t is within range from 0 to 1 */
-    void pushTransparency(float t);
-
-    /*! A method to pop out from the vector container of photo transparency values. */
-    void popBackTransparency();
-
-    /*! A method to insert into vector with canvas data flags.
-     * \param index is specified index at which needed to be inserted
-     * \param flag is the value to be inserted */
-    void insertDataFlag(int index, bool flag);
+    void setPhotoTransparency(unsigned int id, float t);
 
-    /*! A method to erase from vector with canvas data flags.
-     * \param index is specified index which needs to be erased */
-    void eraseDataFlag(int index);
+    /*! \return true if the state was read from a file with the positional per-canvas data. */
+    bool hasLegacyData() const;
 
-    /*! A method to insert into vector with canvas tool flags.
-     * \param index is specified index at which needed to be inserted
-     * \param flag is the value to be inserted */
-    void insertToolFlag(int index, bool flag);
-
-    /*! A method to erase from vector with canvas tool flags.
-     * \param index is specified index which needs to be erased */
-    void eraseToolFlag(int index);
-
-    /*! A method to insert into vector with photo transparency values.
-     * \param index is specified index at which needed to be inserted
-     * \param t is the value to be inserted */
-    void insertTransparency(int index, float t);
-
-    /*! A method to erase from vector with photo transparencies.
-     * \param start is specified start index  from which needs to be erased (inclusive)
-     * \param number is the number of consequtive elements to erase */
-    void eraseTransparency(int start, int number);
-
-    /*! A method to reset a vector value with photo transparencies.
-     * \param index is specified index  which needs to be reset
-     * \param t is the new transparency value */
-    void resetTransparency(int index, float t);
+    /*! A method to translate the positional data of the older files into the id-keyed data. The scene
+     * canvases and photos must be in the same order as when the state was taken, i.e., right after loading.
+     * \param scene is the scene whose ids are assigned, see entity::UserScene::initializeIds() */
+    void convertLegacyData(entity::UserScene* scene);
 
     /*! A method to create a new instance of entity::SVMData and add it as a child to the scene state.
      * \param wall is matrix transform for the current canvas,
@@ -147,12 +148,22 @@ public:
 
     osg::ProtectedGroup* getChildData();
 
+protected:
+    /*! \return the transparency of a photo which is not stored explicitly, see getPhotoTransparency(). */
+    float getPhotoTransparencyDefault(unsigned int id) const;
+
 private:
     bool m_axisFlag;  /*!< Boolean flag indicating whether global axis visibility is on (true) or off (false). */
     bool m_bookmarksFlag; /*!< Boolean flag indicating whether bookmarks visibility is on (true) or off (false). */
-    std::vector<bool> m_canvasDataFlags; /*!< Vector of boolean flags indicating whether canvas content visibility is on (true) or off (false). */
-    std::vector<bool> m_canvasToolFlags; /*!< Vector of boolean flags indicating whether canvas tools visibility is on (true) or off (false). */
-    std::vector<float> m_photoTransparencies; /*!< Vector of values indicating photo transparency level - from 0 (invisible) to 1 (visibile). */
+    std::vector<unsigned int> m_canvasDataHidden; /*!< Sorted ids of the canvases whose content is invisible. */
+    std::vector<unsigned int> m_canvasToolHidden; /*!< Sorted ids of the canvases whose tools are invisible. */
+    std::vector<unsigned int> m_photoIds; /*!< Sorted ids of the photos whose transparency differs from the default. */
+    std::vector<float> m_photoValues; /*!< Transparencies of m_photoIds - from 0 (invisible) to 1 (visibile). */
+    unsigned int m_idLimit; /*!< Next scene id at the moment the state was taken, 0 for an empty state. */
+
+    std::vector<bool> m_canvasDataFlags; /*!< Positional canvas content flags of the older files. */
+    std::vector<bool> m_canvasToolFlags; /*!< Positional canvas tool flags of the older files. */
+    std::vector<float> m_photoTransparencies; /*!< Positional photo transparencies of the older files. */
 
 }; // class SceneState
 
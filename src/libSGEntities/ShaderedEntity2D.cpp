@@ -1,5 +1,8 @@
 #include "ShaderedEntity2D.h"
 
+#include <cmath>
+#include <algorithm>
+
 #include <QtGlobal>
 #include <QDebug>
 
@@ -14,6 +17,10 @@ entity::ShaderedEntity2D::ShaderedEntity2D(unsigned int drawing, AttributeBindin
     , m_isShadered(false)
     , m_colorNormal(color)
     , m_colorSelected(cher::STROKE_CLR_SELECTED)
+    , m_mesh(0)
+    , m_meshVertices(0)
+    , m_meshRevision(0)
+    , m_meshChordalError(0.f)
 {
     osg::Vec4Array* colors = new osg::Vec4Array;
     osg::Vec3Array* verts = new osg::Vec3Array;
@@ -37,6 +44,10 @@ entity::ShaderedEntity2D::ShaderedEntity2D(const entity::ShaderedEntity2D &copy,
     , m_program(copy.m_program)
     , m_isShadered(copy.m_isShadered)
     , m_colorNormal(copy.m_colorNormal)
+    , m_mesh(0)
+    , m_meshVertices(0)
+    , m_meshRevision(0)
+    , m_meshChordalError(0.f)
 {
 }
 
@@ -54,10 +65,16 @@ void entity::ShaderedEntity2D::initializeProgram(ProgramEntity2D *p, unsigned in
     /* to disable Stroke shader program, e.g., if it is phantom stroke, override with an empty program
      * The OFF option would not work for the already established program (that is attached to Canvas::m_geodeStrokes), for
      * more details see: http://forum.openscenegraph.org/viewtopic.php?t=11783&view=previous */
-    this->getOrCreateStateSet()->setAttributeAndModes(new osg::Program, osg::StateAttribute::PROTECTED);
+    this->setStateSet(p->getPhantomStateSet());
     m_isShadered = false;
 }
 
+void entity::ShaderedEntity2D::inheritProgram()
+{
+    /* the state set loaded along with the entity is dropped as well, the geode program overrides it anyway */
+    this->setStateSet(0);
+}
+
 bool entity::ShaderedEntity2D::copyFrom(const entity::ShaderedEntity2D *copy)
 {
     if (!copy || !this->getLines()) return false;
@@ -274,6 +291,104 @@ ProgramEntity2D *entity::ShaderedEntity2D::getProgram() const
 }
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
+osg::Node *entity::ShaderedEntity2D::getMeshRepresentation(float) const
+{
+    return nullptr;
+}
+
+osg::Node *entity::ShaderedEntity2D::getMesh(float chordalError)
+{
+    const osg::Array* vertices = this->getVertexArray();
+    if (!vertices) return nullptr;
+
+    /* the vertex array could be replaced altogether, e.g., by the curve fitting */
+    if (!this->getCachedMesh(chordalError)){
+        m_mesh = this->getMeshRepresentation(chordalError);
+        m_meshVertices = vertices;
+        m_meshRevision = this->getGeometryRevision();
+        m_meshChordalError = chordalError;
+    }
+    return m_mesh.get();
+}
+
+osg::Node *entity::ShaderedEntity2D::getCachedMesh(float chordalError) const
+{
+    const osg::Array* vertices = this->getVertexArray();
+    if (!vertices || !m_mesh.get() || m_meshVertices.get() != vertices || m_meshRevision != this->getGeometryRevision()
+            || m_meshChordalError != chordalError)
+        return nullptr;
+    return m_mesh.get();
+}
+
+void entity::ShaderedEntity2D::releaseMesh()
+{
+    m_mesh = 0;
+    m_meshVertices = 0;
+}
+
+unsigned int entity::ShaderedEntity2D::getGeometryRevision() const
+{
+    const osg::Array* vertices = this->getVertexArray();
+    return vertices? vertices->getModifiedCount() : 0;
+}
+
+unsigned int entity::ShaderedEntity2D::getExtrusionSides(float radius, float chordalError)
+{
+    if (chordalError <= 0.f || radius <= 0.f) return cher::EXTRUSION_MESH_SHAPE;
+    if (chordalError >= radius) return cher::EXTRUSION_MESH_SHAPE_MIN;
+
+    /* sagitta of a side: r * (1 - cos(pi/n)) <= e */
+    double halfAngle = std::acos(1.0 - static_cast<double>(chordalError) / radius);
+    unsigned int sides = static_cast<unsigned int>(std::ceil(cher::PI / halfAngle));
+    return std::max(cher::EXTRUSION_MESH_SHAPE_MIN, std::min(cher::EXTRUSION_MESH_SHAPE_MAX, sides));
+}
+
+std::vector<osg::Vec3f> entity::ShaderedEntity2D::simplifyPath(const std::vector<osg::Vec3f> &path, float chordalError)
+{
+    if (chordalError <= 0.f || path.size() <= 3) return path;
+
+    std::vector<bool> keep(path.size(), false);
+    keep.front() = true;
+    keep.back() = true;
+
+    std::vector< std::pair<size_t, size_t> > spans;
+    spans.push_back(std::make_pair(size_t(0), path.size()-1));
+    while (!spans.empty()){
+        size_t first = spans.back().first, last = spans.back().second;
+        spans.pop_back();
+        if (last <= first+1) continue;
+
+        /* the farthest point from the chord */
+        const osg::Vec3f& a = path[first];
+        osg::Vec3f chord = path[last] - a;
+        double length2 = chord.length2();
+        double maxDistance = -1;
+        size_t farthest = first;
+        for (size_t i=first+1; i<last; ++i){
+            osg::Vec3f ap = path[i] - a;
+            double t = length2 > 0? std::max(0.0, std::min(1.0, (ap * chord) / length2)) : 0.0;
+            double distance = (ap - chord * t).length();
+            if (distance > maxDistance){
+                maxDistance = distance;
+                farthest = i;
+            }
+        }
+        if (maxDistance > chordalError){
+            keep[farthest] = true;
+            spans.push_back(std::make_pair(first, farthest));
+            spans.push_back(std::make_pair(farthest, last));
+        }
+    }
+
+    std::vector<osg::Vec3f> result;
+    for (size_t i=0; i<path.size(); ++i)
+        if (keep[i]) result.push_back(path[i]);
+    /* straight run: keep one interior ring, as the uniform path always had some */
+    if (result.size() == 2)
+        result.insert(result.begin()+1, (result.front() + result.back()) * 0.5f);
+    return result;
+}
+
 osg::Vec3f entity::ShaderedEntity2D::getPoint3(unsigned int i) const
 {
     osg::Vec2f p2 = this->getPoint(i);
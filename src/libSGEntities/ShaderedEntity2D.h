@@ -2,9 +2,11 @@
 #define SHADEREDENTITY2D_H
 
 #include <string>
+#include <vector>
 #include <osg/Geometry>
 #include <osg/Program>
 #include <osg/MatrixTransform>
+#include <osg/Node>
 
 #include "Entity2D.h"
 #include "libSGControls/ProgramEntity2D.h"
@@ -26,7 +28,8 @@ public:
     ShaderedEntity2D(const entity::ShaderedEntity2D& copy, const osg::CopyOp& copyop);
 
     /*! A method tok be called after it is initialized. It initializes the program that entity is going to use
-     * for shadering. */
+     * for shadering. Until the entity is re-defined to shader, it uses the phantom state set, i.e., it is drawn
+     * without the program of its canvas geode. \sa ProgramEntity2D::getPhantomStateSet() */
     virtual void initializeProgram(ProgramEntity2D* p, unsigned int mode = GL_LINE_STRIP);
 
     /*! A method to be used to copy the input geometry data. It is assumed *this is empty.
@@ -52,10 +55,48 @@ public:
     /*! \return number of vertices. */
     int getNumPoints() const;
 
+    /*! A method that generates mesh representation of the entity, e.g., as a tube. The default implementation
+     * returns NULL, i.e., the entity type has no mesh representation.
+     * \param chordalError is the maximal allowed distance between the mesh and the ideal tube surface; the
+     * number of tube sides and the path sampling are adapted to it, see getExtrusionSides() and simplifyPath().
+     * Zero means the fixed tessellation of cher::EXTRUSION_MESH_SHAPE sides along every path point.
+     * \return pointer on the created mesh structure. The structure is not attached to the scene graph. */
+    virtual osg::Node* getMeshRepresentation(float chordalError = 0.f) const;
+
+    /*! A method to obtain mesh representation of the entity from the per-entity cache. The mesh is
+     * re-generated by getMeshRepresentation() only if the geometry revision or the chordal error has changed
+     * since it was cached. The method can be called from a worker thread provided no other thread accesses
+     * the same entity.
+     * \return pointer on the cached mesh structure, or NULL if entity has no mesh representation. */
+    osg::Node* getMesh(float chordalError = 0.f);
+
+    /*! \return the cached mesh if it is still valid for the entity geometry and the chordal error, or NULL
+     * otherwise; unlike getMesh(), nothing is generated nor stored. \sa MeshGenerator::generate() */
+    osg::Node* getCachedMesh(float chordalError = 0.f) const;
+
+    /*! A method to drop the cached mesh, e.g., when the entity is kept only for undo, see CanvasSnapshot. */
+    void releaseMesh();
+
+    /*! \return revision number of the entity geometry which is increased each time the vertices are modified. */
+    unsigned int getGeometryRevision() const;
+
 protected:
     /*! A method to tune the look of the entity with shader effects. */
     virtual bool redefineToShader(osg::MatrixTransform* t) = 0;
 
+    /*! A method to drop the phantom state set, or the one the entity was read with, so that the entity inherits
+     * the program and the rest of the state from its canvas geode. It is called by redefineToShader(). */
+    void inheritProgram();
+
+    /*! \return number of tube sides so that the polygonal cross-section deviates from the circle of the given
+     * radius by no more than the chordal error; cher::EXTRUSION_MESH_SHAPE is returned for zero error. */
+    static unsigned int getExtrusionSides(float radius, float chordalError);
+
+    /*! A method to drop the path points which can be removed without the path deviating by more than the
+     * chordal error (Douglas-Peucker), so that straight runs collapse to a few rings while tight bends keep
+     * their sampling. At least one interior point is always kept. */
+    static std::vector<osg::Vec3f> simplifyPath(const std::vector<osg::Vec3f>& path, float chordalError);
+
 public:
     /*! A method to perform translation of the stroke in delta movement.
      * \param du is delta movement in X local axis direction, \param dv is delta movement in Y local axis direction. */
@@ -103,6 +144,12 @@ protected:
     bool                                m_isShadered;
     osg::Vec4f                          m_colorNormal, m_colorSelected;
 
+private:
+    osg::ref_ptr<osg::Node>             m_mesh; /*!< cached mesh representation */
+    osg::ref_ptr<const osg::Array>      m_meshVertices; /*!< vertex array the mesh was generated from */
+    unsigned int                        m_meshRevision; /*!< geometry revision the mesh was generated at */
+    float                               m_meshChordalError; /*!< chordal error the mesh was generated with */
+
 }; // class ShaderedEntity2D
 
 } // namespace entity
@@ -57,50 +57,57 @@ bool entity::Stroke::copyFrom(const entity::ShaderedEntity2D *copy)
     return true;
 }
 
-bool entity::Stroke::redefineToShape(osg::MatrixTransform *t)
+bool entity::Stroke::redefineToCurve()
 {
-    if (m_isCurved && m_isShadered) return true;
+    if (m_isCurved) return true;
 
-    if (!m_isCurved){
-        osg::ref_ptr<osg::Vec3Array> path = static_cast<osg::Vec3Array*>(this->getVertexArray());
-        if (!path.get()){
-            qWarning("Vertex data is NULL");
-            return false;
-        }
-        qDebug() << "path.samples=" << path->size();
+    osg::ref_ptr<osg::Vec3Array> path = static_cast<osg::Vec3Array*>(this->getVertexArray());
+    if (!path.get()){
+        qWarning("Vertex data is NULL");
+        return false;
+    }
+    qDebug() << "path.samples=" << path->size();
 
-        osg::Vec4Array* colors = static_cast<osg::Vec4Array*>(this->getColorArray());
-        if (!colors){
-            qWarning("Color data is NULL");
-            return false;
-        }
+    osg::Vec4Array* colors = static_cast<osg::Vec4Array*>(this->getColorArray());
+    if (!colors){
+        qWarning("Color data is NULL");
+        return false;
+    }
 
-        /* set up auto threshold if necessary */
-        float tolerance = -1.f;
-        if (tolerance < 0.f){
-            /* auto threshold helps to avoid under-fitting or over-fitting of the curve
+    /* set up auto threshold if necessary */
+    float tolerance = -1.f;
+    if (tolerance < 0.f){
+        /* auto threshold helps to avoid under-fitting or over-fitting of the curve
          * depending on the scale of drawn stroke. */
-//            float length = this->getLength();
-//            const double scale = 0.001;
-            tolerance = 0.0001; //length * scale;
-        }
-
-        // normalize the coordinates
-        osg::Vec3f center = this->getBoundingBox().center();
-        double scale = this->normalize(path.get(), center);
-        OsgPathFitter<osg::Vec3Array, osg::Vec3f, float> fitter;
-        fitter.init(*(path.get()));
-        osg::ref_ptr<osg::Vec3Array> curves = fitter.fit(tolerance);
-        if (!curves.get()){
-            qWarning("Curves is NULL");
-            return false;
-        }
-        // denormalize the coordinates
-        this->denormalize(curves.get(), center, scale);
+//        float length = this->getLength();
+//        const double scale = 0.001;
+        tolerance = 0.0001; //length * scale;
+    }
 
-        this->setVertexArray(curves.get());
-        m_isCurved = true;
+    // normalize the coordinates
+    osg::Vec3f center = this->getBoundingBox().center();
+    double scale = this->normalize(path.get(), center);
+    OsgPathFitter<osg::Vec3Array, osg::Vec3f, float> fitter;
+    fitter.init(*(path.get()));
+    osg::ref_ptr<osg::Vec3Array> curves = fitter.fit(tolerance);
+    if (!curves.get()){
+        qWarning("Curves is NULL");
+        return false;
     }
+    // denormalize the coordinates
+    this->denormalize(curves.get(), center, scale);
+
+    this->setVertexArray(curves.get());
+    m_isCurved = true;
+    return true;
+}
+
+bool entity::Stroke::redefineToShape(osg::MatrixTransform *t)
+{
+    if (m_isCurved && m_isShadered) return true;
+
+    if (!this->redefineToCurve())
+        return false;
 
     if (this->redefineToShader(t==0? MainWindow::instance().getCanvasCurrent()->getTransform() : t) ) {
         m_isShadered = true;
@@ -137,7 +144,7 @@ bool entity::Stroke::redefineToShape(osg::MatrixTransform *t)
     return true;
 }
 
-osg::Node *entity::Stroke::getMeshRepresentation() const
+osg::Node *entity::Stroke::getMeshRepresentation(float chordalError) const
 {
     if (!m_isCurved){
         qCritical("The stroke was never sampled and cannot be converted to the mesh.");
@@ -156,8 +163,10 @@ osg::Node *entity::Stroke::getMeshRepresentation() const
         }
         path.push_back(vertices->at(i));
     }
+    path = ShaderedEntity2D::simplifyPath(path, chordalError);
 
-    PTFTube extrusion(path, cher::STROKE_MESH_RADIUS, cher::EXTRUSION_MESH_SHAPE);
+    PTFTube extrusion(path, cher::STROKE_MESH_RADIUS,
+                      ShaderedEntity2D::getExtrusionSides(cher::STROKE_MESH_RADIUS, chordalError));
     extrusion.build();
 
     return extrusion.generateTriMesh();
@@ -186,8 +195,8 @@ bool entity::Stroke::redefineToShader(osg::MatrixTransform *t)
     Q_CHECK_PTR(colors);
     this->setVertexAttribArray(1, colors, osg::Array::BIND_PER_VERTEX);
 
-    /* apply shader to the state set */
-    this->getOrCreateStateSet()->setAttributeAndModes(m_program.get(), osg::StateAttribute::ON);
+    /* the shader is applied by the state set of the stroke geode */
+    this->inheritProgram();
 
     m_isShadered = true;
     return true;
@@ -83,9 +83,16 @@ public:
      * \return true upon success. */
     virtual bool redefineToShape(osg::MatrixTransform* t = 0);
 
+    /*! A method that performs the CPU-only part of redefineToShape(): fitting of the stroke's points to a set of
+     * Bezier curves. It does not touch any shader or GL state, therefore it can be run from a worker thread,
+     * e.g., by SceneLoader, as long as the stroke is not yet a part of the rendered scene.
+     * \return true upon success, or if the stroke was already curved. */
+    bool redefineToCurve();
+
     /*! A method that generates mesh representation of the stroke using Parallel Transport Algorithm.
+     * \param chordalError is the tessellation tolerance, see entity::ShaderedEntity2D::getMeshRepresentation().
      * \return pointer on the cretated mesh structure. The structure is not attached to the scene graph. */
-    osg::Node* getMeshRepresentation() const;
+    virtual osg::Node* getMeshRepresentation(float chordalError = 0.f) const;
 
 protected:
     /*! A method to tune the look of the stroke with smoother connections and thicker linewidth.
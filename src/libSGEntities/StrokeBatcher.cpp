@@ -0,0 +1,319 @@
+#include "StrokeBatcher.h"
+
+#include <set>
+#include <algorithm>
+
+#include <QDebug>
+
+#include <osg/PrimitiveSet>
+#include <osg/Array>
+
+#include "Settings.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+namespace {
+
+/* Excludes the batched strokes from rendering, their control points are drawn by the batch of the canvas. */
+class SkipCullCallback : public osg::Drawable::CullCallback
+{
+public:
+    bool cull(osg::NodeVisitor*, osg::Drawable*, osg::RenderInfo*) const
+    {
+        return true;
+    }
+};
+
+osg::Drawable::CullCallback* getSkipCallback()
+{
+    static osg::ref_ptr<osg::Drawable::CullCallback> callback = new SkipCullCallback;
+    return callback.get();
+}
+
+} // namespace
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+StrokeBatcher::StrokeBatcher()
+    : m_settle(cher::STROKE_BATCH_SETTLE)
+    , m_frame(0)
+    , m_enabled(true)
+{
+    m_timer.start();
+}
+
+void StrokeBatcher::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+    if (enabled) return;
+    this->detach();
+    m_batches.clear();
+    m_statistics = Statistics();
+}
+
+bool StrokeBatcher::isEnabled() const
+{
+    return m_enabled;
+}
+
+void StrokeBatcher::setSettleTime(qint64 msec)
+{
+    m_settle = msec;
+    for (std::map<const entity::Canvas*, Batch>::iterator it = m_batches.begin(); it != m_batches.end(); ++it)
+        it->second.dirty = true;
+}
+
+qint64 StrokeBatcher::getSettleTime() const
+{
+    return m_settle;
+}
+
+bool StrokeBatcher::update(entity::UserScene *scene)
+{
+    if (!scene || !m_enabled) return false;
+    m_frame++;
+    qint64 now = m_timer.elapsed();
+
+    Statistics statistics;
+    for (int i=0; i<scene->getNumCanvases(); ++i){
+        entity::Canvas* canvas = scene->getCanvas(i);
+        if (!canvas) continue;
+        Batch& batch = m_batches[canvas];
+        if (batch.canvas.get() != canvas){
+            /* a new canvas, or a new one at the address of a deleted one */
+            batch = Batch();
+            batch.canvas = canvas;
+        }
+        batch.frame = m_frame;
+        if (isChanged(batch, canvas, now) && this->updateBatch(batch, now)) statistics.numRebuilds++;
+
+        if (!canvas->getVisibilityAll()) continue;
+        statistics.numDrawCallsUnbatched += canvas->getNumStrokes();
+        statistics.numDrawCalls += canvas->getNumStrokes() - batch.ranges.size();
+        statistics.numStrokes += batch.ranges.size();
+        if (batch.ranges.empty()) continue;
+        statistics.numBatches++;
+        statistics.numDrawCalls += batch.geode->getDrawable(0)->asGeometry()->getNumPrimitiveSets();
+    }
+
+    /* forget the batches of the canvases which are no longer within the scene */
+    for (std::map<const entity::Canvas*, Batch>::iterator it = m_batches.begin(); it != m_batches.end(); ){
+        if (it->second.frame == m_frame){
+            ++it;
+            continue;
+        }
+        this->releaseBatch(it->second);
+        m_batches.erase(it++);
+    }
+    m_statistics = statistics;
+    return statistics.numRebuilds > 0;
+}
+
+void StrokeBatcher::detach()
+{
+    for (std::map<const entity::Canvas*, Batch>::iterator it = m_batches.begin(); it != m_batches.end(); ++it){
+        this->releaseBatch(it->second);
+        it->second.dirty = true;
+    }
+}
+
+const StrokeBatcher::Statistics &StrokeBatcher::getStatistics() const
+{
+    return m_statistics;
+}
+
+osg::Geode *StrokeBatcher::getBatch(const entity::Canvas *canvas) const
+{
+    std::map<const entity::Canvas*, Batch>::const_iterator it = m_batches.find(canvas);
+    if (it == m_batches.end() || it->second.canvas.get() != canvas || it->second.ranges.empty()) return NULL;
+    return it->second.geode.get();
+}
+
+bool StrokeBatcher::isBatched(const entity::Stroke *stroke) const
+{
+    unsigned int first = 0, count = 0;
+    return this->getRange(stroke, first, count);
+}
+
+bool StrokeBatcher::getRange(const entity::Stroke *stroke, unsigned int &first, unsigned int &count) const
+{
+    if (!stroke) return false;
+    for (std::map<const entity::Canvas*, Batch>::const_iterator it = m_batches.begin(); it != m_batches.end(); ++it){
+        const Batch& batch = it->second;
+        if (batch.records.find(stroke) == batch.records.end()) continue;
+        for (size_t r=0; r<batch.ranges.size(); ++r){
+            if (batch.ranges[r].stroke.get() != stroke) continue;
+            first = batch.ranges[r].first;
+            count = batch.ranges[r].count;
+            return true;
+        }
+    }
+    return false;
+}
+
+qint64 StrokeBatcher::getTimeToSettle() const
+{
+    qint64 settle = -1;
+    for (std::map<const entity::Canvas*, Batch>::const_iterator it = m_batches.begin(); it != m_batches.end(); ++it){
+        if (it->second.settle >= 0 && (settle < 0 || it->second.settle < settle))
+            settle = it->second.settle;
+    }
+    if (settle < 0) return -1;
+    return qMax(Q_INT64_C(0), settle - m_timer.elapsed());
+}
+
+bool StrokeBatcher::isCandidate(const entity::Canvas *canvas, const entity::Stroke *stroke)
+{
+    if (!canvas || !stroke || !stroke->getIsShadered()) return false;
+    if (stroke == canvas->getStrokeCurrent()) return false;
+    const std::vector<entity::Entity2D*>& selected = canvas->getEntitiesSelected();
+    if (std::find(selected.begin(), selected.end(), stroke) != selected.end()) return false;
+    const osg::Vec3Array* vertices = dynamic_cast<const osg::Vec3Array*>(stroke->getVertexArray());
+    const osg::Vec4Array* colors = dynamic_cast<const osg::Vec4Array*>(stroke->getColorArray());
+    return vertices && colors && vertices->size() >= 4 && colors->size() == vertices->size();
+}
+
+bool StrokeBatcher::isChanged(const StrokeBatcher::Batch &batch, const entity::Canvas *canvas, qint64 now)
+{
+    if (batch.dirty) return true;
+    if (batch.settle >= 0 && now >= batch.settle) return true;
+    return batch.revision != canvas->getContentRevision()
+            || batch.numStrokes != canvas->getNumStrokes()
+            || batch.current != canvas->getStrokeCurrent()
+            || batch.selected != canvas->getEntitiesSelected();
+}
+
+bool StrokeBatcher::updateBatch(StrokeBatcher::Batch &batch, qint64 now)
+{
+    osg::ref_ptr<entity::Canvas> canvas;
+    if (!batch.canvas.lock(canvas)) return false;
+    batch.revision = canvas->getContentRevision();
+    batch.numStrokes = canvas->getNumStrokes();
+    batch.current = canvas->getStrokeCurrent();
+    batch.selected = canvas->getEntitiesSelected();
+    batch.settle = -1;
+    batch.dirty = false;
+
+    /* an edited stroke is timed anew, the strokes which are no longer within the canvas are forgotten */
+    std::vector<entity::Stroke*> settled;
+    for (unsigned int j=0; j<canvas->getNumStrokes(); ++j){
+        entity::Stroke* stroke = canvas->getStroke(j);
+        if (!stroke) continue;
+        Record& record = batch.records[stroke];
+        const osg::Array* vertices = stroke->getVertexArray();
+        const osg::Array* colors = stroke->getColorArray();
+        unsigned int vertexRevision = vertices? vertices->getModifiedCount() : 0;
+        unsigned int colorRevision = colors? colors->getModifiedCount() : 0;
+        if (record.frame == 0 || record.vertices != vertices || record.colors != colors
+                || record.vertexRevision != vertexRevision || record.colorRevision != colorRevision){
+            record.vertices = vertices;
+            record.colors = colors;
+            record.vertexRevision = vertexRevision;
+            record.colorRevision = colorRevision;
+            record.changed = now;
+        }
+        record.frame = m_frame;
+        bool candidate = isCandidate(canvas.get(), stroke);
+        if (candidate && now - record.changed >= m_settle){
+            settled.push_back(stroke);
+            continue;
+        }
+        if (candidate && (batch.settle < 0 || record.changed + m_settle < batch.settle))
+            batch.settle = record.changed + m_settle;
+        if (stroke->getCullCallback() == getSkipCallback())
+            stroke->setCullCallback(0);
+    }
+    for (std::map<const entity::Stroke*, Record>::iterator it = batch.records.begin(); it != batch.records.end(); ){
+        if (it->second.frame == m_frame) ++it;
+        else batch.records.erase(it++);
+    }
+    if (settled.size() < cher::STROKE_BATCH_MIN) settled.clear();
+
+    /* the batch is rebuilt only when the set of the settled strokes changes */
+    bool same = settled.size() == batch.ranges.size();
+    for (size_t r=0; r<batch.ranges.size() && same; ++r)
+        same = batch.ranges[r].stroke.get() == settled[r];
+    if (same) return false;
+
+    if (settled.empty()){
+        this->releaseBatch(batch);
+        return true;
+    }
+    this->buildBatch(batch, settled);
+    return true;
+}
+
+void StrokeBatcher::buildBatch(StrokeBatcher::Batch &batch, const std::vector<entity::Stroke *> &strokes)
+{
+    osg::ref_ptr<entity::Canvas> canvas;
+    if (!batch.canvas.lock(canvas)) return;
+    if (!batch.geode.get()){
+        batch.geode = new osg::Geode;
+        batch.geode->setName("StrokeBatch");
+        batch.geode->setNodeMask(cher::MASK_STROKEBATCH_IN);
+    }
+    if (batch.ranges.empty() && !canvas->attachStrokeBatch(batch.geode.get())){
+        qWarning("StrokeBatcher: could not attach batch to the canvas");
+        return;
+    }
+
+    /* the control points of all the strokes within one buffer, a range per stroke */
+    osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array;
+    osg::ref_ptr<osg::Vec4Array> colors = new osg::Vec4Array;
+    std::vector<Range> ranges;
+    for (size_t i=0; i<strokes.size(); ++i){
+        const osg::Vec3Array* points = static_cast<const osg::Vec3Array*>(strokes[i]->getVertexArray());
+        const osg::Vec4Array* pointColors = static_cast<const osg::Vec4Array*>(strokes[i]->getColorArray());
+        Range range;
+        range.stroke = strokes[i];
+        range.first = vertices->size();
+        range.count = points->size();
+        vertices->insert(vertices->end(), points->begin(), points->end());
+        colors->insert(colors->end(), pointColors->begin(), pointColors->end());
+        ranges.push_back(range);
+    }
+
+    osg::ref_ptr<osg::Geometry> geometry = new osg::Geometry;
+    geometry->setUseDisplayList(false);
+    geometry->setUseVertexBufferObjects(true);
+    geometry->setVertexArray(vertices.get());
+    geometry->setColorArray(colors.get(), osg::Array::BIND_PER_VERTEX);
+    geometry->setVertexAttribArray(0, vertices.get(), osg::Array::BIND_PER_VERTEX);
+    geometry->setVertexAttribArray(1, colors.get(), osg::Array::BIND_PER_VERTEX);
+#ifdef OSG_HAS_MULTIDRAWARRAYS
+    osg::MultiDrawArrays* lines = new osg::MultiDrawArrays(GL_LINES_ADJACENCY_EXT);
+    for (size_t r=0; r<ranges.size(); ++r)
+        lines->add(ranges[r].first, ranges[r].count);
+    geometry->addPrimitiveSet(lines);
+#else
+    for (size_t r=0; r<ranges.size(); ++r)
+        geometry->addPrimitiveSet(new osg::DrawArrays(GL_LINES_ADJACENCY_EXT, ranges[r].first, ranges[r].count));
+#endif
+    batch.geode->removeDrawables(0, batch.geode->getNumDrawables());
+    batch.geode->addDrawable(geometry.get());
+
+    /* the batched strokes are not drawn on their own, the lifted ones draw themselves again, e.g., the ones
+     * removed from the canvas, since they can be brought back by undo */
+    std::set<const entity::Stroke*> batched(strokes.begin(), strokes.end());
+    for (size_t r=0; r<batch.ranges.size(); ++r){
+        osg::ref_ptr<entity::Stroke> stroke;
+        if (batch.ranges[r].stroke.lock(stroke) && batched.find(stroke.get()) == batched.end()
+                && stroke->getCullCallback() == getSkipCallback())
+            stroke->setCullCallback(0);
+    }
+    batch.ranges.swap(ranges);
+    for (size_t i=0; i<strokes.size(); ++i)
+        strokes[i]->setCullCallback(getSkipCallback());
+}
+
+void StrokeBatcher::releaseBatch(StrokeBatcher::Batch &batch)
+{
+    for (size_t r=0; r<batch.ranges.size(); ++r){
+        osg::ref_ptr<entity::Stroke> stroke;
+        if (batch.ranges[r].stroke.lock(stroke) && stroke->getCullCallback() == getSkipCallback())
+            stroke->setCullCallback(0);
+    }
+    batch.ranges.clear();
+    osg::ref_ptr<entity::Canvas> canvas;
+    if (!batch.geode.get()) return;
+    if (batch.canvas.lock(canvas)) canvas->detachStrokeBatch(batch.geode.get());
+    batch.geode->removeDrawables(0, batch.geode->getNumDrawables());
+}
@@ -0,0 +1,152 @@
+#ifndef STROKEBATCHER_H
+#define STROKEBATCHER_H
+
+#include <vector>
+#include <map>
+
+#include <QtGlobal>
+#include <QElapsedTimer>
+
+#include <osg/ref_ptr>
+#include <osg/observer_ptr>
+#include <osg/Geode>
+#include <osg/Geometry>
+
+#include "UserScene.h"
+#include "Canvas.h"
+#include "Stroke.h"
+
+/*! \class StrokeBatcher
+ * \brief Merges the settled strokes of each canvas into a single static geometry, so that a canvas with many
+ * strokes is drawn by a single multi-draw call instead of one draw call per stroke.
+ *
+ * A stroke is settled when it is shadered, it is neither selected nor the current stroke, and its control points
+ * and colors did not change for the settle time, see setSettleTime(). A canvas is batched when it has at least
+ * cher::STROKE_BATCH_MIN settled strokes. The batch concatenates the control points and colors of the settled
+ * strokes into one vertex buffer, and keeps the index range of each stroke within it, see getRange().
+ * The batch geode is attached to the canvas group data and shares the state set of the stroke geode, i.e., the
+ * canvas stroke program. Each stroke range is drawn as GL_LINES_ADJACENCY_EXT by an osg::MultiDrawArrays, or by
+ * a draw call per range if OpenSceneGraph is built without it.
+ *
+ * The strokes themselves stay within the scene graph, e.g., for picking, selection, editing and serialization,
+ * but the batched ones are skipped by the cull traversal. A stroke which is selected or edited is lifted out of
+ * the batch and draws itself until it settles again. The batches are never written, see detach().
+ *
+ * A canvas is re-examined stroke by stroke only when its content revision, number of strokes, current stroke or
+ * selection changes, or when one of its strokes is due to settle; the other canvases cost a constant time per
+ * update. Since an idle view is not repainted, the view schedules an update by getTimeToSettle().
+*/
+class StrokeBatcher
+{
+public:
+    /*! Draw statistics of the visible strokes as of the last update. */
+    struct Statistics{
+        Statistics() : numBatches(0), numStrokes(0), numDrawCalls(0), numDrawCallsUnbatched(0), numRebuilds(0) {}
+        unsigned int numBatches; /*!< number of batched canvases. */
+        unsigned int numStrokes; /*!< number of strokes drawn by the batches. */
+        unsigned int numDrawCalls; /*!< stroke draw calls per frame. */
+        unsigned int numDrawCallsUnbatched; /*!< stroke draw calls per frame if there were no batches. */
+        unsigned int numRebuilds; /*!< number of batches rebuilt by the last update. */
+    };
+
+    /*! Constructor, the batcher is enabled. */
+    StrokeBatcher();
+
+    /*! A method to enable or disable the batches. When they are disabled, all the batches are released and
+     * the strokes are drawn one by one. */
+    void setEnabled(bool enabled);
+
+    /*! \return true if the batches are enabled. */
+    bool isEnabled() const;
+
+    /*! A method to set the time a stroke has to stay unchanged before it is batched.
+     * \param msec is the settle time in milliseconds, cher::STROKE_BATCH_SETTLE by default. */
+    void setSettleTime(qint64 msec);
+
+    /*! \return the settle time in milliseconds. */
+    qint64 getSettleTime() const;
+
+    /*! A method to lift the changed, selected and current strokes out of the batches, and to merge the strokes
+     * which have settled. It is called before each frame, see RootScene::updateStrokeBatches().
+     * \return true if any batch was rebuilt. */
+    bool update(entity::UserScene* scene);
+
+    /*! A method to remove the batches from their canvases and to let the strokes draw themselves, e.g., before
+     * the scene is written to file. The batches are restored by the next update(). */
+    void detach();
+
+    /*! \return draw statistics as of the last update. */
+    const Statistics& getStatistics() const;
+
+    /*! \return the batch geode of the canvas, or NULL if the canvas is not batched. */
+    osg::Geode* getBatch(const entity::Canvas* canvas) const;
+
+    /*! \return true if the stroke is drawn by a batch. */
+    bool isBatched(const entity::Stroke* stroke) const;
+
+    /*! A method to obtain the range of the stroke control points within the batch vertex buffer of its canvas.
+     * \param first is the index of the first control point, \param count is the number of control points.
+     * \return false if the stroke is not batched. */
+    bool getRange(const entity::Stroke* stroke, unsigned int& first, unsigned int& count) const;
+
+    /*! \return time in milliseconds until the next stroke settles, or -1 if there is no stroke to settle. The view
+     * is repainted after that time so that the strokes are batched while the view is idle, see GLWidget::paintGL(). */
+    qint64 getTimeToSettle() const;
+
+protected:
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+    struct Record{
+        Record() : vertices(0), colors(0), vertexRevision(0), colorRevision(0), changed(0), frame(0) {}
+        const osg::Array* vertices;
+        const osg::Array* colors;
+        unsigned int vertexRevision, colorRevision;
+        qint64 changed; /*!< time of the last change of the stroke. */
+        unsigned int frame; /*!< last update the stroke was found within the canvas. */
+    };
+    struct Range{
+        osg::observer_ptr<entity::Stroke> stroke;
+        unsigned int first, count;
+    };
+    struct Batch{
+        Batch() : revision(0), numStrokes(0), current(0), settle(-1), frame(0), dirty(true) {}
+        osg::observer_ptr<entity::Canvas> canvas;
+        osg::ref_ptr<osg::Geode> geode;
+        std::vector<Range> ranges;
+        std::map<const entity::Stroke*, Record> records;
+        /* the canvas state as of the last examination */
+        unsigned int revision, numStrokes;
+        const entity::Stroke* current;
+        std::vector<entity::Entity2D*> selected;
+        qint64 settle; /*!< time the next stroke settles at, or -1 if there is none. */
+        unsigned int frame; /*!< last update the canvas was found within the scene. */
+        bool dirty; /*!< the canvas has to be examined regardless of its state. */
+    };
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+    /*! \return true if the stroke can be drawn by the batch of the canvas, regardless of how long it is unchanged. */
+    static bool isCandidate(const entity::Canvas* canvas, const entity::Stroke* stroke);
+
+    /*! \return true if the canvas strokes may have changed since the batch was last examined, or if one of them
+     * is due to settle. */
+    static bool isChanged(const Batch& batch, const entity::Canvas* canvas, qint64 now);
+
+    /*! A method to update the records of the canvas strokes and to rebuild the canvas batch if the set of the
+     * settled strokes has changed. \return true if the batch was rebuilt. */
+    bool updateBatch(Batch& batch, qint64 now);
+
+    /*! A method to concatenate the strokes into the batch geometry. */
+    void buildBatch(Batch& batch, const std::vector<entity::Stroke*>& strokes);
+
+    /*! A method to release the batch of the canvas and let its strokes draw themselves. */
+    void releaseBatch(Batch& batch);
+
+private:
+    std::map<const entity::Canvas*, Batch> m_batches;
+    Statistics m_statistics;
+    QElapsedTimer m_timer;
+    qint64 m_settle;
+    unsigned int m_frame;
+    bool m_enabled;
+};
+
+#endif // STROKEBATCHER_H
@@ -0,0 +1,160 @@
+#include "TextureResidency.h"
+
+#include <map>
+#include <set>
+
+#include <QDebug>
+
+#include "Settings.h"
+#include "Photo.h"
+
+TextureResidency::TextureResidency()
+    : m_budget(cher::PHOTO_RESIDENCY_BUDGET)
+    , m_maxAge(cher::PHOTO_RESIDENCY_AGE)
+{
+    m_timer.start();
+}
+
+void TextureResidency::setBudget(quint64 bytes)
+{
+    m_budget = bytes;
+}
+
+quint64 TextureResidency::getBudget() const
+{
+    return m_budget;
+}
+
+void TextureResidency::setMaxAge(qint64 msec)
+{
+    m_maxAge = msec;
+}
+
+qint64 TextureResidency::getMaxAge() const
+{
+    return m_maxAge;
+}
+
+bool TextureResidency::update(entity::UserScene *scene, const std::vector<bool> &seen)
+{
+    if (!scene) return false;
+    qint64 now = m_timer.elapsed();
+    bool changed = false;
+
+    /* forget the deleted canvases, before their address can be taken by a new canvas */
+    for (Records::iterator it = m_records.begin(); it != m_records.end();){
+        if (!it->second.canvas.valid())
+            m_records.erase(it++);
+        else
+            ++it;
+    }
+
+    /* usage of each canvas; a shared image is accounted for by the first canvas it is found within, and it is
+     * never evicted while any of its canvases is seen */
+    quint64 total = 0;
+    std::vector<Record*> records;
+    std::map<const entity::PhotoImage*, const entity::Canvas*> owners;
+    std::set<const entity::PhotoImage*> kept;
+    for (int i=0; i<scene->getNumCanvases(); ++i){
+        entity::Canvas* canvas = scene->getCanvas(i);
+        if (!canvas) continue;
+        Records::iterator it = m_records.find(canvas);
+        if (it == m_records.end()){
+            Record record;
+            record.canvas = canvas;
+            record.lastSeen = now;
+            record.evicted = false;
+            it = m_records.insert(std::make_pair(canvas, record)).first;
+        }
+        Record& record = it->second;
+        bool isSeen = i < static_cast<int>(seen.size()) && seen[i];
+        if (isSeen){
+            record.lastSeen = now;
+            record.evicted = false;
+        }
+        else
+            records.push_back(&record);
+
+        for (unsigned int j=0; j<canvas->getNumPhotos(); ++j){
+            const entity::Photo* photo = canvas->getPhoto(j);
+            if (!photo) continue;
+            if (owners.find(photo->getPhotoImage()) == owners.end()) owners[photo->getPhotoImage()] = canvas;
+            if (isSeen) kept.insert(photo->getPhotoImage());
+        }
+        Usage usage = this->getUsage(canvas, owners);
+        changed = changed || usage.host != record.usage.host || usage.texture != record.usage.texture;
+        record.usage = usage;
+        total += usage.host + usage.texture;
+    }
+
+    /* the canvases that are not seen: the long unseen ones, then the least recently seen ones until within budget */
+    for (;;){
+        Record* lru = 0;
+        for (size_t k=0; k<records.size(); ++k){
+            const Record* record = records[k];
+            if (record->evicted || record->usage.host + record->usage.texture == 0) continue;
+            if (!lru || record->lastSeen < lru->lastSeen) lru = records[k];
+        }
+        if (!lru) break;
+        if (total <= m_budget && now - lru->lastSeen <= m_maxAge) break;
+
+        qDebug() << "TextureResidency: evicting photos of" << lru->canvas->getName().c_str();
+        this->evict(lru->canvas.get(), kept);
+        total -= lru->usage.host + lru->usage.texture;
+        lru->usage = this->getUsage(lru->canvas.get(), owners);
+        total += lru->usage.host + lru->usage.texture;
+        lru->evicted = true;
+        changed = true;
+    }
+
+    return changed;
+}
+
+TextureResidency::Usage TextureResidency::getUsage(const entity::Canvas *canvas) const
+{
+    Records::const_iterator it = m_records.find(canvas);
+    if (it == m_records.end() || !it->second.canvas.valid()) return Usage();
+    return it->second.usage;
+}
+
+quint64 TextureResidency::getTotalBytes() const
+{
+    quint64 total = 0;
+    for (Records::const_iterator it = m_records.begin(); it != m_records.end(); ++it){
+        if (it->second.canvas.valid())
+            total += it->second.usage.host + it->second.usage.texture;
+    }
+    return total;
+}
+
+bool TextureResidency::isEvicted(const entity::Canvas *canvas) const
+{
+    Records::const_iterator it = m_records.find(canvas);
+    return it != m_records.end() && it->second.canvas.valid() && it->second.evicted;
+}
+
+void TextureResidency::evict(entity::Canvas *canvas, const std::set<const entity::PhotoImage *> &kept)
+{
+    if (!canvas) return;
+    for (unsigned int j=0; j<canvas->getNumPhotos(); ++j){
+        entity::Photo* photo = canvas->getPhoto(j);
+        if (photo && kept.find(photo->getPhotoImage()) == kept.end())
+            photo->getPhotoImage()->evict();
+    }
+}
+
+TextureResidency::Usage TextureResidency::getUsage(const entity::Canvas *canvas,
+                                                   const std::map<const entity::PhotoImage *, const entity::Canvas *> &owners) const
+{
+    Usage usage;
+    std::set<const entity::PhotoImage*> counted;
+    for (unsigned int j=0; j<canvas->getNumPhotos(); ++j){
+        const entity::Photo* photo = canvas->getPhoto(j);
+        if (!photo || !counted.insert(photo->getPhotoImage()).second) continue;
+        std::map<const entity::PhotoImage*, const entity::Canvas*>::const_iterator it = owners.find(photo->getPhotoImage());
+        if (it == owners.end() || it->second != canvas) continue;
+        usage.host += photo->getPhotoImage()->getHostBytes();
+        usage.texture += photo->getPhotoImage()->getTextureBytes();
+    }
+    return usage;
+}
@@ -0,0 +1,94 @@
+#ifndef TEXTURERESIDENCY_H
+#define TEXTURERESIDENCY_H
+
+#include <vector>
+#include <map>
+#include <set>
+
+#include <QElapsedTimer>
+
+#include <osg/observer_ptr>
+
+#include "UserScene.h"
+#include "Canvas.h"
+#include "PhotoImage.h"
+
+/*! \class TextureResidency
+ * \brief Keeps the photo images of the scene resident in host and GPU memory within a budget.
+ *
+ * The residency is managed per canvas. A canvas is seen when it is visible and at least one of its photos is
+ * within the viewport. When the memory taken by the photos of all the canvases exceeds the budget, the canvases
+ * which are not seen are evicted in the least recently seen order, see entity::PhotoImage::evict(). The canvases
+ * which were not seen for longer than the maximal age are evicted regardless of the budget. An evicted photo
+ * keeps only its coarsest pyramid level; the finer levels are paged in asynchronously from the project container
+ * when the canvas is seen again, see RootScene::updatePhotoLevels().
+*/
+class TextureResidency
+{
+public:
+    /*! Memory taken by the photos of a canvas. */
+    struct Usage{
+        Usage() : host(0), texture(0) {}
+        quint64 host; /*!< host memory of the resident pyramid levels, in bytes. */
+        quint64 texture; /*!< GPU memory of the photo textures, in bytes. */
+    };
+
+    /*! Constructor, sets up budget and age from cher::PHOTO_RESIDENCY_BUDGET and cher::PHOTO_RESIDENCY_AGE. */
+    TextureResidency();
+
+    /*! A method to set the memory budget of all the photos, host and GPU memory together, in bytes. */
+    void setBudget(quint64 bytes);
+
+    /*! \return the memory budget, in bytes. */
+    quint64 getBudget() const;
+
+    /*! A method to set the time after which a canvas that is not seen is evicted, in milliseconds. */
+    void setMaxAge(qint64 msec);
+
+    /*! \return the time after which a canvas that is not seen is evicted, in milliseconds. */
+    qint64 getMaxAge() const;
+
+    /*! A method to update the usage records and to evict the canvases as necessary.
+     * \param scene is the user scene,
+     * \param seen contains a flag for each canvas of the scene whether it is seen in the current frame.
+     * \return true if memory usage of any canvas has changed since the previous update. */
+    bool update(entity::UserScene* scene, const std::vector<bool>& seen);
+
+    /*! \return memory taken by the photos of the canvas as of the last update. */
+    Usage getUsage(const entity::Canvas* canvas) const;
+
+    /*! \return memory taken by the photos of all the canvases as of the last update, in bytes. */
+    quint64 getTotalBytes() const;
+
+    /*! \return true if the canvas was evicted and was not seen since. */
+    bool isEvicted(const entity::Canvas* canvas) const;
+
+protected:
+    /*! A method to evict all the photos of the canvas but the ones which share their image with a seen canvas.
+     * \param canvas is the canvas to evict,
+     * \param kept is the list of images of the seen canvases. */
+    void evict(entity::Canvas* canvas, const std::set<const entity::PhotoImage*>& kept);
+
+    /*! \return memory taken by the images of the canvas, each image counted only by its owner canvas.
+     * \param canvas is the canvas of the record,
+     * \param owners maps each image of the scene to the first canvas it is found within. */
+    Usage getUsage(const entity::Canvas* canvas,
+                   const std::map<const entity::PhotoImage*, const entity::Canvas*>& owners) const;
+
+private:
+    struct Record{
+        osg::observer_ptr<entity::Canvas> canvas;
+        qint64 lastSeen;
+        Usage usage;
+        bool evicted;
+    };
+
+    typedef std::map<const entity::Canvas*, Record> Records;
+
+    Records m_records; /*!< usage records keyed by canvas, a record of a deleted canvas is dropped on update */
+    QElapsedTimer m_timer;
+    quint64 m_budget;
+    qint64 m_maxAge;
+};
+
+#endif // TEXTURERESIDENCY_H
@@ -266,6 +266,7 @@ entity::FrameTool::FrameTool()
     , m_geodeRotation(new osg::Geode)
 
     , m_geomIntersect(new osg::Geometry)
+    , m_geomNeighbours(new osg::Geometry)
 
     , m_geomNormal1(new osg::Geometry)
     , m_geomNormal2(new osg::Geometry)
@@ -325,8 +326,16 @@ void entity::FrameTool::initializeSG()
     m_geomIntersect->addPrimitiveSet(new osg::DrawArrays(osg::PrimitiveSet::LINE_STRIP, 0,4));
     m_geomIntersect->getOrCreateStateSet()->setAttributeAndModes(ls, osg::StateAttribute::ON | osg::StateAttribute::OVERRIDE);
 
+    m_geomNeighbours->setVertexArray(new osg::Vec3Array);
+    osg::Vec4Array* colorNeighbours = new osg::Vec4Array(1);
+    (*colorNeighbours)[0] = cher::CANVAS_CLR_INTERSECTION;
+    m_geomNeighbours->setColorArray(colorNeighbours, osg::Array::BIND_OVERALL);
+    m_geomNeighbours->addPrimitiveSet(new osg::DrawArrays(osg::PrimitiveSet::LINES, 0, 0));
+    m_geomNeighbours->getOrCreateStateSet()->setAttributeAndModes(ls, osg::StateAttribute::ON | osg::StateAttribute::OVERRIDE);
+
     /* scene graph structure */
     m_geodeIntersect->addDrawable(m_geomIntersect);
+    m_geodeIntersect->addDrawable(m_geomNeighbours);
 
     m_geodeNormal->addDrawable(m_geomNormal1);
     m_geodeNormal->addDrawable(m_geomNormal2);
@@ -565,6 +574,25 @@ void entity::FrameTool::setIntersection(const osg::Vec3f &P1, const osg::Vec3f &
     this->updateGeometry(m_geomIntersect);
 }
 
+void entity::FrameTool::setNeighbourIntersections(const std::vector<osg::Vec3f> &points)
+{
+    osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(m_geomNeighbours->getVertexArray());
+    osg::DrawArrays* lines = static_cast<osg::DrawArrays*>(m_geomNeighbours->getPrimitiveSet(0));
+    Q_CHECK_PTR(verts);
+    Q_CHECK_PTR(lines);
+    verts->assign(points.begin(), points.begin() + (points.size() - points.size()%2));
+    verts->dirty();
+    lines->setCount(verts->size());
+    lines->dirty();
+
+    this->updateGeometry(m_geomNeighbours);
+}
+
+unsigned int entity::FrameTool::getNumNeighbourIntersections() const
+{
+    return m_geomNeighbours->getVertexArray()->getNumElements() / 2;
+}
+
 void entity::FrameTool::setColorIntersection(const osg::Vec4f &colorIntersect)
 {
     osg::Vec4Array* colorInter = static_cast<osg::Vec4Array*>(m_geomIntersect->getColorArray());
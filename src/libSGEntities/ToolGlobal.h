@@ -230,7 +230,8 @@ protected:
  * Each geode represents a single functionality / element within the canvas frame:
  *
  * * GeodeWire is the non-editable canvas wire
- * * GeodeIntersect contains the geometry of two canvas intersection (normally would contained within the previous canvas).
+ * * GeodeIntersect contains the geometry of two canvas intersection (normally would contained within the previous canvas),
+ * and the intersections with all the other canvases when those are shown, see setNeighbourIntersections().
  * * AT_Pickbale contains a selectable quad of a non-editable canvas, and it only allows changing the state of a canvas, e.g.,
  * from current to previous.
  * * AT_Center etc. are the quads which appear when the canvas is in 2D-editable mode and they allow to change the scale of the 2D
@@ -282,6 +283,14 @@ public:
     /*! A mthod to set intersection geometry */
     void setIntersection(const osg::Vec3f &P1, const osg::Vec3f &P2, const osg::Vec3f &P3, const osg::Vec3f &P4);
 
+    /*! A method to set the geometry of the intersections with the neighbouring canvases, see
+     * entity::Canvas::setNeighbourIntersections(). \param points are the end points of the line segments in canvas
+     * local coordinates, two per segment; empty to hide the lines. */
+    void setNeighbourIntersections(const std::vector<osg::Vec3f>& points);
+
+    /*! \return number of line segments of the intersections with the neighbouring canvases. */
+    unsigned int getNumNeighbourIntersections() const;
+
 protected:
     /*! A separate method to set intersection color */
     void setColorIntersection(const osg::Vec4f& colorIntersect);
@@ -329,6 +338,7 @@ protected:
 private:
     osg::Geode* m_geodeIntersect, * m_geodeNormal, * m_geodeRotation;
     osg::Geometry* m_geomIntersect;
+    osg::Geometry* m_geomNeighbours; /*!< intersections with the neighbouring canvases, one line segment per pair of vertices */
 
     /* canvas offset and 3d rotation drawables */
     osg::Geometry * m_geomNormal1, * m_geomNormal2; /*!< canvas offset geomtries */
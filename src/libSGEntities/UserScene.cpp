@@ -1,5 +1,8 @@
 #include "UserScene.h"
 
+#include <algorithm>
+#include <set>
+
 #include <QDebug>
 #include <QtGlobal>
 
@@ -33,7 +36,9 @@ entity::UserScene::UserScene()
     , m_idCanvas(0)
     , m_idPhoto(0)
     , m_idBookmark(0)
+    , m_idUnique(1)
     , m_filePath("")
+    , m_intersectionsCanvas(0)
 {
     this->setName("UserScene");
     m_groupBookmarks->setName("groupBookmarks");
@@ -60,7 +65,9 @@ entity::UserScene::UserScene(const entity::UserScene& scene, const osg::CopyOp&
     , m_idCanvas(scene.m_idCanvas)
     , m_idPhoto(scene.m_idPhoto)
     , m_idBookmark(scene.m_idBookmark)
+    , m_idUnique(scene.m_idUnique)
     , m_filePath(scene.m_filePath)
+    , m_intersectionsCanvas(0)
 {
 }
 
@@ -126,6 +133,16 @@ unsigned int entity::UserScene::getIdBookmark() const
     return m_idBookmark;
 }
 
+void entity::UserScene::setIdUnique(unsigned int id)
+{
+    m_idUnique = id;
+}
+
+unsigned int entity::UserScene::getIdUnique() const
+{
+    return m_idUnique;
+}
+
 void entity::UserScene::setFilePath(const std::string &name)
 {
     m_filePath = name;
@@ -137,6 +154,27 @@ const std::string &entity::UserScene::getFilePath() const
 }
 #endif // DOXYGEN_SHOULD_SKIP_THIS
 
+void entity::UserScene::initializeIds()
+{
+    /* the counter must exceed all the ids in use, e.g., when the file was saved without it */
+    for (int i=0; i<this->getNumCanvases(); ++i){
+        entity::Canvas* cnv = this->getCanvas(i);
+        if (!cnv) continue;
+        m_idUnique = std::max(m_idUnique, cnv->getId()+1);
+        for (size_t j=0; j<cnv->getNumPhotos(); ++j){
+            entity::Photo* photo = cnv->getPhoto(j);
+            if (photo) m_idUnique = std::max(m_idUnique, photo->getId()+1);
+        }
+    }
+    for (int i=0; i<this->getNumCanvases(); ++i)
+        this->assignIds(this->getCanvas(i));
+
+    for (int i=0; i<m_groupBookmarks->getNumBookmarks(); ++i){
+        entity::SceneState* state = m_groupBookmarks->getSceneState(i);
+        if (state) state->convertLegacyData(this);
+    }
+}
+
 bool entity::UserScene::isSetFilePath() const
 {
     return m_filePath == ""? false : true;
@@ -179,6 +217,28 @@ void entity::UserScene::addCanvas(QUndoStack* stack, const osg::Matrix& R, const
 
 }
 
+void entity::UserScene::addCanvases(QUndoStack *stack, const std::vector<osg::Matrix> &R, const std::vector<osg::Matrix> &T)
+{
+    if (!stack){
+        qWarning("addCanvases(): undo stack is NULL, Canvases will not be added. "
+                 "Restart the program to ensure undo stack initialization.");
+        return;
+    }
+    if (R.empty() || R.size() != T.size()){
+        qWarning("addCanvases(): rotation and translation matrices do not match");
+        return;
+    }
+    std::vector<std::string> names;
+    for (size_t i=0; i<R.size(); ++i)
+        names.push_back(getEntityName(cher::NAME_CANVAS, m_idCanvas++));
+    fur::AddCanvasesCommand* cmd = new fur::AddCanvasesCommand(this, R, T, names);
+    if (!cmd){
+        qWarning("addCanvases: cmd is NULL");
+        return;
+    }
+    stack->push(cmd);
+}
+
 void entity::UserScene::addStroke(QUndoStack* stack, float u, float v, cher::EVENT event)
 {
     if (!stack){
@@ -290,6 +350,25 @@ void entity::UserScene::addPhoto(QUndoStack* stack, const std::string& fname)
     stack->push(cmd);
 }
 
+void entity::UserScene::addPhotos(QUndoStack *stack, const std::vector<std::string> &fnames)
+{
+    if (!stack){
+        qWarning("addPhotos(): undo stack is NULL, photos will not be added. "
+                 "Restart the program to ensure undo stack initialization.");
+        return;
+    }
+    if (fnames.empty()) return;
+    std::vector<std::string> enames;
+    for (size_t i=0; i<fnames.size(); ++i)
+        enames.push_back(this->getPhotoName());
+    fur::AddPhotosCommand* cmd = new fur::AddPhotosCommand(this, fnames, enames);
+    if (!cmd){
+        qWarning("addPhotos(): could not allocate fur::AddPhotosCommand.");
+        return;
+    }
+    stack->push(cmd);
+}
+
 void entity::UserScene::addBookmark(BookmarkWidget *widget, const osg::Vec3d &eye, const osg::Vec3d &center, const osg::Vec3d &up, const double &fov)
 {
     if (!m_groupBookmarks.get())
@@ -496,6 +575,43 @@ entity::Canvas*entity::UserScene::getCanvasPrevious() const
     return m_canvasPrevious.get();
 }
 
+bool entity::UserScene::updateIntersections(bool visible)
+{
+    bool changed = false;
+    entity::Canvas* canvas = visible? m_canvasCurrent.get() : 0;
+    if (m_intersectionsCanvas.get() != canvas){
+        if (m_intersectionsCanvas.get()){
+            m_intersectionsCanvas->setNeighbourIntersections(std::vector<entity::Canvas*>());
+            changed = true;
+        }
+        m_intersectionsCanvas = canvas;
+        m_intersectionsStamp.clear();
+        m_intersectionsFrame.clear();
+    }
+    if (!canvas) return changed;
+
+    /* transform revisions are unique among all the canvases, so the stamp changes with any addition or removal too */
+    std::vector<entity::Canvas*> neighbours;
+    std::vector<unsigned int> stamp;
+    stamp.push_back(m_canvasPrevious.get()? m_canvasPrevious->getId() : 0);
+    for (int i=0; i<this->getNumCanvases(); ++i){
+        entity::Canvas* cnvi = this->getCanvas(i);
+        if (!cnvi) continue;
+        stamp.push_back(cnvi->getTransformRevision());
+        stamp.push_back(cnvi->getVisibilityAll()? 1 : 0);
+        if (cnvi != canvas && cnvi != m_canvasPrevious.get() && cnvi->getVisibilityAll())
+            neighbours.push_back(cnvi);
+    }
+    const osg::Vec3Array* vertices = canvas->getFrameVertices();
+    std::vector<osg::Vec3f> frame(vertices->begin(), vertices->end());
+    if (stamp == m_intersectionsStamp && frame == m_intersectionsFrame) return changed;
+
+    m_intersectionsStamp.swap(stamp);
+    m_intersectionsFrame.swap(frame);
+    canvas->setNeighbourIntersections(neighbours);
+    return true;
+}
+
 int entity::UserScene::getCanvasIndex(entity::Canvas *canvas) const
 {
     if (!m_groupCanvases.get())
@@ -755,14 +871,15 @@ void entity::UserScene::editPhotoTransparency(entity::Photo *photo, entity::Canv
         return;
     }
     photo->setTransparency(t);
-    int index = this->getPhotoIndex(photo, canvas);
+    canvas->increaseContentRevision();
+    /* the new transparency is taken by all the bookmarks */
     for (int i=0; i<m_groupBookmarks->getNumBookmarks(); ++i){
         entity::SceneState* state = m_groupBookmarks->getSceneState(i);
         if (!state) {
             qCritical("editPhotoTransparency : state is NULL");
             continue;
         }
-        state->resetTransparency(index, t);
+        state->setPhotoTransparency(photo->getId(), t);
     }
 }
 
@@ -1000,6 +1117,7 @@ bool entity::UserScene::clearUserData()
     m_idCanvas=0;
     m_idPhoto=0;
     m_idBookmark=0;
+    m_idUnique=1;
     return m_groupCanvases->removeChildren(0, this->getNumCanvases());
 }
 
@@ -1010,34 +1128,34 @@ void entity::UserScene::updateWidgets()
 
 void entity::UserScene::resetModel(CanvasPhotoWidget *widget)
 {
-    widget->clear();
+    if (!widget) return;
+
+    /* the whole tree is built at once instead of the per-item signals, the row is the canvas index */
+    std::vector<CanvasPhotoWidget::CanvasData> canvases(this->getNumCanvases());
     for (int i=0; i<this->getNumCanvases(); ++i){
         entity::Canvas* cnv = this->getCanvas(i);
         if (!cnv) qFatal("UserScene::resetModel canvas is NULL");
-        emit this->canvasAdded(cnv->getName().c_str());
+        CanvasPhotoWidget::CanvasData& data = canvases[i];
+        data.name = cnv->getName();
 
         if (cnv == m_canvasCurrent.get())
-            emit this->canvasSelectedColor(this->getCanvasIndex(cnv),1);
+            data.color = 1;
         else if (cnv == m_canvasPrevious.get())
-            emit this->canvasSelectedColor(this->getCanvasIndex(cnv),2);
+            data.color = 2;
         else
-            emit this->canvasSelectedColor(this->getCanvasIndex(cnv),0);
+            data.color = 0;
 
-        /* if canvas has any photos, reset photowidget */
         for (size_t j=0; j<cnv->getNumPhotos(); ++j){
             entity::Photo* photo = cnv->getPhoto(j);
             if (!photo) continue;
-            emit this->photoAdded(photo->getName(), this->getCanvasIndex(cnv));
+            data.photos.push_back(photo->getName());
         }
 
-        /* set canvas visibility on scene and on GUI */
-        if (!cnv->getVisibilityAll()){
-            cnv->setVisibilityAll(false);
-            int row = this->getCanvasIndex(cnv);
-            qDebug() << "Trying to set up canvas visibility scene and GUI " << row;
-            emit canvasVisibilitySet(row, false);
-        }
+        /* set canvas visibility on scene, the GUI is set by the widget */
+        data.visibility = cnv->getVisibilityAll();
+        if (!data.visibility) cnv->setVisibilityAll(false);
     }
+    widget->resetCanvases(canvases);
 }
 
 void entity::UserScene::onItemChanged(QTreeWidgetItem *item, int column)
@@ -1856,28 +1974,11 @@ bool entity::UserScene::addCanvas(entity::Canvas *canvas)
         emit this->photoAdded(photo->getName(), this->getCanvasIndex(canvas));
     }
 
-    // scene graph addition
+    // scene graph addition; bookmark states refer to the canvas by id, so they need no update
+    this->assignIds(canvas);
     bool result = m_groupCanvases->addChild(canvas);
     this->setCanvasCurrent(canvas);
 
-    // for each bookmark's state, add data for new canvas
-    int index = this->getCanvasIndex(canvas);
-    int idx = this->getNumPhotosTill(canvas);
-    for (int i=0; i<m_groupBookmarks->getNumBookmarks(); ++i){
-        entity::SceneState* state = m_groupBookmarks->getSceneState(i);
-        if (!state) qFatal("UserScene::addCanvas(): could not obtain a scene state");
-
-        state->insertDataFlag(index, canvas->getVisibilityAll());
-        state->insertToolFlag(index, canvas->getVisibilityFrameInternal());
-
-        // if canvas contains any photos, insert photo transparencies too
-        for (size_t j=0; j<canvas->getNumPhotos(); ++j){
-            entity::Photo* photo = canvas->getPhoto(j);
-            if (!photo) qFatal("UserScene::addCanvas(): photo is NULL");
-            state->insertTransparency(idx++, photo->getTransparency());
-        }
-    }
-
     // update frame and widget
     canvas->updateFrame(this->getCanvasPrevious());
     bool vis = true;
@@ -1888,28 +1989,105 @@ bool entity::UserScene::addCanvas(entity::Canvas *canvas)
     return result;
 }
 
+bool entity::UserScene::addCanvases(const std::vector<entity::Canvas *> &canvases)
+{
+    if (canvases.empty()) return false;
+
+    bool result = true;
+    bool vis = true;
+    emit this->requestSceneToolStatus(vis);
+    for (size_t i=0; i<canvases.size(); ++i){
+        entity::Canvas* canvas = canvases[i];
+        if (!canvas) qFatal("UserScene::addCanvases(): canvas is NULL");
+
+        // scene graph; bookmark states refer to the canvas by id, so they need no update
+        this->assignIds(canvas);
+        result = m_groupCanvases->addChild(canvas) && result;
+        canvas->setVisibilityFrameInternal(vis);
+    }
+
+    // only the last two canvases become previous and current, the frames of the rest are updated once
+    if (canvases.size() > 1)
+        this->setCanvasCurrent(canvases.at(canvases.size()-2));
+    this->setCanvasCurrent(canvases.back());
+    for (size_t i=0; i+2<canvases.size(); ++i)
+        canvases.at(i)->updateFrame(0);
+
+    // gui elements are re-built at once instead of per canvas and photo
+    emit this->canvasesReset();
+    this->updateWidgets();
+
+    return result;
+}
+
+bool entity::UserScene::removeCanvases(const std::vector<entity::Canvas *> &canvases)
+{
+    if (canvases.empty()) return false;
+
+    std::set<const entity::Canvas*> removed;
+    std::set<unsigned int> ids;
+    for (size_t i=0; i<canvases.size(); ++i){
+        if (!canvases.at(i)) qFatal("UserScene::removeCanvases(): canvas is NULL");
+        removed.insert(canvases.at(i));
+        ids.insert(canvases.at(i)->getId());
+    }
+
+    // make sure current/previous rules hold, the candidates are searched among the remaining canvases only
+    entity::Canvas* current = m_canvasCurrent.get();
+    entity::Canvas* previous = m_canvasPrevious.get();
+    if (removed.find(current) != removed.end())
+        current = removed.find(previous) == removed.end()? previous : 0;
+    if (removed.find(previous) != removed.end() || previous == current)
+        previous = 0;
+    for (int i = 0; i < this->getNumCanvases() && (!current || !previous); ++i){
+        entity::Canvas* cnvi = this->getCanvas(i);
+        if (!cnvi || removed.find(cnvi) != removed.end() || cnvi == current || cnvi == previous) continue;
+        if (!current) current = cnvi;
+        else previous = cnvi;
+    }
+    if (current != m_canvasCurrent.get()){
+        if (previous == m_canvasCurrent.get()) this->setCanvasCurrent(current);
+        else {
+            this->setCanvasPrevious(0);
+            if (current) this->setCanvasCurrent(current);
+            else m_canvasCurrent = 0;
+        }
+    }
+    if (previous != m_canvasPrevious.get())
+        this->setCanvasPrevious(previous);
+
+    // scene graph; the removed canvases are calculated anew if the removal is undone
+    bool result = true;
+    for (size_t i=canvases.size(); i>0; --i){
+        entity::Canvas* canvas = canvases.at(i-1);
+        canvas->unselectAll();
+        result = m_groupCanvases->removeChild(canvas) && result;
+        canvas->clearIntersections();
+    }
+
+    // intersection tables of the remaining canvases are pruned once for the whole batch
+    for (int i = 0; i < this->getNumCanvases(); ++i){
+        entity::Canvas* cnvi = this->getCanvas(i);
+        if (cnvi) cnvi->removeIntersections(ids);
+    }
+
+    // gui elements are re-built at once instead of per canvas
+    emit this->canvasesReset();
+
+    // updates
+    if (m_canvasCurrent.get())
+        m_canvasCurrent->updateFrame(m_canvasPrevious.get());
+    this->updateWidgets();
+
+    return result;
+}
+
 bool entity::UserScene::removeCanvas(entity::Canvas *canvas)
 {
     if (!canvas) qFatal("UserScene::removeCanvas(Canvas*): canvas is NULL");
 
+    // bookmark states keep the canvas data, so that it is restored when the removal is undone
     int index = this->getCanvasIndex(canvas);
-    // for each bookmark's state, remove data of the canvas
-    for (int i=0; i<m_groupBookmarks->getNumBookmarks(); ++i){
-        entity::SceneState* state = m_groupBookmarks->getSceneState(i);
-        if (!state) qFatal("UserScene::removeCanvas(): could not obtain a scene state");
-        state->eraseDataFlag(index);
-        state->eraseToolFlag(index);
-//        state->popBackDataFlag();
-//        state->popBackToolFlag();
-
-        // if canvas contains any photos, erase data of photo transparencies too
-        if (canvas->getNumPhotos() > 0){
-            if (canvas->getPhoto(0)){
-                int start = this->getPhotoIndex(canvas->getPhoto(0), canvas);
-                state->eraseTransparency(start, canvas->getNumPhotos());
-            }
-        }
-    }
 
     // make sure current/previous rules hold
     if (canvas == m_canvasCurrent.get())
@@ -1935,6 +2113,13 @@ bool entity::UserScene::removeCanvas(entity::Canvas *canvas)
     canvas->unselectAll();
     bool result = m_groupCanvases->removeChild(canvas);
 
+    // intersection tables, the removed canvas is calculated anew if the removal is undone
+    canvas->clearIntersections();
+    for (int i = 0; i < this->getNumCanvases(); ++i){
+        entity::Canvas* cnvi = this->getCanvas(i);
+        if (cnvi) cnvi->removeIntersection(canvas->getId());
+    }
+
     // updates
     if (m_canvasCurrent.get())
         m_canvasCurrent->updateFrame(m_canvasPrevious.get());
@@ -1951,17 +2136,15 @@ bool entity::UserScene::addEntity(entity::Canvas *canvas, Entity2D *entity)
     /* scene state update, if needed */
     switch(entity->getEntityType()){
     case cher::ENTITY_PHOTO:{
-        /* add photo transparencies to each bookmark scene state */
-        int idx = this->getNumPhotosTill(canvas);
         entity::Photo* photo = dynamic_cast<entity::Photo*>(entity);
         if (!photo) return result;
-        for (int i=0; i<m_groupBookmarks->getNumBookmarks(); ++i){
-            entity::SceneState* state = m_groupBookmarks->getSceneState(i);
-            if (!state) return result;
-            if (i<m_groupBookmarks->getNumBookmarks()-1)
-                state->insertTransparency(idx, 0.f);
-            else
-                state->insertTransparency(idx, photo->getTransparency());
+        /* a new photo is hidden within the older bookmark states, see SceneState::getIdLimit(),
+         * but is shown within the last bookmark */
+        if (photo->getId() == 0){
+            photo->setId(m_idUnique++);
+            int last = m_groupBookmarks->getNumBookmarks()-1;
+            entity::SceneState* state = last >= 0? m_groupBookmarks->getSceneState(last) : 0;
+            if (state) state->setPhotoTransparency(photo->getId(), photo->getTransparency());
         }
         break;
     }
@@ -1971,6 +2154,7 @@ bool entity::UserScene::addEntity(entity::Canvas *canvas, Entity2D *entity)
 
     /* add entity to scene graph */
     result = canvas->addEntity(entity);
+    if (result) canvas->increaseContentRevision();
 
     /* gui elements, if needed */
     if (result){
@@ -1998,15 +2182,9 @@ bool entity::UserScene::removeEntity(entity::Canvas *canvas, Entity2D *entity)
     /* and remove from gui elements, if needed */
     switch(entity->getEntityType()){
     case cher::ENTITY_PHOTO:{
-        /* add photo transparencies to each bookmark scene state */
-        int idx = this->getNumPhotosTill(canvas);
+        /* bookmark states keep the photo data by id, so they need no update */
         entity::Photo* photo = dynamic_cast<entity::Photo*>(entity);
         if (!photo) return result;
-        for (int i=0; i<m_groupBookmarks->getNumBookmarks(); ++i){
-            entity::SceneState* state = m_groupBookmarks->getSceneState(i);
-            if (!state) return result;
-            state->eraseTransparency(idx, 1);
-        }
         emit this->photoRemoved(this->getCanvasIndex(canvas), this->getPhotoIndex(photo, canvas));
         break;
     }
@@ -2016,6 +2194,7 @@ bool entity::UserScene::removeEntity(entity::Canvas *canvas, Entity2D *entity)
 
     /* remove entity from scene graph */
     result = canvas->removeEntity(entity);
+    if (result) canvas->increaseContentRevision();
 
     /* make sure it is not a part of selected group, or it will stay within the scene graph */
     canvas->removeEntitySelected(entity);
@@ -2027,6 +2206,16 @@ bool entity::UserScene::removeEntity(entity::Canvas *canvas, Entity2D *entity)
     return result;
 }
 
+void entity::UserScene::assignIds(entity::Canvas *canvas)
+{
+    if (!canvas) return;
+    if (canvas->getId() == 0) canvas->setId(m_idUnique++);
+    for (size_t i=0; i<canvas->getNumPhotos(); ++i){
+        entity::Photo* photo = canvas->getPhoto(i);
+        if (photo && photo->getId() == 0) photo->setId(m_idUnique++);
+    }
+}
+
 #endif // DOXYGEN_SHOULD_SKIP_THIS
 
 REGISTER_OBJECT_WRAPPER(UserScene_Wrapper
@@ -2039,5 +2228,6 @@ REGISTER_OBJECT_WRAPPER(UserScene_Wrapper
     ADD_UINT_SERIALIZER(IdCanvas, 0);
     ADD_UINT_SERIALIZER(IdPhoto, 0);
     ADD_UINT_SERIALIZER(IdBookmark, 0);
+    ADD_UINT_SERIALIZER(IdUnique, 1);
     ADD_STRING_SERIALIZER(FilePath, "");
 }
@@ -2,6 +2,7 @@
 #define USERSCENE_H
 
 #include <string>
+#include <vector>
 
 #include <QUndoStack>
 #include <QObject>
@@ -33,7 +34,9 @@ class Bookmarks;
 class BookmarkWidget;
 namespace fur {
 class AddCanvasCommand;
+class AddCanvasesCommand;
 class AddPhotoCommand;
+class AddPhotosCommand;
 class EditCanvasDeleteCommand;
 class AddCanvasSeparationCommand;
 class EditPhotoDeleteCommand;
@@ -102,6 +105,12 @@ public:
      * from RootScene ctor. */
     void initializeSG();
 
+    /*! A method to assign the ids to the canvases and photos of a loaded scene which have none, e.g., when
+     * the file was saved before the ids were introduced, and to translate the older bookmark states into
+     * the id-keyed ones. It should be called right after the scene is loaded.
+     * \sa entity::Canvas::getId(), entity::SceneState::convertLegacyData() */
+    void initializeIds();
+
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
     void setGroupCanvases(osg::Group* group);
     const osg::Group* getGroupCanvases() const;
@@ -119,6 +128,9 @@ public:
     void setIdBookmark(unsigned int id);
     unsigned int getIdBookmark() const;
 
+    void setIdUnique(unsigned int id);
+    unsigned int getIdUnique() const;
+
     void setFilePath(const std::string& name);
     const std::string& getFilePath() const;
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
@@ -151,6 +163,14 @@ public:
      * \param name is the canvas name */
     void addCanvas(QUndoStack* stack, const osg::Matrix& R, const osg::Matrix& T, const std::string& name);
 
+    /*! Creates and adds a set of canvases through undo/redo framework as a single fur::AddCanvasesCommand,
+     * each canvas is given an automatic name. The canvases are added within one pass, so that the widgets are
+     * updated only once, the last two canvases become current and previous.
+     * \param stack is the undo/redo stack where the fur::AddCanvasesCommand will be pushed to
+     * \param R is the vector of rotation matrices of the new canvases
+     * \param T is the vector of translation matrices of the new canvases, it must be of the same size as R */
+    void addCanvases(QUndoStack* stack, const std::vector<osg::Matrix>& R, const std::vector<osg::Matrix>& T);
+
 
     /*! Adds a point to a current stroke of the current canvas through undo/redo framework.
      * If there is no current stroke exists, it creates it.
@@ -183,6 +203,12 @@ public:
      * \param fname is the photo file path from where it is loaded */
     void addPhoto(QUndoStack* stack, const std::string& fname);
 
+    /*! Creates and adds several photos to a current canvas as a single undo step; the photo images are decoded
+     * in parallel, see ImageDecoder.
+     * \param stack is the undo/redo stack where the fur::AddPhotosCommand will be pushed to
+     * \param fnames are the photo file paths from where they are loaded */
+    void addPhotos(QUndoStack* stack, const std::vector<std::string>& fnames);
+
 
     /*! Creates and adds a bookmark to the Bookmarks group and the corresponding BookmarkWidget
      * by asigning to it an automatic name.
@@ -329,6 +355,13 @@ public:
     /*! \return A pointer on previous canvas, editable. */
     entity::Canvas* getCanvasPrevious() const;
 
+    /*! A method to show the intersection lines of the current canvas with all the other visible canvases but the
+     * previous one, whose intersection is shown by entity::Canvas::updateFrame(). The lines are only rebuilt when the
+     * current canvas, its frame, or the transform or visibility of any canvas has changed since the previous call;
+     * the intersections come from the tables of the canvases, see entity::Canvas::setNeighbourIntersections().
+     * \param visible is false to hide the lines. \return true if the lines were rebuilt or hidden. */
+    bool updateIntersections(bool visible);
+
 
     /*! A method to return a sequential index of Canvas pointer. Normally, the index is aligned with
      * child index of UserScene, however, it is not always the case since one of the children is
@@ -513,7 +546,7 @@ public:
 
     /*! A method to reset Canvas and Photo data within the corresponding widget, as well as its model. It updates the
      * widget with the new UserScene. This method is called when a file was open. The main principle is that it traverses
-     * the scene graph and adds the found Canvas entities to the CanvasPhotoWidget.
+     * the scene graph and re-builds the CanvasPhotoWidget at once, see CanvasPhotoWidget::resetCanvases().
      * \param widget is the CanvasPhotoWidget to update */
     void resetModel(CanvasPhotoWidget* widget);
 
@@ -530,6 +563,10 @@ signals:
     /*! A signal which is connected with  CanvasPhotoWidget::onCanvasRemoved() to request to remove a canvas item from the widget */
     void canvasRemoved(int row);
 
+    /*! A signal which is connected with MainWindow::onCanvasesReset() to request to re-build the canvas items of
+     * the widget at once, e.g., after a batch of canvases was added or removed. \sa resetModel() */
+    void canvasesReset();
+
     /*! A signal which is connected with  CanvasPhotoWidget::onPhotoRemoved() to request to remove a photo item from the widget */
     void photoRemoved(int rowCanvas, int rowPhoto);
 
@@ -545,6 +582,13 @@ signals:
      * This value also corresponds to Canvas::getVisibilityData(). */
     void canvasVisibilitySet(int row, bool visibility);
 
+    /*! A signal which is connected with CanvasPhotoWidget::onCanvasMemoryUsage() and is emitted from RootScene when
+     * the memory taken by the photos of canvases changes, see TextureResidency.
+     * \param row is the sequential canvas index as it is in the canvas-photo widget,
+     * \param host is the host memory of the photos, in bytes,
+     * \param texture is the GPU memory of the photos, in bytes. */
+    void canvasMemoryUsage(int row, quint64 host, quint64 texture);
+
     /*! A signal to be emitted on addition of new canvas to the scene. It requests tool's status of MainWindow, and turns
      * the internal frame on or off depending on the result.
      * \param visibility is a boolean flag which indicated whether the tools are on (true) of off (false). */
@@ -626,7 +670,9 @@ protected:
     void canvasRotateFinish(QUndoStack* stack);
 
     friend class ::fur::AddCanvasCommand;
+    friend class ::fur::AddCanvasesCommand;
     friend class ::fur::AddPhotoCommand;
+    friend class ::fur::AddPhotosCommand;
     friend class ::fur::EditCanvasDeleteCommand;
     friend class ::fur::AddCanvasSeparationCommand;
     friend class ::fur::EditPhotoDeleteCommand;
@@ -641,13 +687,20 @@ protected:
     friend class ::fur::EditCutCommand;
     friend class ::fur::EditPhotoPushCommand;
     friend class ::fur::EditSelectedEntitiesDeleteCommand;
+    friend class ProjectContainer;
 
     bool addCanvas(entity::Canvas* canvas);
     bool removeCanvas(entity::Canvas* canvas);
+    bool addCanvases(const std::vector<entity::Canvas*>& canvases);
+    bool removeCanvases(const std::vector<entity::Canvas*>& canvases);
 
     bool addEntity(entity::Canvas* canvas, entity::Entity2D* entity);
     bool removeEntity(entity::Canvas* canvas, entity::Entity2D* entity);
 
+    /*! A method to assign the ids to the canvas and its photos, unless they already have ones, e.g., when
+     * the canvas is added back by undo. */
+    void assignIds(entity::Canvas* canvas);
+
 private:
     osg::ref_ptr<osg::Group>            m_groupCanvases;    /*!< Group that contains all the bookmarks. */
     osg::ref_ptr<entity::Bookmarks>     m_groupBookmarks;   /*!< Pointer on Bookmarks data structure, it is one of the direct children of UserScene. */
@@ -668,7 +721,13 @@ private:
     unsigned int    m_idCanvas;    /*!< Naming convention identification number for canvases. */
     unsigned int    m_idPhoto;     /*!< Naming convention identification number for photos. */
     unsigned int    m_idBookmark;  /*!< Naming convention identification number for bookmarks. */
+    unsigned int    m_idUnique;    /*!< Next id of canvases and photos, see entity::Canvas::getId(). */
     std::string     m_filePath;     /*!< File path where the scene is saved to. */
+
+    /* state the neighbour intersections were last shown for, see updateIntersections() */
+    osg::observer_ptr<entity::Canvas> m_intersectionsCanvas; /*!< canvas which shows the neighbour intersections. */
+    std::vector<unsigned int> m_intersectionsStamp; /*!< transform revision and visibility of each canvas. */
+    std::vector<osg::Vec3f> m_intersectionsFrame; /*!< frame vertices of the canvas which shows the intersections. */
 };
 
 }
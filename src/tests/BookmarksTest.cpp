@@ -10,6 +10,7 @@
 #include "SVMData.h"
 #include "DraggableWire.h"
 #include "Utilities.h"
+#include "ThumbnailRenderer.h"
 
 #include "HomographyMatrix.h"
 
@@ -62,6 +63,127 @@ void BookmarksTest::testAddBookmark()
 
 }
 
+void BookmarksTest::testScreenshotsOffscreen()
+{
+    qInfo("Prepare scene with two bookmarks");
+    osg::ref_ptr<entity::Stroke> stroke = new entity::Stroke;
+    stroke->initializeProgram(m_canvas2->getProgramStroke());
+    stroke->appendPoint(0,0);
+    stroke->appendPoint(1,1);
+    stroke->appendPoint(2,2);
+    QVERIFY(m_canvas2->addEntity(stroke));
+    QVERIFY(stroke->redefineToShape());
+    this->onBookmark();
+    this->onVisibilitySetCanvas(2);
+    QVERIFY(!m_canvas2->getVisibilityAll());
+    this->onBookmark();
+    entity::Bookmarks* bs = m_scene->getBookmarksModel();
+    QCOMPARE(bs->getNumBookmarks(), 2);
+
+    qInfo("Render the screenshots of both bookmarks in one batch");
+    osg::Vec3d eye, center, up;
+    double fov;
+    m_glWidget->getCameraView(eye, center, up, fov);
+    ThumbnailRenderer* renderer = m_glWidget->getThumbnailRenderer();
+    QVERIFY(renderer);
+    unsigned int numRendered = renderer->getNumRendered();
+    std::vector<entity::SceneState*> states;
+    states.push_back(bs->getSceneState(0));
+    states.push_back(bs->getSceneState(1));
+    QList<QPixmap> pmaps = this->getScreenshots(bs->getEyes(), bs->getCenters(), bs->getUps(), states);
+    QCOMPARE(pmaps.size(), 2);
+    QCOMPARE(renderer->getNumRendered(), numRendered + 2);
+    for (int i=0; i<pmaps.size(); ++i){
+        QVERIFY(!pmaps[i].isNull());
+        QCOMPARE(pmaps[i].height(), renderer->getHeight());
+        QVERIFY(!isWhite(pmaps[i]));
+    }
+
+    qInfo("The view and the scene state are intact");
+    osg::Vec3d eye_, center_, up_;
+    double fov_;
+    m_glWidget->getCameraView(eye_, center_, up_, fov_);
+    QVERIFY(eye_ == eye && center_ == center && up_ == up);
+    QVERIFY(!m_canvas2->getVisibilityAll());
+    QVERIFY(m_rootScene->getToolsVisibility());
+
+    qInfo("Reset of the model uses the stored icons");
+    m_bookmarkWidget->clear();
+    bs->resetModel(m_bookmarkWidget);
+    QCOMPARE(m_bookmarkWidget->count(), 2);
+    QVERIFY(!m_bookmarkWidget->item(1)->icon().isNull());
+    QCOMPARE(renderer->getNumRendered(), numRendered + 2);
+}
+
+void BookmarksTest::testThumbnailsRefresh()
+{
+    qInfo("Prepare scene with two bookmarks, the second one does not see Canvas2");
+    osg::ref_ptr<entity::Stroke> stroke = new entity::Stroke;
+    stroke->initializeProgram(m_canvas2->getProgramStroke());
+    stroke->appendPoint(0,0);
+    stroke->appendPoint(1,1);
+    stroke->appendPoint(2,2);
+    QVERIFY(m_canvas2->addEntity(stroke));
+    QVERIFY(stroke->redefineToShape());
+    this->onBookmark();
+    this->onVisibilitySetCanvas(2);
+    this->onBookmark();
+    entity::Bookmarks* bs = m_scene->getBookmarksModel();
+    QCOMPARE(bs->getNumBookmarks(), 2);
+    QCOMPARE(static_cast<int>(bs->getThumbnails().size()), 2);
+    QCOMPARE(static_cast<int>(bs->getFingerprints().size()), 2);
+    for (int i=0; i<2; ++i){
+        QVERIFY(!bs->getThumbnails()[i].empty());
+        QVERIFY(!bs->getThumbnail(i).isNull());
+        QCOMPARE(bs->getFingerprints()[i], bs->computeFingerprint(i, m_scene.get()));
+    }
+
+    qInfo("Nothing is re-rendered while nothing has changed");
+    QCOMPARE(bs->refreshThumbnails(m_bookmarkWidget), 0);
+
+    qInfo("Selection is not an edit");
+    std::string canvas = m_canvas2->getContentFingerprint();
+    unsigned int revision = m_canvas2->getContentRevision();
+    m_canvas2->addEntitySelected(stroke);
+    QCOMPARE(m_canvas2->getContentFingerprint(), canvas);
+    m_canvas2->unselectEntities();
+    QCOMPARE(m_canvas2->getContentRevision(), revision);
+
+    qInfo("Only the bookmark that sees the edited canvas is re-rendered");
+    std::string fingerprint = bs->getFingerprints()[0];
+    QVERIFY(m_scene->removeEntity(m_canvas2.get(), stroke));
+    QVERIFY(m_canvas2->getContentRevision() > revision);
+    QVERIFY(m_canvas2->getContentFingerprint() != canvas);
+    bs->onSceneChanged();
+    QVERIFY(bs->isRefreshPending());
+    QCOMPARE(bs->refreshThumbnails(m_bookmarkWidget), 1);
+    QVERIFY(!bs->isRefreshPending());
+    QVERIFY(bs->getFingerprints()[0] != fingerprint);
+    fingerprint = bs->getFingerprints()[0];
+    QVERIFY(m_scene->addEntity(m_canvas2.get(), stroke));
+    QVERIFY(m_canvas2->getContentFingerprint() != canvas);
+    QCOMPARE(bs->refreshThumbnails(m_bookmarkWidget), 1);
+    QVERIFY(bs->getFingerprints()[0] != fingerprint);
+
+    qInfo("The thumbnails are saved with the scene and not re-rendered on load");
+    QString filename = "RW_BookmarkThumbnails.cherish";
+    m_rootScene->setFilePath(filename.toStdString());
+    QVERIFY(m_rootScene->writeScenetoFile());
+    this->onFileClose();
+    m_rootScene->setFilePath(filename.toStdString());
+    ThumbnailRenderer* renderer = m_glWidget->getThumbnailRenderer();
+    unsigned int numRendered = renderer->getNumRendered();
+    QVERIFY(this->loadSceneFromFile());
+    bs = m_rootScene->getBookmarksModel();
+    QCOMPARE(bs->getNumBookmarks(), 2);
+    QCOMPARE(m_bookmarkWidget->count(), 2);
+    QVERIFY(!m_bookmarkWidget->item(0)->icon().isNull());
+    QVERIFY(!m_bookmarkWidget->item(1)->icon().isNull());
+    QCOMPARE(renderer->getNumRendered(), numRendered);
+    QVERIFY(bs->isRefreshPending());
+    QCOMPARE(bs->refreshThumbnails(m_bookmarkWidget), 0);
+}
+
 void BookmarksTest::testNewBookmarkPure()
 {
     qInfo("Test bookmark calculation through SVM data manipulation. ");
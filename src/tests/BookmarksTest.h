@@ -14,6 +14,13 @@ private slots:
     /* Test bookmarking the current view. */
     void testAddBookmark();
 
+    /*! Test the bookmark screenshots are rendered offscreen in a batch, without moving the view.
+     * \sa ThumbnailRenderer */
+    void testScreenshotsOffscreen();
+
+    /*! Test the bookmark thumbnails are saved with the scene, and re-rendered only when the visible content changes. */
+    void testThumbnailsRefresh();
+
     /* Test bookmark add through the SVM data. The steps follow closely the same steps
      * from MainWindow::onBookmarkNew() slot.
      * \sa testNewBookmarkNoise();
@@ -2,6 +2,12 @@
 
 #include <math.h>
 
+#include <QSignalSpy>
+#include <QTreeWidgetItem>
+
+#include "Stroke.h"
+#include "Utilities.h"
+
 void CanvasTest::testBasicApi()
 {
     qInfo("Test canvas basic api - create new canvas");
@@ -221,6 +227,219 @@ void CanvasTest::testCloneOrtho()
     this->testOrthogonality(canvas2);
 }
 
+void CanvasTest::testNewCanvasSets()
+{
+    qInfo("Test parallel canvas set is added as a single undo step");
+    int count = m_undoStack->count();
+    QCOMPARE(m_scene->getCanvasCurrent(), m_canvas2.get());
+    osg::Vec3f normal = m_canvas2->getNormal();
+    this->onNewCanvasParallel();
+    QCOMPARE(m_scene->getNumCanvases(), 3 + cher::CANVAS_SET_SIZE);
+    QCOMPARE(m_canvasWidget->topLevelItemCount(), 3 + cher::CANVAS_SET_SIZE);
+    QCOMPARE(m_undoStack->count(), count+1);
+    for (int i=3; i<m_scene->getNumCanvases(); ++i){
+        entity::Canvas* cnvi = m_scene->getCanvas(i);
+        QVERIFY(cnvi);
+        QVERIFY(differenceWithinThreshold(cnvi->getNormal(), normal));
+        this->testOrthogonality(cnvi);
+    }
+
+    qInfo("Test current/previous holds for the last two canvases");
+    entity::Canvas* last = m_scene->getCanvas(m_scene->getNumCanvases()-1);
+    QCOMPARE(m_scene->getCanvasCurrent(), last);
+    QCOMPARE(m_scene->getCanvasPrevious(), m_scene->getCanvas(m_scene->getNumCanvases()-2));
+    QVERIFY(differenceWithinThreshold(last->getCenter(),
+                                      m_canvas2->getCenter() + normal * cher::CANVAS_SET_STEP * cher::CANVAS_SET_SIZE));
+
+    qInfo("Test undo removes the whole set");
+    m_undoStack->undo();
+    QCOMPARE(m_scene->getNumCanvases(), 3);
+    QCOMPARE(m_canvasWidget->topLevelItemCount(), 3);
+    QCOMPARE(m_scene->getCanvasCurrent(), m_canvas2.get());
+    QCOMPARE(m_scene->getCanvasPrevious(), m_canvas1.get());
+    for (int i=0; i<m_scene->getNumCanvases(); ++i)
+        QVERIFY(m_scene->getCanvas(i)->getNumIntersections() <= 2);
+
+    qInfo("Test redo restores the set");
+    m_undoStack->redo();
+    QCOMPARE(m_scene->getNumCanvases(), 3 + cher::CANVAS_SET_SIZE);
+    QCOMPARE(m_scene->getCanvasCurrent(), last);
+
+    qInfo("Test ring and coaxial sets are orthogonal and at the expected distance");
+    m_undoStack->undo();
+    this->onNewCanvasRing();
+    QCOMPARE(m_scene->getNumCanvases(), 3 + cher::CANVAS_SET_SIZE);
+    for (int i=3; i<m_scene->getNumCanvases(); ++i){
+        entity::Canvas* cnvi = m_scene->getCanvas(i);
+        this->testOrthogonality(cnvi);
+        QVERIFY(std::fabs((cnvi->getCenter() - m_canvas2->getCenter()).length() - cher::CANVAS_SET_RADIUS) < cher::EPSILON);
+    }
+    m_undoStack->undo();
+    this->onNewCanvasCoaxial();
+    QCOMPARE(m_scene->getNumCanvases(), 3 + cher::CANVAS_SET_SIZE);
+    for (int i=3; i<m_scene->getNumCanvases(); ++i){
+        entity::Canvas* cnvi = m_scene->getCanvas(i);
+        this->testOrthogonality(cnvi);
+        QVERIFY(differenceWithinThreshold(cnvi->getCenter(), m_canvas2->getCenter()));
+        QVERIFY(differenceWithinThreshold(cnvi->getGlobalAxisV(), m_canvas2->getGlobalAxisV()));
+    }
+}
+
+void CanvasTest::testDeleteSnapshot()
+{
+    qInfo("Add stroke to the canvas");
+    osg::ref_ptr<entity::Stroke> stroke = new entity::Stroke;
+    stroke->initializeProgram(m_canvas2->getProgramStroke());
+    stroke->appendPoint(0,0);
+    stroke->appendPoint(1,1);
+    stroke->appendPoint(2,2);
+    QVERIFY(m_canvas2->addEntity(stroke));
+    QVERIFY(stroke->redefineToShape());
+    const osg::Vec3Array* vertices = static_cast<const osg::Vec3Array*>(stroke->getVertexArray());
+    QVERIFY(vertices && vertices->size() > 0);
+    osg::ref_ptr<osg::Vec3Array> copy = new osg::Vec3Array(vertices->begin(), vertices->end());
+
+    qInfo("Delete the canvas: its geometry data is moved into the snapshot");
+    osg::ref_ptr<entity::Canvas> canvas = m_canvas2.get();
+    int count = m_scene->getNumCanvases();
+    m_scene->editCanvasDelete(m_undoStack, canvas.get());
+    QCOMPARE(static_cast<int>(m_scene->getNumCanvases()), count-1);
+    QVERIFY(stroke->getVertexArray() == vertices);
+    QCOMPARE(static_cast<int>(vertices->size()), 0);
+
+    qInfo("Undo the deletion: the same stroke is re-materialized");
+    m_undoStack->undo();
+    QCOMPARE(static_cast<int>(m_scene->getNumCanvases()), count);
+    QVERIFY(canvas->getEntity(0) == stroke.get());
+    QCOMPARE(vertices->size(), copy->size());
+    for (size_t i=0; i<copy->size(); ++i)
+        QCOMPARE((*vertices)[i], (*copy)[i]);
+}
+
+void CanvasTest::testIntersectionTable()
+{
+    qInfo("Test intersection of orthogonal canvases");
+    osg::Vec3f P1, P2, P3, P4;
+    QVERIFY(m_canvas2->getIntersection(m_canvas1.get(), P1, P2, P3, P4));
+    osg::Vec3f Q1, Q2, Q3, Q4;
+    QVERIFY(Utilities::getCanvasesIntersection(m_canvas2.get(), m_canvas1.get(), Q1, Q2, Q3, Q4) == 2);
+    QVERIFY(differenceWithinThreshold(P1, Q1));
+    QVERIFY(differenceWithinThreshold(P4, Q4));
+
+    qInfo("Test canvas switch does not change the transform revisions");
+    unsigned int revision = m_canvas2->getTransformRevision();
+    unsigned int revision1 = m_canvas1->getTransformRevision();
+    m_scene->setCanvasCurrent(m_canvas1.get());
+    m_scene->setCanvasCurrent(m_canvas2.get());
+    QCOMPARE(m_canvas2->getTransformRevision(), revision);
+    QCOMPARE(m_canvas1->getTransformRevision(), revision1);
+    QVERIFY(m_canvas2->getIntersection(m_canvas1.get(), Q1, Q2, Q3, Q4));
+    QVERIFY(differenceWithinThreshold(P1, Q1));
+
+    qInfo("Test the intersection is re-calculated once the other canvas is moved");
+    m_canvas1->translate(osg::Matrix::translate(m_canvas1->getNormal() * 0.5f));
+    QVERIFY(m_canvas1->getTransformRevision() != revision1);
+    QVERIFY(m_canvas2->getIntersection(m_canvas1.get(), Q1, Q2, Q3, Q4));
+    QVERIFY(!differenceWithinThreshold(P1, Q1));
+    QVERIFY(Utilities::getCanvasesIntersection(m_canvas2.get(), m_canvas1.get(), P1, P2, P3, P4) == 2);
+    QVERIFY(differenceWithinThreshold(P1, Q1));
+
+    qInfo("Test parallel canvases have no intersection");
+    m_canvas1->setMatrixRotation(m_canvas2->getMatrixRotation());
+    QVERIFY(!m_canvas2->getIntersection(m_canvas1.get(), Q1, Q2, Q3, Q4));
+
+    qInfo("Test the entries of a removed canvas are pruned");
+    m_canvas2->getIntersection(m_canvas0.get(), Q1, Q2, Q3, Q4);
+    m_canvas1->getIntersection(m_canvas2.get(), Q1, Q2, Q3, Q4);
+    QCOMPARE(m_canvas2->getNumIntersections(), 2u);
+    QVERIFY(m_scene->removeCanvas(m_canvas1.get()));
+    QCOMPARE(m_canvas2->getNumIntersections(), 1u);
+    QCOMPARE(m_canvas1->getNumIntersections(), 0u);
+    QVERIFY(m_scene->addCanvas(m_canvas1.get()));
+}
+
+void CanvasTest::testNeighbourIntersections()
+{
+    qInfo("Test the intersections with all the canvases are hidden by default");
+    QCOMPARE(m_scene->getCanvasCurrent(), m_canvas2.get());
+    QCOMPARE(m_scene->getCanvasPrevious(), m_canvas1.get());
+    QVERIFY(!m_rootScene->getCanvasIntersectionsVisibility());
+    m_rootScene->updateCanvasIntersections();
+    QCOMPARE(m_canvas2->getToolFrame()->getNumNeighbourIntersections(), 0u);
+
+    qInfo("Test the current canvas shows its intersections with the canvases but the previous one");
+    osg::Vec3f P1, P2, P3, P4;
+    bool crossed = m_canvas2->getIntersection(m_canvas0.get(), P1, P2, P3, P4);
+    m_actionCanvasIntersections->setChecked(true);
+    QVERIFY(m_rootScene->getCanvasIntersectionsVisibility());
+    QVERIFY(m_rootScene->updateCanvasIntersections());
+    QCOMPARE(m_canvas2->getToolFrame()->getNumNeighbourIntersections(), crossed? 1u : 0u);
+
+    qInfo("Test the lines are not rebuilt while nothing changes");
+    QVERIFY(!m_rootScene->updateCanvasIntersections());
+
+    qInfo("Test the lines are rebuilt once a neighbour is moved");
+    m_canvas0->translate(osg::Matrix::translate(m_canvas0->getNormal() * 0.5f));
+    QVERIFY(m_rootScene->updateCanvasIntersections());
+    QVERIFY(!m_rootScene->updateCanvasIntersections());
+
+    qInfo("Test the lines move to the new current canvas");
+    m_scene->setCanvasCurrent(m_canvas0.get());
+    QVERIFY(m_rootScene->updateCanvasIntersections());
+    QCOMPARE(m_canvas2->getToolFrame()->getNumNeighbourIntersections(), 0u);
+    crossed = m_canvas0->getIntersection(m_canvas1.get(), P1, P2, P3, P4);
+    QCOMPARE(m_canvas0->getToolFrame()->getNumNeighbourIntersections(), crossed? 1u : 0u);
+
+    qInfo("Test the lines are hidden when switched off");
+    m_actionCanvasIntersections->setChecked(false);
+    QVERIFY(m_rootScene->updateCanvasIntersections());
+    QCOMPARE(m_canvas0->getToolFrame()->getNumNeighbourIntersections(), 0u);
+    m_scene->setCanvasCurrent(m_canvas1.get());
+    m_scene->setCanvasCurrent(m_canvas2.get());
+}
+
+void CanvasTest::testResetModel()
+{
+    qInfo("Prepare canvas with a photo and a hidden canvas");
+    m_rootScene->setCanvasCurrent(m_canvas0.get());
+    QString fname = "../../samples/ds-32.bmp";
+    m_rootScene->addPhoto(fname.toStdString());
+    QCOMPARE(static_cast<int>(m_canvas0->getNumPhotos()), 1);
+    m_rootScene->setCanvasCurrent(m_canvas2.get());
+    m_canvas1->setVisibilityAll(false);
+
+    qInfo("Reset the widget at once, no item changes are reported");
+    QSignalSpy spy(m_canvasWidget, SIGNAL(itemChanged(QTreeWidgetItem*,int)));
+    m_scene->resetModel(m_canvasWidget);
+    QCOMPARE(spy.count(), 0);
+    QCOMPARE(m_canvasWidget->topLevelItemCount(), 3);
+
+    qInfo("Test canvas items content");
+    QTreeWidgetItem* item0 = m_canvasWidget->topLevelItem(0);
+    QVERIFY(item0);
+    QCOMPARE(item0->text(0), QString(m_canvas0->getName().c_str()));
+    QCOMPARE(item0->childCount(), 1);
+    QCOMPARE(item0->child(0)->text(0), QString(m_canvas0->getPhoto(0)->getName().c_str()));
+    QCOMPARE(item0->data(0, cher::DelegateBGColor).value<QColor>(),
+             Utilities::getQColor(cher::CANVAS_CLR_PREVIOUS));
+
+    QTreeWidgetItem* item1 = m_canvasWidget->topLevelItem(1);
+    QVERIFY(item1);
+    QCOMPARE(item1->data(0, cher::DelegateVisibilityRole).toBool(), true);
+    QCOMPARE(m_canvas1->getVisibilityAll(), false);
+    QCOMPARE(item1->data(0, cher::DelegateBGColor).value<QColor>(), QColor(Qt::white));
+
+    QTreeWidgetItem* item2 = m_canvasWidget->topLevelItem(2);
+    QVERIFY(item2);
+    QCOMPARE(item2->data(0, cher::DelegateVisibilityRole).toBool(), false);
+    QCOMPARE(item2->data(0, cher::DelegateBGColor).value<QColor>(),
+             Utilities::getQColor(cher::CANVAS_CLR_CURRENT));
+
+    qInfo("Test the widget still follows the scene after the reset");
+    this->onNewCanvasXY();
+    QCOMPARE(m_canvasWidget->topLevelItemCount(), 4);
+}
+
 bool CanvasTest::differenceWithinThreshold(const osg::Vec3f &X, const osg::Vec3f &Y)
 {
     osg::Vec3f diff = X-Y;
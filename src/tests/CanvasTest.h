@@ -14,6 +14,11 @@ private slots:
     void testNewYZ();
     void testNewXZ();
     void testCloneOrtho();
+    void testNewCanvasSets();
+    void testDeleteSnapshot();
+    void testIntersectionTable();
+    void testNeighbourIntersections();
+    void testResetModel();
 
 private:
     bool differenceWithinThreshold(const osg::Vec3f& X, const osg::Vec3f& Y);
@@ -2,6 +2,13 @@
 
 #include <QTreeWidgetItem>
 #include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QImage>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include "PhotoModel.h"
 
 void MainWindowTest::testToolsOnOff()
 {
@@ -175,5 +182,155 @@ void MainWindowTest::testUndoRedoCanvasMove()
     QCOMPARE(stack->canRedo(), true);
 }
 
+void MainWindowTest::testUndoMergeCanvasMove()
+{
+    qInfo("Offset the canvas by two separate gestures");
+    entity::Canvas* canvas = m_scene->getCanvasCurrent();
+    QVERIFY(canvas);
+    QUndoStack* stack = this->m_undoStack;
+    int count = stack->count();
+    osg::Vec3f center = canvas->getCenter();
+    m_scene->editCanvasOffset(stack, osg::Vec3f(0,1,0), cher::EVENT_PRESSED);
+    m_scene->editCanvasOffset(stack, osg::Vec3f(0,1,0), cher::EVENT_RELEASED);
+    m_scene->editCanvasOffset(stack, osg::Vec3f(0,0,1), cher::EVENT_PRESSED);
+    m_scene->editCanvasOffset(stack, osg::Vec3f(0,0,1), cher::EVENT_RELEASED);
+
+    qInfo("Consecutive offsets of the same canvas are merged into one command");
+    QCOMPARE(stack->count(), count+1);
+    QVERIFY((canvas->getCenter() - (center + osg::Vec3f(0,2,2))).length() < cher::EPSILON);
+
+    qInfo("Both offsets are undone at once");
+    stack->undo();
+    QCOMPARE(stack->index(), count);
+    QVERIFY((canvas->getCenter() - center).length() < cher::EPSILON);
+
+    qInfo("Offset of another canvas is not merged");
+    stack->redo();
+    m_scene->setCanvasCurrent(m_canvas0.get());
+    m_scene->editCanvasOffset(stack, osg::Vec3f(1,0,0), cher::EVENT_PRESSED);
+    m_scene->editCanvasOffset(stack, osg::Vec3f(1,0,0), cher::EVENT_RELEASED);
+    QCOMPARE(stack->count(), count+2);
+}
+
+void MainWindowTest::testUndoHistoryBudget()
+{
+    QUndoStack* stack = this->m_undoStack;
+    fur::UndoHistory* history = this->m_undoHistory;
+    QVERIFY(history);
+    QCOMPARE(history->getBudget(), cher::UNDO_HISTORY_BUDGET);
+    QCOMPARE(history->getMemoryUsage(), Q_UINT64_C(0));
+    int count = stack->count();
+
+    qInfo("Deleted canvases are kept by the history");
+    QSignalSpy spy(history, SIGNAL(memoryUsageChanged(quint64,quint64)));
+    m_scene->editCanvasDelete(stack, m_canvas2.get());
+    QCOMPARE(spy.count(), 1);
+    quint64 usage = history->getMemoryUsage();
+    QVERIFY(usage > 0);
+    QCOMPARE(history->getIndexMinimum(), 0);
+
+    qInfo("Exceed the budget: the oldest commands are dropped, the last one is kept");
+    history->setBudget(1);
+    QCOMPARE(history->getMemoryUsage(), usage);
+    m_scene->editCanvasDelete(stack, m_canvas1.get());
+    QCOMPARE(stack->count(), count+2);
+    QCOMPARE(history->getIndexMinimum(), count+1);
+    QVERIFY(history->getMemoryUsage() > 0);
+    QVERIFY(!m_canvas2.get());
+    QCOMPARE(m_scene->getNumCanvases(), 1);
+
+    qInfo("The history cannot be undone past the dropped commands");
+    QVERIFY(history->canUndo());
+    QVERIFY(m_actionUndo->isEnabled());
+    m_actionUndo->trigger();
+    QCOMPARE(m_scene->getNumCanvases(), 2);
+    QCOMPARE(stack->index(), count+1);
+    QVERIFY(!history->canUndo());
+    QVERIFY(!m_actionUndo->isEnabled());
+    m_actionUndo->trigger();
+    history->undo();
+    QCOMPARE(stack->index(), count+1);
+    QCOMPARE(m_scene->getNumCanvases(), 2);
+
+    qInfo("Budget is not limited to 32 bits");
+    history->setBudget(Q_UINT64_C(8)*1024*1024*1024);
+    QCOMPARE(history->getBudget(), Q_UINT64_C(8)*1024*1024*1024);
+
+    qInfo("Clear of the stack resets the history");
+    history->setBudget(cher::UNDO_HISTORY_BUDGET);
+    stack->clear();
+    QCOMPARE(history->getIndexMinimum(), 0);
+    QCOMPARE(history->getMemoryUsage(), Q_UINT64_C(0));
+    QVERIFY(!m_actionUndo->isEnabled());
+}
+
+void MainWindowTest::testFileOpenAsync()
+{
+    qInfo("Save the scene to file");
+    QString filename = "RW_MainWindowTest.osgt";
+    m_rootScene->setFilePath(filename.toStdString());
+    QVERIFY(m_rootScene->writeScenetoFile());
+
+    qInfo("Start loading and cancel it right away");
+    this->onFileClose();
+    QCOMPARE(m_rootScene->getUserScene()->getNumCanvases(), 0);
+    this->loadSceneFromFileAsync(filename);
+    QVERIFY(m_sceneLoader);
+    QSignalSpy spy_canceled(m_sceneLoader, SIGNAL(finished(bool)));
+    m_sceneLoader->cancel();
+    QVERIFY(spy_canceled.wait(5000));
+    QCOMPARE(spy_canceled.takeFirst().at(0).toBool(), false);
+    QTest::qWait(100);
+    QVERIFY(!m_sceneLoader);
+    QCOMPARE(m_rootScene->getUserScene()->getNumCanvases(), 0);
+    QVERIFY(!m_rootScene->isSetFilePath());
+
+    qInfo("Load the scene on the worker thread");
+    this->loadSceneFromFileAsync(filename);
+    QVERIFY(m_sceneLoader);
+    QSignalSpy spy_loaded(m_sceneLoader, SIGNAL(finished(bool)));
+    QVERIFY(spy_loaded.wait(5000));
+    QCOMPARE(spy_loaded.takeFirst().at(0).toBool(), true);
+    QTest::qWait(100);
+    QVERIFY(!m_sceneLoader);
+    QCOMPARE(m_rootScene->getUserScene()->getNumCanvases(), 3);
+    QCOMPARE(m_canvasWidget->topLevelItemCount(), 3);
+    QVERIFY(m_rootScene->getUserScene()->thread() == this->thread());
+}
+
+void MainWindowTest::testPhotoBaseThumbnails()
+{
+    QTemporaryDir photos, cache;
+    QVERIFY(photos.isValid() && cache.isValid());
+    QImage image(320, 240, QImage::Format_RGB32);
+    image.fill(Qt::red);
+    QVERIFY(image.save(QDir(photos.path()).filePath("a.bmp"), "BMP"));
+    QVERIFY(image.save(QDir(photos.path()).filePath("b.bmp"), "BMP"));
+    QFile broken(QDir(photos.path()).filePath("c.bmp"));
+    QVERIFY(broken.open(QIODevice::WriteOnly));
+    broken.write("not an image");
+    broken.close();
+
+    qInfo("The items are populated before their thumbnails are generated");
+    PhotoModel model;
+    model.setCacheDirectory(cache.path());
+    model.setRootPath(photos.path());
+    QCOMPARE(model.rowCount(), 3);
+    model.waitForDone();
+    QCOMPARE(model.getNumPending(), 0);
+    QCOMPARE(model.rowCount(), 2);
+    QVERIFY(!model.item(0)->icon().isNull());
+    QVERIFY(!model.item(1)->icon().isNull());
+
+    qInfo("The thumbnails are cached by path, modification time and size");
+    QFileInfo info(QDir(photos.path()).filePath("a.bmp"));
+    QVERIFY(QFile::exists(model.getThumbnailCachePath(info)));
+    QCOMPARE(QDir(cache.path()).entryList(QStringList() << "*.png", QDir::Files).size(), 2);
+    model.setRootPath(photos.path());
+    model.waitForDone();
+    QCOMPARE(model.rowCount(), 2);
+    QCOMPARE(QDir(cache.path()).entryList(QStringList() << "*.png", QDir::Files).size(), 2);
+}
+
 QTEST_MAIN(MainWindowTest)
 #include "MainWindowTest.moc"
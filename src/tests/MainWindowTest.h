@@ -14,6 +14,10 @@ private slots:
     void testToolsOnOff();
     void testUndoRedoSketch();
     void testUndoRedoCanvasMove();
+    void testUndoMergeCanvasMove();
+    void testUndoHistoryBudget();
+    void testFileOpenAsync();
+    void testPhotoBaseThumbnails();
 };
 
 #endif // MAINWINDOWTEST_H
@@ -0,0 +1,339 @@
+#include "PhotoTest.h"
+
+#include <algorithm>
+
+#include <osg/ref_ptr>
+#include <QTemporaryDir>
+#include <QImage>
+#include <QDir>
+
+#include "Photo.h"
+#include "ImageLoader.h"
+#include "ImageCache.h"
+#include "ImageDecoder.h"
+#include "PhotoTiler.h"
+#include "PhotoAtlas.h"
+#include "ProjectContainer.h"
+#include "TextureResidency.h"
+
+void PhotoTest::testImageLoader()
+{
+    /* 24 bit BMP: the left half is red, the right half is blue */
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QImage source(64, 48, QImage::Format_RGB888);
+    source.fill(Qt::blue);
+    for (int y=0; y<source.height(); ++y)
+        for (int x=0; x<source.width()/2; ++x)
+            source.setPixel(x, y, qRgb(255, 0, 0));
+    std::string fname = QDir(dir.path()).filePath("loader.bmp").toStdString();
+    QVERIFY(source.save(QString::fromStdString(fname), "BMP"));
+
+    int width = 0, height = 0;
+    QVERIFY(ImageLoader::readSize(fname, width, height));
+    QCOMPARE(width, 64);
+    QCOMPARE(height, 48);
+    QCOMPARE(ImageLoader::getScaleForSize(width, height, 16, 12), 4u);
+    QCOMPARE(ImageLoader::getScaleForSize(width, height, 100, 80), 1u);
+
+    /* full resolution image refers to the mapped file */
+    osg::ref_ptr<osg::Image> full = ImageLoader::read(fname);
+    QVERIFY(full.get());
+    QCOMPARE(full->s(), 64);
+    QCOMPARE(full->t(), 48);
+    QCOMPARE(ImageLoader::toQImage(full.get()).pixel(0, 0), qRgb(255, 0, 0));
+    QCOMPARE(ImageLoader::toQImage(full.get()).pixel(63, 47), qRgb(0, 0, 255));
+
+    /* strided read at 1/4 */
+    osg::ref_ptr<osg::Image> quarter = ImageLoader::read(fname, 4);
+    QVERIFY(quarter.get());
+    QCOMPARE(quarter->s(), 16);
+    QCOMPARE(quarter->t(), 12);
+    QImage qimage = ImageLoader::toQImage(quarter.get());
+    QCOMPARE(qimage.pixel(0, 0), qRgb(255, 0, 0));
+    QCOMPARE(qimage.pixel(15, 11), qRgb(0, 0, 255));
+
+    /* the pyramid of the mapped image is built from its copies */
+    std::vector< osg::ref_ptr<osg::Image> > levels;
+    entity::PhotoImage::createPyramid(full.get(), levels);
+    QVERIFY(!levels.empty());
+    QVERIFY(!ImageCache::getHash(full.get()).empty());
+}
+
+void PhotoTest::testTiledPhoto()
+{
+    /* the full resolution level is wider than the tiling threshold */
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QImage source(4200, 64, QImage::Format_RGB888);
+    source.fill(Qt::green);
+    std::string fname = QDir(dir.path()).filePath("tiled.bmp").toStdString();
+    QVERIFY(source.save(QString::fromStdString(fname), "BMP"));
+
+    osg::ref_ptr<entity::Photo> photo = new entity::Photo;
+    photo->loadImage(fname);
+    entity::PhotoImage* image = photo->getPhotoImage();
+    QVERIFY(image->getNumLevels() > 2);
+    QVERIFY(image->isLevelTiled(0));
+    QVERIFY(!image->isLevelTiled(1));
+    QCOMPARE(image->getBaseLevel(), 1u);
+    QCOMPARE(image->getTextureLevel(0), 1u);
+    QVERIFY(image->setLevel(0));
+    QCOMPARE(image->getImage(), image->getLevelImage(1));
+
+    /* the tiles are cut from the resident level, the edge tile is smaller */
+    int cols = 0, rows = 0;
+    PhotoTiler::getGrid(4200, 64, cols, rows);
+    QCOMPARE(cols, 9);
+    QCOMPARE(rows, 1);
+    QVERIFY(image->requestTile(0, 8, 0));
+    QVERIFY(!image->requestTile(0, 9, 0));
+    QCOMPARE(image->getTileTexture(0, 8, 0)->getImage()->s(), 104);
+    QCOMPARE(image->getTileTexture(0, 8, 0)->getImage()->t(), 64);
+    float u0, v0, u1, v1;
+    PhotoTiler::getTileRect(4200, 64, 8, 0, u0, v0, u1, v1);
+    QCOMPARE(u1, 1.f);
+    photo->addTile(image->getTileTexture(0, 8, 0), 0, 8, 0, u0, v0, u1, v1);
+    QCOMPARE(photo->getNumTilesDrawn(), 1u);
+    photo->clearTiles();
+    QCOMPARE(photo->getNumTilesDrawn(), 0u);
+
+    /* the tile quad is kept for the next frame, and it is built anew once the photo moves */
+    QCOMPARE(photo->getNumTileQuads(), 1u);
+    photo->addTile(image->getTileTexture(0, 8, 0), 0, 8, 0, u0, v0, u1, v1);
+    QCOMPARE(photo->getNumTileQuads(), 1u);
+    photo->clearTiles();
+    photo->moveDelta(0.5, 0);
+    photo->addTile(image->getTileTexture(0, 8, 0), 0, 7, 0, u0, v0, u1, v1);
+    QCOMPARE(photo->getNumTileQuads(), 1u);
+    photo->releaseTiles();
+    QCOMPARE(photo->getNumTileQuads(), 0u);
+    QCOMPARE(photo->getNumTilesDrawn(), 0u);
+
+    /* the tiles of the current frame are kept, the older ones are released */
+    image->releaseTiles(0);
+    QCOMPARE(image->getNumTiles(), 1u);
+    image->releaseTiles(0);
+    QCOMPARE(image->getNumTiles(), 0u);
+
+    /* the tiles are assembled back into the same level */
+    std::vector< osg::ref_ptr<osg::Image> > tiles;
+    PhotoTiler::createTiles(image->getLevelImage(0), tiles);
+    QCOMPARE(static_cast<int>(tiles.size()), cols * rows);
+    osg::ref_ptr<osg::Image> merged = PhotoTiler::merge(tiles, cols, rows);
+    QVERIFY(merged.get());
+    QCOMPARE(merged->s(), 4200);
+    QCOMPARE(merged->t(), 64);
+    for (int r=0; r<merged->t(); ++r)
+        QVERIFY(std::equal(merged->data(0, r), merged->data(0, r) + 4200*3, image->getLevelImage(0)->data(0, r)));
+
+    /* the tiled level is stored tile by tile */
+    m_rootScene->setCanvasCurrent(m_canvas2.get());
+    m_rootScene->addPhoto(fname);
+    ImageDecoder::instance().waitForDone();
+    QString filename = "RW_TiledPhoto.cherish";
+    m_rootScene->setFilePath(filename.toStdString());
+    QVERIFY(m_rootScene->writeScenetoFile());
+    osg::ref_ptr<entity::ProjectContainer> container = new entity::ProjectContainer;
+    QVERIFY(container->open(filename.toStdString()));
+    std::string key = entity::ProjectContainer::getPhotoKey(m_canvas2.get(), 0);
+    QCOMPARE(container->getNumPhotoLevels(key), image->getNumLevels());
+    QVERIFY(container->findChunk(entity::ProjectContainer::CHUNK_PHOTO, key) < 0);
+    QVERIFY(container->findChunk(entity::ProjectContainer::CHUNK_PHOTO, entity::ProjectContainer::getTileKey(key, 0, 8, 0)) >= 0);
+    osg::ref_ptr<osg::Image> level = container->readPhotoLevel(key, 0);
+    QVERIFY(level.get());
+    QCOMPARE(level->s(), 4200);
+
+    /* the re-opened photo pages in its tiles one by one */
+    this->onFileClose();
+    m_rootScene->setFilePath(filename.toStdString());
+    QVERIFY(this->loadSceneFromFile());
+    ImageDecoder::instance().waitForDone();
+    entity::Photo* loaded = m_rootScene->getUserScene()->getCanvas(2)->getPhoto(0);
+    QVERIFY(loaded);
+    image = loaded->getPhotoImage();
+    QCOMPARE(image->getStoreKey(), key);
+    QVERIFY(!image->getLevelImage(0));
+    QVERIFY(image->getLevelImage(image->getNumLevels()-1));
+    QVERIFY(!image->requestTile(0, 0, 0));
+    image->setTilePending(0, 0, 0);
+    ImageDecoder::instance().decode(loaded, container.get(), key, 0, 0, 0);
+    ImageDecoder::instance().waitForDone();
+    QVERIFY(!image->isTilePending(0, 0, 0));
+    QVERIFY(image->requestTile(0, 0, 0));
+    QCOMPARE(image->getTileTexture(0, 0, 0)->getImage()->s(), cher::PHOTO_TILE_SIZE);
+    container->close();
+}
+
+void PhotoTest::testPhotoAtlas()
+{
+    PhotoAtlas& atlas = m_rootScene->getPhotoAtlas();
+    QVERIFY(atlas.isEnabled());
+    m_rootScene->updatePhotoLevels(this->getCamera());
+    unsigned int numImages = atlas.getStatistics().numImages;
+
+    /* three small photos of different content */
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const Qt::GlobalColor colors[3] = {Qt::red, Qt::green, Qt::blue};
+    m_rootScene->setCanvasCurrent(m_canvas2.get());
+    for (int i=0; i<3; ++i){
+        QImage source(32, 24, QImage::Format_RGB888);
+        source.fill(colors[i]);
+        QString fname = QDir(dir.path()).filePath(QString("small%1.bmp").arg(i));
+        QVERIFY(source.save(fname, "BMP"));
+        m_rootScene->addPhoto(fname.toStdString());
+    }
+    ImageDecoder::instance().waitForDone();
+    QCOMPARE(m_canvas2->getNumPhotos(), 3u);
+    QVERIFY(PhotoAtlas::isCandidate(m_canvas2->getPhoto(0)->getPhotoImage()));
+
+    /* the photos are drawn by a single batch of a single page */
+    m_rootScene->updatePhotoLevels(this->getCamera());
+    QCOMPARE(atlas.getStatistics().numImages, numImages + 3);
+    QCOMPARE(atlas.getNumPages(), 1u);
+    QVERIFY(atlas.getPageTexture(0));
+    osg::Geode* batch = atlas.getBatch(m_canvas2.get());
+    QVERIFY(batch);
+    QCOMPARE(batch->getNumDrawables(), 1u);
+    QCOMPARE(batch->getDrawable(0)->asGeometry()->getVertexArray()->getNumElements(), 12u);
+    for (unsigned int j=0; j<m_canvas2->getNumPhotos(); ++j){
+        QVERIFY(atlas.isPacked(m_canvas2->getPhoto(j)->getPhotoImage()));
+        QVERIFY(m_canvas2->getPhoto(j)->getCullCallback());
+    }
+    const PhotoAtlas::Statistics& statistics = atlas.getStatistics();
+    QVERIFY(statistics.numDrawCalls < statistics.numDrawCallsUnbatched);
+    QVERIFY(statistics.numTextureBinds < statistics.numTextureBindsUnbatched);
+
+    /* the batch is rebuilt only when its photos change */
+    osg::ref_ptr<osg::Array> array = batch->getDrawable(0)->asGeometry()->getVertexArray();
+    QVERIFY(!atlas.update(m_rootScene->getUserScene()));
+    QCOMPARE(batch->getDrawable(0)->asGeometry()->getVertexArray(), array.get());
+    m_canvas2->getPhoto(0)->moveDelta(0.5, 0);
+    QVERIFY(!atlas.update(m_rootScene->getUserScene()));
+    QVERIFY(batch->getDrawable(0)->asGeometry()->getVertexArray() != array.get());
+    QCOMPARE(atlas.getBatch(m_canvas2.get()), batch);
+
+    /* the deleted photo releases its slot */
+    m_undoStack->undo();
+    QCOMPARE(m_canvas2->getNumPhotos(), 2u);
+    m_rootScene->updatePhotoLevels(this->getCamera());
+    QCOMPARE(atlas.getStatistics().numImages, numImages + 2);
+    QCOMPARE(batch->getDrawable(0)->asGeometry()->getVertexArray()->getNumElements(), 8u);
+
+    /* the batch is never written */
+    atlas.detach();
+    QVERIFY(!atlas.getBatch(m_canvas2.get()));
+    QCOMPARE(m_canvas2->getGroupData()->getNumChildren(), 4u);
+    QVERIFY(!m_canvas2->getPhoto(0)->getCullCallback());
+    m_rootScene->updatePhotoLevels(this->getCamera());
+    QVERIFY(atlas.getBatch(m_canvas2.get()));
+
+    /* the disabled atlas lets the photos draw themselves */
+    atlas.setEnabled(false);
+    QCOMPARE(atlas.getNumPages(), 0u);
+    QVERIFY(!atlas.getBatch(m_canvas2.get()));
+    atlas.setEnabled(true);
+}
+
+void PhotoTest::testTextureResidency()
+{
+    /* save and re-open a scene with photo, so that the photo levels can be paged in from the container */
+    m_rootScene->setCanvasCurrent(m_canvas2.get());
+    QString fname = "../../samples/test.bmp";
+    m_rootScene->addPhoto(fname.toStdString());
+    QString filename = "RW_TextureResidency.cherish";
+    m_rootScene->setFilePath(filename.toStdString());
+    QVERIFY(m_rootScene->writeScenetoFile());
+    this->onFileClose();
+    m_rootScene->setFilePath(filename.toStdString());
+    QVERIFY(this->loadSceneFromFile());
+    ImageDecoder::instance().waitForDone();
+
+    entity::Canvas* canvas = m_rootScene->getUserScene()->getCanvas(2);
+    QVERIFY(canvas);
+    QVERIFY(canvas->getPhoto(0));
+    entity::PhotoImage* image = canvas->getPhoto(0)->getPhotoImage();
+    QVERIFY(!image->getStoreKey().empty());
+    unsigned int numLevels = image->getNumLevels();
+    QVERIFY(numLevels >= 1);
+
+    /* hide the canvas and evict it right away */
+    TextureResidency& residency = m_rootScene->getTextureResidency();
+    residency.setBudget(Q_UINT64_C(8)*1024*1024*1024);
+    QCOMPARE(residency.getBudget(), Q_UINT64_C(8)*1024*1024*1024);
+    residency.setBudget(cher::PHOTO_RESIDENCY_BUDGET);
+    residency.setMaxAge(0);
+    this->onVisibilitySetCanvas(2);
+    QVERIFY(!canvas->getVisibilityAll());
+    m_rootScene->updatePhotoLevels(this->getCamera());
+    QTest::qWait(10);
+    m_rootScene->updatePhotoLevels(this->getCamera());
+    QVERIFY(residency.isEvicted(canvas));
+    QCOMPARE(image->getLevel(), numLevels-1);
+    for (unsigned int i=0; i+1<numLevels; ++i)
+        QVERIFY(!image->getLevelImage(i));
+    QVERIFY(image->getLevelImage(numLevels-1));
+    QCOMPARE(residency.getUsage(canvas).host, image->getHostBytes());
+
+    /* show the canvas again: the requested level is paged in */
+    this->onVisibilitySetCanvas(2);
+    QVERIFY(canvas->getVisibilityAll());
+    m_rootScene->updatePhotoLevels(this->getCamera());
+    ImageDecoder::instance().waitForDone();
+    QVERIFY(image->getLevelImage(image->getLevel()));
+
+    residency.setMaxAge(cher::PHOTO_RESIDENCY_AGE);
+}
+
+void PhotoTest::testSharedPhotoImages()
+{
+    /* the same image imported into two canvases */
+    QString fname = "../../samples/test.bmp";
+    m_rootScene->setCanvasCurrent(m_canvas2.get());
+    m_rootScene->addPhoto(fname.toStdString());
+    m_rootScene->setCanvasCurrent(m_canvas0.get());
+    m_rootScene->addPhoto(fname.toStdString());
+    ImageDecoder::instance().waitForDone();
+    entity::Photo* photo0 = m_canvas0->getPhoto(0);
+    entity::Photo* photo2 = m_canvas2->getPhoto(0);
+    QVERIFY(photo0 && photo2);
+    QCOMPARE(photo0->getPhotoImage(), photo2->getPhotoImage());
+    QCOMPARE(photo0->getTexture(), photo2->getTexture());
+    QVERIFY(photo0->isImageShared());
+    QVERIFY(!photo0->getPhotoImage()->getHash().empty());
+
+    /* the image data is written once, the second photo refers to the chunks of the first one */
+    QString filename = "RW_SharedPhotoImages.cherish";
+    m_rootScene->setFilePath(filename.toStdString());
+    QVERIFY(m_rootScene->writeScenetoFile());
+    osg::ref_ptr<entity::ProjectContainer> container = new entity::ProjectContainer;
+    QVERIFY(container->open(filename.toStdString()));
+    std::string key0 = entity::ProjectContainer::getPhotoKey(m_canvas0.get(), 0);
+    std::string key2 = entity::ProjectContainer::getPhotoKey(m_canvas2.get(), 0);
+    QCOMPARE(container->getSharedPhotoKey(key0), key0);
+    QCOMPARE(container->getSharedPhotoKey(key2), key0);
+    QCOMPARE(container->getNumPhotoLevels(key2), container->getNumPhotoLevels(key0));
+    container->close();
+
+    /* the photos of the re-opened scene share the image as well */
+    this->onFileClose();
+    m_rootScene->setFilePath(filename.toStdString());
+    QVERIFY(this->loadSceneFromFile());
+    ImageDecoder::instance().waitForDone();
+    photo0 = m_rootScene->getUserScene()->getCanvas(0)->getPhoto(0);
+    photo2 = m_rootScene->getUserScene()->getCanvas(2)->getPhoto(0);
+    QVERIFY(photo0 && photo2);
+    QCOMPARE(photo0->getPhotoImage(), photo2->getPhotoImage());
+
+    /* copy-on-write: the detached photo gets its own texture */
+    entity::PhotoImage* image = photo0->detachImage();
+    QVERIFY(image != photo2->getPhotoImage());
+    QVERIFY(photo0->getTexture() != photo2->getTexture());
+    QVERIFY(!photo0->isImageShared());
+    QVERIFY(!photo2->isImageShared());
+    QCOMPARE(image->getNumLevels(), photo2->getPhotoImage()->getNumLevels());
+}
+
+QTEST_MAIN(PhotoTest)
+#include "PhotoTest.moc"
@@ -0,0 +1,33 @@
+#ifndef PHOTOTEST_H
+#define PHOTOTEST_H
+
+#include <QObject>
+#include <QTest>
+
+#include "BaseGuiTest.h"
+
+/*! \class PhotoTest
+ * \brief Class that performs testing of the photo images: their reading, paging and drawing.
+*/
+class PhotoTest : public BaseGuiTest
+{
+    Q_OBJECT
+private slots:
+    /*! Battery of tests to check reading of image files at full and reduced scale, see ImageLoader */
+    void testImageLoader();
+
+    /*! Battery of tests to check tiling of the large photo pyramid levels, see PhotoTiler */
+    void testTiledPhoto();
+
+    /*! Battery of tests to check packing of the small photos into atlas textures, see PhotoAtlas */
+    void testPhotoAtlas();
+
+    /*! Battery of tests to check eviction and re-loading of photo images of hidden canvases, see TextureResidency */
+    void testTextureResidency();
+
+    /*! Battery of tests to check sharing of the photo image data among photos of the same image, see ImageCache */
+    void testSharedPhotoImages();
+
+};
+
+#endif // PHOTOTEST_H
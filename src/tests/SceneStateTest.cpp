@@ -1,10 +1,15 @@
 #include "SceneStateTest.h"
 
+#include <algorithm>
+
 #include <osg/ref_ptr>
 #include <QModelIndex>
 #include <QTreeWidgetItem>
 #include <QListWidgetItem>
 #include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QImage>
+#include <QDir>
 
 #include "Data.h"
 #include "SceneState.h"
@@ -12,6 +17,8 @@
 #include "ListWidget.h"
 #include "Bookmarks.h"
 #include "Photo.h"
+#include "ProjectContainer.h"
+#include "ImageDecoder.h"
 
 void SceneStateTest::testBasicApi()
 {
@@ -27,28 +34,35 @@ void SceneStateTest::testBasicApi()
     qInfo("Check both method return the same state scenes");
     QCOMPARE(state_stripped->getAxisFlag(), state_scened->getAxisFlag());
     QCOMPARE(state_stripped->getBookmarksFlag(), state_scened->getBookmarksFlag());
-    QCOMPARE(state_stripped->getCanvasDataFlags(), state_scened->getCanvasDataFlags());
-    QCOMPARE(state_stripped->getCanvasToolFlags(), state_scened->getCanvasToolFlags());
-    QCOMPARE(state_stripped->getPhotoTransparencies(), state_scened->getPhotoTransparencies());
+    QCOMPARE(state_stripped->getCanvasDataHidden(), state_scened->getCanvasDataHidden());
+    QCOMPARE(state_stripped->getCanvasToolHidden(), state_scened->getCanvasToolHidden());
+    QCOMPARE(state_stripped->getPhotoIds(), state_scened->getPhotoIds());
+    QCOMPARE(state_stripped->getPhotoValues(), state_scened->getPhotoValues());
+    QCOMPARE(state_stripped->getIdLimit(), state_scened->getIdLimit());
+
+    qInfo("Canvases have distinct ids");
+    QVERIFY(m_canvas0->getId() != 0);
+    QVERIFY(m_canvas0->getId() != m_canvas1->getId());
+    QVERIFY(m_canvas1->getId() != m_canvas2->getId());
+    QVERIFY(state_stripped->getIdLimit() > m_canvas2->getId());
 
     qInfo("Set some flags of scene state and apply it to Root scene");
     state_stripped->setAxisFlag(false);
     state_stripped->setBookmarksFlag(false);
-    state_stripped->popBackDataFlag();
-    state_stripped->popBackToolFlag();
-    state_stripped->popBackDataFlag();
-    state_stripped->popBackToolFlag();
-    state_stripped->popBackDataFlag();
-    state_stripped->popBackToolFlag();
+    state_stripped->setCanvasDataFlag(m_canvas0->getId(), false);
+    state_stripped->setCanvasToolFlag(m_canvas0->getId(), true);
 
-    state_stripped->pushDataFlag(false);
-    state_stripped->pushToolFlag(true);
+    state_stripped->setCanvasDataFlag(m_canvas1->getId(), false);
+    state_stripped->setCanvasToolFlag(m_canvas1->getId(), false);
 
-    state_stripped->pushDataFlag(false);
-    state_stripped->pushToolFlag(false);
+    state_stripped->setCanvasDataFlag(m_canvas2->getId(), true);
+    state_stripped->setCanvasToolFlag(m_canvas2->getId(), false);
 
-    state_stripped->pushDataFlag(true);
-    state_stripped->pushToolFlag(false);
+    qInfo("Only the hidden canvases are stored");
+    QCOMPARE(static_cast<int>(state_stripped->getCanvasDataHidden().size()), 2);
+    QCOMPARE(static_cast<int>(state_stripped->getCanvasToolHidden().size()), 2);
+    QVERIFY(!state_stripped->getCanvasDataFlag(m_canvas0->getId()));
+    QVERIFY(state_stripped->getCanvasToolFlag(m_canvas0->getId()));
 
     m_rootScene->setSceneState(state_stripped);
 
@@ -78,7 +92,10 @@ void SceneStateTest::testBasicApi()
     QVERIFY(state_stripped.get());
     QVERIFY(!state_stripped->isEmpty());
     QVERIFY( m_scene->getPhoto(m_scene->getCanvasCurrent(), 0) );
-    QCOMPARE(m_rootScene->getUserScene()->getPhoto(m_rootScene->getCanvasCurrent(), 0)->getTransparency(), state_stripped->getPhotoTransparencies()[0]);
+    entity::Photo* photo0 = m_rootScene->getUserScene()->getPhoto(m_rootScene->getCanvasCurrent(), 0);
+    QVERIFY(photo0->getId() != 0);
+    QCOMPARE(photo0->getTransparency(), state_stripped->getPhotoTransparency(photo0->getId()));
+    QVERIFY(state_stripped->getPhotoIds().empty());
 
     qInfo("Add another photo, change its transparency and check if it's saved successfully within scene state");
     m_rootScene->setCanvasCurrent(m_canvas1.get());
@@ -107,8 +124,9 @@ void SceneStateTest::testBasicApi()
     QCOMPARE(photo->getTransparency(), 1-cher::PHOTO_TRANSPARECY_DELTA);
     state_stripped->stripDataFrom(m_rootScene);
     QVERIFY(!state_stripped->isEmpty());
-    QCOMPARE(static_cast<int>(state_stripped->getPhotoTransparencies().size()), 2);
-    QCOMPARE(photo->getTransparency(), state_stripped->getPhotoTransparencies()[1]);
+    QCOMPARE(static_cast<int>(state_stripped->getPhotoIds().size()), 1);
+    QCOMPARE(photo->getTransparency(), state_stripped->getPhotoTransparency(photo->getId()));
+    QCOMPARE(photo0->getTransparency(), state_stripped->getPhotoTransparency(photo0->getId()));
 }
 
 void SceneStateTest::testBookmarkTaken()
@@ -140,12 +158,12 @@ void SceneStateTest::testBookmarkTaken()
     QVERIFY(!state_old->isEmpty());
     QVERIFY(state_old->getAxisFlag() == true);
     QVERIFY(state_old->getBookmarksFlag() == true);
-    QVERIFY(state_old->getCanvasDataFlags()[0] == false);
-    QVERIFY(state_old->getCanvasDataFlags()[1] == true);
-    QVERIFY(state_old->getCanvasDataFlags()[2] == true);
-    QVERIFY(state_old->getCanvasToolFlags()[0] == true);
-    QVERIFY(state_old->getCanvasToolFlags()[1] == true);
-    QVERIFY(state_old->getCanvasToolFlags()[2] == true);
+    QVERIFY(state_old->getCanvasDataFlag(m_canvas0->getId()) == false);
+    QVERIFY(state_old->getCanvasDataFlag(m_canvas1->getId()) == true);
+    QVERIFY(state_old->getCanvasDataFlag(m_canvas2->getId()) == true);
+    QVERIFY(state_old->getCanvasToolFlag(m_canvas0->getId()) == true);
+    QVERIFY(state_old->getCanvasToolFlag(m_canvas1->getId()) == true);
+    QVERIFY(state_old->getCanvasToolFlag(m_canvas2->getId()) == true);
 
     qInfo("spy on emitted signals");
     QSignalSpy spy1(m_rootScene->getUserScene()->getBookmarks(), SIGNAL(requestSceneData(entity::SceneState*)));
@@ -178,12 +196,12 @@ void SceneStateTest::testBookmarkTaken()
     QVERIFY(!state_new->isEmpty());
     QVERIFY(state_new->getAxisFlag() == true);
     QVERIFY(state_new->getBookmarksFlag() == true);
-    QVERIFY(state_new->getCanvasDataFlags()[0] == false);
-    QVERIFY(state_new->getCanvasDataFlags()[1] == true);
-    QVERIFY(state_new->getCanvasDataFlags()[2] == true);
-    QVERIFY(state_new->getCanvasToolFlags()[0] == true);
-    QVERIFY(state_new->getCanvasToolFlags()[1] == true);
-    QVERIFY(state_new->getCanvasToolFlags()[2] == true);
+    QVERIFY(state_new->getCanvasDataFlag(m_canvas0->getId()) == false);
+    QVERIFY(state_new->getCanvasDataFlag(m_canvas1->getId()) == true);
+    QVERIFY(state_new->getCanvasDataFlag(m_canvas2->getId()) == true);
+    QVERIFY(state_new->getCanvasToolFlag(m_canvas0->getId()) == true);
+    QVERIFY(state_new->getCanvasToolFlag(m_canvas1->getId()) == true);
+    QVERIFY(state_new->getCanvasToolFlag(m_canvas2->getId()) == true);
 }
 
 void SceneStateTest::testBookmarkClickedOn()
@@ -258,10 +276,11 @@ void SceneStateTest::testReadWrite()
     QVERIFY(bookmarks);
     QCOMPARE(static_cast<int>(bookmarks->getNumChildren()), 1);
     QCOMPARE(m_bookmarkWidget->count(), 1);
-    QCOMPARE(static_cast<int>(bookmarks->getSceneState(0)->getCanvasDataFlags().size()), 3);
-    QCOMPARE(bookmarks->getSceneState(0)->getCanvasDataFlags()[0], false);
-    QCOMPARE(bookmarks->getSceneState(0)->getCanvasDataFlags()[1], true);
-    QCOMPARE(bookmarks->getSceneState(0)->getCanvasDataFlags()[2], true);
+    std::vector<unsigned int> hidden(1, m_canvas0->getId());
+    QCOMPARE(bookmarks->getSceneState(0)->getCanvasDataHidden(), hidden);
+    QCOMPARE(bookmarks->getSceneState(0)->getCanvasDataFlag(m_canvas0->getId()), false);
+    QCOMPARE(bookmarks->getSceneState(0)->getCanvasDataFlag(m_canvas1->getId()), true);
+    QCOMPARE(bookmarks->getSceneState(0)->getCanvasDataFlag(m_canvas2->getId()), true);
 
     /* save scene as a file */
     QString filename = "RW_SceneStateTest.osgt";
@@ -286,10 +305,125 @@ void SceneStateTest::testReadWrite()
     QCOMPARE(m_bookmarkWidget->count(), 1);
     entity::SceneState* state = m_rootScene->getBookmarksModel()->getSceneState(0);
     QVERIFY(state);
-    QCOMPARE(static_cast<int>(state->getCanvasDataFlags().size()), 3);
-    QCOMPARE(state->getCanvasDataFlags()[0], false);
-    QCOMPARE(state->getCanvasDataFlags()[1], true);
-    QCOMPARE(state->getCanvasDataFlags()[2], true);
+    QCOMPARE(state->getCanvasDataHidden(), hidden);
+    QCOMPARE(m_rootScene->getUserScene()->getCanvas(index)->getId(), hidden[0]);
+    QCOMPARE(state->getCanvasDataFlag(m_rootScene->getUserScene()->getCanvas(1)->getId()), true);
+    QCOMPARE(state->getCanvasDataFlag(m_rootScene->getUserScene()->getCanvas(2)->getId()), true);
+}
+
+void SceneStateTest::testReadWriteContainer()
+{
+    /* add photo to the 2nd canvas and make 1st canvas invisible */
+    m_rootScene->setCanvasCurrent(m_canvas2.get());
+    QString fname = "../../samples/test.bmp";
+    m_rootScene->addPhoto(fname.toStdString());
+    QCOMPARE(static_cast<int>(m_scene->getNumPhotos()), 1);
+    this->onVisibilitySetCanvas(1);
+    QVERIFY(!m_canvas1->getVisibilityAll());
+    this->onBookmark();
+    QCOMPARE(m_bookmarkWidget->count(), 1);
+
+    /* save scene as a project container */
+    QString filename = "RW_SceneStateTest.cherish";
+    m_rootScene->setFilePath(filename.toStdString());
+    QVERIFY(m_rootScene->writeScenetoFile());
+    QVERIFY(m_rootScene->isSavedToFile());
+
+    /* check the table of contents: scene, three canvases and the pyramid levels of one photo */
+    osg::ref_ptr<entity::ProjectContainer> container = new entity::ProjectContainer;
+    QVERIFY(container->open(filename.toStdString()));
+    std::string key = entity::ProjectContainer::getPhotoKey(m_canvas2.get(), 0);
+    unsigned int numLevels = container->getNumPhotoLevels(key);
+    QVERIFY(numLevels >= 1);
+    QCOMPARE(numLevels, m_canvas2->getPhoto(0)->getPhotoImage()->getNumLevels());
+    QCOMPARE(static_cast<int>(container->getChunks().size()), 4 + static_cast<int>(numLevels));
+    QVERIFY(container->findChunk(entity::ProjectContainer::CHUNK_CANVAS, entity::ProjectContainer::getCanvasKey(m_canvas0.get())) >= 0);
+    QVERIFY(container->findChunk(entity::ProjectContainer::CHUNK_CANVAS, entity::ProjectContainer::getCanvasKey(m_canvas2.get())) >= 0);
+    QCOMPARE(container->findChunk(entity::ProjectContainer::CHUNK_CANVAS, m_canvas2->getName()), -1);
+    container->close();
+    QVERIFY(!container->isOpen());
+
+    /* clear and re-open the scene */
+    this->onFileClose();
+    m_rootScene->setFilePath(filename.toStdString());
+    QVERIFY(this->loadSceneFromFile());
+    QVERIFY(m_rootScene->getProjectContainer());
+    QCOMPARE(static_cast<int>(m_rootScene->getUserScene()->getNumCanvases()), 3);
+    QVERIFY(!m_rootScene->getUserScene()->getCanvas(1)->getVisibilityAll());
+    QCOMPARE(static_cast<int>(m_rootScene->getUserScene()->getNumPhotos()), 1);
+
+    /* photo image was paged in from its chunk */
+    entity::Canvas* canvas = m_rootScene->getUserScene()->getCanvas(2);
+    QVERIFY(canvas);
+    QCOMPARE(static_cast<int>(canvas->getNumPhotos()), 1);
+    QVERIFY(canvas->getPhoto(0)->getImage());
+
+    /* photo pyramid: with no texture budget the coarsest level is requested */
+    entity::PhotoImage* image = canvas->getPhoto(0)->getPhotoImage();
+    QCOMPARE(image->getNumLevels(), numLevels);
+    m_rootScene->setPhotoTextureBudget(0);
+    m_rootScene->updatePhotoLevels(this->getCamera());
+    QCOMPARE(image->getLevel(), numLevels-1);
+    QVERIFY(image->getLevelImage(numLevels-1));
+    QCOMPARE(image->getImage(), image->getLevelImage(numLevels-1));
+    int width = 0, height = 0;
+    image->getLevelSize(numLevels-1, width, height);
+    QVERIFY(std::max(width, height) <= cher::PHOTO_PYRAMID_MIN || numLevels == 1);
+
+    /* a budget beyond 4 GB does not wrap around */
+    m_rootScene->setPhotoTextureBudget(Q_UINT64_C(8)*1024*1024*1024);
+    QCOMPARE(m_rootScene->getPhotoTextureBudget(), Q_UINT64_C(8)*1024*1024*1024);
+    QVERIFY(m_rootScene->updatePhotoLevels(this->getCamera()) <= m_rootScene->getPhotoTextureBudget());
+    m_rootScene->setPhotoTextureBudget(cher::PHOTO_TEXTURE_BUDGET);
+
+    /* bookmark and its scene state */
+    QCOMPARE(m_bookmarkWidget->count(), 1);
+    entity::SceneState* state = m_rootScene->getBookmarksModel()->getSceneState(0);
+    QVERIFY(state);
+    QCOMPARE(static_cast<int>(state->getCanvasDataHidden().size()), 1);
+    QCOMPARE(state->getCanvasDataFlag(m_rootScene->getUserScene()->getCanvas(1)->getId()), false);
+    QCOMPARE(state->getPhotoTransparency(canvas->getPhoto(0)->getId()), 1.f);
+}
+
+void SceneStateTest::testContainerCanvasKeys()
+{
+    /* two canvases of the same name, with the key separators in it, and photos of different content */
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    entity::Canvas* canvases[2] = {m_canvas0.get(), m_canvas2.get()};
+    const Qt::GlobalColor colors[2] = {Qt::red, Qt::green};
+    for (int i=0; i<2; ++i){
+        QImage source(32, 24, QImage::Format_RGB888);
+        source.fill(colors[i]);
+        QString fname = QDir(dir.path()).filePath(QString("keys%1.bmp").arg(i));
+        QVERIFY(source.save(fname, "BMP"));
+        m_rootScene->setCanvasCurrent(canvases[i]);
+        m_rootScene->addPhoto(fname.toStdString());
+        canvases[i]->setName("Canvas#1@0_0/0");
+    }
+    ImageDecoder::instance().waitForDone();
+    QVERIFY(entity::ProjectContainer::getCanvasKey(m_canvas0.get()) != entity::ProjectContainer::getCanvasKey(m_canvas2.get()));
+
+    /* each canvas gets its own photo back */
+    QString filename = "RW_ContainerCanvasKeys.cherish";
+    m_rootScene->setFilePath(filename.toStdString());
+    QVERIFY(m_rootScene->writeScenetoFile());
+    this->onFileClose();
+    m_rootScene->setFilePath(filename.toStdString());
+    QVERIFY(this->loadSceneFromFile());
+    ImageDecoder::instance().waitForDone();
+    const int indices[2] = {0, 2};
+    for (int i=0; i<2; ++i){
+        entity::Canvas* canvas = m_rootScene->getUserScene()->getCanvas(indices[i]);
+        QVERIFY(canvas);
+        QCOMPARE(canvas->getName(), std::string("Canvas#1@0_0/0"));
+        QCOMPARE(canvas->getNumPhotos(), 1u);
+        const osg::Image* image = canvas->getPhoto(0)->getImage();
+        QVERIFY(image);
+        osg::Vec4 color = image->getColor(image->s()/2, image->t()/2);
+        QCOMPARE(color.r() > 0.5f, colors[i] == Qt::red);
+        QCOMPARE(color.g() > 0.5f, colors[i] == Qt::green);
+    }
 }
 
 void SceneStateTest::testAddCanvas()
@@ -304,41 +438,43 @@ void SceneStateTest::testAddCanvas()
     this->onBookmark();
     const entity::SceneState* state = m_rootScene->getUserScene()->getBookmarks()->getSceneState(0);
     QVERIFY(state);
-    QCOMPARE(static_cast<int>(state->getCanvasDataFlags().size()), 3);
-    QCOMPARE(static_cast<int>(state->getCanvasToolFlags().size()), 3);
-    QCOMPARE(state->getCanvasDataFlags()[0], false);
-    QCOMPARE(state->getCanvasToolFlags()[0], true);
+    QCOMPARE(static_cast<int>(state->getCanvasDataHidden().size()), 1);
+    QCOMPARE(static_cast<int>(state->getCanvasToolHidden().size()), 0);
+    QCOMPARE(state->getCanvasDataFlag(m_canvas0->getId()), false);
+    QCOMPARE(state->getCanvasToolFlag(m_canvas0->getId()), true);
 
-    /* add new canvas to the scene */
+    /* add new canvas to the scene, the state does not change */
     m_rootScene->addCanvas(osg::Vec3f(1,0,0), osg::Vec3f(1,1,1));
     QCOMPARE(static_cast<int>(m_rootScene->getUserScene()->getNumCanvases()), 4);
-    QCOMPARE(static_cast<int>(state->getCanvasDataFlags().size()), 4);
-    QCOMPARE(static_cast<int>(state->getCanvasToolFlags().size()), 4);
-    QCOMPARE(state->getCanvasDataFlags()[0], false);
-    QCOMPARE(state->getCanvasToolFlags()[0], true);
-    QCOMPARE(state->getCanvasDataFlags()[3], true);
-    QCOMPARE(state->getCanvasToolFlags()[3], true);
+    entity::Canvas* canvas3 = m_rootScene->getUserScene()->getCanvas(3);
+    QVERIFY(canvas3);
+    unsigned int id3 = canvas3->getId();
+    QVERIFY(id3 >= state->getIdLimit());
+    QCOMPARE(static_cast<int>(state->getCanvasDataHidden().size()), 1);
+    QCOMPARE(state->getCanvasDataFlag(m_canvas0->getId()), false);
+    QCOMPARE(state->getCanvasToolFlag(m_canvas0->getId()), true);
+    QCOMPARE(state->getCanvasDataFlag(id3), true);
+    QCOMPARE(state->getCanvasToolFlag(id3), true);
 
     /* do undo */
     m_undoStack->undo();
     QCOMPARE(static_cast<int>(m_rootScene->getUserScene()->getNumCanvases()), 3);
-    QCOMPARE(static_cast<int>(state->getCanvasDataFlags().size()), 3);
-    QCOMPARE(static_cast<int>(state->getCanvasToolFlags().size()), 3);
-    QCOMPARE(state->getCanvasDataFlags()[0], false);
-    QCOMPARE(state->getCanvasToolFlags()[0], true);
+    QCOMPARE(static_cast<int>(state->getCanvasDataHidden().size()), 1);
+    QCOMPARE(state->getCanvasDataFlag(m_canvas0->getId()), false);
+    QCOMPARE(state->getCanvasToolFlag(m_canvas0->getId()), true);
 
-    /* do redo */
+    /* do redo, the canvas keeps its id */
     m_undoStack->redo();
     QCOMPARE(static_cast<int>(m_rootScene->getUserScene()->getNumCanvases()), 4);
-    QCOMPARE(static_cast<int>(state->getCanvasDataFlags().size()), 4);
-    QCOMPARE(static_cast<int>(state->getCanvasToolFlags().size()), 4);
-    QCOMPARE(state->getCanvasDataFlags()[0], false);
-    QCOMPARE(state->getCanvasToolFlags()[0], true);
-    QCOMPARE(state->getCanvasDataFlags()[3], true);
-    QCOMPARE(state->getCanvasToolFlags()[3], true);
+    QCOMPARE(m_rootScene->getUserScene()->getCanvas(3)->getId(), id3);
+    QCOMPARE(state->getCanvasDataFlag(m_canvas0->getId()), false);
+    QCOMPARE(state->getCanvasDataFlag(id3), true);
+    QCOMPARE(state->getCanvasToolFlag(id3), true);
 
     /* check setting scene state does not fail */
     QVERIFY(m_rootScene->setSceneState(state));
+    QVERIFY(!m_canvas0->getVisibilityAll());
+    QVERIFY(m_rootScene->getUserScene()->getCanvas(3)->getVisibilityAll());
 }
 
 void SceneStateTest::testAddPhoto()
@@ -353,9 +489,8 @@ void SceneStateTest::testAddPhoto()
     this->onBookmark();
     const entity::SceneState* state = m_rootScene->getUserScene()->getBookmarks()->getSceneState(0);
     QVERIFY(state);
-    QCOMPARE(static_cast<int>(state->getCanvasDataFlags().size()), 3);
-    QCOMPARE(state->getCanvasDataFlags()[0], false);
-    QCOMPARE(state->getCanvasToolFlags()[0], true);
+    QCOMPARE(state->getCanvasDataFlag(m_canvas0->getId()), false);
+    QCOMPARE(state->getCanvasToolFlag(m_canvas0->getId()), true);
 
     /* add photo to 1st canvas */
     m_rootScene->setCanvasCurrent(m_canvas1.get());
@@ -364,9 +499,17 @@ void SceneStateTest::testAddPhoto()
     m_rootScene->addPhoto(filename1.toStdString());
     QCOMPARE(static_cast<int>(m_canvas1->getNumPhotos()), 1);
 
-    /* make sure the transparency is a part of scene states */
-    QCOMPARE(static_cast<int>(state->getPhotoTransparencies().size()), 1);
-    QCOMPARE(state->getPhotoTransparencies()[0], 1.);
+    /* the photo is added as a placeholder, its image is decoded off the GUI thread */
+    entity::Photo* photo1 = m_canvas1->getPhoto(0);
+    QVERIFY(photo1);
+    QVERIFY(ImageDecoder::instance().getNumPending() > 0 || photo1->getImage());
+    ImageDecoder::instance().waitForDone();
+    QVERIFY(photo1->getImage());
+
+    /* the new photo is shown within the last bookmark */
+    QVERIFY(photo1->getId() >= state->getIdLimit());
+    QCOMPARE(static_cast<int>(state->getPhotoIds().size()), 1);
+    QCOMPARE(state->getPhotoTransparency(photo1->getId()), 1.f);
 
     /* add another photo to second canvas */
     m_rootScene->setCanvasCurrent(m_canvas2.get());
@@ -374,25 +517,46 @@ void SceneStateTest::testAddPhoto()
     QString filename2 = "../../samples/test.bmp";
     m_rootScene->addPhoto(filename2.toStdString());
     QCOMPARE(static_cast<int>(m_canvas2->getNumPhotos()), 1);
+    entity::Photo* photo2 = m_canvas2->getPhoto(0);
+    QVERIFY(photo2);
+    QVERIFY(photo2->getId() != photo1->getId());
+    QCOMPARE(static_cast<int>(state->getPhotoIds().size()), 2);
+    QCOMPARE(state->getPhotoTransparency(photo2->getId()), 1.f);
 
-    /* make sure the transparency is a part of scene states */
-    QCOMPARE(static_cast<int>(state->getPhotoTransparencies().size()), 2);
-    QCOMPARE(state->getPhotoTransparencies()[1], 1.);
+    /* the older bookmark does not show the photos added after it */
+    this->onBookmark();
+    QCOMPARE(m_rootScene->getUserScene()->getBookmarks()->getNumBookmarks(), 2);
+    const entity::SceneState* stateLast = m_rootScene->getUserScene()->getBookmarks()->getSceneState(1);
+    m_rootScene->setCanvasCurrent(m_canvas1.get());
+    m_rootScene->addPhoto(filename2.toStdString());
+    QCOMPARE(static_cast<int>(m_canvas1->getNumPhotos()), 2);
+    entity::Photo* photo3 = m_canvas1->getPhoto(1);
+    QVERIFY(photo3);
+    QCOMPARE(state->getPhotoTransparency(photo3->getId()), 0.f);
+    QCOMPARE(stateLast->getPhotoTransparency(photo3->getId()), 1.f);
+    QCOMPARE(static_cast<int>(stateLast->getPhotoIds().size()), 1);
 
     /* check setting scene state does not fail */
     QVERIFY(m_rootScene->setSceneState(state));
+    QCOMPARE(photo3->getTransparency(), 0.f);
+    QVERIFY(m_rootScene->setSceneState(stateLast));
+    QCOMPARE(photo3->getTransparency(), 1.f);
 
-    /* perform undo 2 times */
+    /* perform undo 3 times, the states are not changed */
     m_undoStack->undo();
     m_undoStack->undo();
-    QCOMPARE(static_cast<int>( state->getPhotoTransparencies().size()), 0);
+    m_undoStack->undo();
+    QCOMPARE(static_cast<int>(m_rootScene->getUserScene()->getNumPhotos()), 0);
+    QCOMPARE(static_cast<int>(state->getPhotoIds().size()), 2);
 
     /* check setting scene state does not fail */
     QVERIFY(m_rootScene->setSceneState(state));
 
-    /* perform a redo */
+    /* perform a redo, the photo keeps its id and transparency within the state */
     m_undoStack->redo();
-    QCOMPARE(static_cast<int>( state->getPhotoTransparencies().size()), 1);
+    QCOMPARE(static_cast<int>(m_canvas1->getNumPhotos()), 1);
+    QCOMPARE(m_canvas1->getPhoto(0), photo1);
+    QCOMPARE(state->getPhotoTransparency(photo1->getId()), 1.f);
 
     /* check setting scene state does not fail */
     QVERIFY(m_rootScene->setSceneState(state));
@@ -415,45 +579,42 @@ void SceneStateTest::testDeleteCanvas()
     this->onBookmark();
     const entity::SceneState* state = m_rootScene->getUserScene()->getBookmarks()->getSceneState(0);
     QVERIFY(state);
-    QCOMPARE(static_cast<int>(state->getCanvasDataFlags().size()), 3);
-    QCOMPARE(static_cast<int>(state->getCanvasToolFlags().size()), 3);
-    QCOMPARE(static_cast<int>(state->getPhotoTransparencies().size()), 1);
-    QCOMPARE(state->getCanvasDataFlags()[0], false);
-    QCOMPARE(state->getCanvasToolFlags()[0], true);
+    unsigned int id0 = m_canvas0->getId();
+    QCOMPARE(static_cast<int>(state->getCanvasDataHidden().size()), 1);
+    QCOMPARE(static_cast<int>(state->getCanvasToolHidden().size()), 0);
+    QVERIFY(state->getPhotoIds().empty());
+    QCOMPARE(state->getCanvasDataFlag(id0), false);
+    QCOMPARE(state->getCanvasToolFlag(id0), true);
 
     /* add another photo to the same canvas */
     QCOMPARE(m_rootScene->getCanvasCurrent(), m_canvas0.get());
     QString filename1 = "../../samples/test.bmp";
     m_rootScene->addPhoto(filename1.toStdString());
     QCOMPARE(static_cast<int>(m_canvas0->getNumPhotos()), 2);
-    QCOMPARE(static_cast<int>(state->getPhotoTransparencies().size()), 2);
+    QCOMPARE(static_cast<int>(state->getPhotoIds().size()), 1);
     /* check setting scene state does not fail */
     QVERIFY(m_rootScene->setSceneState(state));
 
-    /* delete 0th canvas from scene */
+    /* delete 0th canvas from scene, the state keeps its data */
     m_rootScene->editCanvasDelete(m_canvas0.get());
     QCOMPARE(static_cast<int>(m_rootScene->getUserScene()->getNumCanvases()), 2);
-    QCOMPARE(static_cast<int>(state->getCanvasDataFlags().size()), 2);
-    QCOMPARE(static_cast<int>( state->getCanvasToolFlags().size()), 2);
-    QCOMPARE(static_cast<int>(state->getPhotoTransparencies().size()), 0);
     QCOMPARE(static_cast<int>(m_rootScene->getUserScene()->getNumPhotos()), 0);
+    QCOMPARE(state->getCanvasDataFlag(id0), false);
     /* check setting scene state does not fail */
     QVERIFY(m_rootScene->setSceneState(state));
 
-    /* perform undo */
+    /* perform undo, the canvas is restored as it was within the bookmark */
     m_undoStack->undo();
-    QCOMPARE(static_cast<int>(state->getCanvasDataFlags().size()), 3);
-    QCOMPARE(static_cast<int>(state->getCanvasToolFlags().size()), 3);
-    QCOMPARE(static_cast<int>(state->getPhotoTransparencies().size()), 2);
+    QCOMPARE(static_cast<int>(m_rootScene->getUserScene()->getNumCanvases()), 3);
+    QCOMPARE(m_canvas0->getId(), id0);
+    QCOMPARE(static_cast<int>(m_rootScene->getUserScene()->getNumPhotos()), 2);
     /* check setting scene state does not fail */
     QVERIFY(m_rootScene->setSceneState(state));
+    QVERIFY(!m_canvas0->getVisibilityAll());
 
     /* perform redo */
     m_undoStack->redo();
     QCOMPARE(static_cast<int>(m_rootScene->getUserScene()->getNumCanvases()), 2);
-    QCOMPARE(static_cast<int>(state->getCanvasDataFlags().size()), 2);
-    QCOMPARE(static_cast<int>( state->getCanvasToolFlags().size()), 2);
-    QCOMPARE(static_cast<int>(state->getPhotoTransparencies().size()), 0);
     QVERIFY(m_rootScene->setSceneState(state));
 }
 
@@ -473,18 +634,17 @@ void SceneStateTest::testDeletePhoto()
     this->onBookmark();
     const entity::SceneState* state = m_rootScene->getUserScene()->getBookmarks()->getSceneState(0);
     QVERIFY(state);
-    QCOMPARE(static_cast<int>(state->getCanvasDataFlags().size()), 3);
-    QCOMPARE(static_cast<int>(state->getCanvasToolFlags().size()), 3);
-    QCOMPARE(static_cast<int>(state->getPhotoTransparencies().size()), 1);
-    QCOMPARE(state->getCanvasDataFlags()[0], true);
-    QCOMPARE(state->getCanvasToolFlags()[0], true);
+    QVERIFY(state->getCanvasDataHidden().empty());
+    QVERIFY(state->getCanvasToolHidden().empty());
+    QVERIFY(state->getPhotoIds().empty());
+    QCOMPARE(state->getCanvasDataFlag(m_canvas0->getId()), true);
+    QCOMPARE(state->getCanvasToolFlag(m_canvas0->getId()), true);
 
     /* add another photo to the same canvas */
     QCOMPARE(m_rootScene->getCanvasCurrent(), m_canvas0.get());
     QString filename1 = "../../samples/test.bmp";
     m_rootScene->addPhoto(filename1.toStdString());
     QCOMPARE(static_cast<int>(m_canvas0->getNumPhotos()), 2);
-    QCOMPARE(static_cast<int>(state->getPhotoTransparencies().size()), 2);
     /* check setting scene state does not fail */
     QVERIFY(m_rootScene->setSceneState(state));
 
@@ -505,23 +665,24 @@ void SceneStateTest::testDeletePhoto()
     QList<QVariant> args = spy_minus.takeFirst();
     QVERIFY(args.at(0).type() == QVariant::ModelIndex);
 
-    QCOMPARE(static_cast<int>(state->getPhotoTransparencies().size()), 2);
+    /* only the transparent photo is stored */
+    QCOMPARE(static_cast<int>(state->getPhotoIds().size()), 1);
     entity::Photo* photo0 = m_canvas0->getPhoto(0);
     QVERIFY(photo0);
     QCOMPARE(photo0->getTransparency(), 1.);
-    QCOMPARE(photo0->getTransparency(), state->getPhotoTransparencies()[0]);
+    QCOMPARE(photo0->getTransparency(), state->getPhotoTransparency(photo0->getId()));
     entity::Photo* photo1 = m_canvas0->getPhoto(1);
     QVERIFY(photo1);
+    unsigned int id1 = photo1->getId();
     QCOMPARE(photo1->getTransparency(), 1-cher::PHOTO_TRANSPARECY_DELTA);
-    QCOMPARE(photo1->getTransparency(), state->getPhotoTransparencies()[1]);
+    QCOMPARE(photo1->getTransparency(), state->getPhotoTransparency(id1));
 
     /* delete 0th photo, with name ds-32.bmp */
     QSignalSpy spy_delete0(m_rootScene->getUserScene(), SIGNAL(photoRemoved(int,int)));
     m_rootScene->editPhotoDelete(photo0, m_canvas0.get());
     QCOMPARE(spy_delete0.count(), 1);
-    QCOMPARE(static_cast<int>(state->getPhotoTransparencies().size()), 1);
     QVERIFY(photo1);
-    QCOMPARE(photo1->getTransparency(), state->getPhotoTransparencies()[0]);
+    QCOMPARE(photo1->getTransparency(), state->getPhotoTransparency(id1));
     QVERIFY(item);
     QCOMPARE(item->childCount(), 1);
 
@@ -529,9 +690,9 @@ void SceneStateTest::testDeletePhoto()
     QSignalSpy spy_delete1(m_rootScene->getUserScene(), SIGNAL(photoRemoved(int,int)));
     m_rootScene->editPhotoDelete(photo1, m_canvas0.get());
     QCOMPARE(spy_delete1.count(), 1);
-    QCOMPARE(static_cast<int>(state->getPhotoTransparencies().size()), 0);
     QVERIFY(item);
     QCOMPARE(item->childCount(), 0);
+    QVERIFY(m_rootScene->setSceneState(state));
 
     /* perform undo (return 1st photo with name test.bmp) */
     m_undoStack->undo();
@@ -539,17 +700,102 @@ void SceneStateTest::testDeletePhoto()
     photo1 = m_scene->getPhoto(m_canvas0.get(), 0);
     QVERIFY(photo1);
     QCOMPARE(photo1->getName().c_str(), "Photo1");
+    QCOMPARE(photo1->getId(), id1);
     QCOMPARE(photo1->getTransparency(), 1-cher::PHOTO_TRANSPARECY_DELTA);
     QVERIFY(item);
     QCOMPARE(item->childCount(), 1);
     QVERIFY(state);
-    QCOMPARE(static_cast<int>(state->getPhotoTransparencies().size()), 1);
-    QCOMPARE(state->getPhotoTransparencies()[0], photo1->getTransparency());
+    QCOMPARE(state->getPhotoTransparency(id1), photo1->getTransparency());
     child = item->child(0);
     QVERIFY(child);
     QCOMPARE(child->text(0), QString("Photo1"));
 
 }
 
+void SceneStateTest::testLegacyState()
+{
+    /* an older file stores the flags by canvas and photo order */
+    m_rootScene->setCanvasCurrent(m_canvas1.get());
+    QString fname = "../../samples/ds-32.bmp";
+    m_rootScene->addPhoto(fname.toStdString());
+    QCOMPARE(static_cast<int>(m_canvas1->getNumPhotos()), 1);
+    entity::Photo* photo = m_canvas1->getPhoto(0);
+
+    osg::ref_ptr<entity::SceneState> state = new entity::SceneState;
+    QVERIFY(state->isEmpty());
+    std::vector<bool> data(3, true), tools(3, true);
+    data[2] = false;
+    tools[0] = false;
+    state->setCanvasDataFlags(data);
+    state->setCanvasToolFlags(tools);
+    state->setPhotoTransparencies(std::vector<float>(1, 0.4f));
+    QVERIFY(state->hasLegacyData());
+    QVERIFY(!state->isEmpty());
+
+    state->convertLegacyData(m_scene.get());
+    QVERIFY(!state->hasLegacyData());
+    QVERIFY(!state->isEmpty());
+    QCOMPARE(state->getIdLimit(), m_scene->getIdUnique());
+    QCOMPARE(state->getCanvasDataFlag(m_canvas0->getId()), true);
+    QCOMPARE(state->getCanvasDataFlag(m_canvas2->getId()), false);
+    QCOMPARE(state->getCanvasToolFlag(m_canvas0->getId()), false);
+    QCOMPARE(state->getCanvasToolFlag(m_canvas1->getId()), true);
+    QCOMPARE(state->getPhotoTransparency(photo->getId()), 0.4f);
+    QCOMPARE(static_cast<int>(state->getCanvasDataHidden().size()), 1);
+    QCOMPARE(static_cast<int>(state->getCanvasToolHidden().size()), 1);
+    QCOMPARE(static_cast<int>(state->getPhotoIds().size()), 1);
+
+    /* the edits of the scene do not touch the states */
+    for (int i=0; i<10; ++i)
+        m_rootScene->addCanvas(osg::Vec3f(1,0,0), osg::Vec3f(i,1,1));
+    QCOMPARE(static_cast<int>(state->getCanvasDataHidden().size()), 1);
+    QVERIFY(m_rootScene->setSceneState(state.get()));
+    QVERIFY(!m_canvas2->getVisibilityAll());
+    QCOMPARE(photo->getTransparency(), 0.4f);
+    QVERIFY(m_scene->getCanvas(12)->getVisibilityAll());
+}
+
+void SceneStateTest::testApplyStateChanges()
+{
+    /* a hidden canvas and a photo within a bookmark */
+    m_rootScene->setCanvasCurrent(m_canvas1.get());
+    QString fname = "../../samples/ds-32.bmp";
+    m_rootScene->addPhoto(fname.toStdString());
+    QCOMPARE(static_cast<int>(m_canvas1->getNumPhotos()), 1);
+    entity::Photo* photo = m_canvas1->getPhoto(0);
+    QVERIFY(photo);
+    this->onVisibilitySetCanvas(0);
+    QVERIFY(!m_canvas0->getVisibilityAll());
+    this->onBookmark();
+    const entity::SceneState* state = m_rootScene->getUserScene()->getBookmarks()->getSceneState(0);
+    QVERIFY(state);
+
+    /* the state is the same as the scene, nothing is changed */
+    QSignalSpy spy(m_rootScene->getUserScene(), SIGNAL(canvasVisibilitySet(int,bool)));
+    unsigned int modified = photo->getColorArray()->getModifiedCount();
+    QVERIFY(m_rootScene->setSceneState(state));
+    QCOMPARE(spy.count(), 0);
+    QCOMPARE(photo->getColorArray()->getModifiedCount(), modified);
+
+    /* only the changed canvas is updated */
+    this->onVisibilitySetCanvas(0);
+    QVERIFY(m_canvas0->getVisibilityAll());
+    spy.clear();
+    QVERIFY(m_rootScene->setSceneState(state));
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.takeFirst().at(0).toInt(), 0);
+    QVERIFY(!m_canvas0->getVisibilityAll());
+    QVERIFY(m_canvas1->getVisibilityAll());
+    QCOMPARE(photo->getColorArray()->getModifiedCount(), modified);
+
+    /* and only the changed photo */
+    photo->setTransparency(0.5f);
+    modified = photo->getColorArray()->getModifiedCount();
+    QVERIFY(m_rootScene->setSceneState(state));
+    QCOMPARE(photo->getTransparency(), 1.f);
+    QVERIFY(photo->getColorArray()->getModifiedCount() > modified);
+    QCOMPARE(spy.count(), 0);
+}
+
 QTEST_MAIN(SceneStateTest)
 #include "SceneStateTest.moc"
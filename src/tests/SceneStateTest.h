@@ -26,6 +26,12 @@ private slots:
     /*! Battery of tests to check reading and writing of bookmakrs and their corresponding scene states to file */
     void testReadWrite();
 
+    /*! Battery of tests to check reading and writing of the scene, its photos and bookmarks by means of entity::ProjectContainer */
+    void testReadWriteContainer();
+
+    /*! Battery of tests to check that the container chunks do not depend on the user-edited canvas names */
+    void testContainerCanvasKeys();
+
     /*! Battery of tests to check: addition of canvas - fur::AddCanvasCommand */
     void testAddCanvas();
 
@@ -38,6 +44,12 @@ private slots:
     /*! Battery of tests to check: deletion of photo - fur::EditPhotoDeleteCommand */
     void testDeletePhoto();
 
+    /*! Battery of tests to check translation of the positional scene states of older files, see SceneState::convertLegacyData() */
+    void testLegacyState();
+
+    /*! Battery of tests to check that applying a scene state changes only the differing canvases and photos */
+    void testApplyStateChanges();
+
 };
 
 #endif // SCENESTATETEST_H
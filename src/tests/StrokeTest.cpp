@@ -1,13 +1,18 @@
 #include "StrokeTest.h"
 
 #include <QSignalSpy>
+#include <QFile>
 
 #include <osg/ref_ptr>
 #include <osg/Geometry>
 #include <osg/Camera>
 #include <osg/Program>
+#include <osg/Geode>
 
 #include "Stroke.h"
+#include "MeshGenerator.h"
+#include "RootScene.h"
+#include "StrokeBatcher.h"
 
 void StrokeTest::testAddStroke()
 {
@@ -368,5 +373,316 @@ void StrokeTest::testFogSwitch()
     QCOMPARE(s2->getProgram()->getIsFogged(), this->m_actionStrokeFogFactor->isChecked());
 }
 
+void StrokeTest::testMeshCache()
+{
+    qInfo("Create a curved stroke");
+    osg::ref_ptr<entity::Stroke> stroke = new entity::Stroke;
+    stroke->initializeProgram(m_canvas2->getProgramStroke());
+    stroke->appendPoint(0,0);
+    stroke->appendPoint(1,0);
+    stroke->appendPoint(1,1);
+    stroke->appendPoint(0,1);
+    QVERIFY(stroke->redefineToShape());
+    QVERIFY(m_canvas2->addEntity(stroke.get()));
+
+    qInfo("Mesh is generated once and is re-used while geometry is not changed");
+    osg::ref_ptr<osg::Node> mesh = stroke->getMesh();
+    QVERIFY(mesh.get());
+    unsigned int revision = stroke->getGeometryRevision();
+    QCOMPARE(stroke->getMesh(), mesh.get());
+
+    qInfo("Mesh is re-generated after the stroke is moved");
+    stroke->moveDelta(0.5, 0.5);
+    QVERIFY(stroke->getGeometryRevision() != revision);
+    QVERIFY(stroke->getMesh());
+    QVERIFY(stroke->getMesh() != mesh.get());
+
+    qInfo("Parallel generation returns meshes in entity order");
+    std::vector<entity::ShaderedEntity2D*> entities;
+    MeshGenerator::collectEntities(m_canvas2.get(), entities);
+    QCOMPARE(static_cast<int>(entities.size()), static_cast<int>(m_canvas2->getNumStrokes() + m_canvas2->getNumLineSegments()));
+    std::vector< osg::ref_ptr<osg::Node> > meshes;
+    QCOMPARE(MeshGenerator::generate(entities, meshes), static_cast<int>(entities.size()));
+    for (size_t i=0; i<entities.size(); ++i)
+        QCOMPARE(meshes[i].get(), entities[i]->getMesh());
+
+    qInfo("Streaming generation reuses the valid cache, but does not store new meshes");
+    std::vector< osg::ref_ptr<osg::Node> > streamed;
+    QCOMPARE(MeshGenerator::generate(entities, streamed, false), static_cast<int>(entities.size()));
+    for (size_t i=0; i<entities.size(); ++i)
+        QCOMPARE(streamed[i].get(), entities[i]->getCachedMesh());
+    stroke->moveDelta(0.5, 0.5);
+    QVERIFY(!stroke->getCachedMesh());
+    QCOMPARE(MeshGenerator::generate(entities, streamed, false), static_cast<int>(entities.size()));
+    QVERIFY(!stroke->getCachedMesh());
+}
+
+void StrokeTest::testMergeMeshes()
+{
+    qInfo("Create two quads which share an edge");
+    std::vector< osg::ref_ptr<osg::Node> > meshes;
+    std::vector<std::string> names;
+    for (int i=0; i<2; ++i){
+        osg::ref_ptr<osg::Geometry> quad = new osg::Geometry;
+        osg::Vec3Array* verts = new osg::Vec3Array;
+        verts->push_back(osg::Vec3f(i, 0, 0));
+        verts->push_back(osg::Vec3f(i+1, 0, 0));
+        verts->push_back(osg::Vec3f(i+1, 1, 0));
+        verts->push_back(osg::Vec3f(i, 1, 0));
+        quad->setVertexArray(verts);
+        quad->addPrimitiveSet(new osg::DrawArrays(GL_QUADS, 0, 4));
+        osg::ref_ptr<osg::Geode> geode = new osg::Geode;
+        geode->addDrawable(quad.get());
+        meshes.push_back(geode.get());
+        names.push_back(i==0? "Stroke0" : "Stroke1");
+    }
+    meshes.push_back(0);
+    names.push_back("Empty");
+
+    qInfo("Single welded mesh");
+    osg::ref_ptr<osg::Geode> merged = MeshGenerator::merge(meshes, names, "Canvas", false);
+    QVERIFY(merged.get());
+    QCOMPARE(static_cast<int>(merged->getNumDrawables()), 1);
+    osg::Geometry* geometry = merged->getDrawable(0)->asGeometry();
+    QVERIFY(geometry);
+    QCOMPARE(static_cast<int>(geometry->getVertexArray()->getNumElements()), 6);
+    QCOMPARE(static_cast<int>(geometry->getNumPrimitiveSets()), 1);
+    QCOMPARE(static_cast<int>(geometry->getPrimitiveSet(0)->getNumIndices()), 4*3);
+    const osg::Vec3Array* normals = dynamic_cast<const osg::Vec3Array*>(geometry->getNormalArray());
+    QVERIFY(normals);
+    QCOMPARE(static_cast<int>(normals->size()), 6);
+    QVERIFY(std::fabs(std::fabs(normals->at(0).z()) - 1.f) < cher::EPSILON);
+
+    qInfo("Welded mesh with a group per source mesh");
+    merged = MeshGenerator::merge(meshes, names, "Canvas", true);
+    QVERIFY(merged.get());
+    QCOMPARE(static_cast<int>(merged->getNumDrawables()), 2);
+    QCOMPARE(merged->getDrawable(1)->getName(), std::string("Stroke1"));
+    QCOMPARE(static_cast<int>(merged->getDrawable(1)->asGeometry()->getVertexArray()->getNumElements()), 4);
+
+    qInfo("Vertices which straddle a cell boundary are welded");
+    const float tolerance = 0.01f;
+    std::vector< osg::ref_ptr<osg::Node> > straddling;
+    for (int i=0; i<2; ++i){
+        /* the edges x = 0.998 and x = 1.003 are within the tolerance, but on both sides of x = 1 */
+        float x0 = i==0? 0.f : 1.003f;
+        float x1 = i==0? 0.998f : 2.f;
+        osg::ref_ptr<osg::Geometry> quad = new osg::Geometry;
+        osg::Vec3Array* verts = new osg::Vec3Array;
+        verts->push_back(osg::Vec3f(x0, 0, 0));
+        verts->push_back(osg::Vec3f(x1, 0, 0));
+        verts->push_back(osg::Vec3f(x1, 1, 0));
+        verts->push_back(osg::Vec3f(x0, 1, 0));
+        quad->setVertexArray(verts);
+        quad->addPrimitiveSet(new osg::DrawArrays(GL_QUADS, 0, 4));
+        osg::ref_ptr<osg::Geode> geode = new osg::Geode;
+        geode->addDrawable(quad.get());
+        straddling.push_back(geode.get());
+    }
+    merged = MeshGenerator::merge(straddling, std::vector<std::string>(2, "Stroke"), "Canvas", false, tolerance);
+    QVERIFY(merged.get());
+    QCOMPARE(static_cast<int>(merged->getDrawable(0)->asGeometry()->getVertexArray()->getNumElements()), 6);
+
+    qInfo("Nothing to merge");
+    std::vector< osg::ref_ptr<osg::Node> > empty;
+    QVERIFY(!MeshGenerator::merge(empty, std::vector<std::string>(), "Canvas", false));
+}
+
+void StrokeTest::testExportStream()
+{
+    qInfo("Create a curved stroke");
+    osg::ref_ptr<entity::Stroke> stroke = new entity::Stroke;
+    stroke->initializeProgram(m_canvas2->getProgramStroke());
+    stroke->appendPoint(0,0);
+    stroke->appendPoint(1,0);
+    stroke->appendPoint(1,1);
+    QVERIFY(stroke->redefineToShape());
+    QVERIFY(m_canvas2->addEntity(stroke.get()));
+    unsigned int numChildren = m_canvas2->getNumChildren();
+
+    qInfo("Export as binary PLY");
+    QString fnamePly = "Export_StrokeTest.ply";
+    QVERIFY(m_rootScene->exportSceneToFile(fnamePly.toStdString()));
+    QCOMPARE(m_canvas2->getNumChildren(), numChildren);
+    QFile ply(fnamePly);
+    QVERIFY(ply.open(QIODevice::ReadOnly));
+    QCOMPARE(ply.readLine(), QByteArray("ply\n"));
+    QCOMPARE(ply.readLine(), QByteArray("format binary_little_endian 1.0\n"));
+    ply.readLine();
+    QByteArray vertexLine = ply.readLine();
+    QVERIFY(vertexLine.startsWith("element vertex "));
+    QVERIFY(vertexLine.mid(15).trimmed().toInt() > 0);
+    ply.close();
+
+    qInfo("Export as OBJ, merged per canvas");
+    QString fnameObj = "Export_StrokeTest.obj";
+    QVERIFY(m_rootScene->exportSceneToFile(fnameObj.toStdString(), cher::MESH_EXPORT_MERGED));
+    QCOMPARE(m_canvas2->getNumChildren(), numChildren);
+    QFile obj(fnameObj);
+    QVERIFY(obj.open(QIODevice::ReadOnly | QIODevice::Text));
+    QByteArray content = obj.readAll();
+    QVERIFY(content.contains(QByteArray("o ") + QByteArray(m_canvas2->getName().c_str())));
+    QVERIFY(content.contains("\nf "));
+}
+
+void StrokeTest::testAdaptiveTessellation()
+{
+    qInfo("Create a straight curved stroke");
+    osg::ref_ptr<entity::Stroke> stroke = new entity::Stroke;
+    stroke->initializeProgram(m_canvas2->getProgramStroke());
+    for (int i=0; i<=10; ++i)
+        stroke->appendPoint(0.5f*i, 0);
+    QVERIFY(stroke->redefineToShape());
+
+    qInfo("Compare fixed and adaptive triangle counts");
+    std::vector< osg::ref_ptr<osg::Node> > fixed(1, stroke->getMeshRepresentation());
+    std::vector< osg::ref_ptr<osg::Node> > adaptive(1, stroke->getMeshRepresentation(cher::MESH_CHORDAL_ERROR));
+    QVERIFY(fixed[0].get() && adaptive[0].get());
+    std::vector<std::string> names(1, stroke->getName());
+    osg::ref_ptr<osg::Geode> meshFixed = MeshGenerator::merge(fixed, names, "fixed", false);
+    osg::ref_ptr<osg::Geode> meshAdaptive = MeshGenerator::merge(adaptive, names, "adaptive", false);
+    QVERIFY(meshFixed.get() && meshAdaptive.get());
+    unsigned int numFixed = meshFixed->getDrawable(0)->asGeometry()->getPrimitiveSet(0)->getNumIndices();
+    unsigned int numAdaptive = meshAdaptive->getDrawable(0)->asGeometry()->getPrimitiveSet(0)->getNumIndices();
+    /* the straight path collapses to its end points, which outweighs any change of the number of sides */
+    QVERIFY(numAdaptive * 2 <= numFixed);
+
+    qInfo("Cache is re-generated when tolerance changes");
+    osg::ref_ptr<osg::Node> mesh = stroke->getMesh(cher::MESH_CHORDAL_ERROR);
+    QCOMPARE(stroke->getMesh(cher::MESH_CHORDAL_ERROR), mesh.get());
+    QVERIFY(stroke->getMesh() != mesh.get());
+}
+
+void StrokeTest::testStrokeBatch()
+{
+    StrokeBatcher& batcher = m_rootScene->getStrokeBatcher();
+    QVERIFY(batcher.isEnabled());
+    QCOMPARE(m_canvas2->getNumStrokes(), 0u);
+    batcher.setSettleTime(20);
+
+    qInfo("Create three shadered strokes");
+    std::vector< osg::ref_ptr<entity::Stroke> > strokes;
+    for (int i=0; i<3; ++i){
+        osg::ref_ptr<entity::Stroke> stroke = new entity::Stroke;
+        stroke->initializeProgram(m_canvas2->getProgramStroke());
+        QVERIFY(m_canvas2->addEntity(stroke.get()));
+        for (int j=0; j<=4; ++j)
+            stroke->appendPoint(0.5f*j, 0.3f*i*j);
+        QVERIFY(stroke->redefineToShape(m_canvas2->getTransform()));
+        QVERIFY(stroke->getIsShadered());
+        strokes.push_back(stroke);
+    }
+
+    qInfo("The strokes are merged once they settle");
+    m_rootScene->updateStrokeBatches();
+    QVERIFY(!batcher.getBatch(m_canvas2.get()));
+    QVERIFY(batcher.getTimeToSettle() >= 0);
+    QTest::qWait(40);
+    QVERIFY(m_rootScene->updateStrokeBatches());
+    QCOMPARE(batcher.getTimeToSettle(), Q_INT64_C(-1));
+    osg::Geode* batch = batcher.getBatch(m_canvas2.get());
+    QVERIFY(batch);
+    QCOMPARE(batch->getNumDrawables(), 1u);
+    QCOMPARE(batch->getStateSet(), m_canvas2->getGeodeStrokes()->getStateSet());
+    unsigned int total = 0;
+    for (size_t i=0; i<strokes.size(); ++i){
+        unsigned int first = 0, count = 0;
+        QVERIFY(batcher.getRange(strokes[i].get(), first, count));
+        QCOMPARE(first, total);
+        QCOMPARE(count, static_cast<unsigned int>(strokes[i]->getNumPoints()));
+        QVERIFY(strokes[i]->getCullCallback());
+        total += count;
+    }
+    QCOMPARE(batch->getDrawable(0)->asGeometry()->getVertexArray()->getNumElements(), total);
+    const StrokeBatcher::Statistics& statistics = batcher.getStatistics();
+    QCOMPARE(statistics.numStrokes, 3u);
+    QVERIFY(statistics.numDrawCalls < statistics.numDrawCallsUnbatched);
+
+    qInfo("Unchanged canvas is not rebuilt");
+    QVERIFY(!m_rootScene->updateStrokeBatches());
+    QCOMPARE(batcher.getBatch(m_canvas2.get()), batch);
+
+    qInfo("Selected stroke is lifted out of the batch");
+    m_canvas2->addEntitySelected(strokes[1].get());
+    QVERIFY(m_rootScene->updateStrokeBatches());
+    QVERIFY(!batcher.isBatched(strokes[1].get()));
+    QVERIFY(!strokes[1]->getCullCallback());
+    QVERIFY(batcher.isBatched(strokes[0].get()));
+    QCOMPARE(batcher.getStatistics().numStrokes, 2u);
+
+    qInfo("Moved stroke returns to the batch when it settles");
+    m_canvas2->unselectEntities();
+    strokes[1]->moveDelta(0.1, 0.1);
+    m_rootScene->updateStrokeBatches();
+    QVERIFY(!batcher.isBatched(strokes[1].get()));
+    QVERIFY(batcher.getTimeToSettle() >= 0);
+    QTest::qWait(40);
+    m_rootScene->updateStrokeBatches();
+    QVERIFY(batcher.isBatched(strokes[1].get()));
+    QCOMPARE(batcher.getStatistics().numStrokes, 3u);
+
+    qInfo("Deleted stroke draws itself once it is back");
+    QVERIFY(m_canvas2->removeEntity(strokes[2].get()));
+    m_rootScene->updateStrokeBatches();
+    QVERIFY(!batcher.isBatched(strokes[2].get()));
+    QVERIFY(!strokes[2]->getCullCallback());
+    QVERIFY(m_canvas2->addEntity(strokes[2].get()));
+
+    qInfo("The batch is never written");
+    batcher.detach();
+    QVERIFY(!batcher.getBatch(m_canvas2.get()));
+    QCOMPARE(m_canvas2->getGroupData()->getNumChildren(), 4u);
+    for (size_t i=0; i<strokes.size(); ++i)
+        QVERIFY(!strokes[i]->getCullCallback());
+    m_rootScene->updateStrokeBatches();
+    QVERIFY(batcher.getBatch(m_canvas2.get()));
+
+    qInfo("Disabled batcher lets the strokes draw themselves");
+    batcher.setEnabled(false);
+    QVERIFY(!batcher.getBatch(m_canvas2.get()));
+    QVERIFY(!strokes[0]->getCullCallback());
+    batcher.setEnabled(true);
+    batcher.setSettleTime(cher::STROKE_BATCH_SETTLE);
+}
+
+void StrokeTest::testSharedStateSet()
+{
+    qInfo("Strokes being sketched share the phantom state set");
+    osg::ref_ptr<entity::Stroke> s1 = new entity::Stroke;
+    osg::ref_ptr<entity::Stroke> s2 = new entity::Stroke;
+    s1->initializeProgram(m_canvas2->getProgramStroke());
+    s2->initializeProgram(m_canvas2->getProgramStroke());
+    QVERIFY(s1->getStateSet());
+    QCOMPARE(s1->getStateSet(), m_canvas2->getProgramStroke()->getPhantomStateSet());
+    QCOMPARE(s1->getStateSet()->getDataVariance(), osg::Object::STATIC);
+    QCOMPARE(s2->getStateSet(), s1->getStateSet());
+    const osg::Program* phantom = dynamic_cast<const osg::Program*>(
+                s1->getStateSet()->getAttribute(osg::StateAttribute::PROGRAM));
+    QVERIFY(phantom);
+    QCOMPARE(phantom->getNumShaders(), 0u);
+
+    qInfo("Shadered strokes inherit the program of the stroke geode");
+    QVERIFY(m_canvas2->addEntity(s1.get()));
+    QVERIFY(m_canvas2->addEntity(s2.get()));
+    for (int i=0; i<4; ++i){
+        s1->appendPoint(0.5f*i, 0);
+        s2->appendPoint(0, 0.5f*i);
+    }
+    QVERIFY(s1->redefineToShape(m_canvas2->getTransform()));
+    QVERIFY(s2->redefineToShape(m_canvas2->getTransform()));
+    QVERIFY(s1->getIsShadered() && s2->getIsShadered());
+    QVERIFY(!s1->getStateSet());
+    QVERIFY(!s2->getStateSet());
+    const osg::StateSet* stateset = m_canvas2->getGeodeStrokes()->getStateSet();
+    QVERIFY(stateset);
+    QCOMPARE(stateset->getAttribute(osg::StateAttribute::PROGRAM),
+             static_cast<const osg::StateAttribute*>(m_canvas2->getProgramStroke()));
+
+    qInfo("Copy of a shadered stroke does not allocate a state set either");
+    osg::ref_ptr<entity::Stroke> copy = new entity::Stroke;
+    QVERIFY(copy->copyFrom(s1.get()));
+    QVERIFY(!copy->getStateSet());
+}
+
 QTEST_MAIN(StrokeTest)
 #include "StrokeTest.moc"
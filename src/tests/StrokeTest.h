@@ -12,6 +12,12 @@ private slots:
     void testReadWrite();
     void testCopyPaste();
     void testFogSwitch();
+    void testMeshCache();
+    void testMergeMeshes();
+    void testExportStream();
+    void testAdaptiveTessellation();
+    void testStrokeBatch();
+    void testSharedStateSet();
 
 private:
 
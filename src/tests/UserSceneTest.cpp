@@ -1,5 +1,9 @@
 #include "UserSceneTest.h"
 
+#include <cmath>
+
+#include "ImageDecoder.h"
+
 
 void UserSceneTest::testWriteReadCanvases()
 {
@@ -98,9 +102,16 @@ void UserSceneTest::testWriteReadBookmarks()
     QCOMPARE(m_bookmarkWidget->count(), 1);
     entity::SceneState* state = bookmarks->getSceneState(0);
     QVERIFY(state);
-    QCOMPARE(static_cast<int>(state->getCanvasDataFlags().size()), 3);
-    QCOMPARE(static_cast<int>(state->getCanvasToolFlags().size()), 3);
-    QCOMPARE(static_cast<int>(state->getPhotoTransparencies().size()), 1);
+    QVERIFY(!state->isEmpty());
+    QVERIFY(state->getCanvasDataFlag(m_canvas0->getId()));
+    QVERIFY(state->getCanvasToolFlag(m_canvas0->getId()));
+    unsigned int photoId = m_canvas0->getPhoto(0)->getId();
+    QVERIFY(photoId != 0);
+    QCOMPARE(state->getPhotoTransparency(photoId), 1.f);
+    /* everything is visible, so nothing is stored */
+    QVERIFY(state->getCanvasDataHidden().empty());
+    QVERIFY(state->getCanvasToolHidden().empty());
+    QVERIFY(state->getPhotoIds().empty());
 
     /* save scene as file */
     QString filename = "RW_UserSceneTest_bookmarks.osgt";
@@ -126,11 +137,46 @@ void UserSceneTest::testWriteReadBookmarks()
     QCOMPARE(m_bookmarkWidget->count(), 1);
     state = bookmarks->getSceneState(0);
     QVERIFY(state);
-    QCOMPARE(static_cast<int>(state->getCanvasDataFlags().size()), 3);
-    QCOMPARE(static_cast<int>(state->getCanvasToolFlags().size()), 3);
-    QCOMPARE(static_cast<int>(state->getPhotoTransparencies().size()), 1);
+    QVERIFY(!state->isEmpty());
+    QVERIFY(!state->hasLegacyData());
+    QVERIFY(m_scene->getCanvas(0));
+    QVERIFY(m_scene->getCanvas(0)->getPhoto(0));
+    QCOMPARE(m_scene->getCanvas(0)->getPhoto(0)->getId(), photoId);
+    QCOMPARE(state->getPhotoTransparency(photoId), 1.f);
+    QVERIFY(m_scene->getIdUnique() > photoId);
     QCOMPARE(m_bookmarkWidget->count(), 1);
 }
 
+void UserSceneTest::testAddPhotos()
+{
+    QCOMPARE(static_cast<int>(m_scene->getNumPhotos()), 0);
+    int undoCount = m_undoStack->count();
+
+    std::vector<std::string> fnames;
+    fnames.push_back("../../samples/ds-32.bmp");
+    fnames.push_back("../../samples/test.bmp");
+    m_rootScene->addPhotos(fnames);
+
+    /* placeholders are on the scene right away, as one undo step */
+    QCOMPARE(m_undoStack->count(), undoCount+1);
+    QCOMPARE(static_cast<int>(m_rootScene->getCanvasCurrent()->getNumPhotos()), 2);
+
+    /* images are attached once decoded */
+    ImageDecoder::instance().waitForDone();
+    QCOMPARE(ImageDecoder::instance().getNumPending(), 0);
+    for (unsigned int i=0; i<2; ++i){
+        entity::Photo* photo = m_rootScene->getCanvasCurrent()->getPhoto(i);
+        QVERIFY(photo);
+        QVERIFY(photo->getImage());
+        float ratio = static_cast<float>(photo->getImage()->s()) / static_cast<float>(photo->getImage()->t());
+        QVERIFY(std::fabs(photo->getWidth()/photo->getHeight() - ratio) < 0.001f);
+    }
+
+    m_undoStack->undo();
+    QCOMPARE(static_cast<int>(m_rootScene->getCanvasCurrent()->getNumPhotos()), 0);
+    m_undoStack->redo();
+    QCOMPARE(static_cast<int>(m_rootScene->getCanvasCurrent()->getNumPhotos()), 2);
+}
+
 QTEST_MAIN(UserSceneTest)
 #include "UserSceneTest.moc"
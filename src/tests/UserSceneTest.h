@@ -13,6 +13,7 @@ private slots:
 
     void testWriteReadCanvases();
     void testWriteReadBookmarks();
+    void testAddPhotos();
 
 //    void testAddCanvas();
 //    void testCurrentPreviousCanvas();